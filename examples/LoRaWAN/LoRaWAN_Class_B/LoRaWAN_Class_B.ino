@@ -0,0 +1,101 @@
+/*
+  RadioLib LoRaWAN Class B Example
+
+  This example joins a LoRaWAN network, synchronizes to the
+  network beacon and switches to Class B. The device then
+  opens short ping slots at times known to the network,
+  so downlinks arrive with a bounded latency while the radio
+  still sleeps most of the time.
+  An uplink is still sent periodically, Rx1 and Rx2 windows
+  after it are handled as in Class A.
+
+  The beacon is found much faster if the network time is known,
+  so the DeviceTime MAC command is requested before searching.
+  Class B must also be enabled for the device on your LoRaWAN
+  dashboard, and there must be a gateway sending beacons.
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // ask the network for the time, and a ping slot every 32 seconds
+  node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME);
+  node.setPingSlotPeriodicity(5);
+  uint8_t uplinkPayload[1] = { 0 };
+  state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+  debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+
+  // this can take up to a few minutes
+  Serial.println(F("Search for the beacon"));
+  state = node.acquireBeacon();
+  debug(state != RADIOLIB_ERR_NONE, F("Beacon not found"), state, true);
+  Serial.print(F("Beacon time: "));
+  Serial.println(node.getBeaconTime());
+
+  Serial.println(F("Switch to Class B"));
+  state = node.setClass(RADIOLIB_LORAWAN_CLASS_B);
+  debug(state != RADIOLIB_ERR_NONE, F("Switch to Class B failed"), state, true);
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // run the beacon and ping slot scheduler and check whether a downlink was received
+  uint8_t downlinkPayload[255];
+  size_t downlinkSize = 0;
+  LoRaWANEvent_t downlinkDetails;
+  int16_t state = node.getDownlinkClassB(downlinkPayload, &downlinkSize, &downlinkDetails);
+  if(state == RADIOLIB_ERR_NONE) {
+    Serial.print(F("Received a downlink on FPort "));
+    Serial.print(downlinkDetails.fPort);
+    Serial.print(F(", length: "));
+    Serial.println(downlinkSize);
+  } else if(state == RADIOLIB_LORAWAN_NO_BEACON) {
+    // the device is back in Class A now
+    debug(true, F("Beacon lost"), state, true);
+  } else if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+    debug(true, F("Error in getDownlinkClassB"), state, false);
+  }
+
+  // send an uplink every now and then
+  if(millis() - lastUplink >= uplinkIntervalSeconds * 1000UL) {
+    Serial.println(F("Sending uplink"));
+    uint8_t uplinkPayload[1] = { (uint8_t)radio.random(100) };
+    state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+    debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+    lastUplink = millis();
+  }
+}
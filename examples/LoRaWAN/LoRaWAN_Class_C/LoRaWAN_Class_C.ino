@@ -0,0 +1,83 @@
+/*
+  RadioLib LoRaWAN Class C Example
+
+  This example joins a LoRaWAN network, switches to Class C
+  and listens for downlinks continuously. Downlinks sent by
+  the server at any time are received within one airtime,
+  instead of waiting for the next uplink.
+  An uplink is still sent periodically, Rx1 and Rx2 windows
+  after it are handled as in Class A.
+
+  Class C must also be enabled for the device on your LoRaWAN
+  dashboard, otherwise the network will not send any
+  downlinks outside of the Rx windows.
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // switch to Class C, this starts listening immediately
+  Serial.println(F("Switch to Class C"));
+  state = node.setClass(RADIOLIB_LORAWAN_CLASS_C);
+  debug(state != RADIOLIB_ERR_NONE, F("Switch to Class C failed"), state, true);
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // check whether a downlink was received
+  uint8_t downlinkPayload[255];
+  size_t downlinkSize = 0;
+  LoRaWANEvent_t downlinkDetails;
+  int16_t state = node.getDownlinkClassC(downlinkPayload, &downlinkSize, &downlinkDetails);
+  if(state == RADIOLIB_ERR_NONE) {
+    Serial.print(F("Received a downlink on FPort "));
+    Serial.print(downlinkDetails.fPort);
+    Serial.print(F(", length: "));
+    Serial.println(downlinkSize);
+  } else if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+    debug(true, F("Error in getDownlinkClassC"), state, false);
+  }
+
+  // send an uplink every now and then
+  if((lastUplink == 0) || (millis() - lastUplink >= uplinkIntervalSeconds * 1000UL)) {
+    Serial.println(F("Sending uplink"));
+    uint8_t uplinkPayload[1] = { (uint8_t)radio.random(100) };
+    state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+    debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+    lastUplink = millis();
+  }
+}
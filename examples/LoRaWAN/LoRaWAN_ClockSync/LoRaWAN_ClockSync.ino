@@ -0,0 +1,107 @@
+/*
+  RadioLib LoRaWAN Clock Synchronization Example
+
+  This example joins a LoRaWAN network and keeps the clock
+  of the device synchronized to the network time using the
+  application layer clock synchronization package (LoRaWAN
+  TS003). The requests are sent on FPort 202, both when the
+  device asks for them and periodically as configured by
+  the network or by the device itself.
+
+  Between the synchronizations, the time is kept by the
+  local clock. Its drift is measured from consecutive time
+  references and compensated, which also allows the device
+  to open shorter receive windows (see scanGuardSync).
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+// send the pending clock synchronization request or answer, if there is one
+void sendPackageAns() {
+  uint8_t ans[RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN];
+  uint8_t fPort = 0;
+  size_t len = node.getPackageAns(ans, &fPort);
+  if(len == 0) {
+    return;
+  }
+
+  Serial.println(F("Sending clock synchronization"));
+  int16_t state = node.sendReceive(ans, len, fPort);
+  debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+  lastUplink = millis();
+}
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  // process the clock synchronization commands on FPort 202
+  node.TS003 = true;
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // synchronize right away, and then every 128*2^5 seconds (about an hour)
+  node.requestAppTime();
+  node.setAppTimePeriodicity(5);
+
+  // once the drift is known, the receive windows only have to cover the timing of the host
+  node.scanGuardSync = 5;
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // the clock synchronization takes precedence over the application uplinks
+  sendPackageAns();
+
+  // send an uplink every now and then
+  if((lastUplink == 0) || (millis() - lastUplink >= uplinkIntervalSeconds * 1000UL)) {
+    Serial.println(F("Sending uplink"));
+    uint8_t uplinkPayload[1] = { (uint8_t)radio.random(100) };
+    int16_t state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+    debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+    lastUplink = millis();
+
+    // print the network time as kept by the local clock
+    uint32_t unixTime = 0;
+    uint16_t ms = 0;
+    state = node.getNetworkTime(&unixTime, &ms);
+    if(state == RADIOLIB_ERR_NONE) {
+      Serial.print(F("Unix time: "));
+      Serial.print(unixTime);
+      Serial.print(F("."));
+      Serial.print(ms);
+      Serial.print(F(", clock drift: "));
+      Serial.print(node.getClockDrift());
+      Serial.println(F(" ppm"));
+    }
+  }
+}
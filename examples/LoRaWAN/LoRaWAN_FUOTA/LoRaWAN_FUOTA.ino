@@ -0,0 +1,147 @@
+/*
+  RadioLib LoRaWAN FUOTA Example
+
+  This example joins a LoRaWAN network and receives a large
+  data block (e.g. a firmware image) sent in fragments as per
+  LoRaWAN TS004 Fragmented Data Block Transport. Lost fragments
+  are recovered from the redundant (coded) fragments sent by the
+  server. The fragments are usually sent to a multicast group,
+  which is set up by the network through TS005 Remote Multicast
+  Setup, while the device listens in Class C.
+
+  The data block is written through the storage callbacks.
+  This example keeps it in RAM, for a real firmware image,
+  replace the callbacks with ones that access flash memory
+  or external storage.
+
+  Multicast groups are only available with RADIOLIB_LORAWAN_MULTICAST
+  enabled in BuildOpt.h (or as a build flag). Without it, data
+  blocks can still be received as unicast downlinks.
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// storage of the data block, the network must not send blocks larger than this
+#define BLOCK_SIZE_MAX  (4096)
+uint8_t block[BLOCK_SIZE_MAX];
+
+int16_t readBlock(uint32_t offset, uint8_t* data, size_t len, void* ctx) {
+  (void)ctx;
+  if(offset + len > BLOCK_SIZE_MAX) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAGMENT);
+  }
+  memcpy(data, &block[offset], len);
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t writeBlock(uint32_t offset, const uint8_t* data, size_t len, void* ctx) {
+  (void)ctx;
+  if(offset + len > BLOCK_SIZE_MAX) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAGMENT);
+  }
+  memcpy(&block[offset], data, len);
+  return(RADIOLIB_ERR_NONE);
+}
+
+// the fragment decoder keeps its own buffers, so it should not be placed on the stack
+LoRaWANFragDecoder decoder;
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+// whether the completed data block was already reported
+bool blockDone = false;
+
+// send the pending answer of the multicast or fragmentation setup, if there is one
+void sendPackageAns() {
+  uint8_t ans[RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN];
+  uint8_t fPort = 0;
+  size_t len = node.getPackageAns(ans, &fPort);
+  if(len == 0) {
+    return;
+  }
+
+  Serial.print(F("Sending answer on FPort "));
+  Serial.println(fPort);
+  int16_t state = node.sendReceive(ans, len, fPort);
+  debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+  lastUplink = millis();
+}
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  // process the multicast setup commands on FPort 200 and the fragments on FPort 201
+  decoder.setStorage(readBlock, writeBlock);
+  node.setFragDecoder(&decoder);
+  node.TS005 = true;
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // request the network time with the first uplink, it is needed to schedule the multicast sessions
+  node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME);
+
+  // switch to Class C, this starts listening immediately
+  Serial.println(F("Switch to Class C"));
+  state = node.setClass(RADIOLIB_LORAWAN_CLASS_C);
+  debug(state != RADIOLIB_ERR_NONE, F("Switch to Class C failed"), state, true);
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // fragments are processed while the downlinks are received, the payload is not needed here
+  int16_t state = node.getDownlinkClassC(NULL, NULL);
+  if((state != RADIOLIB_ERR_NONE) && (state != RADIOLIB_LORAWAN_NO_DOWNLINK)) {
+    debug(true, F("Error in getDownlinkClassC"), state, false);
+  }
+
+  // the network waits for the answers to its setup commands
+  sendPackageAns();
+
+  if(decoder.isActive() && !decoder.isComplete()) {
+    blockDone = false;
+  }
+  if(decoder.isComplete() && !blockDone) {
+    Serial.print(F("Data block received, size: "));
+    Serial.print(decoder.getSize());
+    Serial.print(F(", descriptor: 0x"));
+    Serial.println(node.getFragDescriptor(), HEX);
+    blockDone = true;
+  }
+
+  // send an uplink every now and then
+  if((lastUplink == 0) || (millis() - lastUplink >= uplinkIntervalSeconds * 1000UL)) {
+    Serial.println(F("Sending uplink"));
+    uint8_t uplinkPayload[1] = { (uint8_t)radio.random(100) };
+    state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+    debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+    lastUplink = millis();
+  }
+}
@@ -0,0 +1,120 @@
+/*
+  RadioLib LoRaWAN Multicast Example
+
+  This example joins a LoRaWAN network and lets the network
+  set up multicast groups remotely (LoRaWAN TS005 Remote
+  Multicast Setup). The same downlink is then received by all
+  devices in a group, e.g. for firmware or configuration
+  updates. Frames sent to a group are reported with the group
+  ID in the downlink event.
+
+  The device stays in Class C, so multicast sessions are
+  received on the channel requested by the network as soon
+  as they start. The network time (DeviceTimeReq) is required
+  to know when a session starts.
+
+  Multicast groups are only available with RADIOLIB_LORAWAN_MULTICAST
+  enabled in BuildOpt.h (or as a build flag), as they take up
+  extra space in the session buffer.
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+// send the pending answer of the multicast setup, if there is one
+void sendPackageAns() {
+  uint8_t ans[RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN];
+  uint8_t fPort = 0;
+  size_t len = node.getPackageAns(ans, &fPort);
+  if(len == 0) {
+    return;
+  }
+
+  Serial.println(F("Sending multicast setup answer"));
+  int16_t state = node.sendReceive(ans, len, fPort);
+  debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+  lastUplink = millis();
+}
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  // process the multicast setup commands on FPort 200
+  // LoRaWAN 1.1 devices derive the multicast keys from the AppKey,
+  // 1.0.x devices (no NwkKey) need the separate GenAppKey: node.setGenAppKey(genAppKey);
+  node.TS005 = true;
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // request the network time with the first uplink, it is needed to schedule the sessions
+  node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME);
+
+  // switch to Class C, this starts listening immediately
+  Serial.println(F("Switch to Class C"));
+  state = node.setClass(RADIOLIB_LORAWAN_CLASS_C);
+  debug(state != RADIOLIB_ERR_NONE, F("Switch to Class C failed"), state, true);
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // check whether a downlink was received
+  uint8_t downlinkPayload[255];
+  size_t downlinkSize = 0;
+  LoRaWANEvent_t downlinkDetails;
+  int16_t state = node.getDownlinkClassC(downlinkPayload, &downlinkSize, &downlinkDetails);
+  if(state == RADIOLIB_ERR_NONE) {
+    if(downlinkDetails.mcGroup != RADIOLIB_LORAWAN_MC_GROUP_NONE) {
+      Serial.print(F("Received a multicast downlink for group "));
+      Serial.print(downlinkDetails.mcGroup);
+    } else {
+      Serial.print(F("Received a downlink"));
+    }
+    Serial.print(F(" on FPort "));
+    Serial.print(downlinkDetails.fPort);
+    Serial.print(F(", length: "));
+    Serial.println(downlinkSize);
+  } else if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+    debug(true, F("Error in getDownlinkClassC"), state, false);
+  }
+
+  // the network waits for the answers to its setup commands
+  sendPackageAns();
+
+  // send an uplink every now and then
+  if((lastUplink == 0) || (millis() - lastUplink >= uplinkIntervalSeconds * 1000UL)) {
+    Serial.println(F("Sending uplink"));
+    uint8_t uplinkPayload[1] = { (uint8_t)radio.random(100) };
+    state = node.sendReceive(uplinkPayload, sizeof(uplinkPayload));
+    debug((state != RADIOLIB_LORAWAN_NO_DOWNLINK) && (state != RADIOLIB_ERR_NONE), F("Error in sendReceive"), state, false);
+    lastUplink = millis();
+  }
+}
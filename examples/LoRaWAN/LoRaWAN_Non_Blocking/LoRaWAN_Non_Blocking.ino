@@ -0,0 +1,102 @@
+/*
+  RadioLib LoRaWAN Non-Blocking Example
+
+  This example joins a LoRaWAN network and sends uplinks
+  without blocking the main loop. Instead of sendReceive(),
+  the uplink is started with startUplink() and the node is
+  then advanced by calling poll() from loop(). In the time
+  between the end of the uplink and the Rx1 and Rx2 windows,
+  the application is free to do other work.
+
+  Running this examples REQUIRES you to check "Resets DevNonces"
+  on your LoRaWAN dashboard. Refer to the network's 
+  documentation on how to do this.
+
+  For default module settings, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/Default-configuration
+
+  For full API reference, see the GitHub Pages
+  https://jgromes.github.io/RadioLib/
+
+  For LoRaWAN details, see the wiki page
+  https://github.com/jgromes/RadioLib/wiki/LoRaWAN
+
+*/
+
+#include "config.h"
+
+// buffer and length of the received downlink
+// it must stay valid until the exchange is completed
+uint8_t downlinkPayload[255];
+size_t downlinkSize = 0;
+
+// timestamp of the last uplink
+unsigned long lastUplink = 0;
+
+// this function is called from poll() once the uplink
+// and both receive windows are done
+void exchangeDone(LoRaWANNode* n, int16_t state, void* ctx) {
+  if(state == RADIOLIB_ERR_NONE) {
+    Serial.print(F("Received a downlink, length: "));
+    Serial.println(downlinkSize);
+  } else if(state == RADIOLIB_LORAWAN_NO_DOWNLINK) {
+    Serial.println(F("No downlink received"));
+  } else {
+    debug(true, F("Error in exchange"), state, false);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while(!Serial);
+  delay(5000);  // Give time to switch to the serial monitor
+  Serial.println(F("\nSetup ... "));
+
+  Serial.println(F("Initialise the radio"));
+  int16_t state = radio.begin();
+  debug(state != RADIOLIB_ERR_NONE, F("Initialise radio failed"), state, true);
+
+  // Setup the OTAA session information
+  node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+
+  Serial.println(F("Join ('login') the LoRaWAN Network"));
+  state = node.activateOTAA();
+  debug(state != RADIOLIB_LORAWAN_NEW_SESSION, F("Join failed"), state, true);
+
+  // set the function that will be called when an uplink/downlink exchange is completed
+  node.setEventAction(exchangeDone);
+
+  Serial.println(F("Ready!\n"));
+}
+
+void loop() {
+  // advance the ongoing exchange, if there is any
+  // this never blocks, so it can be called as often as needed
+  node.poll();
+
+  // start a new uplink when the previous one is done and it is time for the next one
+  if(!node.isBusy() && ((lastUplink == 0) || (millis() - lastUplink >= uplinkIntervalSeconds * 1000UL))) {
+    Serial.println(F("Sending uplink"));
+
+    // Instead of reading any real sensor, we just generate some random numbers as example
+    uint8_t value1 = radio.random(100);
+    uint16_t value2 = radio.random(2000);
+
+    uint8_t uplinkPayload[3];
+    uplinkPayload[0] = value1;
+    uplinkPayload[1] = highByte(value2);
+    uplinkPayload[2] = lowByte(value2);
+
+    // the uplink data is copied into the radio, so the payload may be a local variable
+    int16_t state = node.startUplink(uplinkPayload, sizeof(uplinkPayload), 1, downlinkPayload, &downlinkSize);
+    debug(state != RADIOLIB_ERR_NONE, F("Error in startUplink"), state, false);
+    lastUplink = millis();
+  }
+
+  // the rest of the application runs here
+  // timeUntilPoll() tells how long it can take before poll() must be called again,
+  // e.g. to do some longer work or sleep in the meantime
+  if(node.isBusy() && (node.timeUntilPoll() > 100)) {
+    delay(50);
+  }
+}
@@ -0,0 +1,141 @@
+/*
+   RadioLib PhysicalLayer Coroutines Example
+
+   This example shows how to write radio tasks as C++20 coroutines.
+   Each task reads like a blocking sequence of operations,
+   but co_await suspends it until the operation finishes,
+   so all tasks run concurrently on a single thread.
+   Here, two radios are driven by three tasks: a beacon transmitter,
+   a receiver that scans the channel after each timeout
+   and a heartbeat task that only waits.
+
+   NOTE: This example requires a compiler with C++20 coroutine support
+         (e.g. GCC 10 or later with -std=c++20 or -std=gnu++20),
+         otherwise RADIOLIB_COROUTINES is disabled.
+         Interrupt service routines only notify the radios,
+         all SPI communication is done from the executor.
+
+   For full API reference, see the GitHub Pages
+   https://jgromes.github.io/RadioLib/
+*/
+
+// include the library
+#include <RadioLib.h>
+
+// SX1262 has the following connections:
+// NSS pin:   10
+// DIO1 pin:  2
+// NRST pin:  3
+// BUSY pin:  9
+SX1262 radioTx = new Module(10, 2, 3, 9);
+
+// SX1278 has the following connections:
+// NSS pin:   7
+// DIO0 pin:  4
+// RESET pin: 6
+// DIO1 pin:  5
+SX1278 radioRx = new Module(7, 4, 6, 5);
+
+// the executor running all tasks
+RadioLibExecutor executor(new ArduinoHal);
+
+// these functions are called when the radios raise an interrupt
+// IMPORTANT: these functions MUST be 'void' type
+//            and MUST NOT have any arguments!
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
+void irqTx(void) {
+  radioTx.notifyIrq();
+}
+
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
+void irqRx(void) {
+  radioRx.notifyIrq();
+}
+
+// transmit a beacon every 5 seconds
+RadioLibTask beaconTask() {
+  uint32_t count = 0;
+  while(true) {
+    char str[32];
+    sprintf(str, "Beacon #%lu", (unsigned long)count++);
+    RadioLibEvent_t ev = co_await radioTx.transmitAsync(str);
+    Serial.print(F("[TX] Beacon sent, code "));
+    Serial.println(ev.state);
+    co_await RadioLibDelay(5000);
+  }
+}
+
+// listen for packets, with 10 second timeout
+// after each timeout, check whether there is any activity on the channel
+RadioLibTask receiveTask() {
+  uint8_t buff[64];
+  while(true) {
+    RadioLibEvent_t ev = co_await radioRx.receiveAsync(buff, sizeof(buff), 10000000UL);
+    if(ev.type == RADIOLIB_EVENT_RX_DONE) {
+      Serial.print(F("[RX] Received "));
+      Serial.print(ev.len);
+      Serial.print(F(" bytes, code "));
+      Serial.println(ev.state);
+
+    } else if(ev.type == RADIOLIB_EVENT_TIMEOUT) {
+      ev = co_await radioRx.scanChannelAsync();
+      Serial.print(F("[RX] Timed out, channel scan result "));
+      Serial.println(ev.state);
+
+    } else {
+      // the operation could not be started
+      Serial.print(F("[RX] Failed, code "));
+      Serial.println(ev.state);
+      co_await RadioLibDelay(1000);
+
+    }
+  }
+}
+
+// print a heartbeat every 30 seconds
+RadioLibTask heartbeatTask() {
+  while(true) {
+    co_await RadioLibDelay(30000);
+    Serial.print(F("[Executor] Running tasks: "));
+    Serial.println(executor.getTasks());
+  }
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  // initialize both radios with default settings
+  Serial.print(F("[Radio] Initializing ... "));
+  int state = radioTx.begin(434.0);
+  if(state == RADIOLIB_ERR_NONE) {
+    state = radioRx.begin(434.0);
+  }
+  if(state == RADIOLIB_ERR_NONE) {
+    Serial.println(F("success!"));
+  } else {
+    Serial.print(F("failed, code "));
+    Serial.println(state);
+    while (true) { delay(10); }
+  }
+
+  // set the interrupt actions
+  radioTx.setPacketSentAction(irqTx);
+  radioRx.setPacketReceivedAction(irqRx);
+  radioRx.setChannelScanAction(irqRx);
+
+  // start the tasks
+  executor.spawn(beaconTask());
+  executor.spawn(receiveTask());
+  executor.spawn(heartbeatTask());
+}
+
+void loop() {
+  // resume tasks whose operations finished
+  executor.poll();
+
+  // other code can run here
+}
@@ -0,0 +1,133 @@
+/*
+   RadioLib PhysicalLayer Event Loop Example
+
+   This example shows how to drive multiple radios from a single
+   thread without blocking. Operations are submitted to the radios
+   and their completion is reported as events by RadioLibEventLoop.
+   Here, one radio transmits a packet every few seconds,
+   while the other one keeps listening with a timeout.
+
+   Interrupt service routines only notify the radios,
+   all SPI communication is done from loop().
+
+   For full API reference, see the GitHub Pages
+   https://jgromes.github.io/RadioLib/
+*/
+
+// include the library
+#include <RadioLib.h>
+
+// SX1262 has the following connections:
+// NSS pin:   10
+// DIO1 pin:  2
+// NRST pin:  3
+// BUSY pin:  9
+SX1262 radioTx = new Module(10, 2, 3, 9);
+
+// SX1278 has the following connections:
+// NSS pin:   7
+// DIO0 pin:  4
+// RESET pin: 6
+// DIO1 pin:  5
+SX1278 radioRx = new Module(7, 4, 6, 5);
+
+// the event loop servicing both radios
+RadioLibEventLoop eventLoop;
+
+// buffers must stay valid until the operation finishes
+uint8_t txBuff[] = "Hello World!";
+uint8_t rxBuff[64];
+
+// timestamp of the last transmission
+unsigned long lastTx = 0;
+
+// these functions are called when the radios raise an interrupt
+// IMPORTANT: these functions MUST be 'void' type
+//            and MUST NOT have any arguments!
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
+void irqTx(void) {
+  radioTx.notifyIrq();
+}
+
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
+void irqRx(void) {
+  radioRx.notifyIrq();
+}
+
+// this function is called from the event loop when an operation finishes
+void onEvent(PhysicalLayer* radio, const RadioLibEvent_t* event, void* ctx) {
+  const char* name = (const char*)ctx;
+  Serial.print(F("["));
+  Serial.print(name);
+  Serial.print(F("] "));
+
+  switch(event->type) {
+    case(RADIOLIB_EVENT_TX_DONE):
+      Serial.print(F("Transmission finished, code "));
+      Serial.println(event->state);
+      break;
+
+    case(RADIOLIB_EVENT_RX_DONE):
+      Serial.print(F("Received "));
+      Serial.print(event->len);
+      Serial.print(F(" bytes, code "));
+      Serial.println(event->state);
+      break;
+
+    case(RADIOLIB_EVENT_TIMEOUT):
+      Serial.print(F("Timed out, code "));
+      Serial.println(event->state);
+      break;
+  }
+
+  // keep the receiver listening
+  if(event->op == RADIOLIB_EVENT_OP_RECEIVE) {
+    radio->submitReceive(rxBuff, sizeof(rxBuff), 10000000UL);
+  }
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  // initialize both radios with default settings
+  Serial.print(F("[Radio] Initializing ... "));
+  int state = radioTx.begin(434.0);
+  if(state == RADIOLIB_ERR_NONE) {
+    state = radioRx.begin(434.0);
+  }
+  if(state == RADIOLIB_ERR_NONE) {
+    Serial.println(F("success!"));
+  } else {
+    Serial.print(F("failed, code "));
+    Serial.println(state);
+    while (true) { delay(10); }
+  }
+
+  // set the interrupt actions
+  radioTx.setPacketSentAction(irqTx);
+  radioRx.setPacketReceivedAction(irqRx);
+
+  // register both radios in the event loop
+  eventLoop.addRadio(&radioTx, onEvent, (void*)"TX");
+  eventLoop.addRadio(&radioRx, onEvent, (void*)"RX");
+
+  // start listening, with 10 second timeout
+  radioRx.submitReceive(rxBuff, sizeof(rxBuff), 10000000UL);
+}
+
+void loop() {
+  // service both radios, this never blocks
+  eventLoop.poll();
+
+  // submit a new transmission every 5 seconds
+  if((millis() - lastTx > 5000) && (radioTx.getPendingOperation() == RADIOLIB_EVENT_OP_NONE)) {
+    lastTx = millis();
+    radioTx.submitTransmit(txBuff, sizeof(txBuff) - 1);
+  }
+
+  // other tasks can run here
+}
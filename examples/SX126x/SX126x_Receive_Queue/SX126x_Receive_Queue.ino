@@ -0,0 +1,122 @@
+/*
+   RadioLib SX126x Receive Queue Example
+
+   This example listens for LoRa transmissions and stores
+   received packets in a receive queue. Each packet is read out
+   from the module as soon as possible after it was received,
+   together with its RSSI, SNR, frequency error and timestamp,
+   so that the module is free to receive the next one, while
+   the application processes the queued packets at its own pace.
+
+   The packets are read into the queue by the packet received
+   interrupt, so packets that arrive back to back are kept
+   even while loop() is busy. This needs SPI transactions
+   in the interrupt service routine, so it only works
+   on platforms that allow them.
+
+   Other modules from SX126x family can also be used.
+
+   For default module settings, see the wiki page
+   https://github.com/jgromes/RadioLib/wiki/Default-configuration#sx126x---lora-modem
+
+   For full API reference, see the GitHub Pages
+   https://jgromes.github.io/RadioLib/
+*/
+
+// include the library
+#include <RadioLib.h>
+
+// SX1262 has the following connections:
+// NSS pin:   10
+// DIO1 pin:  2
+// NRST pin:  3
+// BUSY pin:  9
+SX1262 radio = new Module(10, 2, 3, 9);
+
+// or using RadioShield
+// https://github.com/jgromes/RadioShield
+//SX1262 radio = RadioShield.ModuleA;
+
+// or using CubeCell
+//SX1262 radio = new Module(RADIOLIB_BUILTIN_MODULE);
+
+// storage for the receive queue
+// one slot is always reserved for the readout in progress,
+// so this queue can hold up to 7 packets
+RadioLibPacket_t slots[8];
+
+void setup() {
+  Serial.begin(9600);
+
+  // initialize SX1262 with default settings
+  Serial.print(F("[SX1262] Initializing ... "));
+  int state = radio.begin();
+  if (state == RADIOLIB_ERR_NONE) {
+    Serial.println(F("success!"));
+  } else {
+    Serial.print(F("failed, code "));
+    Serial.println(state);
+    while (true) { delay(10); }
+  }
+
+  // set up the receive queue
+  // this also sets the function that will be called
+  // when new packet is received, it reads the packet into the queue
+  Serial.print(F("[SX1262] Setting up the receive queue ... "));
+  state = radio.setRxQueue(slots, 8);
+  if (state == RADIOLIB_ERR_NONE) {
+    Serial.println(F("success!"));
+  } else {
+    Serial.print(F("failed, code "));
+    Serial.println(state);
+    while (true) { delay(10); }
+  }
+
+  // start listening for LoRa packets
+  Serial.print(F("[SX1262] Starting to listen ... "));
+  state = radio.startReceive();
+  if (state == RADIOLIB_ERR_NONE) {
+    Serial.println(F("success!"));
+  } else {
+    Serial.print(F("failed, code "));
+    Serial.println(state);
+    while (true) { delay(10); }
+  }
+}
+
+void loop() {
+  // process one packet from the queue
+  // the packet is accessed in place, without copying it
+  RadioLibPacket_t* pkt = radio.peekPacket();
+  if(pkt) {
+    Serial.print(F("[SX1262] Received packet at "));
+    Serial.print(pkt->timestamp);
+    Serial.println(F(" us"));
+
+    Serial.print(F("[SX1262] Length:\t\t"));
+    Serial.println(pkt->len);
+
+    Serial.print(F("[SX1262] RSSI:\t\t"));
+    Serial.print(pkt->rssi);
+    Serial.println(F(" dBm"));
+
+    Serial.print(F("[SX1262] SNR:\t\t"));
+    Serial.print(pkt->snr);
+    Serial.println(F(" dB"));
+
+    Serial.print(F("[SX1262] Frequency error:\t"));
+    Serial.print(pkt->freqError);
+    Serial.println(F(" Hz"));
+
+    // release the slot so that it can be reused
+    radio.popPacket();
+  }
+
+  // check whether some packets were lost because the queue was full
+  static uint32_t dropped = 0;
+  if(radio.getDroppedPackets() != dropped) {
+    dropped = radio.getDroppedPackets();
+    Serial.print(F("[SX1262] Dropped packets:\t"));
+    Serial.println(dropped);
+  }
+}
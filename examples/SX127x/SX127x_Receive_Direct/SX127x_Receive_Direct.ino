@@ -48,6 +48,10 @@ void setup() {
   // of false detection
   radio.setDirectSyncWord(0x555512AD, 32);
 
+  // optionally, tolerate a few bit errors in the sync word
+  // this improves sensitivity, at the cost of more false detections
+  // radio.setDirectSyncCorrelator(2);
+
   // set function that will be called each time a bit is received
   radio.setDirectAction(readBit);
 
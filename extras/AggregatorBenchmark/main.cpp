@@ -0,0 +1,263 @@
+/*
+  RadioLib LoRaWAN uplink aggregation benchmark
+
+  A sensor produces a 4-byte reading at a fixed interval, and every 10th reading
+  it also reports a 16-byte event. The readings are sent from a LoRaWAN node on
+  a simulated radio, once with an uplink per record and once queued in
+  LoRaWANAggregator for up to the given delay, so that several records share one uplink.
+
+  Every transmitted frame is captured from the simulated radio, decoded with the
+  session keys as the network server would, and unpacked with LoRaWANAggregator::unpack;
+  the records must come out unchanged and in order.
+
+  Usage: radiolib-aggregator-benchmark [--records <n>] [--interval <s>] [--delay <s>] [--datarate <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimHal.h"
+
+// pin numbers are arbitrary, the simulated HAL only cares about RST and BUSY
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+// record types, also used as the port number when sent separately
+#define TYPE_READING  (1)
+#define TYPE_EVENT    (20)
+
+// the simulated radio does not model interrupts, so every operation finishes right away
+// and a downlink window times out, as if there was no downlink
+// frames written to the radio buffer are kept, so that they can be decoded
+class CaptureSimHal : public SimHal {
+  public:
+    CaptureSimHal() : SimHal(SimChip::SX126x, PIN_RST, PIN_BUSY) {}
+
+    uint32_t digitalRead(uint32_t pin) override {
+      if(pin == PIN_IRQ) {
+        return(this->GpioLevelHigh);
+      }
+      return(SimHal::digitalRead(pin));
+    }
+
+    // timing of the radio is not measured here, so skip through the receive windows quickly
+    void yield() override {
+      this->delay(1);
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      // SX126x WriteBuffer: opcode, offset, data
+      if((out[0] == 0x0E) && (len > 2)) {
+        memcpy(&this->frame[out[1]], &out[2], RADIOLIB_MIN(len - 2, sizeof(this->frame) - out[1]));
+        this->frameLen = RADIOLIB_MIN(out[1] + len - 2, sizeof(this->frame));
+      }
+      SimHal::spiTransfer(out, len, in);
+      // SX126x GetIrqStatus: the receive window timed out
+      if((out[0] == RADIOLIB_SX126X_CMD_GET_IRQ_STATUS) && (len > 3)) {
+        in[2] = (RADIOLIB_SX126X_IRQ_TIMEOUT >> 8) & 0xFF;
+        in[3] = RADIOLIB_SX126X_IRQ_TIMEOUT & 0xFF;
+      }
+    }
+
+    uint8_t frame[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+    size_t frameLen = 0;
+};
+
+struct Record {
+  uint8_t type;
+  uint8_t len;
+  uint8_t data[16];
+  unsigned long time;
+};
+
+struct Result {
+  uint64_t uplinks;
+  uint64_t records;
+  uint64_t bytesOnAir;
+  double airtimeMs;
+  double latencySum;
+  unsigned long latencyMax;
+  uint64_t mismatched;
+};
+
+static Record makeRecord(size_t n, unsigned long interval) {
+  // blocks of 10 readings, the last one is followed by an event
+  Record rec;
+  size_t pos = n % 11;
+  rec.time = (n / 11 * 10 + RADIOLIB_MIN(pos, (size_t)9)) * interval;
+  if(pos < 10) {
+    rec.type = TYPE_READING;
+    rec.len = 4;
+  } else {
+    rec.type = TYPE_EVENT;
+    rec.len = 16;
+  }
+  for(size_t i = 0; i < rec.len; i++) {
+    rec.data[i] = (uint8_t)(n*7 + i);
+  }
+  return(rec);
+}
+
+// decode the captured frame and check its records against the ones that were sent
+static void check(CaptureSimHal* sim, const LoRaWANFrameKeys_t* keys, std::deque<Record>* sent, size_t num, bool aggregated, Result* res) {
+  LoRaWANFrame_t frame = {};
+  uint8_t payload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  if(LoRaWANFrame::decode(sim->frame, sim->frameLen, keys, &frame, payload) != RADIOLIB_ERR_NONE) {
+    res->mismatched += num;
+    sent->erase(sent->begin(), sent->begin() + num);
+    return;
+  }
+
+  unsigned long now = sim->millis();
+  size_t offset = 0;
+  for(size_t i = 0; i < num; i++) {
+    Record rec = sent->front();
+    sent->pop_front();
+    unsigned long latency = now - rec.time;
+    res->latencySum += latency;
+    res->latencyMax = RADIOLIB_MAX(res->latencyMax, latency);
+
+    uint8_t type = frame.fPort;
+    const uint8_t* data = payload;
+    size_t len = frame.payloadLen;
+    if(aggregated && (LoRaWANAggregator::unpack(payload, frame.payloadLen, &offset, &type, &data, &len) != RADIOLIB_ERR_NONE)) {
+      res->mismatched++;
+      continue;
+    }
+    res->mismatched += (type != rec.type) || (len != rec.len) || (memcmp(data, rec.data, len) != 0);
+  }
+
+  // there must be nothing left over
+  uint8_t type;
+  const uint8_t* data;
+  size_t len;
+  if(aggregated && (LoRaWANAggregator::unpack(payload, frame.payloadLen, &offset, &type, &data, &len) != RADIOLIB_LORAWAN_NO_RECORDS)) {
+    res->mismatched++;
+  }
+}
+
+static bool run(bool aggregated, size_t numRecords, unsigned long interval, unsigned long delay, uint8_t datarate, Result* res) {
+  CaptureSimHal sim;
+  Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  SX1262 radio(&mod);
+  radio.begin();
+  LoRaWANNode node(&radio, &EU868);
+  node.setDutyCycle(false);
+
+  uint8_t nwkSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x03 };
+  uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x04 };
+  LoRaWANFrameKeys_t keys = { 0x26011234, 0, appSKey, nwkSKey, nwkSKey, nwkSKey };
+  node.beginABP(keys.devAddr, NULL, NULL, nwkSKey, appSKey);
+  node.activateABP();
+  node.setADR(false);
+  node.setDatarate(datarate);
+
+  LoRaWANAggregator agg;
+  agg.begin(&node, 1, delay);
+
+  memset(res, 0, sizeof(Result));
+  std::deque<Record> sent;
+  size_t n = 0;
+  while((n < numRecords) || (agg.getNumRecords() > 0)) {
+    unsigned long now = sim.millis();
+
+    // the queue is full or the oldest record waited for long enough, or there will be no more records
+    if(agg.isDue() || ((n == numRecords) && (agg.getNumRecords() > 0))) {
+      size_t queued = agg.getNumRecords();
+      int16_t state = agg.sendReceive();
+      if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+        fprintf(stderr, "Uplink failed, code %d\n", state);
+        return(false);
+      }
+      res->uplinks++;
+      res->bytesOnAir += sim.frameLen;
+      res->airtimeMs += node.getLastToA();
+      check(&sim, &keys, &sent, queued - agg.getNumRecords(), true, res);
+      continue;
+    }
+
+    // a new record was produced
+    if((n < numRecords) && (now >= makeRecord(n, interval).time)) {
+      Record rec = makeRecord(n++, interval);
+      rec.time = now;
+      sent.push_back(rec);
+      res->records++;
+      if(aggregated) {
+        int16_t state = agg.push(rec.type, rec.data, rec.len);
+        if(state != RADIOLIB_ERR_NONE) {
+          fprintf(stderr, "Failed to queue record, code %d\n", state);
+          return(false);
+        }
+        continue;
+      }
+
+      // without the aggregator, every record goes out on its own
+      int16_t state = node.sendReceive(rec.data, rec.len, rec.type);
+      if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+        fprintf(stderr, "Uplink failed, code %d\n", state);
+        return(false);
+      }
+      res->uplinks++;
+      res->bytesOnAir += sim.frameLen;
+      res->airtimeMs += node.getLastToA();
+      check(&sim, &keys, &sent, 1, false, res);
+      continue;
+    }
+
+    // nothing to do until the next record is produced or the queue is due
+    RadioLibTime_t wait = makeRecord(n, interval).time - now;
+    if(aggregated) {
+      wait = RADIOLIB_MIN(wait, agg.timeUntilDue());
+    }
+    sim.delay(RADIOLIB_MAX(wait, (RadioLibTime_t)1));
+  }
+  return(res->mismatched == 0);
+}
+
+int main(int argc, char** argv) {
+  size_t numRecords = 400;
+  unsigned long interval = 60;
+  unsigned long delay = 600;
+  unsigned long datarate = 3;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--records") == 0) && (i + 1 < argc)) {
+      numRecords = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--interval") == 0) && (i + 1 < argc)) {
+      interval = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--delay") == 0) && (i + 1 < argc)) {
+      delay = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--datarate") == 0) && (i + 1 < argc)) {
+      datarate = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--records <n>] [--interval <s>] [--delay <s>] [--datarate <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((numRecords == 0) || (interval == 0) || (delay == 0) || (datarate > 5)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+
+  printf("%lu records on EU868 DR%lu, a 4-byte reading every %lu s and a 16-byte event every 10th reading, aggregated for up to %lu s\n\n",
+    (unsigned long)numRecords, datarate, interval, delay);
+  printf("| Method         | Uplinks | Bytes on air | Airtime (s) | Airtime/record (ms) | Latency mean/max (s) | Round trip |\n");
+  printf("|----------------|---------|--------------|-------------|---------------------|----------------------|------------|\n");
+  bool ok = true;
+  Result results[2];
+  for(int m = 0; m < 2; m++) {
+    Result& res = results[m];
+    ok &= run(m == 1, numRecords, interval*1000UL, delay*1000UL, datarate, &res);
+    printf("| %-14s | %7llu | %12llu | %11.1f | %19.1f | %9.1f / %8.1f | %10s |\n", m ? "Aggregated" : "Separate",
+      (unsigned long long)res.uplinks, (unsigned long long)res.bytesOnAir, res.airtimeMs / 1000.0, res.airtimeMs / res.records,
+      res.latencySum / res.records / 1000.0, res.latencyMax / 1000.0, res.mismatched ? "FAILED" : "ok");
+  }
+  printf("\nAirtime saved by aggregation: %.1f %%\n", 100.0 * (1.0 - results[1].airtimeMs / results[0].airtimeMs));
+
+  return(ok ? 0 : 1);
+}
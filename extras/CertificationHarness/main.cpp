@@ -0,0 +1,729 @@
+/*
+  RadioLib LoRaWAN certification test harness
+
+  Plays the LoRaWAN TS009 certification test protocol against a LoRaWANNode
+  on a simulated SX1262, without hardware or a test house. The node runs a test
+  application that answers the test protocol downlinks on FPort 224 the way a
+  device under test does, the network server of the fleet simulator plays the
+  test control layer: it sends the test commands and checks the answers, and
+  the timing of what the node does on the channel.
+
+  The time is virtual, so the timing checks are exact and every run is the same.
+  Each test case starts from a fresh node, network server and channel.
+
+  Test cases:
+    package_version  PackageVersionReq is answered in the next uplink
+    echo             EchoPlayReq payloads of several lengths come back incremented
+    rx_app_cnt       RxAppCntReq counts the application downlinks since RxAppCntResetReq
+    duty_cycle       with RegionalDutyCycleCtrlReq off, uplinks follow TxPeriodicityChangeReq,
+                     with it on, the node spends no more than 1 % of the time on air, after a burst
+                     of at most the budget of one hour
+    rejoin           DutJoinReq makes the node join again with a new DevNonce, and the new session works
+    rx_timing_drN    downlinks in RX1 and RX2, 20 us before and after the nominal start of the window,
+                     are all received, and the windows open no more than 12 ms early
+
+  It also reports numbers to watch for performance regressions: the host CPU
+  time and the virtual time from sendReceive to the start of the transmission,
+  and how early the receive windows open and how long they stay open.
+  With --max-build-us, the run fails if the mean host CPU time is higher.
+
+  Usage: radiolib-certification-harness [--test <name>] [--max-build-us <us>] [--seed <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Fleet.h"
+#include "NetworkServer.h"
+
+#define JOIN_EUI        (0x0000000000000000ULL)
+#define DEV_EUI         (0x70B3D57ED0000001ULL)
+#define DEVICE_SNR      (10.0f)
+
+// TS009 test protocol package and the commands used by the test cases
+#define TS009_PACKAGE_ID                (6)
+#define TS009_PACKAGE_VERSION           (1)
+#define TS009_PACKAGE_VERSION_REQ       (0x00)
+#define TS009_DUT_JOIN_REQ              (0x02)
+#define TS009_ADR_BIT_CHANGE_REQ        (0x04)
+#define TS009_DUTY_CYCLE_CTRL_REQ       (0x05)
+#define TS009_TX_PERIODICITY_CHANGE_REQ (0x06)
+#define TS009_TX_FRAMES_CTRL_REQ        (0x07)
+#define TS009_ECHO_PLAY_REQ             (0x08)
+#define TS009_RX_APP_CNT_REQ            (0x09)
+#define TS009_RX_APP_CNT_RESET_REQ      (0x0A)
+
+// port of the uplinks of the test application when it has nothing to answer
+#define APP_FPORT       (1)
+
+// uplink periods selected by TxPeriodicityChangeReq in seconds, the first one is the default
+static const uint16_t periods[] = { 5, 5, 10, 20, 30, 40, 50, 60, 120, 240, 480 };
+
+// the gateway may start a downlink this early or late
+#define RX_TOLERANCE_NS     (20000)
+
+// receive windows may open this early, the guard of the node and the rounding to milliseconds
+#define RX_EARLY_MAX_NS     (12000000)
+
+// 1 % of the time over an hour, all default EU868 channels are in the same sub-band
+#define DUTY_CYCLE_WINDOW_NS  (3600000000000ULL)
+#define DUTY_CYCLE_LIMIT      (0.01)
+
+static std::string format(const char* fmt, ...) {
+  char buff[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buff, sizeof(buff), fmt, args);
+  va_end(args);
+  return(std::string(buff));
+}
+
+// the device under test, a LoRaWANNode running the TS009 test application
+class TestDevice {
+  public:
+    FleetHal hal;
+    Module mod;
+    SX1262 radio;
+    LoRaWANNode node;
+    uint8_t appKey[RADIOLIB_AES128_KEY_SIZE];
+
+    // results
+    int16_t error = RADIOLIB_ERR_NONE;
+    uint64_t joinedNs = 0;
+    std::vector<double> buildCpuUs;
+    std::vector<double> buildTimeUs;
+
+    TestDevice(Fleet* fleet, Channel* channel, uint32_t seed)
+      : hal(fleet, channel, 0, DEVICE_SNR, seed),
+      mod(&hal, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY),
+      radio(&mod),
+      node(&radio, &EU868) {
+      for(size_t i = 0; i < sizeof(this->appKey); i++) {
+        this->appKey[i] = (uint8_t)this->hal.random();
+      }
+      this->hal.logWindows = true;
+    }
+
+    // thread of the node, runs the test application until the given virtual time
+    void run(uint8_t dr, uint64_t end) {
+      this->dr = dr;
+      this->hal.enter(0);
+      this->error = this->radio.begin();
+      if(this->error == RADIOLIB_ERR_NONE) {
+        this->node.beginOTAA(JOIN_EUI, DEV_EUI, NULL, this->appKey);
+        this->node.setDutyCycle(this->dutyCycle);
+        this->node.TS009 = true;
+        this->loop(end);
+      }
+      this->hal.leave();
+    }
+
+  private:
+    // state of the test application
+    uint8_t dr = 0;
+    uint16_t period = periods[0];
+    bool adr = false;
+    bool dutyCycle = true;
+    bool confirmed = false;
+    bool rejoin = false;
+    uint16_t rxAppCnt = 0;
+    uint8_t answer[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+    size_t answerLen = 0;
+
+    bool join(uint64_t end) {
+      while(this->hal.getTimeNs() < end) {
+        this->hal.delay(this->node.timeUntilJoin());
+        int16_t state = this->node.activateOTAA(this->dr);
+        if(state == RADIOLIB_LORAWAN_NEW_SESSION) {
+          this->node.setADR(this->adr);
+          this->node.setDatarate(this->dr);
+          this->joinedNs = this->hal.getTimeNs();
+          return(true);
+        } else if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+          this->error = state;
+          return(false);
+        }
+      }
+      return(false);
+    }
+
+    void loop(uint64_t end) {
+      if(!this->join(end)) {
+        return;
+      }
+      while(this->error == RADIOLIB_ERR_NONE) {
+        this->hal.delay(this->period * 1000UL);
+        if(this->dutyCycle) {
+          this->hal.delay(this->node.timeUntilUplink());
+        }
+        if(this->hal.getTimeNs() >= end) {
+          break;
+        }
+
+        if(this->rejoin) {
+          this->rejoin = false;
+          this->node.clearSession();
+          if(!this->join(end)) {
+            break;
+          }
+          continue;
+        }
+        this->uplink();
+      }
+    }
+
+    // send the pending answer, or an application uplink if there is none
+    void uplink() {
+      uint8_t idle = 0;
+      uint8_t* dataUp = &idle;
+      size_t lenUp = sizeof(idle);
+      uint8_t fPort = APP_FPORT;
+      if(this->answerLen) {
+        dataUp = this->answer;
+        lenUp = this->answerLen;
+        fPort = RADIOLIB_LORAWAN_FPORT_TS009;
+      }
+
+      uint8_t dataDown[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+      size_t lenDown = 0;
+      LoRaWANEvent_t eventDown = {};
+      uint64_t cpu = threadCpuNs();
+      uint64_t start = this->hal.getTimeNs();
+      int16_t state = this->node.sendReceive(dataUp, lenUp, fPort, dataDown, &lenDown, this->confirmed, NULL, &eventDown);
+      if((state != RADIOLIB_ERR_NONE) && (state != RADIOLIB_LORAWAN_NO_DOWNLINK)) {
+        this->error = state;
+        return;
+      }
+      this->buildCpuUs.push_back((this->hal.getTxCpuNs() - cpu) / 1000.0);
+      this->buildTimeUs.push_back((this->hal.getTxStartNs() - start) / 1000.0);
+      this->answerLen = 0;
+
+      if((state == RADIOLIB_ERR_NONE) && (eventDown.fPort != RADIOLIB_LORAWAN_FPORT_MAC_COMMAND)) {
+        this->rxAppCnt++;
+        if(eventDown.fPort == RADIOLIB_LORAWAN_FPORT_TS009) {
+          this->command(dataDown, lenDown);
+        }
+      }
+    }
+
+    void command(const uint8_t* cmd, size_t len) {
+      if(len == 0) {
+        return;
+      }
+      switch(cmd[0]) {
+        case(TS009_PACKAGE_VERSION_REQ):
+          this->answer[0] = TS009_PACKAGE_VERSION_REQ;
+          this->answer[1] = TS009_PACKAGE_ID;
+          this->answer[2] = TS009_PACKAGE_VERSION;
+          this->answerLen = 3;
+          break;
+        case(TS009_DUT_JOIN_REQ):
+          this->rejoin = true;
+          break;
+        case(TS009_ADR_BIT_CHANGE_REQ):
+          if(len > 1) {
+            this->adr = cmd[1];
+            this->node.setADR(this->adr);
+          }
+          break;
+        case(TS009_DUTY_CYCLE_CTRL_REQ):
+          if(len > 1) {
+            this->dutyCycle = cmd[1];
+            this->node.setDutyCycle(this->dutyCycle);
+          }
+          break;
+        case(TS009_TX_PERIODICITY_CHANGE_REQ):
+          if((len > 1) && (cmd[1] < sizeof(periods) / sizeof(periods[0]))) {
+            this->period = periods[cmd[1]];
+          }
+          break;
+        case(TS009_TX_FRAMES_CTRL_REQ):
+          // 0 keeps the current frame type, 1 is unconfirmed and 2 confirmed
+          if((len > 1) && cmd[1]) {
+            this->confirmed = (cmd[1] == 2);
+          }
+          break;
+        case(TS009_ECHO_PLAY_REQ):
+          this->answer[0] = TS009_ECHO_PLAY_REQ;
+          for(size_t i = 1; i < len; i++) {
+            this->answer[i] = cmd[i] + 1;
+          }
+          this->answerLen = len;
+          break;
+        case(TS009_RX_APP_CNT_REQ):
+          this->answer[0] = TS009_RX_APP_CNT_REQ;
+          this->answer[1] = this->rxAppCnt & 0xFF;
+          this->answer[2] = this->rxAppCnt >> 8;
+          this->answerLen = 3;
+          break;
+        case(TS009_RX_APP_CNT_RESET_REQ):
+          this->rxAppCnt = 0;
+          break;
+        default:
+          break;
+      }
+    }
+};
+
+// uplink accepted by the network server
+struct Record {
+  uint64_t start;
+  uint64_t end;
+  uint32_t fCnt;
+  uint8_t fPort;
+  std::vector<uint8_t> payload;
+
+  // test command sent in reply, empty if there was none
+  std::vector<uint8_t> command;
+};
+
+// one run of a test case: the device under test, the channel and the network server as the test control layer
+class Harness {
+  public:
+    Fleet fleet;
+    Channel channel;
+    NetworkServer server;
+    TestDevice device;
+    std::vector<Record> uplinks;
+
+    // called for every accepted uplink before the reply is sent, to queue the next test commands
+    std::function<void(Harness&)> script;
+
+    explicit Harness(uint32_t seed)
+      : fleet(1),
+      server(&channel, 1),
+      device(&fleet, &channel, seed) {
+      this->server.addDevice(DEV_EUI, this->device.appKey, DEVICE_SNR);
+      this->server.onUplink = [this](NetworkServer::Device& dev, const LoRaWANVerifierUplink_t& up, const uint8_t* payload, const Transmission& tx) {
+        Record rec = { tx.start, tx.end, up.frame.fCnt, up.frame.fPort, std::vector<uint8_t>(payload, payload + up.frame.payloadLen), {} };
+        this->uplinks.push_back(rec);
+        if(this->script) {
+          this->script(*this);
+        }
+        if(!dev.queue.empty()) {
+          this->uplinks.back().command.assign(dev.queue.front().begin() + 1, dev.queue.front().end());
+        }
+      };
+    }
+
+    // queue a test command for the next uplink
+    void send(std::vector<uint8_t> cmd) {
+      cmd.insert(cmd.begin(), RADIOLIB_LORAWAN_FPORT_TS009);
+      this->server.devices[0].queue.push_back(cmd);
+    }
+
+    size_t queued() const {
+      return(this->server.devices[0].queue.size());
+    }
+
+    void run(uint8_t dr, double seconds) {
+      uint64_t end = (uint64_t)(seconds * 1000.0) * 1000000ULL;
+      std::thread thread(&TestDevice::run, &this->device, dr, end);
+      this->fleet.run([&](uint64_t now) {
+        while(!this->channel.pending.empty() && (this->channel.pending.begin()->first <= now)) {
+          size_t up = this->channel.pending.begin()->second;
+          this->channel.pending.erase(this->channel.pending.begin());
+          this->server.receive(up);
+        }
+      });
+      thread.join();
+    }
+
+    // the answer to a command must come in the next uplink
+    bool checkAnswer(size_t index, const std::vector<uint8_t>& expected, std::string& details) const {
+      if((index + 1 >= this->uplinks.size()) || (this->uplinks[index + 1].fPort != RADIOLIB_LORAWAN_FPORT_TS009)) {
+        details = format("no answer to command 0x%02x in uplink %lu", this->uplinks[index].command[0], (unsigned long)index + 1);
+        return(false);
+      }
+      if(this->uplinks[index + 1].payload != expected) {
+        details = format("wrong answer to command 0x%02x in uplink %lu", this->uplinks[index].command[0], (unsigned long)index + 1);
+        return(false);
+      }
+      return(true);
+    }
+
+    // all the commands of a type that were sent and their answers
+    bool checkAnswers(uint8_t cmd, std::function<std::vector<uint8_t>(const std::vector<uint8_t>&)> answer, size_t num, std::string& details) const {
+      size_t found = 0;
+      for(size_t i = 0; i < this->uplinks.size(); i++) {
+        const std::vector<uint8_t>& sent = this->uplinks[i].command;
+        if(sent.empty() || (sent[0] != cmd)) {
+          continue;
+        }
+        if(!this->checkAnswer(i, answer(sent), details)) {
+          return(false);
+        }
+        found++;
+      }
+      if(found != num) {
+        details = format("%lu of %lu commands 0x%02x sent", (unsigned long)found, (unsigned long)num, cmd);
+        return(false);
+      }
+      return(true);
+    }
+
+    std::vector<const Transmission*> joinRequests() const {
+      std::vector<const Transmission*> txs;
+      for(const Transmission& tx : this->channel.uplinks) {
+        if((tx.data[0] & RADIOLIB_LORAWAN_MHDR_MTYPE_MASK) == RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_REQUEST) {
+          txs.push_back(&tx);
+        }
+      }
+      return(txs);
+    }
+};
+
+// receive window timing, per spreading factor
+struct WindowStats {
+  size_t num = 0;
+  int64_t earlyMin = INT64_MAX;
+  int64_t earlyMax = 0;
+  uint64_t openNs = 0;
+};
+
+static std::map<uint8_t, WindowStats> windowStats;
+static std::vector<double> buildCpuUs;
+static std::vector<double> buildTimeUs;
+
+// how early the receive windows of data uplinks opened, checks them against the limits
+static bool checkWindows(const Harness& h, std::string& details) {
+  for(const RxWindow& win : h.device.hal.windows) {
+    if(win.start < h.device.joinedNs) {
+      continue;
+    }
+
+    // the last uplink before the window, RX1 opens one second after it and RX2 two seconds
+    const Transmission* up = NULL;
+    for(const Transmission& tx : h.channel.uplinks) {
+      if(tx.end <= win.start) {
+        up = &tx;
+      }
+    }
+    if(!up) {
+      continue;
+    }
+    uint64_t delay = (win.freq == RX2_FREQ_KHZ) ? RADIOLIB_LORAWAN_RECEIVE_DELAY_2_MS : RADIOLIB_LORAWAN_RECEIVE_DELAY_1_MS;
+    int64_t early = (int64_t)(up->end + delay * 1000000ULL) - (int64_t)win.start;
+    if((early < RX_TOLERANCE_NS) || (early > RX_EARLY_MAX_NS)) {
+      details = format("RX window at SF%d opened %.3f ms before the nominal start", win.sf, early / 1e6);
+      return(false);
+    }
+
+    WindowStats& stats = windowStats[win.sf];
+    stats.num++;
+    stats.earlyMin = RADIOLIB_MIN(stats.earlyMin, early);
+    stats.earlyMax = RADIOLIB_MAX(stats.earlyMax, early);
+    stats.openNs += win.end - win.start;
+  }
+  return(true);
+}
+
+struct Test {
+  std::string name;
+  uint8_t dr;
+  double seconds;
+  std::function<void(Harness&)> setup;
+  std::function<bool(Harness&, std::string&)> check;
+};
+
+static std::vector<Test> getTests() {
+  std::vector<Test> tests;
+
+  tests.push_back({ "package_version", 5, 60,
+    [](Harness& h) {
+      h.send({ TS009_PACKAGE_VERSION_REQ });
+    },
+    [](Harness& h, std::string& details) {
+      auto answer = [](const std::vector<uint8_t>&) {
+        return(std::vector<uint8_t>{ TS009_PACKAGE_VERSION_REQ, TS009_PACKAGE_ID, TS009_PACKAGE_VERSION });
+      };
+      if(!h.checkAnswers(TS009_PACKAGE_VERSION_REQ, answer, 1, details)) {
+        return(false);
+      }
+      details = format("package %d version %d", TS009_PACKAGE_ID, TS009_PACKAGE_VERSION);
+      return(true);
+    }
+  });
+
+  tests.push_back({ "echo", 5, 120,
+    [](Harness& h) {
+      for(size_t len : { 0, 1, 16, 50 }) {
+        std::vector<uint8_t> cmd = { TS009_ECHO_PLAY_REQ };
+        for(size_t i = 0; i < len; i++) {
+          cmd.push_back((uint8_t)(7*i + len));
+        }
+        h.send(cmd);
+      }
+    },
+    [](Harness& h, std::string& details) {
+      auto answer = [](const std::vector<uint8_t>& cmd) {
+        std::vector<uint8_t> ans = { TS009_ECHO_PLAY_REQ };
+        for(size_t i = 1; i < cmd.size(); i++) {
+          ans.push_back(cmd[i] + 1);
+        }
+        return(ans);
+      };
+      if(!h.checkAnswers(TS009_ECHO_PLAY_REQ, answer, 4, details)) {
+        return(false);
+      }
+      details = "0, 1, 16 and 50 bytes";
+      return(true);
+    }
+  });
+
+  tests.push_back({ "rx_app_cnt", 5, 120,
+    [](Harness& h) {
+      h.send({ TS009_RX_APP_CNT_RESET_REQ });
+      h.send({ TS009_ECHO_PLAY_REQ, 0x01 });
+      h.send({ TS009_ECHO_PLAY_REQ, 0x02 });
+      h.send({ TS009_RX_APP_CNT_REQ });
+    },
+    [](Harness& h, std::string& details) {
+      // the two echoes and the request itself
+      auto answer = [](const std::vector<uint8_t>&) {
+        return(std::vector<uint8_t>{ TS009_RX_APP_CNT_REQ, 3, 0 });
+      };
+      if(!h.checkAnswers(TS009_RX_APP_CNT_REQ, answer, 1, details)) {
+        return(false);
+      }
+      details = "3 downlinks since the reset";
+      return(true);
+    }
+  });
+
+  // uplinks 2 to 11 are sent with the duty cycle off, the ones after uplink 12 with it on again
+  tests.push_back({ "duty_cycle", 0, 4*3600,
+    [](Harness& h) {
+      h.send({ TS009_TX_PERIODICITY_CHANGE_REQ, 1 });
+      h.send({ TS009_DUTY_CYCLE_CTRL_REQ, 0 });
+      h.script = [](Harness& h) {
+        if(h.uplinks.size() == 12) {
+          h.send({ TS009_DUTY_CYCLE_CTRL_REQ, 1 });
+        }
+      };
+    },
+    [](Harness& h, std::string& details) {
+      if(h.uplinks.size() < 24) {
+        details = format("only %lu uplinks", (unsigned long)h.uplinks.size());
+        return(false);
+      }
+      double maxInterval = 0;
+      for(size_t i = 2; i < 11; i++) {
+        double interval = (h.uplinks[i + 1].start - h.uplinks[i].start) / 1e9;
+        maxInterval = RADIOLIB_MAX(maxInterval, interval);
+        if((interval < periods[1]) || (interval > periods[1] + 5)) {
+          details = format("uplink %lu came %.1f s after the previous one with the duty cycle off", (unsigned long)i + 1, interval);
+          return(false);
+        }
+      }
+
+      // from uplink 12 on, the node may spend the budget of one hour at once, and then 1 % of the time
+      // so the airtime of any run of uplinks must not be more than that
+      const double budgetNs = DUTY_CYCLE_LIMIT * DUTY_CYCLE_WINDOW_NS;
+      double maxDuty = 0;
+      for(size_t i = 12; i < h.uplinks.size(); i++) {
+        uint64_t airtime = 0;
+        size_t last = i;
+        for(size_t j = i; j < h.uplinks.size(); j++) {
+          airtime += h.uplinks[j].end - h.uplinks[j].start;
+          if(airtime > budgetNs + DUTY_CYCLE_LIMIT * (h.uplinks[j].end - h.uplinks[i].start)) {
+            details = format("%.1f s airtime in uplinks %lu to %lu with the duty cycle on", airtime / 1e9, (unsigned long)i, (unsigned long)j);
+            return(false);
+          }
+          if(h.uplinks[j].start < h.uplinks[i].start + DUTY_CYCLE_WINDOW_NS) {
+            last = j;
+          }
+        }
+
+        // highest airtime in an hour, for the report
+        uint64_t hour = 0;
+        for(size_t j = i; j <= last; j++) {
+          hour += h.uplinks[j].end - h.uplinks[j].start;
+        }
+        maxDuty = RADIOLIB_MAX(maxDuty, (double)hour / DUTY_CYCLE_WINDOW_NS);
+      }
+      double span = (h.uplinks.back().end - h.uplinks[12].start) / 1e9;
+      details = format("off: uplinks every %.1f s at most, on: at most %.2f %% airtime in an hour, %lu uplinks in %.1f h",
+        maxInterval, 100.0 * maxDuty, (unsigned long)(h.uplinks.size() - 12), span / 3600.0);
+      return(true);
+    }
+  });
+
+  // DutJoinReq after the second uplink, PackageVersionReq in the new session
+  tests.push_back({ "rejoin", 5, 300,
+    [](Harness& h) {
+      h.script = [](Harness& h) {
+        if(h.uplinks.size() == 2) {
+          h.send({ TS009_DUT_JOIN_REQ });
+        } else if((h.uplinks.back().fCnt == 0) && (h.joinRequests().size() == 2)) {
+          h.send({ TS009_PACKAGE_VERSION_REQ });
+        }
+      };
+    },
+    [](Harness& h, std::string& details) {
+      std::vector<const Transmission*> joins = h.joinRequests();
+      if(joins.size() != 2) {
+        details = format("%lu Join-Requests", (unsigned long)joins.size());
+        return(false);
+      }
+      uint16_t nonces[2];
+      for(size_t i = 0; i < 2; i++) {
+        nonces[i] = joins[i]->data[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_NONCE_POS] | (joins[i]->data[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_NONCE_POS + 1] << 8);
+      }
+      if(nonces[1] <= nonces[0]) {
+        details = format("DevNonce %d after %d", nonces[1], nonces[0]);
+        return(false);
+      }
+
+      // the Join-Request follows the uplink that got DutJoinReq after one period
+      double delay = (joins[1]->start - h.uplinks[1].end) / 1e9;
+      if(delay > periods[0] + 5) {
+        details = format("Join-Request %.1f s after DutJoinReq", delay);
+        return(false);
+      }
+      auto answer = [](const std::vector<uint8_t>&) {
+        return(std::vector<uint8_t>{ TS009_PACKAGE_VERSION_REQ, TS009_PACKAGE_ID, TS009_PACKAGE_VERSION });
+      };
+      if(!h.checkAnswers(TS009_PACKAGE_VERSION_REQ, answer, 1, details)) {
+        return(false);
+      }
+      details = format("Join-Request %.1f s after DutJoinReq, DevNonce %d after %d", delay, nonces[1], nonces[0]);
+      return(true);
+    }
+  });
+
+  // echoes in RX1 and RX2, each one 20 us early and 20 us late
+  for(uint8_t dr : { 5, 3, 0 }) {
+    tests.push_back({ format("rx_timing_dr%d", dr), dr, 300,
+      [](Harness& h) {
+        for(uint8_t i = 0; i < 4; i++) {
+          h.send({ TS009_ECHO_PLAY_REQ, i });
+        }
+        h.script = [](Harness& h) {
+          size_t next = 4 - h.queued();
+          if(next < 4) {
+            h.server.window = next / 2;
+            h.server.offsetNs = (next % 2) ? RX_TOLERANCE_NS : -RX_TOLERANCE_NS;
+          } else {
+            h.server.window = -1;
+            h.server.offsetNs = 0;
+          }
+        };
+      },
+      [](Harness& h, std::string& details) {
+        auto answer = [](const std::vector<uint8_t>& cmd) {
+          return(std::vector<uint8_t>{ TS009_ECHO_PLAY_REQ, (uint8_t)(cmd[1] + 1) });
+        };
+        if(!h.checkAnswers(TS009_ECHO_PLAY_REQ, answer, 4, details)) {
+          return(false);
+        }
+        if(!checkWindows(h, details)) {
+          return(false);
+        }
+        details = "RX1 and RX2, 20 us early and late";
+        return(true);
+      }
+    });
+  }
+
+  return(tests);
+}
+
+static double percentile(std::vector<double> vals, double p) {
+  if(vals.empty()) {
+    return(0);
+  }
+  std::sort(vals.begin(), vals.end());
+  return(vals[(size_t)(p * (vals.size() - 1))]);
+}
+
+static double mean(const std::vector<double>& vals) {
+  double sum = 0;
+  for(double val : vals) {
+    sum += val;
+  }
+  return(vals.empty() ? 0 : sum / vals.size());
+}
+
+int main(int argc, char** argv) {
+  const char* only = NULL;
+  double maxBuildUs = 0;
+  uint32_t seed = 1;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--test") == 0) && (i + 1 < argc)) {
+      only = argv[++i];
+    } else if((strcmp(argv[i], "--max-build-us") == 0) && (i + 1 < argc)) {
+      maxBuildUs = strtod(argv[++i], NULL);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--test <name>] [--max-build-us <us>] [--seed <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+
+  std::vector<Test> tests = getTests();
+  if(only && std::none_of(tests.begin(), tests.end(), [&](const Test& test) { return(test.name == only); })) {
+    fprintf(stderr, "No such test: %s\n", only);
+    return(1);
+  }
+
+  printf("| Test            | Result | Details |\n");
+  printf("|-----------------|--------|---------|\n");
+  size_t run = 0;
+  size_t failed = 0;
+  for(Test& test : tests) {
+    if(only && (test.name != only)) {
+      continue;
+    }
+
+    Harness h(seed);
+    test.setup(h);
+    h.run(test.dr, test.seconds);
+    std::string details;
+    bool ok = false;
+    if(h.device.error != RADIOLIB_ERR_NONE) {
+      details = format("node failed with %d", h.device.error);
+    } else if(h.device.joinedNs == 0) {
+      details = "node did not join";
+    } else {
+      ok = test.check(h, details);
+    }
+    buildCpuUs.insert(buildCpuUs.end(), h.device.buildCpuUs.begin(), h.device.buildCpuUs.end());
+    buildTimeUs.insert(buildTimeUs.end(), h.device.buildTimeUs.begin(), h.device.buildTimeUs.end());
+    printf("| %-15s | %-6s | %s |\n", test.name.c_str(), ok ? "pass" : "FAIL", details.c_str());
+    run++;
+    failed += !ok;
+  }
+
+  // performance numbers
+  printf("\nUplink build, sendReceive to the start of the transmission in %lu uplinks:\n", (unsigned long)buildCpuUs.size());
+  printf("  host CPU: mean %.1f us, 95th percentile %.1f us\n", mean(buildCpuUs), percentile(buildCpuUs, 0.95));
+  printf("  virtual time (SPI, BUSY and delays): mean %.1f us, 95th percentile %.1f us\n", mean(buildTimeUs), percentile(buildTimeUs, 0.95));
+  if(!windowStats.empty()) {
+    printf("\n| RX window | Count | Opened early (ms) | Open for (ms) |\n");
+    printf("|-----------|-------|-------------------|---------------|\n");
+    for(const auto& it : windowStats) {
+      const WindowStats& stats = it.second;
+      printf("| SF%-7d | %5lu | %7.3f - %7.3f | %13.1f |\n", it.first, (unsigned long)stats.num,
+        stats.earlyMin / 1e6, stats.earlyMax / 1e6, stats.openNs / 1e6 / stats.num);
+    }
+  }
+  bool slow = (maxBuildUs > 0) && (mean(buildCpuUs) > maxBuildUs);
+  if(slow) {
+    printf("\nFAIL: uplink build takes %.1f us of host CPU, more than %.1f us\n", mean(buildCpuUs), maxBuildUs);
+  }
+
+  printf("\n%lu of %lu tests passed\n", (unsigned long)(run - failed), (unsigned long)run);
+  return((failed || slow) ? 1 : 0);
+}
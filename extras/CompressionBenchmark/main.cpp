@@ -0,0 +1,359 @@
+/*
+  RadioLib payload compression benchmark
+
+  Encodes a few kinds of representative telemetry with RadioLibLZ and RadioLibDelta
+  and reports the compression ratio, the processor time to encode and decode
+  the payload on the host, and the time-on-air of the resulting LoRaWAN uplink.
+  Every payload is decoded again and compared with the original.
+
+  Then sends the delta coded environmental records through LoRaWANNode::setCompression
+  on a simulated radio, decodes the transmitted frame with the session keys as the
+  network server would, and decompresses it.
+
+  Usage: radiolib-compression-benchmark [--window <bits>] [--length <bits>] [--sf <7-12>] [--iterations <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimHal.h"
+
+// pin numbers are arbitrary, the simulated HAL only cares about RST and BUSY
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+// LoRaWAN frame overhead: MHDR, FHDR without FOpts, FPort and MIC
+#define FRAME_OVERHEAD  (13)
+
+// the simulated radio does not model interrupts, so every operation finishes right away
+// and a downlink window times out, as if there was no downlink
+// frames written to the radio buffer are kept, so that they can be decoded
+class CaptureSimHal : public SimHal {
+  public:
+    CaptureSimHal() : SimHal(SimChip::SX126x, PIN_RST, PIN_BUSY) {}
+
+    uint32_t digitalRead(uint32_t pin) override {
+      if(pin == PIN_IRQ) {
+        return(this->GpioLevelHigh);
+      }
+      return(SimHal::digitalRead(pin));
+    }
+
+    // timing of the radio is not measured here, so skip through the receive windows quickly
+    void yield() override {
+      this->delay(1);
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      // SX126x WriteBuffer: opcode, offset, data
+      if((out[0] == 0x0E) && (len > 2)) {
+        memcpy(&this->frame[out[1]], &out[2], RADIOLIB_MIN(len - 2, sizeof(this->frame) - out[1]));
+        this->frameLen = RADIOLIB_MIN(out[1] + len - 2, sizeof(this->frame));
+      }
+      SimHal::spiTransfer(out, len, in);
+      // SX126x GetIrqStatus: the receive window timed out
+      if((out[0] == RADIOLIB_SX126X_CMD_GET_IRQ_STATUS) && (len > 3)) {
+        in[2] = (RADIOLIB_SX126X_IRQ_TIMEOUT >> 8) & 0xFF;
+        in[3] = RADIOLIB_SX126X_IRQ_TIMEOUT & 0xFF;
+      }
+    }
+
+    uint8_t frame[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+    size_t frameLen = 0;
+};
+
+// xorshift, so that the runs are reproducible
+static uint32_t rng = 1;
+static uint32_t random32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return(rng);
+}
+
+static int32_t step(int32_t range) {
+  return((int32_t)(random32() % (2*range + 1)) - range);
+}
+
+// little endian, as most MCUs would pack it
+static size_t pack(uint8_t* out, int32_t val, size_t width) {
+  for(size_t i = 0; i < width; i++) {
+    out[i] = (uint8_t)((uint32_t)val >> (8*i));
+  }
+  return(width);
+}
+
+#define ENV_FIELDS  (5)
+#define GPS_FIELDS  (4)
+
+// environmental sensor, one record per minute: uptime (s), temperature (0.01 C), humidity (0.5 %), pressure (Pa), battery (mV)
+static const size_t envWidths[ENV_FIELDS] = { 4, 2, 1, 4, 2 };
+static size_t makeEnv(int32_t* values, size_t numRecords) {
+  int32_t rec[ENV_FIELDS] = { 86400, 2153, 91, 101325, 3300 };
+  for(size_t n = 0; n < numRecords; n++) {
+    memcpy(&values[n*ENV_FIELDS], rec, sizeof(rec));
+    rec[0] += 60;
+    rec[1] += step(6);
+    rec[2] += step(1);
+    rec[3] += step(12);
+    rec[4] -= (n % 4 == 3);
+  }
+  return(numRecords*ENV_FIELDS);
+}
+
+// asset tracker, one fix every 30 s while moving: latitude and longitude (1e-7 deg), altitude (m), speed (0.1 m/s)
+static const size_t gpsWidths[GPS_FIELDS] = { 4, 4, 2, 2 };
+static size_t makeGps(int32_t* values, size_t numRecords) {
+  int32_t rec[GPS_FIELDS] = { 501234567, 144567890, 212, 83 };
+  for(size_t n = 0; n < numRecords; n++) {
+    memcpy(&values[n*GPS_FIELDS], rec, sizeof(rec));
+    rec[0] += 2200 + step(300);
+    rec[1] += 1500 + step(300);
+    rec[2] += step(2);
+    rec[3] = RADIOLIB_MAX(rec[3] + step(5), 0);
+  }
+  return(numRecords*GPS_FIELDS);
+}
+
+static size_t packRecords(const int32_t* values, size_t numValues, const size_t* widths, size_t numFields, uint8_t* out) {
+  size_t len = 0;
+  for(size_t i = 0; i < numValues; i++) {
+    len += pack(&out[len], values[i], widths[i % numFields]);
+  }
+  return(len);
+}
+
+struct Timing {
+  double encodeUs;
+  double decodeUs;
+};
+
+static RadioLibLZ lz;
+static size_t iterations = 2000;
+
+// time the encoder and the decoder of a byte payload, and check the round trip
+static bool measureLZ(const uint8_t* in, size_t len, uint8_t* out, size_t* outLen, Timing* t) {
+  size_t maxLen = *outLen;
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < iterations; i++) {
+    *outLen = maxLen;
+    if(lz.compress(in, len, out, outLen) != RADIOLIB_ERR_NONE) {
+      return(false);
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  uint8_t dec[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t decLen = 0;
+  for(size_t i = 0; i < iterations; i++) {
+    decLen = sizeof(dec);
+    if(lz.decompress(out, *outLen, dec, &decLen) != RADIOLIB_ERR_NONE) {
+      return(false);
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  t->encodeUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations;
+  t->decodeUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+  return((decLen == len) && (memcmp(dec, in, len) == 0));
+}
+
+static bool measureDelta(const int32_t* values, size_t numRecords, size_t numFields, bool withLZ, uint8_t* out, size_t* outLen, Timing* t) {
+  size_t maxLen = *outLen;
+  uint8_t tmp[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t tmpLen = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < iterations; i++) {
+    // without the LZ stage, the records go straight to the output
+    uint8_t* enc = withLZ ? tmp : out;
+    tmpLen = withLZ ? sizeof(tmp) : maxLen;
+    if(RadioLibDelta::encode(values, numRecords, numFields, enc, &tmpLen) != RADIOLIB_ERR_NONE) {
+      return(false);
+    }
+    *outLen = tmpLen;
+    if(withLZ) {
+      *outLen = maxLen;
+      if(lz.compress(tmp, tmpLen, out, outLen) != RADIOLIB_ERR_NONE) {
+        return(false);
+      }
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  int32_t dec[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t decRecords = 0;
+  for(size_t i = 0; i < iterations; i++) {
+    const uint8_t* in = out;
+    size_t inLen = *outLen;
+    if(withLZ) {
+      tmpLen = sizeof(tmp);
+      if(lz.decompress(out, *outLen, tmp, &tmpLen) != RADIOLIB_ERR_NONE) {
+        return(false);
+      }
+      in = tmp;
+      inLen = tmpLen;
+    }
+    decRecords = sizeof(dec) / sizeof(dec[0]) / numFields;
+    if(RadioLibDelta::decode(in, inLen, numFields, dec, &decRecords) != RADIOLIB_ERR_NONE) {
+      return(false);
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  t->encodeUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations;
+  t->decodeUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+  return((decRecords == numRecords) && (memcmp(dec, values, numRecords*numFields*sizeof(int32_t)) == 0));
+}
+
+static PhysicalLayer* phy = NULL;
+
+static bool report(const char* name, const char* method, size_t rawLen, size_t len, const Timing* t, bool ok) {
+  double rawToA = phy->getTimeOnAir(rawLen + FRAME_OVERHEAD) / 1000.0;
+  double toA = phy->getTimeOnAir(len + FRAME_OVERHEAD) / 1000.0;
+  printf("| %-12s | %-14s | %5lu | %5lu | %5.2f | %9.2f | %9.2f | %7.1f -> %7.1f | %10s |\n", name, method,
+    (unsigned long)rawLen, (unsigned long)len, (double)rawLen / len, t->encodeUs, t->decodeUs, rawToA, toA, ok ? "ok" : "FAILED");
+  return(ok);
+}
+
+static bool runDataset(const char* name, const int32_t* values, size_t numRecords, size_t numFields, const size_t* widths) {
+  uint8_t raw[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t rawLen = packRecords(values, numRecords*numFields, widths, numFields, raw);
+  uint8_t out[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t outLen;
+  Timing t;
+  bool ok = true;
+
+  outLen = sizeof(out);
+  bool res = measureLZ(raw, rawLen, out, &outLen, &t);
+  ok &= report(name, "LZ", rawLen, outLen, &t, res);
+
+  outLen = sizeof(out);
+  res = measureDelta(values, numRecords, numFields, false, out, &outLen, &t);
+  ok &= report(name, "delta", rawLen, outLen, &t, res);
+
+  outLen = sizeof(out);
+  res = measureDelta(values, numRecords, numFields, true, out, &outLen, &t);
+  ok &= report(name, "delta + LZ", rawLen, outLen, &t, res);
+  return(ok);
+}
+
+// send delta coded records through the compressed transmit path of the node and decode the frame on the "network side"
+static bool runUplink(const int32_t* values, size_t numRecords) {
+  CaptureSimHal sim;
+  Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  SX1262 radio(&mod);
+  radio.begin();
+  LoRaWANNode node(&radio, &EU868);
+  node.setDutyCycle(false);
+
+  uint8_t nwkSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x03 };
+  uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x04 };
+  LoRaWANFrameKeys_t keys = { 0x26011234, 0, appSKey, nwkSKey, nwkSKey, nwkSKey };
+  node.beginABP(keys.devAddr, NULL, NULL, nwkSKey, appSKey);
+  node.activateABP();
+  node.setDatarate(3);
+  node.setCompression(&lz, 2);
+
+  uint8_t payload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t payloadLen = sizeof(payload);
+  RadioLibDelta::encode(values, numRecords, ENV_FIELDS, payload, &payloadLen);
+  int16_t state = node.sendReceive(payload, payloadLen, 2);
+  if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+    fprintf(stderr, "Uplink failed, code %d\n", state);
+    return(false);
+  }
+
+  LoRaWANFrame_t frame = {};
+  uint8_t frmPayload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  state = LoRaWANFrame::decode(sim.frame, sim.frameLen, &keys, &frame, frmPayload);
+  if(state != RADIOLIB_ERR_NONE) {
+    fprintf(stderr, "Failed to decode the frame, code %d\n", state);
+    return(false);
+  }
+  uint8_t dec[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t decLen = sizeof(dec);
+  state = lz.decompress(frmPayload, frame.payloadLen, dec, &decLen);
+  int32_t records[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t numDecoded = sizeof(records) / sizeof(records[0]) / ENV_FIELDS;
+  if(state == RADIOLIB_ERR_NONE) {
+    state = RadioLibDelta::decode(dec, decLen, ENV_FIELDS, records, &numDecoded);
+  }
+  bool ok = (state == RADIOLIB_ERR_NONE) && (numDecoded == numRecords) && (memcmp(records, values, numRecords*ENV_FIELDS*sizeof(int32_t)) == 0);
+
+  printf("\nUplink on port %d with compression: %lu bytes of delta coded records sent as %lu bytes in a %lu byte frame, %lu ms on air: %s\n",
+    frame.fPort, (unsigned long)payloadLen, (unsigned long)frame.payloadLen, (unsigned long)sim.frameLen, (unsigned long)node.getLastToA(),
+    ok ? "decoded ok" : "FAILED");
+  return(ok);
+}
+
+int main(int argc, char** argv) {
+  unsigned long windowBits = RADIOLIB_LZ_WINDOW_BITS;
+  unsigned long lengthBits = RADIOLIB_LZ_LENGTH_BITS;
+  unsigned long sf = 9;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--window") == 0) && (i + 1 < argc)) {
+      windowBits = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--length") == 0) && (i + 1 < argc)) {
+      lengthBits = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--sf") == 0) && (i + 1 < argc)) {
+      sf = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--iterations") == 0) && (i + 1 < argc)) {
+      iterations = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--window <bits>] [--length <bits>] [--sf <7-12>] [--iterations <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((sf < 7) || (sf > 12) || (iterations == 0) || (lz.begin(windowBits, lengthBits) != RADIOLIB_ERR_NONE)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+
+  // time-on-air only, at 125 kHz
+  SimHal sim(SimChip::SX126x, PIN_RST, PIN_BUSY);
+  Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  SX1262 radio(&mod);
+  radio.begin(868.0, 125.0, sf);
+  phy = &radio;
+
+  printf("LZ window %lu bits, length %lu bits, time-on-air at SF%lu BW125 with %d bytes of frame overhead, host processor time (%lu iterations)\n\n",
+    windowBits, lengthBits, sf, FRAME_OVERHEAD, (unsigned long)iterations);
+  printf("| Telemetry    | Method         | Raw B | Out B | Ratio | Enc. (us) | Dec. (us) | Time-on-air (ms)   | Round trip |\n");
+  printf("|--------------|----------------|-------|-------|-------|-----------|-----------|--------------------|------------|\n");
+  bool ok = true;
+
+  int32_t env[12*ENV_FIELDS];
+  makeEnv(env, 12);
+  ok &= runDataset("environment", env, 12, ENV_FIELDS, envWidths);
+
+  int32_t gps[10*GPS_FIELDS];
+  makeGps(gps, 10);
+  ok &= runDataset("GPS track", gps, 10, GPS_FIELDS, gpsWidths);
+
+  // JSON-like text, as produced by quick prototypes
+  char text[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t textLen = 0;
+  for(size_t n = 0; n < 3; n++) {
+    textLen += snprintf(&text[textLen], sizeof(text) - textLen, "{\"t\":%d.%02d,\"h\":%d,\"p\":%d}",
+      (int)env[n*ENV_FIELDS + 1] / 100, (int)env[n*ENV_FIELDS + 1] % 100, (int)env[n*ENV_FIELDS + 2] / 2, (int)env[n*ENV_FIELDS + 3]);
+  }
+  uint8_t out[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t outLen = sizeof(out);
+  Timing t;
+  bool res = measureLZ((uint8_t*)text, textLen, out, &outLen, &t);
+  ok &= report("JSON text", "LZ", textLen, outLen, &t, res);
+
+  // already encrypted or otherwise random data does not compress, it is stored with a single byte of overhead
+  uint8_t noise[48];
+  for(size_t i = 0; i < sizeof(noise); i++) {
+    noise[i] = (uint8_t)random32();
+  }
+  outLen = sizeof(out);
+  res = measureLZ(noise, sizeof(noise), out, &outLen, &t);
+  ok &= report("random", "LZ", sizeof(noise), outLen, &t, res);
+
+  ok &= runUplink(env, 12);
+  return(ok ? 0 : 1);
+}
@@ -0,0 +1,555 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+// include RadioLib
+#include <RadioLib.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "SimHal.h"
+
+// pin numbers are arbitrary, the same for all simulated radios
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+#define TIME_NONE (UINT64_MAX)
+
+// xorshift, so that the runs are reproducible
+static inline uint32_t xorshift(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return(*state);
+}
+
+// CPU time spent by the calling thread in ns
+static inline uint64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+// LoRa time-on-air in ns, coding rate 4/5
+static inline uint64_t loraTimeOnAir(uint8_t sf, uint16_t bw, uint16_t preamble, size_t len, bool crc, bool implicit, bool ldro) {
+  double sym = (double)(1UL << sf) / bw;
+  double num = 8.0*len - 4.0*sf + 28.0 + (crc ? 16.0 : 0.0) - (implicit ? 20.0 : 0.0);
+  double den = 4.0*(sf - (ldro ? 2 : 0));
+  double payloadSym = 8.0 + RADIOLIB_MAX(ceil(num / den)*5.0, 0.0);
+  return((uint64_t)((preamble + 4.25 + payloadSym) * sym * 1000000.0));
+}
+
+// lowest SNR at which a LoRa packet can be demodulated
+static inline float demodFloor(uint8_t sf) {
+  return(-7.5f - 2.5f*(sf - 7));
+}
+
+// a LoRa packet on the shared channel, uplinks come from the nodes, downlinks from the gateway
+struct Transmission {
+  size_t node;          // sender of an uplink, recipient of a downlink
+  uint64_t start;       // ns of virtual time
+  uint64_t end;
+  uint32_t freq;        // kHz
+  uint8_t sf;
+  uint16_t bw;          // kHz
+  uint16_t preamble;    // symbols
+  bool invertIQ;
+  float snr;            // dB, the same in both directions
+  uint8_t data[256];
+  size_t len;
+
+  // outcome of an uplink at the gateway
+  bool collided;        // overlapped another uplink on the same frequency and spreading factor
+  bool blocked;         // the gateway was transmitting a downlink
+  bool weak;            // below the demodulation floor
+};
+
+// receive window opened by a simulated radio
+struct RxWindow {
+  uint64_t start;       // ns of virtual time
+  uint64_t end;         // TIME_NONE for continuous reception
+  uint32_t freq;        // kHz
+  uint8_t sf;
+  bool received;        // a downlink was caught in the window
+};
+
+// the radio channel shared by all nodes and the gateway
+// there is no capture effect, packets that overlap on the same frequency and spreading factor are all lost
+class Channel {
+  public:
+    std::vector<Transmission> uplinks;
+    std::vector<Transmission> downlinks;
+
+    // uplinks that have not been processed at the gateway yet, by the time they end
+    std::multimap<uint64_t, size_t> pending;
+
+    void transmit(const Transmission& tx) {
+      if(tx.invertIQ) {
+        this->downlinks.push_back(tx);
+        return;
+      }
+      this->pending.insert({ tx.end, this->uplinks.size() });
+      this->uplinks.push_back(tx);
+    }
+
+    // decide whether the gateway got the uplink, all uplinks that overlap it must be known by now
+    bool evaluate(size_t index) {
+      Transmission& up = this->uplinks[index];
+      up.weak = up.snr < demodFloor(up.sf);
+
+      // uplinks are added roughly in the order they start, and none is longer than a few seconds
+      for(size_t i = index; i-- > 0;) {
+        const Transmission& other = this->uplinks[i];
+        if(other.start + 5000000000ULL < up.start) {
+          break;
+        }
+        up.collided |= overlaps(up, other);
+      }
+      for(size_t i = index + 1; i < this->uplinks.size(); i++) {
+        const Transmission& other = this->uplinks[i];
+        if(other.start > up.end + 1000000000ULL) {
+          break;
+        }
+        up.collided |= overlaps(up, other);
+      }
+
+      // the gateway can not receive while it transmits
+      up.blocked = this->isGatewayBusy(up.start, up.end);
+      return(!up.weak && !up.collided && !up.blocked);
+    }
+
+    bool isGatewayBusy(uint64_t start, uint64_t end) const {
+      for(size_t i = this->downlinks.size(); i-- > 0;) {
+        const Transmission& dl = this->downlinks[i];
+        if((dl.start < end) && (start < dl.end)) {
+          return(true);
+        }
+        if(dl.end + 10000000000ULL < start) {
+          break;
+        }
+      }
+      return(false);
+    }
+
+    // downlink a receiver would lock onto, it must catch a few preamble symbols and the header before the timeout
+    int findDownlink(uint32_t freq, uint8_t sf, uint16_t bw, uint64_t rxStart, uint64_t rxEnd) const {
+      for(size_t i = this->downlinks.size(); i-- > 0;) {
+        const Transmission& dl = this->downlinks[i];
+        if(dl.end + 10000000000ULL < rxStart) {
+          break;
+        }
+        if((dl.freq != freq) || (dl.sf != sf) || (dl.bw != bw)) {
+          continue;
+        }
+        uint64_t sym = ((uint64_t)1000000 << sf) / bw;
+        if((rxStart <= dl.start + (dl.preamble - 4)*sym) && (dl.start + (dl.preamble + 8)*sym <= rxEnd)) {
+          return((int)i);
+        }
+      }
+      return(-1);
+    }
+
+  private:
+    static bool overlaps(const Transmission& a, const Transmission& b) {
+      return((a.freq == b.freq) && (a.sf == b.sf) && (a.start < b.end) && (b.start < a.end));
+    }
+};
+
+// conservative lock-step scheduler, every node runs in its own thread but only one thread runs at a time
+// the node with the earliest wake-up time always runs next, so the virtual clocks of all nodes
+// move forward together and everything a node does happens in the order of virtual time
+class Fleet {
+  public:
+    explicit Fleet(size_t num) : members(num) {}
+
+    // called by a node thread before it does anything
+    void enter(size_t id, uint64_t wake) {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->members[id].wake = wake;
+      this->members[id].entered = true;
+      this->cv.notify_one();
+      this->members[id].cv.wait(lock, [&] { return(this->running == id); });
+      this->members[id].cpuMark = threadCpuNs();
+    }
+
+    // called by a node thread to sleep until the given virtual time
+    void waitUntil(size_t id, uint64_t wake) {
+      Member& m = this->members[id];
+      m.cpuNs += threadCpuNs() - m.cpuMark;
+      std::unique_lock<std::mutex> lock(this->mtx);
+      m.wake = wake;
+      this->running = NONE;
+      this->cv.notify_one();
+      m.cv.wait(lock, [&] { return(this->running == id); });
+      m.cpuMark = threadCpuNs();
+    }
+
+    // called by a node thread when it is done
+    void leave(size_t id) {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->members[id].done = true;
+      this->running = NONE;
+      this->cv.notify_one();
+    }
+
+    // CPU time the node thread spent running so far, called by the node thread itself
+    uint64_t getCpuNs(size_t id) const {
+      const Member& m = this->members[id];
+      return(m.cpuNs + threadCpuNs() - m.cpuMark);
+    }
+
+    // hand out the turns until all nodes left
+    // advance is called before every turn with its virtual time, nothing else runs at that point
+    void run(std::function<void(uint64_t)> advance) {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->cv.wait(lock, [&] {
+        for(const Member& m : this->members) {
+          if(!m.entered) {
+            return(false);
+          }
+        }
+        return(true);
+      });
+
+      while(true) {
+        size_t next = NONE;
+        for(size_t i = 0; i < this->members.size(); i++) {
+          if(!this->members[i].done && ((next == NONE) || (this->members[i].wake < this->members[next].wake))) {
+            next = i;
+          }
+        }
+        if(next == NONE) {
+          break;
+        }
+
+        advance(this->members[next].wake);
+        this->running = next;
+        this->members[next].cv.notify_one();
+        this->cv.wait(lock, [&] { return(this->running == NONE); });
+      }
+    }
+
+  private:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    struct Member {
+      uint64_t wake = 0;
+      bool entered = false;
+      bool done = false;
+      uint64_t cpuNs = 0;
+      uint64_t cpuMark = 0;
+      std::condition_variable cv;
+    };
+
+    std::vector<Member> members;
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t running = NONE;
+};
+
+// simulated SX126x on the shared channel
+// on top of the register file of SimHal, it follows the frequency, modulation and packet parameters,
+// puts the written buffer on the channel when the transmission starts, and receives the downlinks
+// of the gateway in its receive windows; the radio state is worked out from the virtual time
+// whenever the driver looks at it, and every delay or wait for an interrupt is a turn of the scheduler
+class FleetHal : public SimHal {
+  public:
+    // receive windows opened by the radio, only recorded when logWindows is set
+    bool logWindows = false;
+    std::vector<RxWindow> windows;
+
+    FleetHal(Fleet* fleet, Channel* channel, size_t id, float snr, uint32_t seed)
+      : SimHal(SimChip::SX126x, PIN_RST, PIN_BUSY),
+      fleet(fleet),
+      channel(channel),
+      id(id),
+      snr(snr),
+      rng(seed ? seed : 1) {
+      // the time of the simulation must not depend on the host
+      this->cpuScale = 0;
+    }
+
+    // join the scheduler at the given virtual time
+    void enter(uint64_t ns) {
+      this->nowNs = ns;
+      this->fleet->enter(this->id, ns);
+    }
+
+    void leave() {
+      this->fleet->leave(this->id);
+    }
+
+    uint64_t getTimeNs() const {
+      return(this->nowNs);
+    }
+
+    uint32_t random() {
+      return(xorshift(&this->rng));
+    }
+
+    // virtual time and thread CPU time at which the last transmission started
+    uint64_t getTxStartNs() const {
+      return(this->txStart);
+    }
+
+    uint64_t getTxCpuNs() const {
+      return(this->txCpu);
+    }
+
+    uint32_t digitalRead(uint32_t pin) override {
+      uint32_t val = SimHal::digitalRead(pin);
+      if(pin == PIN_IRQ) {
+        this->update();
+        val = (this->irq & this->dioMask) ? this->GpioLevelHigh : this->GpioLevelLow;
+      }
+      return(val);
+    }
+
+    // the interrupt is raised on the rising edge of the IRQ pin, whenever the radio state is updated
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override {
+      (void)interruptNum;
+      (void)mode;
+      this->isr = interruptCb;
+    }
+
+    void detachInterrupt(uint32_t interruptNum) override {
+      (void)interruptNum;
+      this->isr = NULL;
+    }
+
+    void delay(unsigned long ms) override {
+      this->sleepUntil(this->nowNs + (uint64_t)ms * 1000000UL);
+    }
+
+    void yield() override {
+      // skip straight to the next radio event, unless the driver waits for something else
+      this->update();
+      uint64_t next = this->nextEvent();
+      if((this->nowNs >= this->busyUntilNs) && !(this->irq & this->dioMask) && (next != TIME_NONE)) {
+        this->sleepUntil(RADIOLIB_MAX(next, this->nowNs + 1000));
+        return;
+      }
+      SimHal::yield();
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      this->update();
+      SimHal::spiTransfer(out, len, in);
+      switch(out[0]) {
+        case RADIOLIB_SX126X_CMD_SET_RF_FREQUENCY: {
+          uint32_t frf = ((uint32_t)out[1] << 24) | ((uint32_t)out[2] << 16) | ((uint32_t)out[3] << 8) | out[4];
+          this->freq = (uint32_t)(((uint64_t)frf * 32000000ULL / (1UL << 25) + 500) / 1000);
+        } break;
+        case RADIOLIB_SX126X_CMD_SET_MODULATION_PARAMS:
+          if(this->packetType == RADIOLIB_SX126X_PACKET_TYPE_LORA) {
+            this->sf = out[1];
+            this->bw = (out[2] == RADIOLIB_SX126X_LORA_BW_500_0) ? 500 : ((out[2] == RADIOLIB_SX126X_LORA_BW_250_0) ? 250 : 125);
+            this->ldro = out[4];
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_SET_PACKET_PARAMS:
+          if(this->packetType == RADIOLIB_SX126X_PACKET_TYPE_LORA) {
+            this->preamble = ((uint16_t)out[1] << 8) | out[2];
+            this->implicit = (out[3] == RADIOLIB_SX126X_LORA_HEADER_IMPLICIT);
+            this->payloadLen = out[4];
+            this->crc = (out[5] == RADIOLIB_SX126X_LORA_CRC_ON);
+            this->invertIQ = (out[6] == RADIOLIB_SX126X_LORA_IQ_INVERTED);
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_SET_DIO_IRQ_PARAMS:
+          this->dioMask = ((uint16_t)out[3] << 8) | out[4];
+          break;
+        case RADIOLIB_SX126X_CMD_CLEAR_IRQ_STATUS:
+          this->irq &= ~(((uint16_t)out[1] << 8) | out[2]);
+          break;
+        case RADIOLIB_SX126X_CMD_WRITE_BUFFER:
+          for(size_t i = 2; i < len; i++) {
+            this->txBuff[(out[1] + i - 2) & 0xFF] = out[i];
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_SET_TX:
+          this->startTransmit();
+          break;
+        case RADIOLIB_SX126X_CMD_SET_RX:
+          this->startReceive(((uint32_t)out[1] << 16) | ((uint32_t)out[2] << 8) | out[3]);
+          break;
+        case RADIOLIB_SX126X_CMD_SET_STANDBY:
+        case RADIOLIB_SX126X_CMD_SET_SLEEP:
+        case RADIOLIB_SX126X_CMD_SET_FS:
+          this->mode = Mode::Standby;
+          break;
+        case RADIOLIB_SX126X_CMD_GET_IRQ_STATUS:
+          if(len > 3) {
+            in[2] = (this->irq >> 8) & 0xFF;
+            in[3] = this->irq & 0xFF;
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_GET_RX_BUFFER_STATUS:
+          if(len > 3) {
+            in[2] = this->rxLen;
+            in[3] = 0;
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_GET_PACKET_STATUS:
+          if(len > 4) {
+            int rssi = (int)(-120.0f + this->snr);
+            in[2] = (uint8_t)(-2*rssi);
+            in[3] = (uint8_t)(int8_t)(4.0f*this->snr);
+            in[4] = in[2];
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_READ_BUFFER:
+          for(size_t i = 3; i < len; i++) {
+            in[i] = this->rxBuff[(out[1] + i - 3) & 0xFF];
+          }
+          break;
+        case RADIOLIB_SX126X_CMD_READ_REGISTER:
+          // the random number generator, the drivers only use its least significant bit
+          if((len > 4) && ((((uint32_t)out[1] << 8) | out[2]) == RADIOLIB_SX126X_REG_RANDOM_NUMBER_0)) {
+            in[4] = (uint8_t)this->random();
+          }
+          break;
+        default:
+          break;
+      }
+      this->updateIrqLine();
+    }
+
+  private:
+    enum class Mode {
+      Standby,
+      Tx,
+      Rx,
+    };
+
+    Fleet* fleet;
+    Channel* channel;
+    size_t id;
+    float snr;
+    uint32_t rng;
+
+    // radio configuration
+    uint32_t freq = 0;
+    uint8_t sf = 7;
+    uint16_t bw = 125;
+    bool ldro = false;
+    uint16_t preamble = 8;
+    bool implicit = false;
+    uint8_t payloadLen = 0;
+    bool crc = true;
+    bool invertIQ = false;
+
+    // radio state
+    Mode mode = Mode::Standby;
+    uint16_t irq = 0;
+    uint16_t dioMask = 0;
+    uint64_t txStart = 0;
+    uint64_t txCpu = 0;
+    uint64_t txEnd = 0;
+    uint64_t rxEnd = 0;
+    int rxPacket = -1;
+    uint8_t txBuff[256] = { 0 };
+    uint8_t rxBuff[256] = { 0 };
+    size_t rxLen = 0;
+
+    // interrupt service routine attached to the IRQ pin, and the last level of the pin
+    void (*isr)(void) = NULL;
+    bool irqLine = false;
+
+    void sleepUntil(uint64_t ns) {
+      this->fleet->waitUntil(this->id, ns);
+      this->nowNs = ns;
+      this->update();
+    }
+
+    void updateIrqLine() {
+      // the line is updated first, the interrupt service routine may access the radio again
+      bool line = (this->irq & this->dioMask) != 0;
+      bool rising = line && !this->irqLine;
+      this->irqLine = line;
+      if(rising && this->isr) {
+        this->isr();
+      }
+    }
+
+    void startTransmit() {
+      Transmission tx = {};
+      tx.node = this->id;
+      tx.start = this->nowNs;
+      tx.end = this->nowNs + loraTimeOnAir(this->sf, this->bw, this->preamble, this->payloadLen, this->crc, this->implicit, this->ldro);
+      tx.freq = this->freq;
+      tx.sf = this->sf;
+      tx.bw = this->bw;
+      tx.preamble = this->preamble;
+      tx.invertIQ = this->invertIQ;
+      tx.snr = this->snr;
+      memcpy(tx.data, this->txBuff, this->payloadLen);
+      tx.len = this->payloadLen;
+      this->channel->transmit(tx);
+      this->txStart = tx.start;
+      this->txCpu = threadCpuNs();
+      this->txEnd = tx.end;
+      this->mode = Mode::Tx;
+    }
+
+    void startReceive(uint32_t timeout) {
+      // zero is single reception without timeout, all ones is continuous reception
+      this->rxEnd = TIME_NONE;
+      if((timeout != 0) && (timeout != RADIOLIB_SX126X_RX_TIMEOUT_INF)) {
+        this->rxEnd = this->nowNs + (uint64_t)timeout * 15625ULL;
+      }
+
+      // nodes only hear the gateway, and a downlink is only heard if the link is good enough
+      this->rxPacket = -1;
+      if(this->invertIQ && (this->snr >= demodFloor(this->sf))) {
+        this->rxPacket = this->channel->findDownlink(this->freq, this->sf, this->bw, this->nowNs, this->rxEnd);
+      }
+      if(this->logWindows && this->invertIQ) {
+        this->windows.push_back({ this->nowNs, this->rxEnd, this->freq, this->sf, this->rxPacket >= 0 });
+      }
+      this->mode = Mode::Rx;
+    }
+
+    // move the radio state on to the current time
+    void update() {
+      if((this->mode == Mode::Tx) && (this->nowNs >= this->txEnd)) {
+        this->irq |= RADIOLIB_SX126X_IRQ_TX_DONE;
+        this->mode = Mode::Standby;
+      } else if(this->mode == Mode::Rx) {
+        if(this->rxPacket >= 0) {
+          const Transmission& dl = this->channel->downlinks[this->rxPacket];
+          if(this->nowNs >= dl.end) {
+            memcpy(this->rxBuff, dl.data, dl.len);
+            this->rxLen = dl.len;
+            this->irq |= RADIOLIB_SX126X_IRQ_RX_DONE;
+            this->mode = Mode::Standby;
+          }
+        } else if(this->nowNs >= this->rxEnd) {
+          this->irq |= RADIOLIB_SX126X_IRQ_TIMEOUT;
+          this->mode = Mode::Standby;
+        }
+      }
+      this->updateIrqLine();
+    }
+
+    // time of the next interrupt
+    uint64_t nextEvent() const {
+      if(this->mode == Mode::Tx) {
+        return(this->txEnd);
+      } else if(this->mode == Mode::Rx) {
+        return((this->rxPacket >= 0) ? this->channel->downlinks[this->rxPacket].end : this->rxEnd);
+      }
+      return(TIME_NONE);
+    }
+};
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef NETWORK_SERVER_H
+#define NETWORK_SERVER_H
+
+#include <RadioLib.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "Fleet.h"
+
+// EU868 RX2 window, 869.525 MHz at DR0
+#define RX2_FREQ_KHZ  (869525)
+#define RX2_SF        (12)
+
+// installation margin and the SNR step per datarate used by the network ADR
+#define ADR_MARGIN_DB (10.0f)
+
+// minimal LoRaWAN v1.0.x network server behind a single gateway on the simulated channel
+// it answers Join-Requests, acknowledges confirmed uplinks, answers ADRACKReq,
+// and sends LinkADRReq until the device uses the datarate its SNR allows
+// the gateway is half-duplex and sends one downlink at a time, in RX1 if it is free, otherwise in RX2
+class NetworkServer {
+  public:
+    struct Device {
+      uint64_t devEUI;
+      uint8_t appKey[RADIOLIB_AES128_KEY_SIZE];
+      bool joined;
+      uint32_t devAddr;
+      uint8_t nwkSKey[RADIOLIB_AES128_KEY_SIZE];
+      uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE];
+      uint32_t fCntDown;
+      LoRaWANVerifierSession_t* session;
+
+      // datarate the network wants the device to use, and the one of its last uplink
+      uint8_t targetDr;
+      uint8_t lastDr;
+
+      // application downlinks waiting for the next uplink, the first byte is the FPort
+      std::deque<std::vector<uint8_t>> queue;
+    };
+
+    // counters
+    uint64_t joinRequests = 0;
+    uint64_t uplinks = 0;
+    uint64_t rejected = 0;
+    uint64_t downlinks = 0;
+    uint64_t downlinksRx2 = 0;
+    uint64_t downlinksDropped = 0;
+    uint64_t linkAdrReqs = 0;
+    uint64_t cpuNs = 0;
+
+    std::vector<Device> devices;
+
+    // receive window for the downlinks, -1 for RX1 unless the gateway is busy then, 0 or 1 for only RX1 or RX2
+    int window = -1;
+
+    // offset of the downlinks from the start of the window, to check the timing of the receive windows
+    int64_t offsetNs = 0;
+
+    // called for every accepted uplink with its decrypted payload, before the downlink is decided
+    std::function<void(Device&, const LoRaWANVerifierUplink_t&, const uint8_t*, const Transmission&)> onUplink;
+
+    NetworkServer(Channel* channel, size_t numDevices) : channel(channel) {
+      size_t size = 1;
+      while(size < 2*numDevices) {
+        size *= 2;
+      }
+      this->table.resize(size);
+      this->verifier.begin(this->table.data(), size);
+    }
+
+    void addDevice(uint64_t devEUI, const uint8_t* appKey, float snr) {
+      Device dev = {};
+      dev.devEUI = devEUI;
+      memcpy(dev.appKey, appKey, RADIOLIB_AES128_KEY_SIZE);
+
+      // the fastest datarate that still leaves the installation margin
+      dev.targetDr = 0;
+      for(uint8_t dr = 5; dr > 0; dr--) {
+        if(snr - demodFloor(12 - dr) >= ADR_MARGIN_DB) {
+          dev.targetDr = dr;
+          break;
+        }
+      }
+      this->index[devEUI] = this->devices.size();
+      this->devices.push_back(dev);
+    }
+
+    // an uplink ended, all uplinks that overlap it are known
+    void receive(size_t up) {
+      uint64_t start = threadCpuNs();
+      if(this->channel->evaluate(up)) {
+        const Transmission& tx = this->channel->uplinks[up];
+        uint8_t mType = tx.data[0] & RADIOLIB_LORAWAN_MHDR_MTYPE_MASK;
+        if((mType == RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_REQUEST) && (tx.len == RADIOLIB_LORAWAN_JOIN_REQUEST_LEN)) {
+          this->joinRequest(tx);
+        } else if((mType == RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP) || (mType == RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP)) {
+          this->dataUplink(tx);
+        }
+      }
+      this->cpuNs += threadCpuNs() - start;
+    }
+
+  private:
+    Channel* channel;
+    std::map<uint64_t, size_t> index;
+    std::vector<LoRaWANVerifierSession_t> table;
+    LoRaWANVerifier verifier;
+    uint32_t joinNonce = 0;
+
+    static uint64_t getLE(const uint8_t* buff, size_t len) {
+      uint64_t val = 0;
+      for(size_t i = 0; i < len; i++) {
+        val |= (uint64_t)buff[i] << (8*i);
+      }
+      return(val);
+    }
+
+    static void putLE(uint8_t* buff, uint64_t val, size_t len) {
+      for(size_t i = 0; i < len; i++) {
+        buff[i] = (val >> (8*i)) & 0xFF;
+      }
+    }
+
+    void joinRequest(const Transmission& tx) {
+      this->joinRequests++;
+      auto it = this->index.find(getLE(&tx.data[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_EUI_POS], 8));
+      if(it == this->index.end()) {
+        this->rejected++;
+        return;
+      }
+      Device& dev = this->devices[it->second];
+
+      uint8_t msg[RADIOLIB_LORAWAN_JOIN_REQUEST_LEN];
+      memcpy(msg, tx.data, sizeof(msg));
+      uint8_t cmac[RADIOLIB_AES128_BLOCK_SIZE];
+      RadioLibAES128Instance.init(dev.appKey);
+      RadioLibAES128Instance.generateCMAC(msg, RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t), cmac);
+      if(memcmp(cmac, &msg[RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t)], sizeof(uint32_t)) != 0) {
+        this->rejected++;
+        return;
+      }
+
+      // new session, LoRaWAN v1.0.x key derivation
+      uint16_t devNonce = getLE(&msg[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_NONCE_POS], 2);
+      uint32_t netId = 0x000013;
+      this->joinNonce++;
+      dev.devAddr = 0x26000000UL | (uint32_t)it->second;
+      uint8_t buff[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+      putLE(&buff[1], this->joinNonce, 3);
+      putLE(&buff[4], netId, 3);
+      putLE(&buff[7], devNonce, 2);
+      buff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_F_NWK_S_INT_KEY;
+      RadioLibAES128Instance.encryptECB(buff, RADIOLIB_AES128_BLOCK_SIZE, dev.nwkSKey);
+      buff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_APP_S_KEY;
+      RadioLibAES128Instance.encryptECB(buff, RADIOLIB_AES128_BLOCK_SIZE, dev.appSKey);
+
+      if(dev.session) {
+        this->verifier.removeSession(dev.session);
+      }
+      dev.session = this->verifier.addSession(dev.devAddr, NULL, NULL, dev.nwkSKey, dev.appSKey, 0, &dev);
+      dev.joined = true;
+      dev.fCntDown = 0;
+
+      // Join-Accept without CFList, default RX1 offset, RX2 datarate and RX delay
+      uint8_t accept[RADIOLIB_LORAWAN_JOIN_ACCEPT_CFLIST_POS + sizeof(uint32_t)] = { 0 };
+      accept[0] = RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_ACCEPT | RADIOLIB_LORAWAN_MHDR_MAJOR_R1;
+      putLE(&accept[RADIOLIB_LORAWAN_JOIN_ACCEPT_JOIN_NONCE_POS], this->joinNonce, 3);
+      putLE(&accept[RADIOLIB_LORAWAN_JOIN_ACCEPT_HOME_NET_ID_POS], netId, 3);
+      putLE(&accept[RADIOLIB_LORAWAN_JOIN_ACCEPT_DEV_ADDR_POS], dev.devAddr, 4);
+      RadioLibAES128Instance.init(dev.appKey);
+      RadioLibAES128Instance.generateCMAC(accept, RADIOLIB_LORAWAN_JOIN_ACCEPT_CFLIST_POS, cmac);
+      memcpy(&accept[RADIOLIB_LORAWAN_JOIN_ACCEPT_CFLIST_POS], cmac, sizeof(uint32_t));
+
+      // the device encrypts to decrypt, so the network decrypts to encrypt
+      uint8_t enc[sizeof(accept)];
+      enc[0] = accept[0];
+      RadioLibAES128Instance.decryptECB(&accept[1], sizeof(accept) - 1, &enc[1]);
+      this->sendDownlink(tx, enc, sizeof(enc), RADIOLIB_LORAWAN_JOIN_ACCEPT_DELAY_1_MS);
+    }
+
+    void dataUplink(const Transmission& tx) {
+      uint8_t payload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+      LoRaWANVerifierUplink_t uplink = {};
+      uplink.msg = tx.data;
+      uplink.len = tx.len;
+      uplink.dataRate = 12 - tx.sf;
+      uplink.payload = payload;
+      if(this->verifier.verify(&uplink) != RADIOLIB_ERR_NONE) {
+        this->rejected++;
+        return;
+      }
+      this->uplinks++;
+      Device& dev = *(Device*)uplink.session->ctx;
+      dev.lastDr = 12 - tx.sf;
+      if(this->onUplink) {
+        this->onUplink(dev, uplink, payload, tx);
+      }
+
+      LoRaWANFrame_t frame = {};
+      frame.mType = RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_DOWN;
+      frame.devAddr = dev.devAddr;
+      bool send = false;
+      if(uplink.frame.mType == RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP) {
+        frame.fCtrl |= RADIOLIB_LORAWAN_FCTRL_ACK;
+        send = true;
+      }
+      if(uplink.frame.fCtrl & RADIOLIB_LORAWAN_FCTRL_ADR_ACK_REQ) {
+        send = true;
+      }
+
+      // LinkADRReq: datarate and maximum power, the three default channels, one transmission
+      if((uplink.frame.fCtrl & RADIOLIB_LORAWAN_FCTRL_ADR_ENABLED) && (dev.lastDr != dev.targetDr)) {
+        const uint8_t req[] = { RADIOLIB_LORAWAN_MAC_LINK_ADR, (uint8_t)(dev.targetDr << 4), 0x07, 0x00, 0x01 };
+        memcpy(frame.fOpts, req, sizeof(req));
+        frame.fOptsLen = sizeof(req);
+        this->linkAdrReqs++;
+        send = true;
+      }
+      std::vector<uint8_t> app;
+      if(!dev.queue.empty()) {
+        app = dev.queue.front();
+        dev.queue.pop_front();
+        frame.hasFPort = true;
+        frame.fPort = app[0];
+        frame.payloadLen = app.size() - 1;
+        send = true;
+      }
+      if(!send) {
+        return;
+      }
+
+      frame.fCnt = dev.fCntDown++;
+      LoRaWANFrameKeys_t keys = { dev.devAddr, 0, dev.appSKey, dev.nwkSKey, dev.nwkSKey, dev.nwkSKey };
+      uint8_t out[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+      size_t len = sizeof(out);
+      if(LoRaWANFrame::encode(&frame, app.empty() ? NULL : app.data() + 1, &keys, out, &len) == RADIOLIB_ERR_NONE) {
+        this->sendDownlink(tx, out, len, RADIOLIB_LORAWAN_RECEIVE_DELAY_1_MS);
+      }
+    }
+
+    // RX1 on the frequency and datarate of the uplink, or RX2 a second later, unless a window was forced
+    void sendDownlink(const Transmission& up, const uint8_t* data, size_t len, uint64_t delayMs) {
+      Transmission dl = {};
+      dl.node = up.node;
+      dl.preamble = 8;
+      dl.invertIQ = true;
+      dl.snr = up.snr;
+      dl.bw = up.bw;
+      memcpy(dl.data, data, len);
+      dl.len = len;
+      for(int window = 0; window < 2; window++) {
+        if((this->window >= 0) && (window != this->window)) {
+          continue;
+        }
+        dl.start = up.end + (delayMs + window*1000ULL) * 1000000ULL + this->offsetNs;
+        dl.freq = window ? RX2_FREQ_KHZ : up.freq;
+        dl.sf = window ? RX2_SF : up.sf;
+        dl.end = dl.start + loraTimeOnAir(dl.sf, dl.bw, dl.preamble, len, false, false, dl.sf >= 11);
+        if(!this->channel->isGatewayBusy(dl.start, dl.end)) {
+          this->channel->transmit(dl);
+          this->downlinks++;
+          this->downlinksRx2 += window;
+          return;
+        }
+      }
+      this->downlinksDropped++;
+    }
+};
+
+#endif
@@ -0,0 +1,360 @@
+/*
+  RadioLib LoRaWAN fleet simulator
+
+  Runs hundreds of LoRaWAN nodes in one process, each one a complete LoRaWANNode
+  on its own simulated SX1262. The radios share one channel with a single gateway
+  and a minimal network server, which answers Join-Requests, acknowledges
+  confirmed uplinks and runs ADR with LinkADRReq.
+
+  Every node runs the blocking API in its own thread, a lock-step scheduler lets
+  only one of them run at a time and always the one that is the furthest behind
+  in virtual time, so the run is reproducible and the nodes see each other
+  exactly as on air. Uplinks that overlap on the same frequency and spreading
+  factor are all lost, as are uplinks sent while the gateway transmits.
+  Every node has a fixed SNR, packets below the demodulation floor are lost.
+
+  The nodes start joining at random times within the given spread, at DR5 and
+  one datarate lower after every failed attempt, retrying as soon as the join
+  backoff allows. With --no-join-backoff, they retry after 10 to 40 seconds. Once joined, they send a 12-byte
+  uplink at random intervals around the given one, every n-th of them confirmed,
+  with the duty cycle limit of the node enabled.
+
+  Reported are the fate of the uplinks, join latency, per-node duty cycle over
+  any one-hour window, how many nodes ended at the datarate the network picked,
+  and the host CPU time spent by the node threads (including their simulated
+  radios) and by the network server.
+
+  Usage: radiolib-fleet-simulator [--nodes <n>] [--hours <h>] [--interval <s>]
+         [--spread <s>] [--confirmed <n>] [--seed <n>] [--no-join-backoff]
+*/
+
+#include <RadioLib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "Fleet.h"
+#include "NetworkServer.h"
+
+#define JOIN_EUI        (0x0000000000000000ULL)
+#define DEV_EUI_BASE    (0x70B3D57ED0000000ULL)
+#define PAYLOAD_LEN     (12)
+
+// 1 % in any hour, all default EU868 channels are in the same sub-band
+#define DUTY_CYCLE_WINDOW_NS  (3600000000000ULL)
+#define DUTY_CYCLE_LIMIT      (0.01)
+
+struct Config {
+  size_t nodes;
+  double hours;
+  unsigned long interval;
+  unsigned long spread;
+  unsigned long confirmed;
+  uint32_t seed;
+  bool joinBackoff;
+};
+
+struct Node {
+  FleetHal hal;
+  Module mod;
+  SX1262 radio;
+  LoRaWANNode lorawan;
+  uint8_t appKey[RADIOLIB_AES128_KEY_SIZE];
+  uint64_t devEUI;
+  float snr;
+
+  // results
+  int16_t error = RADIOLIB_ERR_NONE;
+  bool joined = false;
+  uint32_t joinAttempts = 0;
+  uint64_t joinLatency = 0;
+  uint64_t joinCpuNs = 0;
+  uint32_t uplinks = 0;
+  uint32_t confirmed = 0;
+  uint32_t acked = 0;
+  uint32_t downlinks = 0;
+  uint32_t foreign = 0;
+  uint64_t uplinkCpuNs = 0;
+  uint8_t lastDr = 0;
+
+  Node(Fleet* fleet, Channel* channel, size_t id, float snr, uint32_t seed)
+    : hal(fleet, channel, id, snr, seed),
+    mod(&hal, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY),
+    radio(&mod),
+    lorawan(&radio, &EU868),
+    devEUI(DEV_EUI_BASE + id),
+    snr(snr) {
+    for(size_t i = 0; i < sizeof(this->appKey); i++) {
+      this->appKey[i] = (uint8_t)this->hal.random();
+    }
+  }
+};
+
+// the receive windows of a node may catch the downlink of another one, which fails its checks
+static bool isForeign(int16_t state) {
+  return((state == RADIOLIB_ERR_DOWNLINK_MALFORMED) || (state == RADIOLIB_ERR_CRC_MISMATCH));
+}
+
+static void runNode(Node* n, Fleet* fleet, size_t id, const Config* cfg) {
+  uint64_t end = (uint64_t)(cfg->hours * 3600.0) * 1000000000ULL;
+  n->hal.enter((uint64_t)(n->hal.random() % (cfg->spread * 1000UL)) * 1000000ULL);
+  n->error = n->radio.begin();
+  if(n->error != RADIOLIB_ERR_NONE) {
+    n->hal.leave();
+    return;
+  }
+  n->lorawan.beginOTAA(JOIN_EUI, n->devEUI, NULL, n->appKey);
+  n->lorawan.setDutyCycle(true);
+  n->lorawan.setJoinBackoff(cfg->joinBackoff);
+
+  // join, starting fast and slowing down after every failed attempt
+  uint64_t joinStart = n->hal.getTimeNs();
+  uint8_t dr = 5;
+  while(n->hal.getTimeNs() < end) {
+    n->joinAttempts++;
+    uint64_t cpu = fleet->getCpuNs(id);
+    int16_t state = n->lorawan.activateOTAA(dr);
+    n->joinCpuNs += fleet->getCpuNs(id) - cpu;
+    if(state == RADIOLIB_LORAWAN_NEW_SESSION) {
+      n->joined = true;
+      n->joinLatency = n->hal.getTimeNs() - joinStart;
+      break;
+    } else if(isForeign(state)) {
+      n->foreign++;
+    } else if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+      n->error = state;
+    }
+    dr = dr ? dr - 1 : 0;
+    RadioLibTime_t backoff = cfg->joinBackoff ? n->lorawan.timeUntilJoin() : 10000 + n->hal.random() % 30000;
+    n->hal.delay(RADIOLIB_MAX(backoff, n->lorawan.timeUntilUplink()));
+  }
+
+  while(n->joined) {
+    n->hal.delay(cfg->interval * 500UL + n->hal.random() % (cfg->interval * 1000UL));
+    n->hal.delay(n->lorawan.timeUntilUplink());
+    if(n->hal.getTimeNs() >= end) {
+      break;
+    }
+
+    uint8_t payload[PAYLOAD_LEN];
+    for(size_t i = 0; i < sizeof(payload); i++) {
+      payload[i] = (uint8_t)n->hal.random();
+    }
+    bool confirmed = cfg->confirmed && ((n->uplinks % cfg->confirmed) == cfg->confirmed - 1);
+    LoRaWANEvent_t eventUp = {};
+    LoRaWANEvent_t eventDown = {};
+    uint64_t cpu = fleet->getCpuNs(id);
+    int16_t state = n->lorawan.sendReceive(payload, sizeof(payload), 1, confirmed, &eventUp, &eventDown);
+    n->uplinkCpuNs += fleet->getCpuNs(id) - cpu;
+    if(isForeign(state)) {
+      n->foreign++;
+    } else if((state != RADIOLIB_ERR_NONE) && (state != RADIOLIB_LORAWAN_NO_DOWNLINK)) {
+      n->error = state;
+      continue;
+    }
+    n->uplinks++;
+    n->confirmed += confirmed;
+    n->downlinks += (state == RADIOLIB_ERR_NONE);
+    n->acked += confirmed && (state == RADIOLIB_ERR_NONE) && eventDown.confirming;
+    n->lastDr = eventUp.datarate;
+  }
+  n->hal.leave();
+}
+
+// highest airtime of the node in any window, in the same unit as the window
+static double maxDutyCycle(const std::vector<const Transmission*>& txs) {
+  double maxAirtime = 0;
+  size_t first = 0;
+  uint64_t airtime = 0;
+  for(size_t i = 0; i < txs.size(); i++) {
+    airtime += txs[i]->end - txs[i]->start;
+    while(txs[first]->start + DUTY_CYCLE_WINDOW_NS <= txs[i]->start) {
+      airtime -= txs[first]->end - txs[first]->start;
+      first++;
+    }
+    maxAirtime = RADIOLIB_MAX(maxAirtime, (double)airtime);
+  }
+  return(maxAirtime / DUTY_CYCLE_WINDOW_NS);
+}
+
+static double percentile(std::vector<double>& vals, double p) {
+  if(vals.empty()) {
+    return(0);
+  }
+  std::sort(vals.begin(), vals.end());
+  return(vals[(size_t)(p * (vals.size() - 1))]);
+}
+
+int main(int argc, char** argv) {
+  Config cfg = { 200, 2.0, 300, 600, 10, 1, true };
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--nodes") == 0) && (i + 1 < argc)) {
+      cfg.nodes = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--hours") == 0) && (i + 1 < argc)) {
+      cfg.hours = strtod(argv[++i], NULL);
+    } else if((strcmp(argv[i], "--interval") == 0) && (i + 1 < argc)) {
+      cfg.interval = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--spread") == 0) && (i + 1 < argc)) {
+      cfg.spread = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--confirmed") == 0) && (i + 1 < argc)) {
+      cfg.confirmed = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      cfg.seed = strtoul(argv[++i], NULL, 10);
+    } else if(strcmp(argv[i], "--no-join-backoff") == 0) {
+      cfg.joinBackoff = false;
+    } else {
+      fprintf(stderr, "Usage: %s [--nodes <n>] [--hours <h>] [--interval <s>] [--spread <s>] [--confirmed <n>] [--seed <n>] [--no-join-backoff]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((cfg.nodes == 0) || (cfg.hours <= 0) || (cfg.interval == 0) || (cfg.spread == 0)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+  if(cfg.nodes > RADIOLIB_LORAWAN_NODES_MAX) {
+    fprintf(stderr, "At most %d nodes, RadioLib was built with RADIOLIB_LORAWAN_NODES_MAX = %d\n", RADIOLIB_LORAWAN_NODES_MAX, RADIOLIB_LORAWAN_NODES_MAX);
+    return(1);
+  }
+
+  // every node gets its own SNR and random number generator
+  Fleet fleet(cfg.nodes);
+  Channel channel;
+  NetworkServer server(&channel, cfg.nodes);
+  std::vector<std::unique_ptr<Node>> nodes;
+  uint32_t rng = cfg.seed ? cfg.seed : 1;
+  for(size_t i = 0; i < cfg.nodes; i++) {
+    float snr = -20.0f + 30.0f * (xorshift(&rng) >> 8) / 16777216.0f;
+    nodes.emplace_back(new Node(&fleet, &channel, i, snr, xorshift(&rng)));
+    server.addDevice(nodes[i]->devEUI, nodes[i]->appKey, snr);
+  }
+
+  printf("%lu nodes on EU868 for %.1f h, joining within %lu s, a %d-byte uplink every %lu s on average",
+    (unsigned long)cfg.nodes, cfg.hours, cfg.spread, PAYLOAD_LEN, cfg.interval);
+  if(cfg.confirmed) {
+    printf(", 1 in %lu confirmed", cfg.confirmed);
+  }
+  printf("\n\n");
+
+  // the gateway gets every uplink once the scheduler has moved past its end
+  auto wallStart = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < cfg.nodes; i++) {
+    threads.emplace_back(runNode, nodes[i].get(), &fleet, i, &cfg);
+  }
+  fleet.run([&](uint64_t now) {
+    while(!channel.pending.empty() && (channel.pending.begin()->first <= now)) {
+      size_t up = channel.pending.begin()->second;
+      channel.pending.erase(channel.pending.begin());
+      server.receive(up);
+    }
+  });
+  for(std::thread& t : threads) {
+    t.join();
+  }
+  while(!channel.pending.empty()) {
+    server.receive(channel.pending.begin()->second);
+    channel.pending.erase(channel.pending.begin());
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  // uplinks on air
+  uint64_t joinRequests = 0;
+  uint64_t collided = 0;
+  uint64_t blocked = 0;
+  uint64_t weak = 0;
+  std::vector<std::vector<const Transmission*>> perNode(cfg.nodes);
+  for(const Transmission& tx : channel.uplinks) {
+    joinRequests += ((tx.data[0] & RADIOLIB_LORAWAN_MHDR_MTYPE_MASK) == RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_REQUEST);
+    collided += tx.collided;
+    blocked += !tx.collided && tx.blocked;
+    weak += !tx.collided && !tx.blocked && tx.weak;
+    perNode[tx.node].push_back(&tx);
+  }
+  uint64_t total = channel.uplinks.size();
+  uint64_t received = total - collided - blocked - weak;
+  printf("| Uplinks on air           | Count | Share (%%) |\n");
+  printf("|--------------------------|-------|-----------|\n");
+  printf("| Total                    | %5llu | %9.1f |\n", (unsigned long long)total, 100.0);
+  printf("| Join-Requests            | %5llu | %9.1f |\n", (unsigned long long)joinRequests, 100.0 * joinRequests / total);
+  printf("| Received by the gateway  | %5llu | %9.1f |\n", (unsigned long long)received, 100.0 * received / total);
+  printf("| Lost to collisions       | %5llu | %9.1f |\n", (unsigned long long)collided, 100.0 * collided / total);
+  printf("| Lost, gateway was busy   | %5llu | %9.1f |\n", (unsigned long long)blocked, 100.0 * blocked / total);
+  printf("| Lost, below sensitivity  | %5llu | %9.1f |\n\n", (unsigned long long)weak, 100.0 * weak / total);
+
+  // node side
+  size_t joined = 0;
+  size_t errors = 0;
+  size_t adrOk = 0;
+  uint64_t attempts = 0;
+  uint64_t uplinks = 0;
+  uint64_t confirmed = 0;
+  uint64_t acked = 0;
+  uint64_t downlinks = 0;
+  uint64_t foreign = 0;
+  uint64_t joinCpu = 0;
+  uint64_t uplinkCpu = 0;
+  size_t drCount[6] = { 0 };
+  std::vector<double> latency;
+  std::vector<double> duty;
+  size_t dutyExceeded = 0;
+  for(size_t i = 0; i < cfg.nodes; i++) {
+    const Node& n = *nodes[i];
+    errors += (n.error != RADIOLIB_ERR_NONE);
+    attempts += n.joinAttempts;
+    joinCpu += n.joinCpuNs;
+    uplinks += n.uplinks;
+    confirmed += n.confirmed;
+    acked += n.acked;
+    downlinks += n.downlinks;
+    foreign += n.foreign;
+    uplinkCpu += n.uplinkCpuNs;
+    double dc = maxDutyCycle(perNode[i]);
+    duty.push_back(100.0 * dc);
+    dutyExceeded += (dc > DUTY_CYCLE_LIMIT);
+    if(!n.joined) {
+      continue;
+    }
+    joined++;
+    latency.push_back(n.joinLatency / 1e9);
+    if(n.uplinks > 0) {
+      drCount[RADIOLIB_MIN(n.lastDr, (uint8_t)5)]++;
+      adrOk += (n.lastDr == server.devices[i].targetDr);
+    }
+  }
+
+  double latencyMean = 0;
+  for(double l : latency) {
+    latencyMean += l;
+  }
+  latencyMean = latency.empty() ? 0 : latencyMean / latency.size();
+  printf("Joined: %lu of %lu nodes in %llu attempts, latency mean %.1f s, median %.1f s, 95th percentile %.1f s, max %.1f s\n",
+    (unsigned long)joined, (unsigned long)cfg.nodes, (unsigned long long)attempts, latencyMean,
+    percentile(latency, 0.5), percentile(latency, 0.95), percentile(latency, 1.0));
+  printf("Data uplinks: %llu sent, %llu accepted by the network server, %llu downlinks received by the nodes, %llu meant for another node\n",
+    (unsigned long long)uplinks, (unsigned long long)server.uplinks, (unsigned long long)downlinks, (unsigned long long)foreign);
+  printf("Confirmed uplinks: %llu sent, %llu acknowledged (%.1f %%)\n",
+    (unsigned long long)confirmed, (unsigned long long)acked, confirmed ? 100.0 * acked / confirmed : 0.0);
+  printf("Gateway: %llu downlinks (%llu in RX2), %llu dropped as the gateway was busy, %llu LinkADRReq\n",
+    (unsigned long long)server.downlinks, (unsigned long long)server.downlinksRx2,
+    (unsigned long long)server.downlinksDropped, (unsigned long long)server.linkAdrReqs);
+  printf("ADR: %lu of %lu nodes at the datarate picked by the network, last datarate DR0-DR5: %lu %lu %lu %lu %lu %lu\n",
+    (unsigned long)adrOk, (unsigned long)joined, (unsigned long)drCount[0], (unsigned long)drCount[1],
+    (unsigned long)drCount[2], (unsigned long)drCount[3], (unsigned long)drCount[4], (unsigned long)drCount[5]);
+  printf("Duty cycle in any hour: median %.3f %%, max %.3f %%, %lu nodes above %.0f %%\n",
+    percentile(duty, 0.5), percentile(duty, 1.0), (unsigned long)dutyExceeded, 100.0 * DUTY_CYCLE_LIMIT);
+  printf("Host CPU: %.1f us per join attempt, %.1f us per uplink, %.1f us per uplink at the network server\n",
+    attempts ? joinCpu / 1000.0 / attempts : 0.0, uplinks ? uplinkCpu / 1000.0 / uplinks : 0.0,
+    total ? server.cpuNs / 1000.0 / total : 0.0);
+  printf("Simulated %.1f h in %.1f s of wall time\n", cfg.hours, wall);
+  if(errors) {
+    printf("%lu nodes reported errors\n", (unsigned long)errors);
+  }
+
+  return(errors ? 1 : 0);
+}
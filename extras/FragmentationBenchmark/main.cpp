@@ -0,0 +1,256 @@
+/*
+  RadioLib LoRaWAN fragmentation benchmark
+
+  Sends a random data block through the TS004 fragment decoder,
+  losing fragments at the given rates, and reports how many coded
+  fragments were needed and how fast the block was reassembled.
+
+  Before that, it checks the parity matrix rows of the decoder against
+  rows of the LoRaMac-node reference implementation (FragGetParityMatrixRow),
+  and fails if any of them differ. The coded fragments are built with
+  a copy of the reference code, not with the decoder's own rows.
+
+  The storage is kept in RAM and counts the accesses, so the results
+  show the decoder cost and how much it relies on the storage.
+  On target hardware, the storage access time (e.g. flash reads)
+  is added for every read and write reported here.
+
+  Usage: radiolib-fragmentation-benchmark [--size <bytes>] [--frag <bytes>]
+         [--loss <percent>]... [--seed <n>] [--csv]
+*/
+
+#include <RadioLib.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// RAM storage with access counters
+struct Storage {
+  std::vector<uint8_t> mem;
+  unsigned long reads = 0;
+  unsigned long writes = 0;
+};
+
+static int16_t storageRead(uint32_t offset, uint8_t* data, size_t len, void* ctx) {
+  Storage* s = (Storage*)ctx;
+  memcpy(data, &s->mem[offset], len);
+  s->reads++;
+  return(RADIOLIB_ERR_NONE);
+}
+
+static int16_t storageWrite(uint32_t offset, const uint8_t* data, size_t len, void* ctx) {
+  Storage* s = (Storage*)ctx;
+  memcpy(&s->mem[offset], data, len);
+  s->writes++;
+  return(RADIOLIB_ERR_NONE);
+}
+
+// xorshift, so that the runs are reproducible
+static uint32_t rng = 1;
+static uint32_t random32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return(rng);
+}
+
+// known parity matrix rows from the reference implementation, as bitmaps with fragment i in bit i
+struct ParityVector {
+  uint16_t n;
+  uint16_t m;
+  uint8_t line[5];
+};
+
+static const ParityVector parityVectors[] = {
+  { 1, 10, { 0x24, 0x00 } },
+  { 2, 10, { 0x35, 0x02 } },
+  { 3, 10, { 0xEA, 0x00 } },
+  { 1, 16, { 0x37, 0xA4 } },
+  { 5, 16, { 0xF0, 0x18 } },
+  { 1, 40, { 0x2C, 0x81, 0x41, 0x83, 0x81 } },
+  { 7, 40, { 0x78, 0x01, 0x01, 0x0B, 0x61 } },
+  { 100, 40, { 0x0B, 0x00, 0x12, 0x43, 0xDD } },
+};
+
+// LoRaMac-node FragPrbs23 and FragGetParityMatrixRow, one byte per fragment
+static int32_t refPrbs23(int32_t value) {
+  int32_t b0 = value & 0x01;
+  int32_t b1 = (value & 0x20) >> 5;
+  return((value >> 1) + ((b0 ^ b1) << 22));
+}
+
+static void refParityRow(int32_t n, int32_t m, uint8_t* row) {
+  int32_t mTemp = ((m & (m - 1)) == 0) ? 1 : 0;
+  int32_t x = 1 + (1001 * n);
+  memset(row, 0, m);
+  for(int32_t nbCoeff = 0; nbCoeff < (m >> 1); nbCoeff++) {
+    int32_t r = 1 << 16;
+    while(r >= m) {
+      x = refPrbs23(x);
+      r = x % (m + mTemp);
+    }
+    row[r] = 1;
+  }
+}
+
+static bool checkParityLines() {
+  bool ok = true;
+  for(const ParityVector& vec : parityVectors) {
+    uint8_t line[sizeof(vec.line)] = { 0 };
+    uint8_t row[8*sizeof(vec.line)];
+    LoRaWANFragDecoder::getParityLine(vec.n, vec.m, line);
+    refParityRow(vec.n, vec.m, row);
+    for(uint16_t i = 0; i < vec.m; i++) {
+      bool expected = (vec.line[i / 8] >> (i % 8)) & 0x01;
+      if((((line[i / 8] >> (i % 8)) & 0x01) != expected) || (row[i] != expected)) {
+        fprintf(stderr, "Parity matrix row %u of %u fragments differs from the reference at fragment %u\n", vec.n, vec.m, i);
+        ok = false;
+        break;
+      }
+    }
+  }
+  return(ok);
+}
+
+struct Result {
+  double loss;
+  int16_t state;
+  bool complete;
+  uint32_t sent;
+  uint32_t received;
+  double decodeMs;
+  unsigned long reads;
+  unsigned long writes;
+  bool match;
+};
+
+static void run(Result& res, LoRaWANFragDecoder& dec, const std::vector<uint8_t>& block, uint16_t nbFrag, uint8_t fragSize) {
+  Storage storage;
+  storage.mem.assign((size_t)nbFrag * fragSize, 0);
+  dec.setStorage(storageRead, storageWrite, &storage);
+  res.state = dec.begin(nbFrag, fragSize, nbFrag * fragSize - block.size());
+
+  std::vector<uint8_t> row(nbFrag);
+  std::vector<uint8_t> frag(fragSize);
+  std::chrono::duration<double, std::milli> decodeTime(0);
+  res.sent = 0;
+  res.received = 0;
+
+  // send uncoded fragments first, then coded ones until the block is complete (at most 3x the block)
+  for(uint32_t n = 1; (res.state == RADIOLIB_ERR_NONE) && !dec.isComplete() && (n <= 4*(uint32_t)nbFrag); n++) {
+    if(n <= nbFrag) {
+      memcpy(frag.data(), &block[(n - 1) * fragSize], fragSize);
+    } else {
+      refParityRow(n - nbFrag, nbFrag, row.data());
+      memset(frag.data(), 0, fragSize);
+      for(uint16_t i = 0; i < nbFrag; i++) {
+        if(row[i]) {
+          for(uint8_t j = 0; j < fragSize; j++) {
+            frag[j] ^= block[i*fragSize + j];
+          }
+        }
+      }
+    }
+    res.sent++;
+    if((random32() % 10000) < (uint32_t)(res.loss * 100.0)) {
+      continue;
+    }
+    res.received++;
+
+    auto start = std::chrono::steady_clock::now();
+    res.state = dec.push(n, frag.data(), fragSize);
+    decodeTime += std::chrono::steady_clock::now() - start;
+  }
+
+  res.complete = dec.isComplete();
+  res.decodeMs = decodeTime.count();
+  res.reads = storage.reads;
+  res.writes = storage.writes;
+  res.match = res.complete && (memcmp(storage.mem.data(), block.data(), block.size()) == 0);
+}
+
+int main(int argc, char** argv) {
+  uint32_t size = 256*1024UL;
+  uint8_t fragSize = 200;
+  double losses[16];
+  size_t numLosses = 0;
+  bool csv = false;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--size") == 0) && (i + 1 < argc)) {
+      size = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--frag") == 0) && (i + 1 < argc)) {
+      fragSize = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--loss") == 0) && (i + 1 < argc) && (numLosses < 16)) {
+      losses[numLosses++] = strtod(argv[++i], NULL);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      rng = strtoul(argv[++i], NULL, 10);
+    } else if(strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--size <bytes>] [--frag <bytes>] [--loss <percent>]... [--seed <n>] [--csv]\n", argv[0]);
+      return(1);
+    }
+  }
+  if(numLosses == 0) {
+    const double defaults[] = { 0, 1, 5, 10, 20 };
+    for(double loss : defaults) {
+      losses[numLosses++] = loss;
+    }
+  }
+  if((fragSize == 0) || (size == 0)) {
+    fprintf(stderr, "Invalid block or fragment size\n");
+    return(1);
+  }
+
+  if(!checkParityLines()) {
+    return(1);
+  }
+
+  uint16_t nbFrag = (size + fragSize - 1) / fragSize;
+  std::vector<uint8_t> block(size);
+  for(uint32_t i = 0; i < size; i++) {
+    block[i] = random32();
+  }
+
+  // the decoder is large, keep it off the stack
+  static LoRaWANFragDecoder dec;
+
+  if(csv) {
+    printf("size,frag_size,nb_frag,loss,state,complete,sent,received,overhead,decode_ms,throughput_kbps,reads,writes\n");
+  } else {
+    printf("Data block %lu bytes, %u fragments of %u bytes, decoder RAM %lu bytes\n\n",
+      (unsigned long)size, nbFrag, fragSize, (unsigned long)sizeof(LoRaWANFragDecoder));
+    printf("| Loss (%%) | State | Done | Sent   | Received | Overhead (%%) | Decode (ms) | Throughput (kB/s) | Reads    | Writes |\n");
+    printf("|----------|-------|------|--------|----------|--------------|-------------|-------------------|----------|--------|\n");
+  }
+
+  bool corrupted = false;
+  for(size_t i = 0; i < numLosses; i++) {
+    Result res = {};
+    res.loss = losses[i];
+    run(res, dec, block, nbFrag, fragSize);
+
+    // overhead is the number of fragments received above the uncoded ones
+    double overhead = 100.0 * ((double)res.received - nbFrag) / nbFrag;
+    double throughput = (res.decodeMs > 0) ? ((double)size / 1024.0) / (res.decodeMs / 1000.0) : 0;
+    if(csv) {
+      printf("%lu,%u,%u,%.2f,%d,%d,%lu,%lu,%.2f,%.3f,%.1f,%lu,%lu\n", (unsigned long)size, fragSize, nbFrag, res.loss, res.state,
+        res.match, (unsigned long)res.sent, (unsigned long)res.received, overhead, res.decodeMs, throughput, res.reads, res.writes);
+    } else {
+      printf("| %8.2f | %5d | %4s | %6lu | %8lu | %12.2f | %11.3f | %17.1f | %8lu | %6lu |\n", res.loss, res.state,
+        res.match ? "yes" : "no", (unsigned long)res.sent, (unsigned long)res.received, overhead, res.decodeMs, throughput, res.reads, res.writes);
+    }
+
+    // a block that was reported complete must be the one that was sent
+    corrupted |= (res.complete && !res.match);
+  }
+  if(corrupted) {
+    fprintf(stderr, "The decoder reported a complete block that does not match the data block\n");
+    return(1);
+  }
+
+  return(0);
+}
@@ -0,0 +1,244 @@
+/*
+  RadioLib LoRaWAN session journal benchmark
+
+  Sends uplinks from a LoRaWAN node on a simulated radio and saves
+  the session after every one of them into emulated flash, once with
+  LoRaWANJournal and once by writing the whole Nonces and session buffers,
+  which is what applications had to do before.
+
+  The device loses power at random points, also in the middle of a write.
+  After every power loss the session is restored from the journal and
+  the first uplink after that is checked to use a frame counter
+  that was not used before.
+
+  Usage: radiolib-journal-benchmark [--uplinks <n>] [--page <bytes>] [--pages <n>]
+         [--gap <n>] [--cut <1 in n saves>] [--seed <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "SimHal.h"
+
+// pin numbers are arbitrary, the simulated HAL only cares about RST and BUSY
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+// xorshift, so that the runs are reproducible
+static uint32_t rng = 1;
+static uint32_t random32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return(rng);
+}
+
+// the simulated radio does not model interrupts, so every operation finishes right away
+// and a downlink window times out, as if there was no downlink
+class IrqSimHal : public SimHal {
+  public:
+    IrqSimHal() : SimHal(SimChip::SX126x, PIN_RST, PIN_BUSY) {}
+
+    uint32_t digitalRead(uint32_t pin) override {
+      if(pin == PIN_IRQ) {
+        return(this->GpioLevelHigh);
+      }
+      return(SimHal::digitalRead(pin));
+    }
+
+    // timing is not measured here, so skip through the receive windows quickly
+    void yield() override {
+      this->delay(1);
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      SimHal::spiTransfer(out, len, in);
+      // SX126x GetIrqStatus: the receive window timed out
+      if((out[0] == RADIOLIB_SX126X_CMD_GET_IRQ_STATUS) && (len > 3)) {
+        in[2] = (RADIOLIB_SX126X_IRQ_TIMEOUT >> 8) & 0xFF;
+        in[3] = RADIOLIB_SX126X_IRQ_TIMEOUT & 0xFF;
+      }
+    }
+};
+
+// NOR flash: erased bytes read as 0xFF, a byte can only be programmed once per erase
+// a power loss can be scheduled, the write it falls into is cut short and nothing is written after it
+struct Flash {
+  std::vector<uint8_t> mem;
+  uint32_t pageSize;
+  std::vector<uint32_t> erases;
+  uint64_t bytesWritten = 0;
+  uint64_t overwrites = 0;
+  int64_t bytesToCut = -1;
+  bool poweredOff = false;
+};
+
+static int16_t flashRead(uint32_t addr, uint8_t* data, size_t len, void* ctx) {
+  Flash* flash = (Flash*)ctx;
+  memcpy(data, &flash->mem[addr], len);
+  return(RADIOLIB_ERR_NONE);
+}
+
+static int16_t flashWrite(uint32_t addr, const uint8_t* data, size_t len, void* ctx) {
+  Flash* flash = (Flash*)ctx;
+  for(size_t i = 0; i < len; i++) {
+    if(flash->poweredOff || (flash->bytesToCut == 0)) {
+      flash->poweredOff = true;
+      return(RADIOLIB_ERR_UNKNOWN);
+    }
+    if(flash->mem[addr + i] != 0xFF) {
+      flash->overwrites++;
+    }
+    flash->mem[addr + i] &= data[i];
+    flash->bytesWritten++;
+    if(flash->bytesToCut > 0) {
+      flash->bytesToCut--;
+    }
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+static int16_t flashErase(uint32_t addr, size_t len, void* ctx) {
+  Flash* flash = (Flash*)ctx;
+  if(flash->poweredOff) {
+    return(RADIOLIB_ERR_UNKNOWN);
+  }
+  memset(&flash->mem[addr], 0xFF, len);
+  flash->erases[addr / flash->pageSize]++;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int main(int argc, char** argv) {
+  size_t numUplinks = 20000;
+  uint32_t pageSize = 4096;
+  uint8_t numPages = 4;
+  uint32_t fCntGap = RADIOLIB_LORAWAN_JOURNAL_FCNT_GAP;
+  uint32_t cutRate = 500;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--uplinks") == 0) && (i + 1 < argc)) {
+      numUplinks = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--page") == 0) && (i + 1 < argc)) {
+      pageSize = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--pages") == 0) && (i + 1 < argc)) {
+      numPages = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--gap") == 0) && (i + 1 < argc)) {
+      fCntGap = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--cut") == 0) && (i + 1 < argc)) {
+      cutRate = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      rng = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--uplinks <n>] [--page <bytes>] [--pages <n>] [--gap <n>] [--cut <1 in n saves>] [--seed <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+
+  Flash flash;
+  flash.pageSize = pageSize;
+  flash.mem.assign((size_t)pageSize * numPages, 0xFF);
+  flash.erases.assign(numPages, 0);
+
+  uint8_t fNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x01 };
+  uint8_t sNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x02 };
+  uint8_t nwkSEncKey[RADIOLIB_AES128_KEY_SIZE] = { 0x03 };
+  uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x04 };
+  uint8_t payload[8] = { 0 };
+
+  size_t sent = 0;
+  size_t boots = 0;
+  size_t restored = 0;
+  size_t reused = 0;
+  uint64_t skipped = 0;
+  uint32_t lastFCnt = 0;
+  bool anySent = false;
+  while(sent < numUplinks) {
+    // boot: the radio, the node and the journal start from scratch
+    flash.poweredOff = false;
+    flash.bytesToCut = -1;
+    boots++;
+    IrqSimHal sim;
+    Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+    SX1262 radio(&mod);
+    radio.begin();
+    LoRaWANNode node(&radio, &EU868);
+    node.setDutyCycle(false);
+    node.beginABP(0x26011234, fNwkSIntKey, sNwkSIntKey, nwkSEncKey, appSKey);
+
+    LoRaWANJournal journal;
+    journal.setStorage(flashRead, flashWrite, flashErase, &flash);
+    int16_t state = journal.begin(pageSize, numPages, fCntGap);
+    if(state != RADIOLIB_ERR_NONE) {
+      fprintf(stderr, "Journal failed to start, code %d\n", state);
+      return(1);
+    }
+    state = journal.restore(&node);
+    if(state == RADIOLIB_ERR_NONE) {
+      restored++;
+    } else if(anySent) {
+      fprintf(stderr, "Session was not restored after %lu uplinks, code %d\n", (unsigned long)sent, state);
+      return(1);
+    }
+    node.activateABP();
+
+    // uplinks until the next power loss
+    bool first = true;
+    while(sent < numUplinks) {
+      LoRaWANEvent_t event;
+      state = node.sendReceive(payload, sizeof(payload), 1, false, &event);
+      if((state < RADIOLIB_ERR_NONE) && (state != RADIOLIB_LORAWAN_NO_DOWNLINK)) {
+        fprintf(stderr, "Uplink failed, code %d\n", state);
+        return(1);
+      }
+      if(first && anySent) {
+        if(event.fCnt <= lastFCnt) {
+          reused++;
+        } else {
+          skipped += event.fCnt - lastFCnt - 1;
+        }
+      }
+      first = false;
+      anySent = true;
+      lastFCnt = event.fCnt;
+      sent++;
+
+      // power may be lost anywhere in the next save
+      if((cutRate > 0) && (random32() % cutRate == 0)) {
+        flash.bytesToCut = random32() % 16;
+      }
+      (void)journal.save(&node);
+      if(flash.poweredOff) {
+        break;
+      }
+    }
+  }
+
+  uint64_t fullBytes = (uint64_t)sent * RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE;
+  uint32_t maxErases = 0;
+  uint64_t totalErases = 0;
+  for(uint32_t erases : flash.erases) {
+    maxErases = RADIOLIB_MAX(maxErases, erases);
+    totalErases += erases;
+  }
+  printf("%lu uplinks, %lu boots (%lu restored), %u pages of %lu bytes, frame counter gap %lu\n\n",
+    (unsigned long)sent, (unsigned long)boots, (unsigned long)restored, numPages, (unsigned long)pageSize, (unsigned long)fCntGap);
+  printf("| Method         | Bytes written | Bytes/uplink | Page erases | Max erases/page |\n");
+  printf("|----------------|---------------|--------------|-------------|-----------------|\n");
+  printf("| Whole buffers  | %13llu | %12.1f | %11llu | %15llu |\n", (unsigned long long)fullBytes, (double)fullBytes / sent,
+    (unsigned long long)(fullBytes / pageSize), (unsigned long long)(fullBytes / pageSize / numPages));
+  printf("| LoRaWANJournal | %13llu | %12.1f | %11llu | %15lu |\n\n", (unsigned long long)flash.bytesWritten, (double)flash.bytesWritten / sent,
+    (unsigned long long)totalErases, (unsigned long)maxErases);
+  printf("Frame counters skipped after restores: %llu (%.1f per restore)\n", (unsigned long long)skipped, restored ? (double)skipped / restored : 0);
+  printf("Frame counters reused after restores: %lu\n", (unsigned long)reused);
+  printf("Bytes programmed without an erase: %llu\n", (unsigned long long)flash.overwrites);
+
+  if((reused != 0) || (flash.overwrites != 0)) {
+    return(1);
+  }
+  return(0);
+}
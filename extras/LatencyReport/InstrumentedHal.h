@@ -0,0 +1,185 @@
+#ifndef INSTRUMENTED_HAL_H
+#define INSTRUMENTED_HAL_H
+
+// include RadioLib
+#include <RadioLib.h>
+
+// time spent in one measured operation, all values in microseconds
+struct LatencyBreakdown {
+  // wall time of the whole operation
+  RadioLibTime_t total;
+
+  // time between SPI begin and end of transaction
+  RadioLibTime_t spi;
+
+  // time spent polling the BUSY line while it was high
+  RadioLibTime_t busy;
+
+  // time spent in delay() and delayMicroseconds()
+  RadioLibTime_t delay;
+
+  // everything else, i.e. driver code, GPIO and timer calls
+  RadioLibTime_t cpu;
+
+  // number of SPI transactions and bytes transferred
+  uint32_t spiTransactions;
+  uint32_t spiBytes;
+};
+
+// wrapper around any RadioLib HAL that forwards all calls to it,
+// and measures where the time in a driver operation goes
+// it can wrap the simulated HAL as well as a real one (e.g. ArduinoHal),
+// in which case the numbers come from the hardware timer
+class InstrumentedHal : public RadioLibHal {
+  public:
+    InstrumentedHal(RadioLibHal* hal, uint32_t busy = RADIOLIB_NC)
+      : RadioLibHal(hal->GpioModeInput, hal->GpioModeOutput, hal->GpioLevelLow, hal->GpioLevelHigh, hal->GpioInterruptRising, hal->GpioInterruptFalling),
+      hal(hal),
+      busyPin(busy) {
+    }
+
+    // start measuring a new operation
+    void start() {
+      this->stats = {};
+      this->busyActive = false;
+      this->started = this->hal->micros();
+    }
+
+    // stop measuring and get the result
+    LatencyBreakdown stop() {
+      RadioLibTime_t now = this->hal->micros();
+      this->closeBusy(now);
+      this->stats.total = now - this->started;
+      RadioLibTime_t accounted = this->stats.spi + this->stats.busy + this->stats.delay;
+      this->stats.cpu = (this->stats.total > accounted) ? (this->stats.total - accounted) : 0;
+      return(this->stats);
+    }
+
+    void init() override {
+      this->hal->init();
+    }
+
+    void term() override {
+      this->hal->term();
+    }
+
+    void pinMode(uint32_t pin, uint32_t mode) override {
+      this->hal->pinMode(pin, mode);
+    }
+
+    void digitalWrite(uint32_t pin, uint32_t value) override {
+      this->hal->digitalWrite(pin, value);
+    }
+
+    uint32_t digitalRead(uint32_t pin) override {
+      if(pin != this->busyPin) {
+        return(this->hal->digitalRead(pin));
+      }
+
+      // the BUSY wait starts at the first read that returned high and ends at the first low one
+      RadioLibTime_t before = this->hal->micros();
+      uint32_t val = this->hal->digitalRead(pin);
+      if(val == this->GpioLevelHigh) {
+        if(!this->busyActive) {
+          this->busyActive = true;
+          this->busyStart = before;
+        }
+      } else {
+        this->closeBusy(this->hal->micros());
+      }
+      return(val);
+    }
+
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override {
+      this->hal->attachInterrupt(interruptNum, interruptCb, mode);
+    }
+
+    void detachInterrupt(uint32_t interruptNum) override {
+      this->hal->detachInterrupt(interruptNum);
+    }
+
+    void delay(unsigned long ms) override {
+      RadioLibTime_t start = this->hal->micros();
+      this->hal->delay(ms);
+      this->stats.delay += this->hal->micros() - start;
+    }
+
+    void delayMicroseconds(unsigned long us) override {
+      RadioLibTime_t start = this->hal->micros();
+      this->hal->delayMicroseconds(us);
+      this->stats.delay += this->hal->micros() - start;
+    }
+
+    void yield() override {
+      this->hal->yield();
+    }
+
+    unsigned long millis() override {
+      return(this->hal->millis());
+    }
+
+    unsigned long micros() override {
+      return(this->hal->micros());
+    }
+
+    long pulseIn(uint32_t pin, uint32_t state, unsigned long timeout) override {
+      return(this->hal->pulseIn(pin, state, timeout));
+    }
+
+    void spiBegin() override {
+      this->hal->spiBegin();
+    }
+
+    void spiBeginTransaction() override {
+      RadioLibTime_t now = this->hal->micros();
+      this->closeBusy(now);
+      this->spiStart = now;
+      this->hal->spiBeginTransaction();
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      this->hal->spiTransfer(out, len, in);
+      this->stats.spiBytes += len;
+    }
+
+    void spiEndTransaction() override {
+      this->hal->spiEndTransaction();
+      this->stats.spi += this->hal->micros() - this->spiStart;
+      this->stats.spiTransactions++;
+    }
+
+    void spiEnd() override {
+      this->hal->spiEnd();
+    }
+
+    void tone(uint32_t pin, unsigned int frequency, RadioLibTime_t duration = 0) override {
+      this->hal->tone(pin, frequency, duration);
+    }
+
+    void noTone(uint32_t pin) override {
+      this->hal->noTone(pin);
+    }
+
+    uint32_t pinToInterrupt(uint32_t pin) override {
+      return(this->hal->pinToInterrupt(pin));
+    }
+
+  private:
+    RadioLibHal* hal;
+    uint32_t busyPin;
+    LatencyBreakdown stats = {};
+    RadioLibTime_t started = 0;
+    RadioLibTime_t spiStart = 0;
+    RadioLibTime_t busyStart = 0;
+    bool busyActive = false;
+
+    // a BUSY wait may also end by timeout, in which case the next transaction closes it
+    void closeBusy(RadioLibTime_t now) {
+      if(this->busyActive) {
+        this->stats.busy += now - this->busyStart;
+        this->busyActive = false;
+      }
+    }
+};
+
+#endif
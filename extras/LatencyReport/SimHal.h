@@ -0,0 +1,477 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+// include RadioLib
+#include <RadioLib.h>
+
+#include <chrono>
+#include <map>
+#include <string.h>
+
+// radio chips the simulated HAL knows how to talk to
+enum class SimChip {
+  SX126x,
+  SX127x,
+  SX128x,
+  LR11x0,
+  CC1101,
+  RF69,
+  Si443x,
+  nRF24,
+};
+
+// simulated hardware abstraction layer with a virtual clock
+// SPI transfers, BUSY line and delays advance the clock by modeled durations,
+// host time spent between HAL calls is added as CPU time (scaled by cpuScale)
+// register reads and writes go to a simple per-chip register file, so that
+// the drivers can find the chip and verify their register writes
+// a transmitted packet is received back, so that reading it out takes the same path as on hardware
+class SimHal : public RadioLibHal {
+  public:
+    // SPI clock frequency in Hz
+    uint32_t spiFreq = 2000000;
+
+    // fixed per-transaction overhead (CS setup/hold, driver entry) in ns
+    uint32_t spiOverheadNs = 2000;
+
+    // cost of a single GPIO read in ns
+    uint32_t gpioReadNs = 200;
+
+    // host-to-target CPU time ratio, e.g. 20 means target MCU is 20x slower than the host
+    double cpuScale = 20.0;
+
+    SimHal(SimChip chip, uint32_t rst, uint32_t busy)
+      : RadioLibHal(0, 1, 0, 1, 1, 2),
+      chip(chip),
+      rstPin(rst),
+      busyPin(busy) {
+      this->reset();
+    }
+
+    void reset() {
+      this->nowNs = 0;
+      this->busyUntilNs = 0;
+      this->regs.clear();
+      memset(this->fifo, 0, sizeof(this->fifo));
+      this->fifoLen = 0;
+      memset(this->rxFifo, 0, sizeof(this->rxFifo));
+      this->rxFifoLen = 0;
+      this->rxFifoPos = 0;
+      this->respLen = 0;
+      this->packetType = 0;
+      this->hostLast = std::chrono::steady_clock::now();
+
+      // preload identification registers
+      switch(this->chip) {
+        case SimChip::SX126x: {
+          const char ver[] = "SX1261 V2D 2D02";
+          for(size_t i = 0; i < sizeof(ver); i++) {
+            this->regs[0x0320 + i] = ver[i];
+          }
+        } break;
+        case SimChip::SX127x:
+          this->regs[0x42] = 0x12;
+          // the received LoRa header had the payload CRC enabled
+          this->regs[0x1C] = 0x40;
+          break;
+        case SimChip::CC1101:
+          // status registers are mapped above the configuration space
+          this->regs[0x100 | 0x31] = 0x14;
+          // MARCSTATE always reports IDLE
+          this->regs[0x100 | 0x35] = 0x01;
+          break;
+        case SimChip::RF69:
+          this->regs[0x10] = 0x24;
+          break;
+        case SimChip::Si443x:
+          this->regs[0x00] = 0x08;
+          this->regs[0x01] = 0x06;
+          break;
+        case SimChip::nRF24:
+          this->regs[0x03] = 0x03;
+          break;
+        default:
+          break;
+      }
+    }
+
+    void pinMode(uint32_t pin, uint32_t mode) override {
+      this->sync();
+      (void)pin;
+      (void)mode;
+      this->mark();
+    }
+
+    void digitalWrite(uint32_t pin, uint32_t value) override {
+      this->sync();
+      // releasing reset keeps BUSY high until the chip boots
+      if((pin == this->rstPin) && (value == this->GpioLevelHigh) && this->hasBusy()) {
+        this->busyUntilNs = this->nowNs + 3500000UL;
+      }
+      this->mark();
+    }
+
+    uint32_t digitalRead(uint32_t pin) override {
+      this->sync();
+      this->nowNs += this->gpioReadNs;
+      uint32_t val = this->GpioLevelLow;
+      if((pin == this->busyPin) && (this->nowNs < this->busyUntilNs)) {
+        val = this->GpioLevelHigh;
+      }
+      this->mark();
+      return(val);
+    }
+
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override {
+      (void)interruptNum;
+      (void)interruptCb;
+      (void)mode;
+    }
+
+    void detachInterrupt(uint32_t interruptNum) override {
+      (void)interruptNum;
+    }
+
+    void delay(unsigned long ms) override {
+      this->sync();
+      this->nowNs += (uint64_t)ms * 1000000UL;
+      this->mark();
+    }
+
+    void delayMicroseconds(unsigned long us) override {
+      this->sync();
+      this->nowNs += (uint64_t)us * 1000UL;
+      this->mark();
+    }
+
+    void yield() override {
+      // polling loops on the target take at least some time per iteration
+      this->sync();
+      this->nowNs += 1000;
+      this->mark();
+    }
+
+    unsigned long millis() override {
+      this->sync();
+      unsigned long ms = this->nowNs / 1000000UL;
+      this->mark();
+      return(ms);
+    }
+
+    unsigned long micros() override {
+      this->sync();
+      unsigned long us = this->nowNs / 1000UL;
+      this->mark();
+      return(us);
+    }
+
+    long pulseIn(uint32_t pin, uint32_t state, unsigned long timeout) override {
+      (void)pin;
+      (void)state;
+      (void)timeout;
+      return(0);
+    }
+
+    void spiBegin() override {}
+
+    void spiBeginTransaction() override {}
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      this->sync();
+      memset(in, 0, len);
+      switch(this->chip) {
+        case SimChip::SX126x:
+          this->transferSX126x(out, len, in, 0x22, 0x1D, 0x0D, 0x1E, 0x0E, 0x11);
+          break;
+        case SimChip::SX128x:
+          this->transferSX126x(out, len, in, 0x44, 0x19, 0x18, 0x1B, 0x1A, 0x03);
+          break;
+        case SimChip::LR11x0:
+          this->transferLR11x0(out, len, in);
+          break;
+        case SimChip::CC1101:
+          this->transferCC1101(out, len, in);
+          break;
+        case SimChip::nRF24:
+          this->transferNRF24(out, len, in);
+          break;
+        case SimChip::SX127x:
+          this->transferSX127x(out, len, in);
+          break;
+        case SimChip::RF69:
+          this->transferRF69(out, len, in);
+          break;
+        default:
+          this->transferSi443x(out, len, in);
+          break;
+      }
+      this->nowNs += this->spiOverheadNs + ((uint64_t)len * 8UL * 1000000000UL) / this->spiFreq;
+      this->mark();
+    }
+
+    void spiEndTransaction() override {}
+
+    void spiEnd() override {}
+
+  protected:
+    SimChip chip;
+    uint32_t rstPin;
+    uint32_t busyPin;
+
+    uint64_t nowNs = 0;
+    uint64_t busyUntilNs = 0;
+    std::chrono::steady_clock::time_point hostLast;
+
+    std::map<uint32_t, uint8_t> regs;
+    uint8_t fifo[256] = { 0 };
+    size_t fifoLen = 0;
+    uint8_t rxFifo[256] = { 0 };
+    size_t rxFifoLen = 0;
+    size_t rxFifoPos = 0;
+    uint8_t resp[256] = { 0 };
+    size_t respLen = 0;
+    uint8_t packetType = 0;
+
+    bool hasBusy() const {
+      return((this->chip == SimChip::SX126x) || (this->chip == SimChip::SX128x) || (this->chip == SimChip::LR11x0));
+    }
+
+    // add host time elapsed since the last HAL call as target CPU time
+    void sync() {
+      auto now = std::chrono::steady_clock::now();
+      uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->hostLast).count();
+      this->nowNs += (uint64_t)(elapsed * this->cpuScale);
+    }
+
+    // mark the point at which control returns to the driver
+    void mark() {
+      this->hostLast = std::chrono::steady_clock::now();
+    }
+
+    // modeled BUSY duration after a command, roughly per datasheet switching times
+    void setBusy(uint16_t cmd) {
+      uint32_t us = 5;
+      switch(cmd) {
+        case 0x89:    // SX126x Calibrate
+        case 0x010F:  // LR11x0 Calibrate
+          us = 3500;
+          break;
+        case 0x98:    // SX126x CalibrateImage
+        case 0x0111:  // LR11x0 CalibImage
+          us = 1000;
+          break;
+        case 0x82:    // SX126x/SX128x SetRx
+        case 0x83:    // SX126x/SX128x SetTx
+        case 0x0209:  // LR11x0 SetRx
+        case 0x020A:  // LR11x0 SetTx
+          us = 40;
+          break;
+        case 0x80:    // SX126x/SX128x SetStandby
+        case 0x011C:  // LR11x0 SetStandby
+          us = 20;
+          break;
+        default:
+          break;
+      }
+      this->busyUntilNs = this->nowNs + (uint64_t)us * 1000UL;
+    }
+
+    void transferRegisters(bool write, uint32_t addr, const uint8_t* out, uint8_t* in, size_t len) {
+      for(size_t i = 0; i < len; i++) {
+        if(write) {
+          this->regs[addr + i] = out[i];
+        } else {
+          in[i] = this->regs[addr + i];
+        }
+      }
+    }
+
+    // the Tx FIFO becomes the Rx FIFO, the transmitted packet is received back
+    // followed by the status bytes some chips append to it
+    void loopback(const uint8_t* status = NULL, size_t statusLen = 0) {
+      memcpy(this->rxFifo, this->fifo, this->fifoLen);
+      if(status) {
+        memcpy(&this->rxFifo[this->fifoLen], status, statusLen);
+      }
+      this->rxFifoLen = this->fifoLen + statusLen;
+      this->rxFifoPos = 0;
+      this->fifoLen = 0;
+    }
+
+    // the FIFO register does not auto-increment the address, writes go to the Tx FIFO and reads come from the Rx FIFO
+    void transferFifoRegisters(bool write, uint32_t addr, const uint8_t* out, uint8_t* in, size_t len, uint32_t fifoAddr) {
+      if(addr != fifoAddr) {
+        this->transferRegisters(write, addr, out, in, len);
+        return;
+      }
+      for(size_t i = 0; i < len; i++) {
+        if(write && (this->fifoLen < sizeof(this->fifo) - 2)) {
+          this->fifo[this->fifoLen++] = out[i];
+        } else if(!write && (this->rxFifoPos < this->rxFifoLen)) {
+          in[i] = this->rxFifo[this->rxFifoPos++];
+        }
+      }
+    }
+
+    void transferSX126x(const uint8_t* out, size_t len, uint8_t* in, uint8_t status, uint8_t rdReg, uint8_t wrReg, uint8_t rdBuf, uint8_t wrBuf, uint8_t getPkt) {
+      memset(in, status, len < 2 ? len : 2);
+      uint8_t cmd = out[0];
+      if((cmd == 0x8A) && (len > 1)) {
+        // SetPacketType is the same for SX126x and SX128x
+        this->packetType = out[1];
+      } else if((cmd == getPkt) && (len > 2)) {
+        in[2] = this->packetType;
+      } else if((cmd == rdReg) && (len > 4)) {
+        memset(in, status, 4);
+        this->transferRegisters(false, ((uint32_t)out[1] << 8) | out[2], NULL, &in[4], len - 4);
+      } else if((cmd == wrReg) && (len > 3)) {
+        this->transferRegisters(true, ((uint32_t)out[1] << 8) | out[2], &out[3], NULL, len - 3);
+      } else if((cmd == rdBuf) && (len > 3)) {
+        memset(in, status, 3);
+        for(size_t i = 3; i < len; i++) {
+          in[i] = this->fifo[(out[1] + i - 3) & 0xFF];
+        }
+      } else if((cmd == wrBuf) && (len > 2)) {
+        for(size_t i = 2; i < len; i++) {
+          this->fifo[(out[1] + i - 2) & 0xFF] = out[i];
+        }
+      }
+      this->setBusy(cmd);
+    }
+
+    void transferLR11x0(const uint8_t* out, size_t len, uint8_t* in) {
+      // every transaction returns the status bytes first
+      in[0] = 0x05;
+      if(len > 1) {
+        in[1] = 0x00;
+      }
+
+      // a transaction without command reads out the previous response
+      if((len < 2) || ((out[0] == 0x00) && (out[1] == 0x00))) {
+        for(size_t i = 1; i < len; i++) {
+          in[i] = (i - 1 < this->respLen) ? this->resp[i - 1] : 0x00;
+        }
+        return;
+      }
+
+      uint16_t cmd = ((uint16_t)out[0] << 8) | out[1];
+      memset(this->resp, 0, sizeof(this->resp));
+      this->respLen = 0;
+      if((cmd == 0x020E) && (len > 2)) {
+        this->packetType = out[2];
+      } else if(cmd == 0x0202) {
+        this->resp[0] = this->packetType;
+        this->respLen = 1;
+      } else if(cmd == 0x0101) {
+        // GetVersion: hardware, device (LR1110), firmware major/minor
+        const uint8_t ver[] = { 0x22, 0x01, 0x04, 0x01 };
+        memcpy(this->resp, ver, sizeof(ver));
+        this->respLen = sizeof(ver);
+      } else if((cmd == 0x0106) && (len >= 7)) {
+        // ReadRegMem32: address + number of 32-bit words
+        uint32_t addr = ((uint32_t)out[2] << 24) | ((uint32_t)out[3] << 16) | ((uint32_t)out[4] << 8) | out[5];
+        this->respLen = RADIOLIB_MIN((size_t)out[6] * 4, sizeof(this->resp));
+        this->transferRegisters(false, addr, NULL, this->resp, this->respLen);
+      } else if((cmd == 0x0105) && (len > 6)) {
+        uint32_t addr = ((uint32_t)out[2] << 24) | ((uint32_t)out[3] << 16) | ((uint32_t)out[4] << 8) | out[5];
+        this->transferRegisters(true, addr, &out[6], NULL, len - 6);
+      } else if((cmd == 0x0109) && (len > 2)) {
+        memcpy(this->fifo, &out[2], RADIOLIB_MIN(len - 2, sizeof(this->fifo)));
+      } else if((cmd == 0x010A) && (len >= 4)) {
+        this->respLen = RADIOLIB_MIN((size_t)out[3], sizeof(this->resp));
+        memcpy(this->resp, &this->fifo[out[2]], RADIOLIB_MIN(this->respLen, sizeof(this->fifo) - out[2]));
+      }
+      this->setBusy(cmd);
+    }
+
+    void transferSX127x(const uint8_t* out, size_t len, uint8_t* in) {
+      bool write = out[0] & 0x80;
+      uint32_t addr = out[0] & 0x7F;
+      bool lora = this->regs[0x01] & 0x80;
+      if(write && (len > 1) && ((lora && (addr == 0x12)) || (!lora && ((addr == 0x3E) || (addr == 0x3F))))) {
+        // interrupt flags are cleared by writing 1
+        this->regs[addr] &= ~out[1];
+        return;
+      }
+      this->transferFifoRegisters(write, addr, &out[1], &in[1], len - 1, 0x00);
+
+      // switching to transmit mode, the LoRa packet length is reported the same way as for a received packet
+      if(write && (addr == 0x01) && (len > 1) && ((out[1] & 0x07) == 0x03)) {
+        this->loopback();
+        if(lora) {
+          this->regs[0x13] = this->regs[0x22];
+        }
+      }
+    }
+
+    void transferRF69(const uint8_t* out, size_t len, uint8_t* in) {
+      bool write = out[0] & 0x80;
+      uint32_t addr = out[0] & 0x7F;
+      this->transferFifoRegisters(write, addr, &out[1], &in[1], len - 1, 0x00);
+      if(write && (addr == 0x01) && (len > 1) && ((out[1] & 0x1C) == 0x0C)) {
+        this->loopback();
+      }
+    }
+
+    void transferSi443x(const uint8_t* out, size_t len, uint8_t* in) {
+      bool write = out[0] & 0x80;
+      uint32_t addr = out[0] & 0x7F;
+      this->transferFifoRegisters(write, addr, &out[1], &in[1], len - 1, 0x7F);
+
+      // TXON, the received packet length is the transmitted one
+      if(write && (addr == 0x07) && (len > 1) && (out[1] & 0x08)) {
+        this->loopback();
+        this->regs[0x4B] = this->regs[0x3E];
+      }
+    }
+
+    void transferCC1101(const uint8_t* out, size_t len, uint8_t* in) {
+      // single byte transactions are command strobes, chip status byte is 0x0F (IDLE, FIFO available)
+      in[0] = 0x0F;
+      if(len < 2) {
+        switch(out[0]) {
+          case 0x35: {
+            // STX, the appended status bytes are RSSI and LQI with CRC OK
+            const uint8_t status[] = { 0x80, 0x80 };
+            this->loopback(status, sizeof(status));
+          } break;
+          case 0x3A:
+            this->rxFifoLen = 0;
+            this->rxFifoPos = 0;
+            break;
+          case 0x3B:
+            this->fifoLen = 0;
+            break;
+          default:
+            break;
+        }
+        return;
+      }
+
+      bool read = out[0] & 0x80;
+      bool burst = out[0] & 0x40;
+      uint32_t addr = out[0] & 0x3F;
+
+      if(read && burst && (addr >= 0x30) && (addr <= 0x3D)) {
+        addr |= 0x100;
+      }
+      this->transferFifoRegisters(!read, addr, &out[1], &in[1], len - 1, 0x3F);
+    }
+
+    void transferNRF24(const uint8_t* out, size_t len, uint8_t* in) {
+      // first byte is always the STATUS register
+      in[0] = this->regs[0x07];
+      uint8_t cmd = out[0];
+      if(cmd <= 0x1F) {
+        this->transferRegisters(false, cmd & 0x1F, NULL, &in[1], len - 1);
+      } else if(cmd <= 0x3F) {
+        this->transferRegisters(true, cmd & 0x1F, &out[1], NULL, len - 1);
+      } else if(cmd == 0x61) {
+        memcpy(&in[1], this->fifo, RADIOLIB_MIN(len - 1, sizeof(this->fifo)));
+      } else if(cmd == 0xA0) {
+        memcpy(this->fifo, &out[1], RADIOLIB_MIN(len - 1, sizeof(this->fifo)));
+      }
+    }
+};
+
+#endif
@@ -0,0 +1,303 @@
+/*
+  RadioLib driver latency report
+
+  Runs the common PhysicalLayer operations of every supported module
+  against a simulated radio and breaks down their wall time into
+  SPI transfers, BUSY waits, fixed delays and CPU time.
+
+  The simulation uses a virtual clock: SPI time is derived from the SPI
+  clock frequency, BUSY durations are modeled per command and CPU time
+  is measured on the host and scaled by the host-to-target speed ratio.
+  The same InstrumentedHal can wrap a real HAL on target hardware
+  to get measured numbers instead.
+
+  The LoRaWAN part measures waking up with a saved session: restoring
+  the Nonces and session buffers (with the MAC state snapshot),
+  activation and the first uplink.
+
+  Every operation must succeed, otherwise the numbers would not show
+  the usual path through the driver. The tool exits with 1 if any of them
+  returned an unexpected state.
+
+  Usage: radiolib-latency-report [--spi <Hz>] [--cpu-scale <ratio>] [--csv]
+*/
+
+#include <RadioLib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimHal.h"
+#include "InstrumentedHal.h"
+
+// pin numbers are arbitrary, the simulated HAL only cares about RST and BUSY
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+// operations measured for every module
+enum {
+  OP_BEGIN = 0,
+  OP_STANDBY,
+  OP_SET_FREQUENCY,
+  OP_START_TRANSMIT,
+  OP_READ_DATA,
+  OP_NUM,
+};
+
+static const char* opNames[OP_NUM] = {
+  "begin", "standby", "setFrequency", "startTransmit", "readData",
+};
+
+struct ModuleReport {
+  const char* name;
+  int16_t state[OP_NUM];
+  LatencyBreakdown ops[OP_NUM];
+};
+
+// measure one operation
+template<typename T>
+static int16_t measure(InstrumentedHal& hal, LatencyBreakdown& res, T fn) {
+  hal.start();
+  int16_t state = fn();
+  res = hal.stop();
+  return(state);
+}
+
+// measure all operations on a given radio
+// begin is passed as a callable, since every module has different arguments
+template<typename Radio, typename Begin>
+static void profile(ModuleReport& rep, SimChip chip, float freq, uint32_t spiFreq, double cpuScale, Begin begin) {
+  SimHal sim(chip, PIN_RST, PIN_BUSY);
+  sim.spiFreq = spiFreq;
+  sim.cpuScale = cpuScale;
+  InstrumentedHal hal(&sim, PIN_BUSY);
+  Module mod(&hal, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  Radio radio(&mod);
+  PhysicalLayer* phy = &radio;
+
+  uint8_t payload[16] = { 0 };
+  for(size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+
+  rep.state[OP_BEGIN] = measure(hal, rep.ops[OP_BEGIN], [&]() { return(begin(radio)); });
+  rep.state[OP_STANDBY] = measure(hal, rep.ops[OP_STANDBY], [&]() { return(phy->standby()); });
+  rep.state[OP_SET_FREQUENCY] = measure(hal, rep.ops[OP_SET_FREQUENCY], [&]() { return(phy->setFrequency(freq)); });
+  rep.state[OP_START_TRANSMIT] = measure(hal, rep.ops[OP_START_TRANSMIT], [&]() { return(phy->startTransmit(payload, sizeof(payload))); });
+  phy->standby();
+  rep.state[OP_READ_DATA] = measure(hal, rep.ops[OP_READ_DATA], [&]() { return(phy->readData(payload, sizeof(payload))); });
+}
+
+// steps of waking up with a saved LoRaWAN session
+enum {
+  WAKE_RESTORE = 0,
+  WAKE_UPLINK,
+  WAKE_NUM,
+};
+
+static const char* wakeNames[WAKE_NUM] = {
+  "restore", "startUplink",
+};
+
+struct WakeReport {
+  const char* name;
+  int16_t state[WAKE_NUM];
+  LatencyBreakdown ops[WAKE_NUM];
+};
+
+// measure waking up with a session saved by a node that was activated before
+static void profileWake(WakeReport& rep, const LoRaWANBand_t* band, uint8_t subBand, uint32_t spiFreq, double cpuScale) {
+  uint8_t fNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x01 };
+  uint8_t sNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x02 };
+  uint8_t nwkSEncKey[RADIOLIB_AES128_KEY_SIZE] = { 0x03 };
+  uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x04 };
+  uint32_t devAddr = 0x26011234;
+  uint8_t nonces[RADIOLIB_LORAWAN_NONCES_BUF_SIZE];
+  uint8_t session[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
+
+  // the session as it was saved before going to sleep
+  {
+    SimHal sim(SimChip::SX126x, PIN_RST, PIN_BUSY);
+    Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+    SX1262 radio(&mod);
+    radio.begin();
+    LoRaWANNode node(&radio, band, subBand);
+    node.beginABP(devAddr, fNwkSIntKey, sNwkSIntKey, nwkSEncKey, appSKey);
+    node.activateABP();
+    memcpy(nonces, node.getBufferNonces(), sizeof(nonces));
+    memcpy(session, node.getBufferSession(), sizeof(session));
+  }
+  // the radio is initialized before the measurement, as that does not depend on the session
+  SimHal sim(SimChip::SX126x, PIN_RST, PIN_BUSY);
+  sim.spiFreq = spiFreq;
+  sim.cpuScale = cpuScale;
+  InstrumentedHal hal(&sim, PIN_BUSY);
+  Module mod(&hal, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  SX1262 radio(&mod);
+  radio.begin();
+  LoRaWANNode node(&radio, band, subBand);
+
+  rep.state[WAKE_RESTORE] = measure(hal, rep.ops[WAKE_RESTORE], [&]() {
+    node.beginABP(devAddr, fNwkSIntKey, sNwkSIntKey, nwkSEncKey, appSKey);
+    int16_t state = node.setBufferNonces(nonces);
+    RADIOLIB_ASSERT(state);
+    state = node.setBufferSession(session);
+    RADIOLIB_ASSERT(state);
+    return(node.activateABP());
+  });
+
+  // short enough to fit the dwell time limit at the lowest US915 datarate
+  uint8_t payload[8] = { 0 };
+  rep.state[WAKE_UPLINK] = measure(hal, rep.ops[WAKE_UPLINK], [&]() { return(node.startUplink(payload, sizeof(payload))); });
+}
+
+// the restored session is reported as such, everything else must succeed
+static const int16_t wakeExpected[WAKE_NUM] = {
+  RADIOLIB_LORAWAN_SESSION_RESTORED, RADIOLIB_ERR_NONE,
+};
+
+// report all operations that returned an unexpected state
+static int checkStates(const ModuleReport* reports, size_t numReports, const WakeReport* wakeReports, size_t numWakeReports) {
+  int failed = 0;
+  for(size_t i = 0; i < numReports; i++) {
+    for(int j = 0; j < OP_NUM; j++) {
+      if(reports[i].state[j] != RADIOLIB_ERR_NONE) {
+        fprintf(stderr, "%s %s returned %d\n", reports[i].name, opNames[j], reports[i].state[j]);
+        failed++;
+      }
+    }
+  }
+  for(size_t i = 0; i < numWakeReports; i++) {
+    for(int j = 0; j < WAKE_NUM; j++) {
+      if(wakeReports[i].state[j] != wakeExpected[j]) {
+        fprintf(stderr, "%s %s returned %d, expected %d\n", wakeReports[i].name, wakeNames[j], wakeReports[i].state[j], wakeExpected[j]);
+        failed++;
+      }
+    }
+  }
+  return(failed);
+}
+
+static void printWake(const WakeReport& rep, bool csv) {
+  for(int i = 0; i < WAKE_NUM; i++) {
+    const LatencyBreakdown& b = rep.ops[i];
+    if(csv) {
+      printf("%s,%s,%d,%lu,%lu,%lu,%lu,%lu,%u,%u\n", rep.name, wakeNames[i], rep.state[i],
+        b.total, b.spi, b.busy, b.delay, b.cpu, b.spiTransactions, b.spiBytes);
+    } else {
+      printf("| %-6s | %-11s | %6d | %10lu | %9lu | %9lu | %10lu | %9lu | %5u | %6u |\n", rep.name, wakeNames[i], rep.state[i],
+        b.total, b.spi, b.busy, b.delay, b.cpu, b.spiTransactions, b.spiBytes);
+    }
+  }
+}
+
+static void printDetail(const ModuleReport& rep, bool csv) {
+  for(int i = 0; i < OP_NUM; i++) {
+    const LatencyBreakdown& b = rep.ops[i];
+    if(csv) {
+      printf("%s,%s,%d,%lu,%lu,%lu,%lu,%lu,%u,%u\n", rep.name, opNames[i], rep.state[i],
+        b.total, b.spi, b.busy, b.delay, b.cpu, b.spiTransactions, b.spiBytes);
+    } else {
+      printf("| %-8s | %-13s | %6d | %10lu | %9lu | %9lu | %10lu | %9lu | %5u | %6u |\n", rep.name, opNames[i], rep.state[i],
+        b.total, b.spi, b.busy, b.delay, b.cpu, b.spiTransactions, b.spiBytes);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  uint32_t spiFreq = 2000000;
+  double cpuScale = 20.0;
+  bool csv = false;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--spi") == 0) && (i + 1 < argc)) {
+      spiFreq = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--cpu-scale") == 0) && (i + 1 < argc)) {
+      cpuScale = strtod(argv[++i], NULL);
+    } else if(strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--spi <Hz>] [--cpu-scale <ratio>] [--csv]\n", argv[0]);
+      return(1);
+    }
+  }
+
+  ModuleReport reports[] = {
+    { "SX126x", {}, {} },
+    { "SX127x", {}, {} },
+    { "SX128x", {}, {} },
+    { "LR11x0", {}, {} },
+    { "CC1101", {}, {} },
+    { "RF69", {}, {} },
+    { "Si443x", {}, {} },
+    { "nRF24", {}, {} },
+  };
+
+  profile<SX1262>(reports[0], SimChip::SX126x, 868.0, spiFreq, cpuScale, [](SX1262& r) { return(r.begin()); });
+  profile<SX1278>(reports[1], SimChip::SX127x, 434.0, spiFreq, cpuScale, [](SX1278& r) { return(r.begin()); });
+  profile<SX1280>(reports[2], SimChip::SX128x, 2410.0, spiFreq, cpuScale, [](SX1280& r) { return(r.begin()); });
+  profile<LR1110>(reports[3], SimChip::LR11x0, 868.0, spiFreq, cpuScale, [](LR1110& r) { return(r.begin()); });
+  profile<CC1101>(reports[4], SimChip::CC1101, 434.0, spiFreq, cpuScale, [](CC1101& r) { return(r.begin()); });
+  profile<RF69>(reports[5], SimChip::RF69, 868.0, spiFreq, cpuScale, [](RF69& r) { return(r.begin()); });
+  profile<Si4432>(reports[6], SimChip::Si443x, 434.0, spiFreq, cpuScale, [](Si4432& r) { return(r.begin()); });
+  profile<nRF24>(reports[7], SimChip::nRF24, 2410.0, spiFreq, cpuScale, [](nRF24& r) { return(r.begin()); });
+
+  const size_t numReports = sizeof(reports) / sizeof(reports[0]);
+
+  WakeReport wakeReports[] = {
+    { "EU868", {}, {} },
+    { "US915", {}, {} },
+  };
+  profileWake(wakeReports[0], &EU868, 0, spiFreq, cpuScale);
+  profileWake(wakeReports[1], &US915, 2, spiFreq, cpuScale);
+  const size_t numWakeReports = sizeof(wakeReports) / sizeof(wakeReports[0]);
+  int result = (checkStates(reports, numReports, wakeReports, numWakeReports) == 0) ? 0 : 1;
+
+  // per-operation breakdown
+  if(csv) {
+    printf("module,operation,state,total_us,spi_us,busy_us,delay_us,cpu_us,spi_transactions,spi_bytes\n");
+  } else {
+    printf("SPI clock %lu Hz, CPU scale %.1f\n\n", (unsigned long)spiFreq, cpuScale);
+    printf("| Module   | Operation     | State  | Total (us) | SPI (us)  | BUSY (us) | Delay (us) | CPU (us)  | Txns  | Bytes  |\n");
+    printf("|----------|---------------|--------|------------|-----------|-----------|------------|-----------|-------|--------|\n");
+  }
+  for(size_t i = 0; i < numReports; i++) {
+    printDetail(reports[i], csv);
+  }
+  if(csv) {
+    for(size_t i = 0; i < numWakeReports; i++) {
+      printWake(wakeReports[i], csv);
+    }
+    return(result);
+  }
+
+  // comparison across modules, total time per operation
+  printf("\n| Module   |");
+  for(int i = 0; i < OP_NUM; i++) {
+    printf(" %13s |", opNames[i]);
+  }
+  printf("\n|----------|");
+  for(int i = 0; i < OP_NUM; i++) {
+    printf("---------------|");
+  }
+  printf("\n");
+  for(size_t i = 0; i < numReports; i++) {
+    printf("| %-8s |", reports[i].name);
+    for(int j = 0; j < OP_NUM; j++) {
+      printf(" %13lu |", reports[i].ops[j].total);
+    }
+    printf("\n");
+  }
+
+  // LoRaWAN wake-up with a saved session, on SX126x
+  printf("\nLoRaWAN wake-up with a saved session (SX126x)\n\n");
+  printf("| Band   | Step        | State  | Total (us) | SPI (us)  | BUSY (us) | Delay (us) | CPU (us)  | Txns  | Bytes  |\n");
+  printf("|--------|-------------|--------|------------|-----------|-----------|------------|-----------|-------|--------|\n");
+  for(size_t i = 0; i < numWakeReports; i++) {
+    printWake(wakeReports[i], csv);
+  }
+
+  return(result);
+}
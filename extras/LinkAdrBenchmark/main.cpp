@@ -0,0 +1,209 @@
+/*
+  RadioLib LoRaWAN link margin ADR benchmark
+
+  Simulates fixed devices on EU868 at random distances from a gateway
+  and sends uplinks from all of them, once at fixed datarates and once with
+  the datarate and power picked by LoRaWANLinkAdr. The network does not run
+  ADR, every 8th uplink is confirmed and every 16th one carries a LinkCheckReq.
+
+  Every packet sees log-normal fading on top of the path loss of the device,
+  a packet is received if its SNR is above the demodulation floor of the datarate.
+  The energy is that of the transmissions only, based on a simple model
+  of the power amplifier efficiency.
+
+  Usage: radiolib-link-adr-benchmark [--devices <n>] [--uplinks <n>] [--payload <bytes>]
+         [--fading <dB>] [--margin <dB>] [--seed <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// EU868 datarates 0 - 5 are SF12 - SF7 at 125 kHz, the power goes from 16 dBm down in steps of 2 dB
+#define NUM_DR          (6)
+#define MAX_POWER_STEPS (7)
+#define MAX_POWER_DBM   (16)
+
+// xorshift, so that the runs are reproducible
+static uint32_t rng = 1;
+static uint32_t random32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return(rng);
+}
+
+static float uniform() {
+  return((random32() >> 8) / 16777216.0f);
+}
+
+// Box-Muller
+static float gaussian() {
+  float u1 = uniform() + 1e-7f;
+  float u2 = uniform();
+  return(sqrtf(-2.0f*logf(u1)) * cosf(2.0f*(float)M_PI*u2));
+}
+
+static uint8_t spreadingFactor(uint8_t dr) {
+  return(12 - dr);
+}
+
+static float demodFloor(uint8_t dr) {
+  return(-7.5f - 2.5f*(spreadingFactor(dr) - 7));
+}
+
+// LoRa time-on-air in ms, explicit header, CRC on, coding rate 4/5, 8 symbol preamble
+static float timeOnAir(uint8_t dr, size_t len) {
+  uint8_t sf = spreadingFactor(dr);
+  float tSym = (float)(1UL << sf) / 125.0f;
+  int de = (sf >= 11) ? 1 : 0;
+  float num = 8.0f*len - 4.0f*sf + 28 + 16;
+  float nPayload = 8 + RADIOLIB_MAX(ceilf(num / (4.0f*(sf - 2*de))) * 5, 0.0f);
+  return((8 + 4.25f + nPayload) * tSym);
+}
+
+// supply power in mW: a fixed part for the radio and 35 % efficient amplifier
+static float supplyPower(uint8_t powerSteps) {
+  float dbm = MAX_POWER_DBM - 2.0f*powerSteps;
+  return(50.0f + powf(10.0f, dbm / 10.0f) / 0.35f);
+}
+
+struct Device {
+  float snr;          // mean SNR of an uplink at the maximum power
+  uint8_t dr;
+  uint8_t powerSteps;
+  uint32_t changes;
+  LoRaWANLinkAdr adr;
+};
+
+struct Result {
+  const char* method;
+  uint64_t sent;
+  uint64_t delivered;
+  double airtimeMs;
+  double energyMj;
+  uint64_t changes;
+  uint64_t drCount[NUM_DR];
+};
+
+int main(int argc, char** argv) {
+  size_t numDevices = 1000;
+  size_t numUplinks = 500;
+  size_t payloadLen = 20;
+  float fading = 4.0f;
+  float margin = RADIOLIB_LORAWAN_LINK_ADR_MARGIN;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--devices") == 0) && (i + 1 < argc)) {
+      numDevices = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--uplinks") == 0) && (i + 1 < argc)) {
+      numUplinks = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--payload") == 0) && (i + 1 < argc)) {
+      payloadLen = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--fading") == 0) && (i + 1 < argc)) {
+      fading = strtof(argv[++i], NULL);
+    } else if((strcmp(argv[i], "--margin") == 0) && (i + 1 < argc)) {
+      margin = strtof(argv[++i], NULL);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      rng = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--devices <n>] [--uplinks <n>] [--payload <bytes>] [--fading <dB>] [--margin <dB>] [--seed <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((numDevices == 0) || (numUplinks == 0) || (payloadLen > 51)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+
+  // devices between very close and just at the edge of SF12
+  std::vector<Device> devices(numDevices);
+  for(Device& dev : devices) {
+    dev.snr = -20.0f + 32.0f*uniform();
+  }
+
+  // frame header (13 bytes) and the payload
+  size_t frameLen = 13 + payloadLen;
+  Result results[3] = {
+    { "Fixed DR0 (SF12)", 0, 0, 0, 0, 0, { 0 } },
+    { "Fixed DR5 (SF7)", 0, 0, 0, 0, 0, { 0 } },
+    { "LoRaWANLinkAdr", 0, 0, 0, 0, 0, { 0 } },
+  };
+  uint32_t seed = rng;
+  for(size_t m = 0; m < 3; m++) {
+    Result& res = results[m];
+
+    // every method sees the same fading
+    rng = seed;
+    for(Device& dev : devices) {
+      dev.dr = (m == 1) ? 5 : 0;
+      dev.powerSteps = 0;
+      dev.changes = 0;
+      dev.adr.begin(RADIOLIB_LORAWAN_LINK_ADR_APPLY, margin);
+      for(uint8_t dr = 0; dr < NUM_DR; dr++) {
+        dev.adr.setDataRate(dr, spreadingFactor(dr), 125.0f);
+      }
+    }
+
+    for(size_t n = 0; n < numUplinks; n++) {
+      bool confirmed = (n % 8 == 7);
+      bool linkCheck = (n % 16 == 15);
+      for(Device& dev : devices) {
+        if(m == 2) {
+          uint8_t dr, steps;
+          if(dev.adr.recommend(dev.dr, dev.powerSteps, MAX_POWER_STEPS, (1UL << NUM_DR) - 1, &dr, &steps)) {
+            dev.dr = dr;
+            dev.powerSteps = steps;
+            dev.changes++;
+          }
+        }
+
+        float airtime = timeOnAir(dev.dr, frameLen);
+        res.sent++;
+        res.airtimeMs += airtime;
+        res.energyMj += airtime * supplyPower(dev.powerSteps) / 1000.0f;
+        res.drCount[dev.dr]++;
+        dev.adr.addUplink(dev.dr, dev.powerSteps, confirmed);
+
+        float snrUp = dev.snr - 2.0f*dev.powerSteps + fading*gaussian();
+        if(snrUp < demodFloor(dev.dr)) {
+          continue;
+        }
+        res.delivered++;
+
+        // the network answers confirmed uplinks and LinkCheckReq in Rx1, at the uplink datarate
+        if(confirmed || linkCheck) {
+          float snrDown = dev.snr + fading*gaussian();
+          if(snrDown >= demodFloor(dev.dr)) {
+            dev.adr.addDownlink(dev.dr, snrDown, snrDown + RADIOLIB_LORAWAN_LINK_ADR_NOISE_FLOOR, confirmed);
+            if(linkCheck) {
+              dev.adr.addLinkCheck((uint8_t)RADIOLIB_MAX(snrUp - demodFloor(dev.dr), 0.0f), 1);
+            }
+          }
+        }
+      }
+    }
+
+    for(Device& dev : devices) {
+      res.changes += dev.changes;
+    }
+  }
+
+  printf("%lu devices, %lu uplinks each with %lu bytes of payload, fading %.1f dB, installation margin %.1f dB\n\n",
+    (unsigned long)numDevices, (unsigned long)numUplinks, (unsigned long)payloadLen, fading, margin);
+  printf("| Method           | Delivered | Airtime/uplink (ms) | Energy/delivered (mJ) | Changes/device | DR0 - DR5 share (%%)           |\n");
+  printf("|------------------|-----------|---------------------|-----------------------|----------------|-------------------------------|\n");
+  for(size_t m = 0; m < 3; m++) {
+    Result& res = results[m];
+    printf("| %-16s | %8.2f%% | %19.1f | %21.2f | %14.1f |", res.method, 100.0 * res.delivered / res.sent,
+      res.airtimeMs / res.sent, res.delivered ? res.energyMj / res.delivered : 0, (double)res.changes / numDevices);
+    for(uint8_t dr = 0; dr < NUM_DR; dr++) {
+      printf(" %4.1f", 100.0 * res.drCount[dr] / res.sent);
+    }
+    printf(" |\n");
+  }
+  return(0);
+}
@@ -0,0 +1,252 @@
+/*
+  RadioLib LoRaWAN retransmission benchmark
+
+  Sends confirmed uplinks from a LoRaWAN node on a simulated radio that never
+  receives the acknowledgement, so every uplink is retransmitted until the
+  transmissions run out. Every transmission is reported by the uplink callback,
+  which checks that the frame counter stays the same and that the channel changes.
+  The gap between two transmissions is made up of the Rx windows and the random
+  retransmit timeout; the simulated radio has no noise, so the random part hardly
+  varies here. Runs once with a LoRaWAN v1.0.x session and once with a v1.1 one,
+  blocking and non-blocking.
+
+  Then compares the processor time needed to build an uplink frame from scratch
+  with the time needed to send an already built one again.
+
+  Usage: radiolib-retransmit-benchmark [--uplinks <n>] [--trans <n>] [--payload <bytes>] [--iterations <n>]
+*/
+
+#include <RadioLib.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SimHal.h"
+
+// pin numbers are arbitrary, the simulated HAL only cares about RST and BUSY
+#define PIN_CS    (10)
+#define PIN_IRQ   (2)
+#define PIN_RST   (9)
+#define PIN_BUSY  (3)
+
+// the simulated radio does not model interrupts, so every operation finishes right away
+// and a downlink window times out, as if there was no downlink
+class IrqSimHal : public SimHal {
+  public:
+    IrqSimHal() : SimHal(SimChip::SX126x, PIN_RST, PIN_BUSY) {}
+
+    uint32_t digitalRead(uint32_t pin) override {
+      if(pin == PIN_IRQ) {
+        return(this->GpioLevelHigh);
+      }
+      return(SimHal::digitalRead(pin));
+    }
+
+    // timing is not measured here, so skip through the receive windows quickly
+    void yield() override {
+      this->delay(1);
+    }
+
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override {
+      SimHal::spiTransfer(out, len, in);
+      // SX126x GetIrqStatus: the receive window timed out
+      if((out[0] == RADIOLIB_SX126X_CMD_GET_IRQ_STATUS) && (len > 3)) {
+        in[2] = (RADIOLIB_SX126X_IRQ_TIMEOUT >> 8) & 0xFF;
+        in[3] = RADIOLIB_SX126X_IRQ_TIMEOUT & 0xFF;
+      }
+    }
+
+    // the non-blocking mode waits for the interrupt, it is raised by the polling loop after every transmission
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override {
+      (void)interruptNum;
+      (void)mode;
+      this->isr = interruptCb;
+    }
+
+    void (*isr)(void) = NULL;
+    bool txDone = false;
+};
+
+struct Stats {
+  IrqSimHal* sim;
+  unsigned long last;
+  uint32_t lastFCnt;
+  float lastFreq;
+  uint64_t transmissions;
+  uint64_t retransmissions;
+  uint64_t sameFCnt;
+  uint64_t hopped;
+  unsigned long gapMin;
+  unsigned long gapMax;
+};
+
+static void onUplink(LoRaWANNode* node, const LoRaWANEvent_t* event, void* ctx) {
+  Stats* stats = (Stats*)ctx;
+  unsigned long now = stats->sim->millis();
+  stats->transmissions++;
+  if(event->attempt > 1) {
+    // the gap is counted from the end of the previous transmission, so it includes both Rx windows
+    unsigned long gap = now - stats->last - node->getLastToA();
+    stats->retransmissions++;
+    stats->sameFCnt += (event->fCnt == stats->lastFCnt);
+    stats->hopped += (event->freq != stats->lastFreq);
+    stats->gapMin = RADIOLIB_MIN(stats->gapMin, gap);
+    stats->gapMax = RADIOLIB_MAX(stats->gapMax, gap);
+  }
+  stats->last = now;
+  stats->lastFCnt = event->fCnt;
+  stats->lastFreq = event->freq;
+  stats->sim->txDone = true;
+}
+
+static bool run(bool rev11, bool async, size_t numUplinks, uint8_t numTrans, size_t payloadLen) {
+  IrqSimHal sim;
+  Module mod(&sim, PIN_CS, PIN_IRQ, PIN_RST, PIN_BUSY);
+  SX1262 radio(&mod);
+  radio.begin();
+  LoRaWANNode node(&radio, &EU868);
+  node.setDutyCycle(true);
+
+  uint8_t fNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x01 };
+  uint8_t sNwkSIntKey[RADIOLIB_AES128_KEY_SIZE] = { 0x02 };
+  uint8_t nwkSEncKey[RADIOLIB_AES128_KEY_SIZE] = { 0x03 };
+  uint8_t appSKey[RADIOLIB_AES128_KEY_SIZE] = { 0x04 };
+  if(rev11) {
+    node.beginABP(0x26011234, fNwkSIntKey, sNwkSIntKey, nwkSEncKey, appSKey);
+  } else {
+    node.beginABP(0x26011234, NULL, NULL, nwkSEncKey, appSKey);
+  }
+  node.activateABP();
+
+  Stats stats = { &sim, 0, 0, 0, 0, 0, 0, 0, (unsigned long)-1, 0 };
+  node.setUplinkAction(onUplink, &stats);
+  node.setRetransmissions(true, numTrans);
+
+  uint8_t payload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+  unsigned long start = sim.millis();
+  for(size_t n = 0; n < numUplinks; n++) {
+    int16_t state;
+    LoRaWANEvent_t event;
+    if(async) {
+      state = node.startUplink(payload, payloadLen, 1, NULL, NULL, true, &event);
+      while(node.isBusy()) {
+        if(sim.isr && sim.txDone) {
+          sim.txDone = false;
+          sim.isr();
+        }
+        state = node.poll();
+        sim.delay(RADIOLIB_MAX(node.timeUntilPoll(), (RadioLibTime_t)1));
+      }
+    } else {
+      state = node.sendReceive(payload, payloadLen, 1, true, &event);
+    }
+    if(state != RADIOLIB_LORAWAN_NO_DOWNLINK) {
+      fprintf(stderr, "Uplink failed, code %d\n", state);
+      return(false);
+    }
+    if(event.attempt != numTrans) {
+      fprintf(stderr, "Uplink was sent %d times instead of %d\n", event.attempt, numTrans);
+      return(false);
+    }
+
+    // the next uplink has to wait for the duty cycle anyway
+    sim.delay(node.timeUntilUplink());
+  }
+
+  printf("| v1.%d %-12s | %13llu | %7.1f %% | %9.1f %% | %5lu - %5lu | %15.1f |\n", rev11 ? 1 : 0, async ? "non-blocking" : "blocking",
+    (unsigned long long)stats.transmissions, 100.0 * stats.sameFCnt / stats.retransmissions, 100.0 * stats.hopped / stats.retransmissions,
+    stats.gapMin, stats.gapMax, (double)(sim.millis() - start) / numUplinks / 1000.0);
+  return((stats.sameFCnt == stats.retransmissions) && (stats.hopped == stats.retransmissions));
+}
+
+int main(int argc, char** argv) {
+  size_t numUplinks = 20;
+  unsigned long numTrans = 4;
+  size_t payloadLen = 20;
+  size_t iterations = 10000;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--uplinks") == 0) && (i + 1 < argc)) {
+      numUplinks = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--trans") == 0) && (i + 1 < argc)) {
+      numTrans = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--payload") == 0) && (i + 1 < argc)) {
+      payloadLen = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--iterations") == 0) && (i + 1 < argc)) {
+      iterations = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [--uplinks <n>] [--trans <n>] [--payload <bytes>] [--iterations <n>]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((numUplinks == 0) || (numTrans < 2) || (numTrans > RADIOLIB_LORAWAN_RETRANSMIT_MAX) || (payloadLen > 51) || (iterations == 0)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+
+  printf("%lu confirmed uplinks with %lu bytes of payload on EU868, %lu transmissions each, no acknowledgements\n\n",
+    (unsigned long)numUplinks, (unsigned long)payloadLen, numTrans);
+  printf("| Session           | Transmissions | Same FCnt | New channel | Gap (ms)      | Time/uplink (s) |\n");
+  printf("|-------------------|---------------|-----------|-------------|---------------|-----------------|\n");
+  bool ok = true;
+  for(int rev = 0; rev < 2; rev++) {
+    ok &= run(rev == 1, false, numUplinks, numTrans, payloadLen);
+    ok &= run(rev == 1, true, numUplinks, numTrans, payloadLen);
+  }
+
+  // processor time: building the frame from scratch, or only updating the MIC for the new channel
+  uint8_t key[RADIOLIB_AES128_KEY_SIZE] = { 0x01 };
+  LoRaWANFrameKeys_t keys = { 0x26011234, 1, key, key, key, key };
+  uint8_t payload[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+  uint8_t msg[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t msgLen = 0;
+  LoRaWANFrame_t frame = {
+    .mType = RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP,
+    .devAddr = keys.devAddr,
+    .fCtrl = 0x00,
+    .fCnt = 0,
+    .fOptsLen = 0,
+    .fOpts = { 0 },
+    .hasFPort = true,
+    .fPort = 1,
+    .payloadLen = payloadLen,
+    .confFCnt = 0,
+    .dataRate = 5,
+    .chIndex = 0,
+    .mic = 0,
+  };
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < iterations; i++) {
+    frame.fCnt = i;
+    msgLen = sizeof(msg);
+    (void)LoRaWANFrame::encode(&frame, payload, &keys, msg, &msgLen);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double build = std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations;
+
+  // the frame step of a retransmission, as done by the node: only v1.1 updates the MIC for the new channel
+  // the revision is volatile, so that the check is not optimized away
+  uint32_t sum = 0;
+  auto retransmitFrame = [&](uint8_t revision) {
+    volatile uint8_t rev = revision;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; i++) {
+      frame.chIndex = i % 3;
+      if(rev == 1) {
+        frame.mic = LoRaWANFrame::calculateMIC(msg, msgLen - sizeof(uint32_t), &frame, &keys);
+      }
+      sum += frame.mic;
+    }
+    return(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations);
+  };
+  double mic = retransmitFrame(1);
+  double asIs = retransmitFrame(0);
+
+  printf("\nProcessor time per transmission (%lu iterations, checksum %08lx):\n", (unsigned long)iterations, (unsigned long)sum);
+  printf("  frame built again:         %7.3f us\n", build);
+  printf("  v1.1 frame, MIC updated:   %7.3f us (%.0f %% saved)\n", mic, 100.0 * (1.0 - mic / build));
+  printf("  v1.0.x frame, sent as is:  %7.3f us (%.0f %% saved)\n", asIs, 100.0 * (1.0 - asIs / build));
+
+  return(ok ? 0 : 1);
+}
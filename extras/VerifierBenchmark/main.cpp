@@ -0,0 +1,242 @@
+/*
+  RadioLib LoRaWAN uplink verifier benchmark
+
+  Generates uplinks from many synthetic device sessions and verifies
+  them the way a network server would: find the session by the device
+  address, reconstruct the 32-bit frame counter, check the MIC and
+  decrypt the payload. Some of the sessions start close to a 16-bit
+  frame counter rollover, so the reconstruction is exercised too.
+
+  The verifier is compared against decoding every frame with plain
+  keys (LoRaWANFrame::decode), which expands the keys on each frame.
+
+  Usage: radiolib-verifier-benchmark [--sessions <n>] [--frames <n>]
+         [--payload <bytes>] [--rev <0|1>] [--batch <n>] [--seed <n>] [--csv]
+*/
+
+#include <RadioLib.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// xorshift, so that the runs are reproducible
+static uint32_t rng = 1;
+static uint32_t random32() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return(rng);
+}
+
+// plain session of a synthetic device
+struct Device {
+  uint32_t devAddr;
+  uint32_t fCntStart;
+  uint32_t fCntUp;
+  uint8_t keys[4][RADIOLIB_AES128_KEY_SIZE];
+};
+
+// generated uplink
+struct Frame {
+  size_t dev;
+  uint8_t msg[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  size_t len;
+  uint8_t dataRate;
+  uint8_t chIndex;
+};
+
+struct Result {
+  const char* method;
+  size_t accepted;
+  double ms;
+};
+
+static double since(std::chrono::steady_clock::time_point start) {
+  return(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void addSessions(LoRaWANVerifier& verifier, std::vector<LoRaWANVerifierSession_t>& table, std::vector<Device>& devices, uint8_t rev) {
+  verifier.begin(table.data(), table.size());
+  for(Device& dev : devices) {
+    uint8_t* fNwkSIntKey = rev ? dev.keys[0] : NULL;
+    uint8_t* sNwkSIntKey = rev ? dev.keys[1] : NULL;
+    verifier.addSession(dev.devAddr, fNwkSIntKey, sNwkSIntKey, dev.keys[2], dev.keys[3], dev.fCntStart);
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t numSessions = 10000;
+  size_t numFrames = 200000;
+  size_t payloadLen = 20;
+  uint8_t rev = 0;
+  size_t batch = 64;
+  bool csv = false;
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "--sessions") == 0) && (i + 1 < argc)) {
+      numSessions = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {
+      numFrames = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--payload") == 0) && (i + 1 < argc)) {
+      payloadLen = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--rev") == 0) && (i + 1 < argc)) {
+      rev = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--batch") == 0) && (i + 1 < argc)) {
+      batch = strtoul(argv[++i], NULL, 10);
+    } else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+      rng = strtoul(argv[++i], NULL, 10);
+    } else if(strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--sessions <n>] [--frames <n>] [--payload <bytes>] [--rev <0|1>] [--batch <n>] [--seed <n>] [--csv]\n", argv[0]);
+      return(1);
+    }
+  }
+  if((numSessions == 0) || (numFrames == 0) || (batch == 0) || (rev > 1) || (payloadLen > 222)) {
+    fprintf(stderr, "Invalid arguments\n");
+    return(1);
+  }
+
+  // the table is kept at most half full
+  size_t tableSize = 1;
+  while(tableSize < 2*numSessions) {
+    tableSize <<= 1;
+  }
+
+  // devices in one network share the NetID bits of the address, every 8th one is about to roll over
+  std::vector<Device> devices(numSessions);
+  for(size_t i = 0; i < numSessions; i++) {
+    Device& dev = devices[i];
+    dev.devAddr = 0x26000000UL | (random32() & 0x01FFFFFFUL);
+    dev.fCntStart = (i % 8 == 0) ? 0xFFF0 : (random32() % 1000);
+    dev.fCntUp = dev.fCntStart;
+    for(size_t k = 0; k < 4; k++) {
+      for(size_t j = 0; j < RADIOLIB_AES128_KEY_SIZE; j++) {
+        dev.keys[k][j] = random32();
+      }
+    }
+  }
+
+  // generate the uplinks, as LoRaWANNode::uplink would send them
+  std::vector<Frame> frames(numFrames);
+  std::vector<uint8_t> payload(payloadLen);
+  for(Frame& f : frames) {
+    f.dev = random32() % numSessions;
+    Device& dev = devices[f.dev];
+    LoRaWANFrameKeys_t keys = { dev.devAddr, rev, dev.keys[3], dev.keys[2], dev.keys[rev ? 0 : 2], dev.keys[rev ? 1 : 2] };
+    LoRaWANFrame_t frame = {};
+    frame.mType = RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP;
+    frame.devAddr = dev.devAddr;
+    frame.fCnt = ++dev.fCntUp;
+    frame.hasFPort = true;
+    frame.fPort = 1 + (random32() % 200);
+    frame.payloadLen = payloadLen;
+    frame.dataRate = f.dataRate = random32() % 6;
+    frame.chIndex = f.chIndex = random32() % 8;
+    for(uint8_t& b : payload) {
+      b = random32();
+    }
+    f.len = sizeof(f.msg);
+    LoRaWANFrame::encode(&frame, payload.data(), &keys, f.msg, &f.len);
+  }
+
+  std::vector<LoRaWANVerifierSession_t> table(tableSize);
+  LoRaWANVerifier verifier;
+  std::vector<uint8_t> out(RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN * batch);
+  std::vector<LoRaWANVerifierUplink_t> uplinks(batch);
+  Result results[3];
+
+  // key expansion of all sessions
+  auto start = std::chrono::steady_clock::now();
+  addSessions(verifier, table, devices, rev);
+  double setupMs = since(start);
+
+  // baseline: the session is known, keys are used as they are
+  results[0] = { "LoRaWANFrame::decode", 0, 0 };
+  std::vector<uint32_t> fCntLast(numSessions);
+  for(size_t i = 0; i < numSessions; i++) {
+    fCntLast[i] = devices[i].fCntStart;
+  }
+  start = std::chrono::steady_clock::now();
+  for(Frame& f : frames) {
+    Device& dev = devices[f.dev];
+    LoRaWANFrameKeys_t keys = { dev.devAddr, rev, dev.keys[3], dev.keys[2], dev.keys[rev ? 0 : 2], dev.keys[rev ? 1 : 2] };
+    LoRaWANFrame_t frame = {};
+    frame.fCnt = fCntLast[f.dev];
+    frame.dataRate = f.dataRate;
+    frame.chIndex = f.chIndex;
+    if(LoRaWANFrame::decode(f.msg, f.len, &keys, &frame, out.data()) == RADIOLIB_ERR_NONE) {
+      fCntLast[f.dev] = frame.fCnt;
+      results[0].accepted++;
+    }
+  }
+  results[0].ms = since(start);
+
+  // one frame at a time, including the session lookup
+  results[1] = { "LoRaWANVerifier::verify", 0, 0 };
+  addSessions(verifier, table, devices, rev);
+  start = std::chrono::steady_clock::now();
+  for(Frame& f : frames) {
+    LoRaWANVerifierUplink_t& up = uplinks[0];
+    up.msg = f.msg;
+    up.len = f.len;
+    up.dataRate = f.dataRate;
+    up.chIndex = f.chIndex;
+    up.payload = out.data();
+    if(verifier.verify(&up) == RADIOLIB_ERR_NONE) {
+      results[1].accepted++;
+    }
+  }
+  results[1].ms = since(start);
+
+  // batches of frames
+  results[2] = { "LoRaWANVerifier::verifyBatch", 0, 0 };
+  addSessions(verifier, table, devices, rev);
+  start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < numFrames; i += batch) {
+    size_t num = RADIOLIB_MIN(batch, numFrames - i);
+    for(size_t j = 0; j < num; j++) {
+      Frame& f = frames[i + j];
+      uplinks[j].msg = f.msg;
+      uplinks[j].len = f.len;
+      uplinks[j].dataRate = f.dataRate;
+      uplinks[j].chIndex = f.chIndex;
+      uplinks[j].payload = &out[j * RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+    }
+    results[2].accepted += verifier.verifyBatch(uplinks.data(), num);
+  }
+  results[2].ms = since(start);
+
+  if(csv) {
+    printf("method,rev,sessions,frames,payload,batch,accepted,time_ms,frames_per_s\n");
+  } else {
+    printf("%lu sessions (LoRaWAN v1.%u), %lu frames with %lu bytes of payload, table of %lu slots (%lu kB)\n",
+      (unsigned long)numSessions, rev, (unsigned long)numFrames, (unsigned long)payloadLen,
+      (unsigned long)tableSize, (unsigned long)(tableSize * sizeof(LoRaWANVerifierSession_t) / 1024));
+    printf("Sessions added in %.1f ms (%.0f sessions/s)\n\n", setupMs, 1000.0 * numSessions / setupMs);
+    printf("| Method                       | Batch | Accepted | Time (ms) | Frames/s  |\n");
+    printf("|------------------------------|-------|----------|-----------|-----------|\n");
+  }
+  for(size_t i = 0; i < 3; i++) {
+    Result& res = results[i];
+    double rate = (res.ms > 0) ? 1000.0 * numFrames / res.ms : 0;
+    size_t resBatch = (i == 2) ? batch : 1;
+    if(csv) {
+      printf("%s,%u,%lu,%lu,%lu,%lu,%lu,%.3f,%.0f\n", res.method, rev, (unsigned long)numSessions, (unsigned long)numFrames,
+        (unsigned long)payloadLen, (unsigned long)resBatch, (unsigned long)res.accepted, res.ms, rate);
+    } else {
+      printf("| %-28s | %5lu | %8lu | %9.1f | %9.0f |\n", res.method, (unsigned long)resBatch, (unsigned long)res.accepted, res.ms, rate);
+    }
+  }
+
+  // every frame is valid, so anything else is an error
+  for(size_t i = 0; i < 3; i++) {
+    if(results[i].accepted != numFrames) {
+      fprintf(stderr, "%s accepted %lu of %lu frames\n", results[i].method, (unsigned long)results[i].accepted, (unsigned long)numFrames);
+      return(1);
+    }
+  }
+  return(0);
+}
@@ -0,0 +1,98 @@
+import sys, argparse
+from argparse import RawTextHelpFormatter
+
+
+def lz_decompress(data, window_bits=8, length_bits=4):
+    '''Decompress a stream produced by RadioLibLZ::compress with the same window and length sizes.'''
+    if len(data) == 0:
+        raise ValueError('empty stream')
+
+    # stored as it was
+    if not data[0] & 0x80:
+        return bytes(data[1:])
+
+    token_bits = 1 + window_bits + length_bits
+    min_match = token_bits // 9 + 1
+    bit_len = 8*len(data)
+    bit_pos = 1
+
+    def get_bits(n):
+        nonlocal bit_pos
+        val = 0
+        for _ in range(n):
+            val = (val << 1) | ((data[bit_pos // 8] >> (7 - bit_pos % 8)) & 1)
+            bit_pos += 1
+        return val
+
+    # the last byte is padded with less than a token
+    out = bytearray()
+    while bit_len - bit_pos >= min(token_bits, 9):
+        if get_bits(1):
+            if bit_len - bit_pos < 8:
+                break
+            out.append(get_bits(8))
+            continue
+        if bit_len - bit_pos < token_bits - 1:
+            break
+        dist = get_bits(window_bits) + 1
+        n = get_bits(length_bits) + min_match
+        if dist > len(out):
+            raise ValueError('reference before the start of the payload')
+        for _ in range(n):
+            out.append(out[-dist])
+    return bytes(out)
+
+
+def delta_decode(data, num_fields):
+    '''Decode records produced by RadioLibDelta::encode, returns a list of records.'''
+    values = []
+    pos = 0
+    while pos < len(data):
+        zigzag = 0
+        shift = 0
+        while True:
+            if pos >= len(data) or shift >= 35:
+                raise ValueError('truncated integer')
+            b = data[pos]
+            pos += 1
+            zigzag |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        diff = (zigzag >> 1) ^ -(zigzag & 1)
+        prev = values[-num_fields] if len(values) >= num_fields else 0
+
+        # modulo 2^32, as signed 32-bit integers
+        val = (prev + diff) & 0xFFFFFFFF
+        values.append(val - (1 << 32) if val & 0x80000000 else val)
+
+    if len(values) % num_fields:
+        raise ValueError('incomplete record')
+    return [values[i:i + num_fields] for i in range(0, len(values), num_fields)]
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(formatter_class=RawTextHelpFormatter, description='''
+        RadioLib payload decoder script. Decompresses frame payloads produced by RadioLibLZ
+        (e.g. uplinks sent with LoRaWANNode::setCompression) and decodes records produced by RadioLibDelta.
+
+        Without --fields, the decompressed payload is printed in hexadecimal.
+        With --fields, the payload is decoded as records of that many fields, one record per line.
+    ''')
+    parser.add_argument('payload', metavar='payload', type=str, help='Frame payload in hexadecimal')
+    parser.add_argument('--window', metavar='bits', default=8, type=int, help='Window size of the LZ codec in bits (defaults to 8)')
+    parser.add_argument('--length', metavar='bits', default=4, type=int, help='Length size of the LZ codec in bits (defaults to 4)')
+    parser.add_argument('--raw', action='store_true', help='Payload is not LZ compressed')
+    parser.add_argument('--fields', metavar='n', default=0, type=int, help='Number of fields per delta coded record')
+    args = parser.parse_args()
+
+    payload = bytes.fromhex(args.payload)
+    if not args.raw:
+        payload = lz_decompress(payload, args.window, args.length)
+
+    if args.fields == 0:
+        print(payload.hex())
+        sys.exit(0)
+
+    for record in delta_decode(payload, args.fields):
+        print(' '.join(str(v) for v in record))
@@ -106,6 +106,82 @@
   #define RADIOLIB_STATIC_ARRAY_SIZE   (256)
 #endif
 
+// set the size of a single packet slot in the PhysicalLayer receive queue
+#if !defined(RADIOLIB_RX_QUEUE_SLOT_SIZE)
+  #define RADIOLIB_RX_QUEUE_SLOT_SIZE   (RADIOLIB_STATIC_ARRAY_SIZE)
+#endif
+
+// set the maximum number of radios that can have a receive queue at the same time
+// each radio needs a packet received action of its own
+#if !defined(RADIOLIB_RX_QUEUE_MAX_RADIOS)
+  #define RADIOLIB_RX_QUEUE_MAX_RADIOS   (4)
+#endif
+
+// set the maximum number of sync words searched for simultaneously in direct reception mode
+#if !defined(RADIOLIB_DIRECT_SYNC_WORDS_MAX)
+  #define RADIOLIB_DIRECT_SYNC_WORDS_MAX   (4)
+#endif
+
+// set the transmission timeout in microseconds used by PhysicalLayer::submitTransmit
+// for modules that do not report the time-on-air (otherwise, 5x the time-on-air is used)
+#if !defined(RADIOLIB_EVENT_TX_TIMEOUT)
+  #define RADIOLIB_EVENT_TX_TIMEOUT   (10000000UL)
+#endif
+
+// set the maximum number of radios serviced by a single event loop
+#if !defined(RADIOLIB_EVENT_LOOP_MAX_RADIOS)
+  #define RADIOLIB_EVENT_LOOP_MAX_RADIOS   (4)
+#endif
+
+// set the maximum number of LoRaWAN nodes that can be active at the same time
+// each node needs an interrupt action and a flag of its own
+#if !defined(RADIOLIB_LORAWAN_NODES_MAX)
+  #define RADIOLIB_LORAWAN_NODES_MAX   (4)
+#endif
+
+// enable LoRaWAN multicast groups, set up locally or through TS005 remote multicast setup
+// each group takes RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN bytes of the session buffer, so they are only saved when enabled
+#if !defined(RADIOLIB_LORAWAN_MULTICAST)
+  #define RADIOLIB_LORAWAN_MULTICAST   (0)
+#endif
+
+// set the number of slots the hour is split into for the LoRaWAN duty cycle accounting
+// the airtime of a slot only expires once the whole slot is more than an hour old,
+// so more slots let an uplink go out closer to the limit at the cost of 4 bytes per slot and sub-band
+#if !defined(RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS)
+  #define RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS   (6)
+#endif
+
+// set the limits of the LoRaWAN fragmented data block decoder (TS004)
+// maximum number of fragments in a data block, maximum fragment size
+// and maximum number of lost fragments that can be recovered
+#if !defined(RADIOLIB_LORAWAN_FRAG_MAX_NB)
+  #define RADIOLIB_LORAWAN_FRAG_MAX_NB   (4096)
+#endif
+#if !defined(RADIOLIB_LORAWAN_FRAG_MAX_SIZE)
+  #define RADIOLIB_LORAWAN_FRAG_MAX_SIZE   (232)
+#endif
+#if !defined(RADIOLIB_LORAWAN_FRAG_MAX_MISSING)
+  #define RADIOLIB_LORAWAN_FRAG_MAX_MISSING   (128)
+#endif
+
+// enable coroutine wrappers when the compiler supports C++20 coroutines
+#if !defined(RADIOLIB_COROUTINES)
+  #if defined(__cpp_impl_coroutine) && defined(__has_include)
+    #if __has_include(<coroutine>)
+      #define RADIOLIB_COROUTINES   (1)
+    #endif
+  #endif
+#endif
+#if !defined(RADIOLIB_COROUTINES)
+  #define RADIOLIB_COROUTINES   (0)
+#endif
+
+// set the maximum number of coroutine tasks run by a single executor
+#if !defined(RADIOLIB_COROUTINE_MAX_TASKS)
+  #define RADIOLIB_COROUTINE_MAX_TASKS   (8)
+#endif
+
 /*
  * Uncomment on boards whose clock runs too slow or too fast
  * Set the value according to the following scheme:
@@ -97,6 +97,8 @@
 
 // physical layer protocols
 #include "protocols/PhysicalLayer/PhysicalLayer.h"
+#include "protocols/PhysicalLayer/EventLoop.h"
+#include "protocols/PhysicalLayer/Coroutines.h"
 #include "protocols/AFSK/AFSK.h"
 #include "protocols/AX25/AX25.h"
 #include "protocols/Hellschreiber/Hellschreiber.h"
@@ -111,10 +113,13 @@
 #include "protocols/Print/Print.h"
 #include "protocols/BellModem/BellModem.h"
 #include "protocols/LoRaWAN/LoRaWAN.h"
+#include "protocols/LoRaWAN/LoRaWANJournal.h"
+#include "protocols/LoRaWAN/LoRaWANAggregator.h"
 
 // utilities
 #include "utils/CRC.h"
 #include "utils/Cryptography.h"
+#include "utils/Compression.h"
 
 // only create Radio class when using RadioShield
 #if RADIOLIB_RADIOSHIELD
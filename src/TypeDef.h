@@ -250,6 +250,26 @@
 */
 #define RADIOLIB_ERR_NULL_POINTER                              (-28)
 
+/*!
+  \brief The supplied receive queue size is invalid.
+*/
+#define RADIOLIB_ERR_INVALID_QUEUE_SIZE                        (-29)
+
+/*!
+  \brief Another operation was already submitted and did not finish yet.
+*/
+#define RADIOLIB_ERR_OPERATION_PENDING                         (-30)
+
+/*!
+  \brief No more radios can be added to the event loop.
+*/
+#define RADIOLIB_ERR_EVENT_LOOP_FULL                           (-31)
+
+/*!
+  \brief No more radios can have a receive queue.
+*/
+#define RADIOLIB_ERR_RX_QUEUE_FULL                             (-32)
+
 // RF69-specific status codes
 
 /*!
@@ -593,6 +613,82 @@
 */
 #define RADIOLIB_LORAWAN_INVALID_MODE                            (-1121)
 
+/*!
+  \brief The requested device class is not supported, or the command is unavailable in the current class.
+*/
+#define RADIOLIB_LORAWAN_INVALID_CLASS                           (-1122)
+
+/*!
+  \brief No beacon was received while acquiring it, or the beacon was lost in Class B.
+*/
+#define RADIOLIB_LORAWAN_NO_BEACON                               (-1123)
+
+/*!
+  \brief The requested ping slot periodicity is out of range.
+*/
+#define RADIOLIB_LORAWAN_INVALID_PERIODICITY                     (-1124)
+
+/*!
+  \brief The multicast group ID is out of range, the group is not set up, or its frame counter range is invalid.
+*/
+#define RADIOLIB_LORAWAN_INVALID_MC_GROUP                        (-1125)
+
+/*!
+  \brief The fragment or fragmentation session parameters are invalid, or no session is running.
+*/
+#define RADIOLIB_LORAWAN_INVALID_FRAGMENT                        (-1126)
+
+/*!
+  \brief More fragments were lost than the fragment decoder is able to recover.
+*/
+#define RADIOLIB_LORAWAN_FRAG_TOO_MANY_LOST                      (-1127)
+
+/*!
+  \brief No network time was received yet, from DeviceTimeAns, a beacon or TS003 AppTimeAns.
+*/
+#define RADIOLIB_LORAWAN_NO_NETWORK_TIME                         (-1128)
+
+/*!
+  \brief The requested channel hopping policy is not supported.
+*/
+#define RADIOLIB_LORAWAN_INVALID_CHANNEL_POLICY                  (-1129)
+
+/*!
+  \brief Data frame is malformed, is not a data frame, or does not fit into the buffer.
+*/
+#define RADIOLIB_LORAWAN_INVALID_FRAME                           (-1130)
+
+/*!
+  \brief No session was found for the device address of the frame.
+*/
+#define RADIOLIB_LORAWAN_UNKNOWN_DEVICE                          (-1131)
+
+/*!
+  \brief Uplink frame counter of the device is exhausted and can not be used any more.
+*/
+#define RADIOLIB_LORAWAN_FCNT_UP_INVALID                         (-1132)
+
+/*!
+  \brief The session table size is not a power of 2.
+*/
+#define RADIOLIB_LORAWAN_INVALID_TABLE_SIZE                      (-1133)
+
+/*!
+  \brief The journal pages are too small to hold the session, there are fewer than two of them,
+  or the reserved frame counter gap is out of range.
+*/
+#define RADIOLIB_LORAWAN_INVALID_JOURNAL_SIZE                    (-1134)
+
+/*!
+  \brief There are no records queued or left to unpack.
+*/
+#define RADIOLIB_LORAWAN_NO_RECORDS                              (-1135)
+
+/*!
+  \brief There are more LoRaWAN nodes than RADIOLIB_LORAWAN_NODES_MAX, this one can not be activated.
+*/
+#define RADIOLIB_LORAWAN_TOO_MANY_NODES                          (-1136)
+
 // LR11x0-specific status codes
 
 /*!
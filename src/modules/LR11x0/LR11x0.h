@@ -1176,7 +1176,7 @@ class LR11x0: public PhysicalLayer {
       \brief Gets frequency error of the latest received packet.
       \returns Frequency error in Hz.
     */
-    float getFrequencyError();
+    float getFrequencyError() override;
 
     /*!
       \brief Query modem for the packet length of received payload.
@@ -943,7 +943,7 @@ class SX126x: public PhysicalLayer {
 
       \returns Frequency error in Hz.
     */
-    float getFrequencyError();
+    float getFrequencyError() override;
 
     /*!
       \brief Query modem for the packet length of received payload.
@@ -802,6 +802,10 @@ int16_t SX127x::invertPreamble(bool enable) {
   return(RADIOLIB_ERR_UNKNOWN);
 }
 
+float SX127x::getFrequencyError() {
+  return(this->getFrequencyError(false));
+}
+
 float SX127x::getFrequencyError(bool autoCorrect) {
   int16_t modem = getActiveModem();
   if(modem == RADIOLIB_SX127X_LORA) {
@@ -736,7 +736,7 @@ class SX128x: public PhysicalLayer {
       \brief Gets frequency error of the latest received packet.
       \returns Frequency error in Hz.
     */
-    float getFrequencyError();
+    float getFrequencyError() override;
 
     /*!
       \brief Query modem for the packet length of received payload.
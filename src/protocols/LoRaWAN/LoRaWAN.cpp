@@ -6,17 +6,40 @@
 
 #if !RADIOLIB_EXCLUDE_LORAWAN
 
-// flag to indicate whether there was some action during Rx mode (timeout or downlink)
-static volatile bool downlinkAction = false;
-
-// interrupt service routine to handle downlinks automatically
+// flags to indicate whether there was some action during Rx mode (timeout or downlink) or at the end of Tx
+// the actions take no arguments, so every node has a slot with a flag and an action of its own
+// the last flag belongs to the nodes that did not get a slot, those are never activated
+static volatile bool downlinkActions[RADIOLIB_LORAWAN_NODES_MAX + 1] = { false };
+static LoRaWANNode* downlinkNodes[RADIOLIB_LORAWAN_NODES_MAX] = { NULL };
+
+// interrupt service routine to handle downlinks automatically, one for each slot
+template<size_t N>
 #if defined(ESP8266) || defined(ESP32)
   IRAM_ATTR
 #endif
 static void LoRaWANNodeOnDownlinkAction(void) {
-  downlinkAction = true;
+  downlinkActions[N] = true;
 }
 
+// look up the action of a slot, split in halves so that the template nesting stays shallow
+template<size_t First, size_t Num>
+struct LoRaWANNodeActions {
+  static void (*get(size_t slot))(void) {
+    if(slot < First + Num/2) {
+      return(LoRaWANNodeActions<First, Num/2>::get(slot));
+    }
+    return(LoRaWANNodeActions<First + Num/2, Num - Num/2>::get(slot));
+  }
+};
+
+template<size_t First>
+struct LoRaWANNodeActions<First, 1> {
+  static void (*get(size_t slot))(void) {
+    (void)slot;
+    return(LoRaWANNodeOnDownlinkAction<First>);
+  }
+};
+
 uint8_t getDownlinkDataRate(uint8_t uplink, uint8_t offset, uint8_t base, uint8_t min, uint8_t max) {
   int8_t dr = uplink - offset + base;
   if(dr < min) {
@@ -27,6 +50,54 @@ uint8_t getDownlinkDataRate(uint8_t uplink, uint8_t offset, uint8_t base, uint8_
   return(dr);
 }
 
+// number of channels in a channel mask, loops once per enabled channel
+static uint8_t countChannels(uint16_t mask) {
+  uint8_t num = 0;
+  while(mask) {
+    mask &= mask - 1;
+    num++;
+  }
+  return(num);
+}
+
+// index of the n-th (from 0) enabled channel in a channel mask
+static uint8_t selectChannel(uint16_t mask, uint8_t n) {
+  while(n--) {
+    mask &= mask - 1;
+  }
+  uint8_t idx = 0;
+  while(!(mask & 0x01)) {
+    mask >>= 1;
+    idx++;
+  }
+  return(idx);
+}
+
+// time in milliseconds until a duty cycle bucket has room for the airtime within the last hour
+// its slots drop out oldest first, each one when the slot after it is over
+static RadioLibTime_t dutyCycleDrain(const uint32_t* used, uint8_t current, RadioLibTime_t elapsed, RadioLibTime_t limit, RadioLibTime_t airtime) {
+  if(limit == 0) {
+    return(0);
+  }
+
+  // an uplink longer than the whole budget has to wait until the bucket is empty
+  airtime = RADIOLIB_MIN(airtime, limit);
+  uint64_t sum = 0;
+  for(uint8_t i = 0; i <= RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS; i++) {
+    sum += used[i];
+  }
+
+  const RadioLibTime_t slotLen = RADIOLIB_LORAWAN_DUTY_CYCLE_PERIOD / RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS;
+  RadioLibTime_t wait = 0;
+  RadioLibTime_t next = slotLen - elapsed;
+  for(uint8_t i = 1; (sum + airtime > limit) && (i <= RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS + 1); i++) {
+    sum -= used[(current + i) % (RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS + 1)];
+    wait = next;
+    next += slotLen;
+  }
+  return(wait);
+}
+
 LoRaWANNode::LoRaWANNode(PhysicalLayer* phy, const LoRaWANBand_t* band, uint8_t subBand) {
   this->phyLayer = phy;
   this->band = band;
@@ -39,6 +110,33 @@ LoRaWANNode::LoRaWANNode(PhysicalLayer* phy, const LoRaWANBand_t* band, uint8_t
   this->dwellTimeEnabledUp = this->dwellTimeUp != 0;
   this->dwellTimeEnabledDn = this->dwellTimeDn != 0;
   memset(this->availableChannels, 0, sizeof(this->availableChannels));
+  memset(this->mcGroups, 0, sizeof(this->mcGroups));
+}
+
+LoRaWANNode::~LoRaWANNode() {
+  if(this->actionSlot < RADIOLIB_LORAWAN_NODES_MAX) {
+    downlinkNodes[this->actionSlot] = NULL;
+  }
+}
+
+bool LoRaWANNode::claimAction() {
+  if(this->actionSlot < RADIOLIB_LORAWAN_NODES_MAX) {
+    return(true);
+  }
+
+  for(size_t i = 0; i < RADIOLIB_LORAWAN_NODES_MAX; i++) {
+    if(downlinkNodes[i] == NULL) {
+      downlinkNodes[i] = this;
+      downlinkActions[i] = false;
+      this->actionSlot = i;
+      return(true);
+    }
+  }
+  return(false);
+}
+
+void (*LoRaWANNode::getAction())(void) {
+  return(LoRaWANNodeActions<0, RADIOLIB_LORAWAN_NODES_MAX + 1>::get(this->actionSlot));
 }
 
 void LoRaWANNode::setCSMA(uint8_t backoffMax, uint8_t difsSlots, bool enableCSMA) {
@@ -70,6 +168,8 @@ void LoRaWANNode::clearSession() {
   memset(this->bufferSession, 0, RADIOLIB_LORAWAN_SESSION_BUF_SIZE);
   memset(&(this->commandsUp), 0, sizeof(LoRaWANMacCommandQueue_t));
   memset(&(this->commandsDown), 0, sizeof(LoRaWANMacCommandQueue_t));
+  memset(this->mcGroups, 0, sizeof(this->mcGroups));
+  this->pkgAnsLen = 0;
   this->bufferNonces[RADIOLIB_LORAWAN_NONCES_ACTIVE] = (uint8_t)false;
   this->isActive = false;
 }
@@ -82,13 +182,20 @@ uint8_t* LoRaWANNode::getBufferNonces() {
   return(this->bufferNonces);
 }
 
-int16_t LoRaWANNode::setBufferNonces(uint8_t* persistentBuffer) {
+int16_t LoRaWANNode::setBufferNonces(uint8_t* persistentBuffer, RadioLibTime_t offTime) {
   if(this->isActivated()) {
     RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Did not update buffer: session already active");
     return(RADIOLIB_ERR_NONE);
   }
 
-  int16_t state = LoRaWANNode::checkBufferCommon(persistentBuffer, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
+  // a buffer of the previous version is shorter, only the fields it has in common are read from it
+  uint16_t version = LoRaWANNode::ntoh<uint16_t>(&persistentBuffer[RADIOLIB_LORAWAN_NONCES_VERSION]);
+  uint16_t size = RADIOLIB_LORAWAN_NONCES_BUF_SIZE;
+  if(version == RADIOLIB_LORAWAN_NONCES_VERSION_1) {
+    size = RADIOLIB_LORAWAN_NONCES_VERSION_1_SIZE;
+  }
+
+  int16_t state = LoRaWANNode::checkBufferCommon(persistentBuffer, size);
   RADIOLIB_ASSERT(state);
 
   bool isSameKeys = LoRaWANNode::ntoh<uint16_t>(&persistentBuffer[RADIOLIB_LORAWAN_NONCES_CHECKSUM]) == this->keyCheckSum;
@@ -101,15 +208,24 @@ int16_t LoRaWANNode::setBufferNonces(uint8_t* persistentBuffer) {
     // if configuration did not match, discard whatever is currently in the buffers and start fresh
     RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Configuration mismatch (keys: %d, mode: %d, class: %d, plan: %d)", isSameKeys, isSameMode, isSameClass, isSamePlan);
     RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Discarding the Nonces buffer:");
-    RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(persistentBuffer, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
+    RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(persistentBuffer, size);
     return(RADIOLIB_LORAWAN_NONCES_DISCARDED);
   }
 
-  // copy the whole buffer over
-  memcpy(this->bufferNonces, persistentBuffer, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
+  // copy the whole buffer over, the join backoff fields were added behind the ones of the previous version
+  // so those are left empty, which are the defaults
+  if(version == RADIOLIB_LORAWAN_NONCES_VERSION_1) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Upgrading the Nonces buffer from version %d", version);
+    memset(this->bufferNonces, 0, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
+    memcpy(this->bufferNonces, persistentBuffer, RADIOLIB_LORAWAN_NONCES_VERSION_1_SIZE - sizeof(uint16_t));
+    LoRaWANNode::hton<uint16_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_VERSION], RADIOLIB_LORAWAN_NONCES_VERSION_VAL);
+  } else {
+    memcpy(this->bufferNonces, persistentBuffer, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
+  }
 
   this->devNonce  = LoRaWANNode::ntoh<uint16_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_DEV_NONCE]);
   this->joinNonce = LoRaWANNode::ntoh<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_NONCE], 3);
+  this->restoreJoinBackoff(offTime);
 
   // revert to inactive as long as no session is restored
   this->bufferNonces[RADIOLIB_LORAWAN_NONCES_ACTIVE] = (uint8_t)false;
@@ -130,6 +246,33 @@ uint8_t* LoRaWANNode::getBufferSession() {
   // save the current uplink MAC command queue
   memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL], &this->commandsUp, sizeof(LoRaWANMacCommandQueue_t));
 
+  // save the MAC state as it is, so that it does not have to be rebuilt from the MAC commands
+  this->saveState(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_STATE]);
+
+  #if RADIOLIB_LORAWAN_MULTICAST
+  // save the multicast groups, including their frame counters
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_MC_GROUPS; i++) {
+    LoRaWANMulticastGroup_t* group = &this->mcGroups[i];
+    uint8_t* buff = &this->bufferSession[RADIOLIB_LORAWAN_SESSION_MC_GROUPS + i*RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN];
+    memset(buff, 0, RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN);
+    if(!group->defined) {
+      continue;
+    }
+    buff[0] = (uint8_t)true;
+    LoRaWANNode::hton<uint32_t>(&buff[1], group->mcAddr);
+    memcpy(&buff[5], group->mcAppSKey, RADIOLIB_AES128_KEY_SIZE);
+    memcpy(&buff[21], group->mcNwkSKey, RADIOLIB_AES128_KEY_SIZE);
+    LoRaWANNode::hton<uint32_t>(&buff[37], group->fCntMin);
+    LoRaWANNode::hton<uint32_t>(&buff[41], group->fCntMax);
+    buff[45] = group->sessionClass;
+    LoRaWANNode::hton<uint32_t>(&buff[46], group->sessionTime);
+    buff[50] = group->sessionTimeout;
+    LoRaWANNode::hton<uint32_t>(&buff[51], (uint32_t)(group->freq*10000.0 + 0.5), 3);
+    buff[54] = group->dr;
+    buff[55] = group->periodicity;
+  }
+  #endif
+
   // generate the signature of the Session buffer, and store it in the last two bytes of the Session buffer
   uint16_t signature = LoRaWANNode::checkSum16(this->bufferSession, RADIOLIB_LORAWAN_SESSION_BUF_SIZE - 2);
   LoRaWANNode::hton<uint16_t>(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_SIGNATURE], signature);
@@ -154,6 +297,13 @@ int16_t LoRaWANNode::setBufferSession(uint8_t* persistentBuffer) {
     return(RADIOLIB_LORAWAN_SESSION_DISCARDED);
   }
 
+  // restore the complete MAC state from the snapshot
+  // this only fails for a snapshot of a different sub-band or layout, which cannot be used for this session
+  if(!this->restoreState(&persistentBuffer[RADIOLIB_LORAWAN_SESSION_STATE])) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("The MAC state in the supplied session buffer cannot be used");
+    return(RADIOLIB_LORAWAN_SESSION_DISCARDED);
+  }
+
   // copy the whole buffer over
   memcpy(this->bufferSession, persistentBuffer, RADIOLIB_LORAWAN_SESSION_BUF_SIZE);
 
@@ -180,117 +330,154 @@ int16_t LoRaWANNode::setBufferSession(uint8_t* persistentBuffer) {
   this->confFCntDown = LoRaWANNode::ntoh<uint32_t>(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_CONF_FCNT_DOWN]);
   this->adrFCnt      = LoRaWANNode::ntoh<uint32_t>(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_ADR_FCNT]);
   this->fCntUp       = LoRaWANNode::ntoh<uint32_t>(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_FCNT_UP]);
-  
-  // restore the complete MAC state
 
-  // all-zero buffer used for checking if MAC commands are set
-  uint8_t bufferZeroes[RADIOLIB_LORAWAN_MAX_MAC_COMMAND_LEN_DOWN] = { 0 };
+  this->pingPeriodicity = this->bufferSession[RADIOLIB_LORAWAN_SESSION_PERIODICITY] & 0x07;
+  this->pingPeriodicityReq = this->pingPeriodicity;
 
-  LoRaWANMacCommand_t cmd = {
-    .cid = 0,
-    .payload = { 0 }, 
-    .len = 0,
-    .repeat = 0,
-  };
-
-  // for dynamic bands, first restore the defined channels before restoring ADR
-  // this is because the ADR command acts as a mask for the enabled channels
-  if(this->band->bandType == RADIOLIB_LORAWAN_BAND_DYNAMIC) {
-    // setup the default channels
-    state = this->setupChannelsDyn();
-    RADIOLIB_ASSERT(state);
-
-    // restore the session channels
-    uint8_t *startChannelsUp = &this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS];
-
-    cmd.cid = RADIOLIB_LORAWAN_MAC_NEW_CHANNEL;
-    for(int i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
-      cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_NEW_CHANNEL].lenDn;
-      memcpy(cmd.payload, startChannelsUp + (i * cmd.len), cmd.len);
-      if(memcmp(cmd.payload, bufferZeroes, cmd.len) != 0) { // only execute if it is not all zeroes
-        cmd.repeat = 1;
-        (void)execMacCommand(&cmd);
-      }
-    }
-
-    uint8_t *startChannelsDown = &this->bufferSession[RADIOLIB_LORAWAN_SESSION_DL_CHANNELS];
+  // copy uplink MAC command queue back in place
+  memcpy(&this->commandsUp, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL], sizeof(LoRaWANMacCommandQueue_t));
 
-    cmd.cid = RADIOLIB_LORAWAN_MAC_DL_CHANNEL;
-    for(int i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
-      cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_DL_CHANNEL].lenDn;
-      memcpy(cmd.payload, startChannelsDown + (i * cmd.len), cmd.len);
-      if(memcmp(cmd.payload, bufferZeroes, cmd.len) != 0) { // only execute if it is not all zeroes
-        (void)execMacCommand(&cmd);
-      }
+  #if RADIOLIB_LORAWAN_MULTICAST
+  // restore the multicast groups
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_MC_GROUPS; i++) {
+    LoRaWANMulticastGroup_t* group = &this->mcGroups[i];
+    uint8_t* buff = &this->bufferSession[RADIOLIB_LORAWAN_SESSION_MC_GROUPS + i*RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN];
+    memset(group, 0, sizeof(LoRaWANMulticastGroup_t));
+    if(!buff[0]) {
+      continue;
     }
+    group->defined = true;
+    group->mcAddr = LoRaWANNode::ntoh<uint32_t>(&buff[1]);
+    memcpy(group->mcAppSKey, &buff[5], RADIOLIB_AES128_KEY_SIZE);
+    memcpy(group->mcNwkSKey, &buff[21], RADIOLIB_AES128_KEY_SIZE);
+    group->fCntMin = LoRaWANNode::ntoh<uint32_t>(&buff[37]);
+    group->fCntMax = LoRaWANNode::ntoh<uint32_t>(&buff[41]);
+    group->sessionClass = buff[45];
+    group->sessionTime = LoRaWANNode::ntoh<uint32_t>(&buff[46]);
+    group->sessionTimeout = buff[50];
+    group->freq = (float)LoRaWANNode::ntoh<uint32_t>(&buff[51], 3)/10000.0;
+    group->dr = buff[54];
+    group->periodicity = buff[55];
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast group %d: 0x%08X, FCnt %lu", i, group->mcAddr, (unsigned long)group->fCntMin);
   }
+  #endif
 
-  cmd.cid = RADIOLIB_LORAWAN_MAC_TX_PARAM_SETUP,
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_TX_PARAM_SETUP].lenDn,
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_TX_PARAM_SETUP], cmd.len);
-  (void)execMacCommand(&cmd);
-
-  cmd.cid = RADIOLIB_LORAWAN_MAC_LINK_ADR;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_LINK_ADR].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_LINK_ADR], cmd.len);
-  (void)execMacCommand(&cmd);
+  // as both the Nonces and session are restored, revert to active session
+  this->bufferNonces[RADIOLIB_LORAWAN_NONCES_ACTIVE] = (uint8_t)true;
 
-  // for fixed bands, first restore ADR, then the defined channels
-  if(this->band->bandType == RADIOLIB_LORAWAN_BAND_FIXED) {
-    // setup the default channels
-    state = this->setupChannelsFix(this->subBand);
-    RADIOLIB_ASSERT(state);
+  return(state);
+}
 
-    // restore the session channels
-    uint8_t *startMACpayload = &this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS];
-    
-    // there are at most 8 channel masks present
-    cmd.cid = RADIOLIB_LORAWAN_MAC_LINK_ADR;
-    for(int i = 0; i < 8; i++) {
-      cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_LINK_ADR].lenDn;
-      memcpy(cmd.payload, startMACpayload + (i * cmd.len), cmd.len);
-      // there COULD, according to spec, be an all zeroes ADR command - meh
-      if(memcmp(cmd.payload, bufferZeroes, cmd.len) == 0) {
-        break;
-      }
-      cmd.repeat = (i+1);
-      (void)execMacCommand(&cmd);
+void LoRaWANNode::saveState(uint8_t* buff) {
+  memset(buff, 0, RADIOLIB_LORAWAN_STATE_BUF_SIZE);
+  buff[RADIOLIB_LORAWAN_STATE_VERSION] = RADIOLIB_LORAWAN_STATE_VERSION_VAL;
+  buff[RADIOLIB_LORAWAN_STATE_PLAN] = this->band->bandNum;
+  buff[RADIOLIB_LORAWAN_STATE_SUB_BAND] = this->subBand;
+  buff[RADIOLIB_LORAWAN_STATE_DATA_RATES] = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  buff[RADIOLIB_LORAWAN_STATE_DATA_RATES + 1] = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK];
+  buff[RADIOLIB_LORAWAN_STATE_TX_POWER_STEPS] = this->txPowerSteps;
+  buff[RADIOLIB_LORAWAN_STATE_TX_POWER_MAX] = this->txPowerMax;
+  buff[RADIOLIB_LORAWAN_STATE_NB_TRANS] = this->nbTrans;
+  LoRaWANNode::hton<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_DUTY_CYCLE], this->dutyCycle);
+  buff[RADIOLIB_LORAWAN_STATE_DWELL_TIME] = (this->dwellTimeEnabledUp ? 0x01 : 0x00) | (this->dwellTimeEnabledDn ? 0x02 : 0x00);
+  buff[RADIOLIB_LORAWAN_STATE_RX1_DR_OFFSET] = this->rx1DrOffset;
+  LoRaWANNode::saveChannel(&buff[RADIOLIB_LORAWAN_STATE_RX2], &this->rx2);
+  LoRaWANNode::hton<uint16_t>(&buff[RADIOLIB_LORAWAN_STATE_RX_DELAYS], this->rxDelays[0]);
+  LoRaWANNode::hton<uint16_t>(&buff[RADIOLIB_LORAWAN_STATE_RX_DELAYS + 2], this->rxDelays[1]);
+  buff[RADIOLIB_LORAWAN_STATE_ADR_PARAM] = (this->adrLimitExp << 4) | (this->adrDelayExp & 0x0F);
+  LoRaWANNode::hton<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_PING_SLOT], (uint32_t)(this->pingFreq*10000.0 + 0.5), 3);
+  buff[RADIOLIB_LORAWAN_STATE_PING_SLOT + 3] = this->pingDr;
+  LoRaWANNode::hton<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_BEACON_FREQ], (uint32_t)(this->beaconFreq*10000.0 + 0.5), 3);
+
+  uint8_t* chnlBuff = &buff[RADIOLIB_LORAWAN_STATE_CHANNELS];
+  for(uint8_t dir = 0; dir < 2; dir++) {
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
+      LoRaWANNode::saveChannel(chnlBuff, &this->availableChannels[dir][i]);
+      chnlBuff += RADIOLIB_LORAWAN_STATE_CHANNEL_LEN;
     }
-
   }
+}
 
-  cmd.cid = RADIOLIB_LORAWAN_MAC_DUTY_CYCLE;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_DUTY_CYCLE].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_DUTY_CYCLE], cmd.len);
-  (void)execMacCommand(&cmd);
-
-  cmd.cid = RADIOLIB_LORAWAN_MAC_RX_PARAM_SETUP;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_RX_PARAM_SETUP].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_RX_PARAM_SETUP], cmd.len);
-  (void)execMacCommand(&cmd);
+bool LoRaWANNode::restoreState(uint8_t* buff) {
+  // the snapshot is only valid for the same band, sub-band and snapshot layout
+  if((buff[RADIOLIB_LORAWAN_STATE_VERSION] != RADIOLIB_LORAWAN_STATE_VERSION_VAL) ||
+     (buff[RADIOLIB_LORAWAN_STATE_PLAN] != this->band->bandNum) ||
+     (buff[RADIOLIB_LORAWAN_STATE_SUB_BAND] != this->subBand)) {
+    return(false);
+  }
 
-  cmd.cid = RADIOLIB_LORAWAN_MAC_RX_TIMING_SETUP;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_RX_TIMING_SETUP].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_RX_TIMING_SETUP], cmd.len);
-  (void)execMacCommand(&cmd);
+  // check everything before anything is applied, so that a bad snapshot leaves the defaults in place
+  for(uint8_t dir = 0; dir < 2; dir++) {
+    uint8_t dr = buff[RADIOLIB_LORAWAN_STATE_DATA_RATES + dir];
+    if((dr >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) || (this->band->dataRates[dr] == RADIOLIB_LORAWAN_DATA_RATE_UNUSED)) {
+      return(false);
+    }
+  }
+  uint8_t nbTrans = buff[RADIOLIB_LORAWAN_STATE_NB_TRANS];
+  uint16_t rxDelay1 = LoRaWANNode::ntoh<uint16_t>(&buff[RADIOLIB_LORAWAN_STATE_RX_DELAYS]);
+  uint16_t rxDelay2 = LoRaWANNode::ntoh<uint16_t>(&buff[RADIOLIB_LORAWAN_STATE_RX_DELAYS + 2]);
+  if((buff[RADIOLIB_LORAWAN_STATE_TX_POWER_STEPS] > 0x0F) || (nbTrans == 0) || (nbTrans > 0x0F) ||
+     (buff[RADIOLIB_LORAWAN_STATE_RX1_DR_OFFSET] > 0x07) || (rxDelay1 == 0) || (rxDelay2 <= rxDelay1)) {
+    return(false);
+  }
+  // the RX2 channel first, then all available channels
+  for(size_t i = 0; i <= 2*RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
+    uint8_t* chnlBuff = (i == 0) ? &buff[RADIOLIB_LORAWAN_STATE_RX2] : &buff[RADIOLIB_LORAWAN_STATE_CHANNELS + (i - 1)*RADIOLIB_LORAWAN_STATE_CHANNEL_LEN];
+    if((chnlBuff[0] > 1) || ((chnlBuff[5] & 0x0F) >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) ||
+       (((chnlBuff[5] & 0xF0) >> 4) >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES)) {
+      return(false);
+    }
+  }
 
-  cmd.cid = RADIOLIB_LORAWAN_MAC_ADR_PARAM_SETUP;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_ADR_PARAM_SETUP].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_ADR_PARAM_SETUP], cmd.len);
-  (void)execMacCommand(&cmd);
+  this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK] = buff[RADIOLIB_LORAWAN_STATE_DATA_RATES];
+  this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK] = buff[RADIOLIB_LORAWAN_STATE_DATA_RATES + 1];
+  this->txPowerSteps = buff[RADIOLIB_LORAWAN_STATE_TX_POWER_STEPS];
+  this->txPowerMax = buff[RADIOLIB_LORAWAN_STATE_TX_POWER_MAX];
+  this->nbTrans = nbTrans;
+  this->dutyCycle = LoRaWANNode::ntoh<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_DUTY_CYCLE]);
+  this->dwellTimeEnabledUp = buff[RADIOLIB_LORAWAN_STATE_DWELL_TIME] & 0x01;
+  this->dwellTimeUp = this->dwellTimeEnabledUp ? RADIOLIB_LORAWAN_DWELL_TIME : 0;
+  this->dwellTimeEnabledDn = buff[RADIOLIB_LORAWAN_STATE_DWELL_TIME] & 0x02;
+  this->dwellTimeDn = this->dwellTimeEnabledDn ? RADIOLIB_LORAWAN_DWELL_TIME : 0;
+  this->rx1DrOffset = buff[RADIOLIB_LORAWAN_STATE_RX1_DR_OFFSET];
+  LoRaWANNode::restoreChannel(&buff[RADIOLIB_LORAWAN_STATE_RX2], &this->rx2);
+  this->rxDelays[0] = rxDelay1;
+  this->rxDelays[1] = rxDelay2;
+  this->adrLimitExp = (buff[RADIOLIB_LORAWAN_STATE_ADR_PARAM] & 0xF0) >> 4;
+  this->adrDelayExp = buff[RADIOLIB_LORAWAN_STATE_ADR_PARAM] & 0x0F;
+  this->pingFreq = (float)LoRaWANNode::ntoh<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_PING_SLOT], 3)/10000.0;
+  this->pingDr = buff[RADIOLIB_LORAWAN_STATE_PING_SLOT + 3];
+  this->beaconFreq = (float)LoRaWANNode::ntoh<uint32_t>(&buff[RADIOLIB_LORAWAN_STATE_BEACON_FREQ], 3)/10000.0;
+
+  uint8_t* chnlBuff = &buff[RADIOLIB_LORAWAN_STATE_CHANNELS];
+  for(uint8_t dir = 0; dir < 2; dir++) {
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
+      LoRaWANNode::restoreChannel(chnlBuff, &this->availableChannels[dir][i]);
+      chnlBuff += RADIOLIB_LORAWAN_STATE_CHANNEL_LEN;
+    }
+  }
+  this->updateChannelMasks();
 
-  cmd.cid = RADIOLIB_LORAWAN_MAC_REJOIN_PARAM_SETUP;
-  cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_REJOIN_PARAM_SETUP].lenDn;
-  memcpy(cmd.payload, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_REJOIN_PARAM_SETUP], cmd.len);
-  (void)execMacCommand(&cmd);
+  #if RADIOLIB_DEBUG_PROTOCOL
+  this->printChannels();
+  #endif
 
-  // copy uplink MAC command queue back in place
-  memcpy(&this->commandsUp, &this->bufferSession[RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL], sizeof(LoRaWANMacCommandQueue_t));
+  return(true);
+}
 
-  // as both the Nonces and session are restored, revert to active session
-  this->bufferNonces[RADIOLIB_LORAWAN_NONCES_ACTIVE] = (uint8_t)true;
+void LoRaWANNode::saveChannel(uint8_t* buff, const LoRaWANChannel_t* chnl) {
+  buff[0] = chnl->enabled ? 1 : 0;
+  buff[1] = chnl->idx;
+  LoRaWANNode::hton<uint32_t>(&buff[2], (uint32_t)(chnl->freq*10000.0 + 0.5), 3);
+  buff[5] = (chnl->drMax << 4) | (chnl->drMin & 0x0F);
+}
 
-  return(state);
+void LoRaWANNode::restoreChannel(uint8_t* buff, LoRaWANChannel_t* chnl) {
+  chnl->enabled = buff[0];
+  chnl->idx = buff[1];
+  chnl->freq = (float)LoRaWANNode::ntoh<uint32_t>(&buff[2], 3)/10000.0;
+  chnl->drMin = buff[5] & 0x0F;
+  chnl->drMax = (buff[5] & 0xF0) >> 4;
 }
 
 int16_t LoRaWANNode::checkBufferCommon(uint8_t *buffer, uint16_t size) {
@@ -338,17 +525,8 @@ void LoRaWANNode::activateCommon(uint8_t initialDr) {
   } else {
     // if the user specified a certain datarate, check if any of the configured channels allows it
     if(initialDr != RADIOLIB_LORAWAN_DATA_RATE_UNUSED) {
-      uint8_t i = 0; 
-      for(; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
-        if(this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].enabled) {
-          if(initialDr >= this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].drMin
-            && initialDr <= this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].drMax) {
-              break;
-          }
-        }
-      }
       // if there is no channel that allowed the user-specified datarate, revert to default datarate
-      if(i == RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS) {
+      if((initialDr >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) || (this->channelMasks[initialDr] == 0)) {
         RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Datarate %d is not valid - using default", initialDr);
         initialDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED;
       }
@@ -382,22 +560,7 @@ void LoRaWANNode::activateCommon(uint8_t initialDr) {
 
   cmd.cid = RADIOLIB_LORAWAN_MAC_DUTY_CYCLE;
   cmd.len = MacTable[RADIOLIB_LORAWAN_MAC_DUTY_CYCLE].lenDn;
-  uint8_t maxDCyclePower;
-  switch(this->band->dutyCycle) {
-    case(0):
-      maxDCyclePower = 0;
-      break;
-    case(3600):
-      maxDCyclePower = 10;
-      break;
-    case(36000):
-      maxDCyclePower = 7;
-      break;
-    default:
-      maxDCyclePower = 0;
-      break;
-  }
-  cmd.payload[0]  = maxDCyclePower;
+  cmd.payload[0]  = 0;                // no aggregated limit, the regional (sub-band) limits apply
   (void)execMacCommand(&cmd);
 
   cmd.cid = RADIOLIB_LORAWAN_MAC_RX_PARAM_SETUP;
@@ -452,6 +615,11 @@ void LoRaWANNode::activateCommon(uint8_t initialDr) {
   cmd.payload[0]  = (RADIOLIB_LORAWAN_REJOIN_MAX_TIME_N << 4);
   cmd.payload[0] |= RADIOLIB_LORAWAN_REJOIN_MAX_COUNT_N;
   (void)execMacCommand(&cmd);
+
+  // Class B starts with the default ping slot periodicity
+  this->pingPeriodicity = RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_DEFAULT;
+  this->pingPeriodicityReq = this->pingPeriodicity;
+  this->bufferSession[RADIOLIB_LORAWAN_SESSION_PERIODICITY] = this->pingPeriodicity;
 }
 
 void LoRaWANNode::beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey) {
@@ -477,11 +645,34 @@ void LoRaWANNode::beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey,
   this->lwMode = RADIOLIB_LORAWAN_MODE_OTAA;
   this->lwClass = RADIOLIB_LORAWAN_CLASS_A;
 
+  // expand the root keys once for all the join attempts
+  RadioLibAES128Instance.expandKey(this->appKey, &this->appKeyExp);
+  RadioLibAES128Instance.expandKey(this->nwkKey, &this->nwkKeyExp);
+
+  // the LoRaWAN v1.1 join accept integrity key only depends on the NwkKey and DevEUI
+  uint8_t keyDerivationBuff[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_JS_INT_KEY;
+  LoRaWANNode::hton<uint64_t>(&keyDerivationBuff[1], this->devEUI);
+  RadioLibAES128Instance.init(&this->nwkKeyExp);
+  RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->jSIntKey);
+
+  // prepare the join-request, only DevNonce and MIC change between attempts
+  this->joinRequestMsg[0] = RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_REQUEST | RADIOLIB_LORAWAN_MHDR_MAJOR_R1;
+  LoRaWANNode::hton<uint64_t>(&this->joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_JOIN_EUI_POS], this->joinEUI);
+  LoRaWANNode::hton<uint64_t>(&this->joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_EUI_POS], this->devEUI);
+
   // set the device credentials
+  // the join backoff carries on, it is only reset on power-up
   this->createNonces();
+  this->saveJoinBackoff();
 }
 
 int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent) {
+  // the node needs an action of its own for the radio interrupts
+  if(!this->claimAction()) {
+    return(RADIOLIB_LORAWAN_TOO_MANY_NODES);
+  }
+
   // check if there is an active session
   if(this->isActivated()) {
     // already activated, don't do anything
@@ -493,6 +684,11 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
     return(RADIOLIB_LORAWAN_SESSION_RESTORED);
   }
 
+  // if adhering to the join backoff and the next join-request is not allowed yet, return an error
+  if(this->joinBackoffEnabled && (this->timeUntilJoin() > 0)) {
+    return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
+  }
+
   int16_t state = RADIOLIB_ERR_UNKNOWN;
   
   // either no valid session was found or user forced a new session, so clear all activity
@@ -540,22 +736,13 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
   // copy devNonce currently in use
   uint16_t devNonceUsed = this->devNonce;
 
-  // build the join-request message
-  uint8_t joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_LEN];
-  
-  // set the packet fields
-  joinRequestMsg[0] = RADIOLIB_LORAWAN_MHDR_MTYPE_JOIN_REQUEST | RADIOLIB_LORAWAN_MHDR_MAJOR_R1;
-  LoRaWANNode::hton<uint64_t>(&joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_JOIN_EUI_POS], this->joinEUI);
-  LoRaWANNode::hton<uint64_t>(&joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_EUI_POS], this->devEUI);
+  // complete the join-request message prepared by beginOTAA
+  uint8_t* joinRequestMsg = this->joinRequestMsg;
   LoRaWANNode::hton<uint16_t>(&joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_DEV_NONCE_POS], devNonceUsed);
 
   // add the authentication code
-  uint32_t mic = 0;
-  if(this->rev == 1) {
-    mic =this->generateMIC(joinRequestMsg, RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t), this->nwkKey);
-  } else {
-    mic =this->generateMIC(joinRequestMsg, RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t), this->appKey);
-  }
+  const RadioLibAES128Key_t* joinKey = (this->rev == 1) ? &this->nwkKeyExp : &this->appKeyExp;
+  uint32_t mic = this->generateMIC(joinRequestMsg, RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t), joinKey);
   LoRaWANNode::hton<uint32_t>(&joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_LEN - sizeof(uint32_t)], mic);
 
   // send it
@@ -563,6 +750,11 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
   state = this->phyLayer->transmit(joinRequestMsg, RADIOLIB_LORAWAN_JOIN_REQUEST_LEN);
   this->rxDelayStart = mod->hal->millis();
   RADIOLIB_ASSERT(state);
+  RadioLibTime_t toa = this->phyLayer->getTimeOnAir(RADIOLIB_LORAWAN_JOIN_REQUEST_LEN) / 1000;
+  this->consumeDutyCycle(this->channelLast, toa);
+
+  // the MIC is unique to this device and attempt, so it seeds the random delay without using the radio
+  this->consumeJoinBackoff(toa, mic);
   RADIOLIB_DEBUG_PROTOCOL_PRINTLN("JoinRequest sent (DevNonce = %d) <-- Rx Delay start", this->devNonce);
 
   // join-request successfully sent, so increase & save devNonce
@@ -609,11 +801,7 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
   // the first byte is the MAC header which is not encrypted
   uint8_t joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_MAX_LEN];
   joinAcceptMsg[0] = joinAcceptMsgEnc[0];
-  if(this->rev == 1) {
-    RadioLibAES128Instance.init(this->nwkKey);
-  } else {
-    RadioLibAES128Instance.init(this->appKey);
-  }
+  RadioLibAES128Instance.init(joinKey);
   RadioLibAES128Instance.encryptECB(&joinAcceptMsgEnc[1], RADIOLIB_LORAWAN_JOIN_ACCEPT_MAX_LEN - 1, &joinAcceptMsg[1]);
 
   // get current joinNonce from downlink
@@ -622,36 +810,15 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
   RADIOLIB_DEBUG_PROTOCOL_PRINTLN("JoinAccept (JoinNonce = %lu, previously %lu):", (unsigned long)joinNonceNew, (unsigned long)this->joinNonce);
   RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(joinAcceptMsg, lenRx);
 
-  if(this->rev == 1) {
-    // for v1.1, the JoinNonce received must be greater than the last joinNonce heard, else error
-    if((this->joinNonce > 0) && (joinNonceNew <= this->joinNonce)) {
-      return(RADIOLIB_ERR_JOIN_NONCE_INVALID);
-    }
-  } else {
-    // for v1.0.4, the JoinNonce is simply a non-repeating value (we only check the last value)
-    if(joinNonceNew == this->joinNonce) {
-      return(RADIOLIB_ERR_JOIN_NONCE_INVALID);
-    }
-  }
-  this->joinNonce = joinNonceNew;
-
-  this->homeNetId = LoRaWANNode::ntoh<uint32_t>(&joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_HOME_NET_ID_POS], 3);
-  this->devAddr = LoRaWANNode::ntoh<uint32_t>(&joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_DEV_ADDR_POS]);
-
   // check LoRaWAN revision (the MIC verification depends on this)
+  // nothing is saved until the MIC is verified, the Join-Accept may have been meant for another device
   uint8_t dlSettings = joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_DL_SETTINGS_POS];
-  this->rev = (dlSettings & RADIOLIB_LORAWAN_JOIN_ACCEPT_R_1_1) >> 7;
-  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("LoRaWAN revision: 1.%d", this->rev);
+  uint8_t revNew = (dlSettings & RADIOLIB_LORAWAN_JOIN_ACCEPT_R_1_1) >> 7;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("LoRaWAN revision: 1.%d", revNew);
 
   // verify MIC
-  if(this->rev == 1) {
-    // 1.1 version, first we need to derive the join accept integrity key
-    uint8_t keyDerivationBuff[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
-    keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_JS_INT_KEY;
-    LoRaWANNode::hton<uint64_t>(&keyDerivationBuff[1], this->devEUI);
-    RadioLibAES128Instance.init(this->nwkKey);
-    RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->jSIntKey);
-
+  if(revNew == 1) {
+    // 1.1 version, the join accept integrity key was derived by beginOTAA
     // prepare the buffer for MIC calculation
     uint8_t micBuff[3*RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
     micBuff[0] = RADIOLIB_LORAWAN_JOIN_REQUEST_TYPE;
@@ -662,14 +829,28 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
     if(!verifyMIC(micBuff, lenRx + 11, this->jSIntKey)) {
       return(RADIOLIB_ERR_CRC_MISMATCH);
     }
+
+    // for v1.1, the JoinNonce received must be greater than the last joinNonce heard, else error
+    if((this->joinNonce > 0) && (joinNonceNew <= this->joinNonce)) {
+      return(RADIOLIB_ERR_JOIN_NONCE_INVALID);
+    }
   
   } else {
     // 1.0 version
-    if(!verifyMIC(joinAcceptMsg, lenRx, this->appKey)) {
+    if(!verifyMIC(joinAcceptMsg, lenRx, &this->appKeyExp)) {
       return(RADIOLIB_ERR_CRC_MISMATCH);
     }
 
+    // for v1.0.4, the JoinNonce is simply a non-repeating value (we only check the last value)
+    if(joinNonceNew == this->joinNonce) {
+      return(RADIOLIB_ERR_JOIN_NONCE_INVALID);
+    }
+
   }
+  this->rev = revNew;
+  this->joinNonce = joinNonceNew;
+  this->homeNetId = LoRaWANNode::ntoh<uint32_t>(&joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_HOME_NET_ID_POS], 3);
+  this->devAddr = LoRaWANNode::ntoh<uint32_t>(&joinAcceptMsg[RADIOLIB_LORAWAN_JOIN_ACCEPT_DEV_ADDR_POS]);
 
   LoRaWANMacCommand_t cmd = {
     .cid = RADIOLIB_LORAWAN_MAC_RX_PARAM_SETUP,
@@ -711,19 +892,17 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
     LoRaWANNode::hton<uint16_t>(&keyDerivationBuff[RADIOLIB_LORAWAN_JOIN_ACCEPT_DEV_NONCE_POS], devNonceUsed);
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_APP_S_KEY;
 
-    RadioLibAES128Instance.init(this->appKey);
+    RadioLibAES128Instance.init(&this->appKeyExp);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->appSKey);
 
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_F_NWK_S_INT_KEY;
-    RadioLibAES128Instance.init(this->nwkKey);
+    RadioLibAES128Instance.init(&this->nwkKeyExp);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->fNwkSIntKey);
 
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_S_NWK_S_INT_KEY;
-    RadioLibAES128Instance.init(this->nwkKey);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->sNwkSIntKey);
 
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_NWK_S_ENC_KEY;
-    RadioLibAES128Instance.init(this->nwkKey);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->nwkSEncKey);
 
     // enqueue the RekeyInd MAC command to be sent in the next uplink
@@ -740,11 +919,10 @@ int16_t LoRaWANNode::activateOTAA(uint8_t joinDr, LoRaWANJoinEvent_t *joinEvent)
     LoRaWANNode::hton<uint32_t>(&keyDerivationBuff[RADIOLIB_LORAWAN_JOIN_ACCEPT_HOME_NET_ID_POS], this->homeNetId, 3);
     LoRaWANNode::hton<uint16_t>(&keyDerivationBuff[RADIOLIB_LORAWAN_JOIN_ACCEPT_DEV_ADDR_POS], devNonceUsed);
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_APP_S_KEY;
-    RadioLibAES128Instance.init(this->appKey);
+    RadioLibAES128Instance.init(&this->appKeyExp);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->appSKey);
 
     keyDerivationBuff[0] = RADIOLIB_LORAWAN_JOIN_ACCEPT_F_NWK_S_INT_KEY;
-    RadioLibAES128Instance.init(this->appKey);
     RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, this->fNwkSIntKey);
 
     memcpy(this->sNwkSIntKey, this->fNwkSIntKey, RADIOLIB_AES128_KEY_SIZE);
@@ -824,6 +1002,11 @@ void LoRaWANNode::beginABP(uint32_t addr, uint8_t* fNwkSIntKey, uint8_t* sNwkSIn
 }
 
 int16_t LoRaWANNode::activateABP(uint8_t initialDr) {
+  // the node needs an action of its own for the radio interrupts
+  if(!this->claimAction()) {
+    return(RADIOLIB_LORAWAN_TOO_MANY_NODES);
+  }
+
   // check if there is an active session
   if(this->isActivated()) {
     // already activated, don't do anything
@@ -897,13 +1080,67 @@ int16_t LoRaWANNode::uplink(const char* str, uint8_t fPort, bool isConfirmed, Lo
 }
 
 int16_t LoRaWANNode::uplink(uint8_t* data, size_t len, uint8_t fPort, bool isConfirmed, LoRaWANEvent_t* event) {
+  // check the uplink can be sent and configure the physical layer for it
+  uint8_t fOptsLen = 0;
+  bool adrAckReq = false;
+  int16_t state = this->prepareUplink(&data, &len, fPort, &fOptsLen, &adrAckReq);
+  RADIOLIB_ASSERT(state);
+
+  // build the uplink message
+  bool isConfirmingDown = false;
+  state = this->buildUplink(data, len, fPort, isConfirmed, fOptsLen, adrAckReq, &isConfirmingDown);
+  RADIOLIB_ASSERT(state);
+
+  // perform CSMA if enabled.
+  if (enableCSMA) {
+    performCSMA();
+  }
+
+  // send it
+  state = this->phyLayer->transmit(this->retxMsg, this->retxLen);
+
+  // set the timestamp so that we can measure when to start receiving
+  this->rxDelayStart = this->phyLayer->getMod()->hal->millis();
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink sent <-- Rx Delay start");
+
+  // calculate Time on Air of this uplink in milliseconds
+  this->lastToA = this->phyLayer->getTimeOnAir(this->retxLen) / 1000;
+  RADIOLIB_ASSERT(state);
+  this->consumeDutyCycle(this->channelLast, this->lastToA);
+
+  this->finishUplink(fPort, isConfirmed, isConfirmingDown, event);
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::compressUplink(uint8_t** data, size_t* len, uint8_t fPort) {
+  if(!this->compression || (fPort != this->compressionPort)) {
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  // the payload is compressed to where it goes in a frame without FOpts,
+  // this overwrites the previous frame, so it can not be retransmitted anymore
+  this->retxLeft = 0;
+  uint8_t* buff = &this->retxMsg[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(0)];
+  size_t compressedLen = RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN - RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(0) - sizeof(uint32_t);
+  int16_t state = this->compression->compress(*data, *len, buff, &compressedLen);
+  RADIOLIB_ASSERT(state);
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Payload compressed from %d to %d bytes", (int)*len, (int)compressedLen);
+  *data = buff;
+  *len = compressedLen;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::prepareUplink(uint8_t** data, size_t* len, uint8_t fPort, uint8_t* fOptsLen, bool* adrAckReq) {
   // if not joined, don't do anything
   if(!this->isActivated()) {
     return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
   }
   
-  Module* mod = this->phyLayer->getMod();
-  
+  // check there is no exchange in progress
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
   // check if the Rx windows were closed after sending the previous uplink
   // this FORCES a user to call downlink() after an uplink()
   if(this->rxDelayEnd < this->rxDelayStart) {
@@ -911,8 +1148,14 @@ int16_t LoRaWANNode::uplink(uint8_t* data, size_t len, uint8_t fPort, bool isCon
     return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
   }
 
-  // if adhering to dutyCycle and the time since last uplink + interval has not elapsed, return an error
-  if(this->dutyCycleEnabled && this->rxDelayStart + (RadioLibTime_t)dutyCycleInterval(this->dutyCycle, this->lastToA) > mod->hal->millis()) {
+  // if adhering to dutyCycle and none of the channels has enough airtime left, return an error
+  if(this->dutyCycleEnabled && (this->timeUntilUplink() > 0)) {
+    return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
+  }
+
+  // a frame received in a ping slot is still in the radio buffer, it must be collected first
+  if(this->classBState == RADIOLIB_LORAWAN_CLASS_B_PING_DONE) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Ping slot downlink not collected by getDownlinkClassB yet");
     return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
   }
 
@@ -933,32 +1176,37 @@ int16_t LoRaWANNode::uplink(uint8_t* data, size_t len, uint8_t fPort, bool isCon
     this->isMACPayload = false;
   }
 
-  int16_t state = RADIOLIB_ERR_UNKNOWN;
+  // uplinks take precedence over the Class B beacon and ping slots
+  this->stopClassB();
+
+  // the length limits apply to the payload as it is sent
+  int16_t state = this->compressUplink(data, len, fPort);
+  RADIOLIB_ASSERT(state);
 
   // check if there are some MAC commands to piggyback (only when piggybacking onto a application-frame)
-  uint8_t fOptsLen = 0;
+  *fOptsLen = 0;
   if(this->commandsUp.numCommands > 0 && fPort != RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) {
     // there are, assume the maximum possible FOpts len for buffer allocation
-    fOptsLen = this->commandsUp.len;
+    *fOptsLen = this->commandsUp.len;
   }
 
   // check maximum payload len as defined in phy
-  if(len > this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK]]) {
+  if(*len > this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK]]) {
     // normally, throw an error if the packet is too long
     if(this->TS009 == false) {
       return(RADIOLIB_ERR_PACKET_TOO_LONG);
     }
     // if testing with TS009 Specification Verification Protocol, don't throw error but clip the message
-    len = this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK]];
+    *len = this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK]];
   }
 
-  bool adrAckReq = false;
+  *adrAckReq = false;
   if(this->adrEnabled) {
     // check if we need to do ADR stuff
     uint32_t adrLimit = 0x01 << this->adrLimitExp;
     uint32_t adrDelay = 0x01 << this->adrDelayExp;
     if((this->fCntUp - this->adrFCnt) >= adrLimit) {
-      adrAckReq = true;
+      *adrAckReq = true;
     }
     // if we hit the Limit + Delay, try one of three, in order: 
     // set TxPower to max, set DR to min, enable all default channels
@@ -1009,184 +1257,205 @@ int16_t LoRaWANNode::uplink(uint8_t* data, size_t len, uint8_t fPort, bool isCon
 
       // we tried something to improve the range, so increase the ADR frame counter by 'ADR delay'
       this->adrFCnt += adrDelay;
+
+      // the link was lost, so the samples of the link margin ADR do not apply anymore
+      if(this->linkAdr) {
+        this->linkAdr->reset();
+      }
     }
   }
 
+  // the link margin ADR may pick a different datarate or power
+  this->updateLinkAdr(*len);
+
   // set the physical layer configuration for uplink
-  this->selectChannels();
+  state = this->selectChannels();
+  RADIOLIB_ASSERT(state);
   state = this->setPhyProperties(RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK);
   RADIOLIB_ASSERT(state);
 
   // if dwell time is imposed, calculated expected time on air and cancel if exceeds
-  if(this->dwellTimeEnabledUp && this->phyLayer->getTimeOnAir(RADIOLIB_LORAWAN_FRAME_LEN(len, fOptsLen) - 16)/1000 > this->dwellTimeUp) {
+  RadioLibTime_t toa = this->phyLayer->getTimeOnAir(RADIOLIB_LORAWAN_FRAME_LEN(*len, *fOptsLen) - 16)/1000;
+  if(this->dwellTimeEnabledUp && toa > this->dwellTimeUp) {
     return(RADIOLIB_ERR_DWELL_TIME_EXCEEDED);
   }
 
-  // build the uplink message
-  // the first 16 bytes are reserved for MIC calculation blocks
-  size_t uplinkMsgLen = RADIOLIB_LORAWAN_FRAME_LEN(len, fOptsLen);
-  #if RADIOLIB_STATIC_ONLY
-  uint8_t uplinkMsg[RADIOLIB_STATIC_ARRAY_SIZE];
-  #else
-  uint8_t* uplinkMsg = new uint8_t[uplinkMsgLen];
-  #endif
-  
+  // the channel was picked for an uplink as long as the previous one, this one may be longer
+  if(this->dutyCycleEnabled && (this->dutyCycleWait(1UL << this->channelLast, NULL, toa + 1) > 0)) {
+    return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
+  }
+
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::buildUplink(uint8_t* data, size_t len, uint8_t fPort, bool isConfirmed, uint8_t fOptsLen, bool adrAckReq, bool* isConfirmingDown) {
+  LoRaWANFrame_t frame = {
+    .mType = RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP,
+    .devAddr = this->devAddr,
+    .fCtrl = 0x00,
+    .fCnt = this->fCntUp,
+    .fOptsLen = fOptsLen,
+    .fOpts = { 0 },
+    .hasFPort = true,
+    .fPort = fPort,
+    .payloadLen = len,
+    .confFCnt = 0,
+    .dataRate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK],
+    .chIndex = this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK].idx,
+    .mic = 0,
+  };
+
   // set the packet fields
   if(isConfirmed) {
-    uplinkMsg[RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS] = RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP;
+    frame.mType = RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP;
     this->confFCntUp = this->fCntUp;
-  } else {
-    uplinkMsg[RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS] = RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP;
   }
-  uplinkMsg[RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS] |= RADIOLIB_LORAWAN_MHDR_MAJOR_R1;
-  LoRaWANNode::hton<uint32_t>(&uplinkMsg[RADIOLIB_LORAWAN_FHDR_DEV_ADDR_POS], this->devAddr);
 
-  // length of fOpts will be added later
-  uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] = 0x00;
   if(this->adrEnabled) {
-    uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] |= RADIOLIB_LORAWAN_FCTRL_ADR_ENABLED;
+    frame.fCtrl |= RADIOLIB_LORAWAN_FCTRL_ADR_ENABLED;
     if(adrAckReq) {
-      uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] |= RADIOLIB_LORAWAN_FCTRL_ADR_ACK_REQ;
+      frame.fCtrl |= RADIOLIB_LORAWAN_FCTRL_ADR_ACK_REQ;
     }
   }
 
+  // let the network know the ping slots are open
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_B) {
+    frame.fCtrl |= RADIOLIB_LORAWAN_FCTRL_CLASS_B;
+  }
+
   // if the saved confirm-fCnt is set, set the ACK bit
-  bool isConfirmingDown = false;
+  *isConfirmingDown = false;
   if(this->confFCntDown != RADIOLIB_LORAWAN_FCNT_NONE) {
-    isConfirmingDown = true;
-    uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] |= RADIOLIB_LORAWAN_FCTRL_ACK;
+    *isConfirmingDown = true;
+    frame.fCtrl |= RADIOLIB_LORAWAN_FCTRL_ACK;
+    frame.confFCnt = (uint16_t)this->confFCntDown;
   }
 
-  LoRaWANNode::hton<uint16_t>(&uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCNT_POS], (uint16_t)this->fCntUp);
-
-  // check if we have some MAC commands to append
+  // append all MAC replies into fOpts buffer
   if(fOptsLen > 0) {
-    // assume maximum possible buffer size
-    uint8_t fOptsBuff[RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN];
-    uint8_t* fOptsPtr = fOptsBuff;
-
-    // append all MAC replies into fOpts buffer
-    int16_t i = 0;
-    for (; i < this->commandsUp.numCommands; i++) {
-      LoRaWANMacCommand_t cmd = this->commandsUp.commands[i];
-      memcpy(fOptsPtr, &cmd, 1 + cmd.len);
-      fOptsPtr += cmd.len + 1;
-    }
-    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink MAC payload (%d commands):", this->commandsUp.numCommands);
-    RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(fOptsBuff, fOptsLen);
-
-    // pop the commands from back to front
-    for (; i >= 0; i--) {
-      if(this->commandsUp.commands[i].repeat > 0) {
-        this->commandsUp.commands[i].repeat--;
-      } else {
-        deleteMacCommand(this->commandsUp.commands[i].cid, &this->commandsUp);
-      }
-    }
+    this->dequeueMacCommands(frame.fOpts);
+  }
 
-    uplinkMsgLen = RADIOLIB_LORAWAN_FRAME_LEN(len, fOptsLen);
-    uplinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] |= fOptsLen;
+  // the frame is built in place of the previous one
+  this->retxLeft = 0;
+  this->retxLen = 0;
 
-    if(this->rev == 1) {
-      // in LoRaWAN v1.1, the FOpts are encrypted using the NwkSEncKey
-      processAES(fOptsBuff, fOptsLen, this->nwkSEncKey, &uplinkMsg[RADIOLIB_LORAWAN_FHDR_FOPTS_POS], this->fCntUp, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK, 0x01, true);
-    } else {
-      // in LoRaWAN v1.0.x, the FOpts are unencrypted
-      memcpy(&uplinkMsg[RADIOLIB_LORAWAN_FHDR_FOPTS_POS], fOptsBuff, fOptsLen);
+  // a compressed payload is already in the frame buffer, move it behind the FOpts
+  // the encryption then works in place
+  uint8_t* payload = &this->retxMsg[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(fOptsLen)];
+  if((data != payload) && (data >= this->retxMsg) && (data < &this->retxMsg[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN])) {
+    if(RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(fOptsLen) + len + sizeof(uint32_t) > RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN) {
+      return(RADIOLIB_ERR_PACKET_TOO_LONG);
     }
-    
-  }
-
-  // set the fPort
-  uplinkMsg[RADIOLIB_LORAWAN_FHDR_FPORT_POS(fOptsLen)] = fPort;
-
-  // select encryption key based on the target fPort
-  uint8_t* encKey = this->appSKey;
-  if(fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) {
-    encKey = this->nwkSEncKey;
+    memmove(payload, data, len);
+    data = payload;
   }
 
-  // encrypt the frame payload
-  processAES(data, len, encKey, &uplinkMsg[RADIOLIB_LORAWAN_FRAME_PAYLOAD_POS(fOptsLen)], this->fCntUp, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK, 0x00, true);
+  // encrypt and authenticate it
+  LoRaWANFrameKeys_t keys;
+  this->getFrameKeys(&keys);
+  size_t frameLen = RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN;
+  int16_t state = LoRaWANFrame::encode(&frame, data, &keys, this->retxMsg, &frameLen);
+  RADIOLIB_ASSERT(state);
+  this->retxFrame = frame;
+  this->retxLen = frameLen;
 
-  // create blocks for MIC calculation
-  uint8_t block0[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
-  block0[RADIOLIB_LORAWAN_BLOCK_MAGIC_POS] = RADIOLIB_LORAWAN_MIC_BLOCK_MAGIC;
-  block0[RADIOLIB_LORAWAN_BLOCK_DIR_POS] = RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK;
-  LoRaWANNode::hton<uint32_t>(&block0[RADIOLIB_LORAWAN_BLOCK_DEV_ADDR_POS], this->devAddr);
-  LoRaWANNode::hton<uint32_t>(&block0[RADIOLIB_LORAWAN_BLOCK_FCNT_POS], this->fCntUp);
-  block0[RADIOLIB_LORAWAN_MIC_BLOCK_LEN_POS] = uplinkMsgLen - RADIOLIB_AES128_BLOCK_SIZE - sizeof(uint32_t);
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink (FCntUp = %lu) encoded:", (unsigned long)this->fCntUp);
+  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(this->retxMsg, this->retxLen);
+  return(RADIOLIB_ERR_NONE);
+}
 
-  uint8_t block1[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
-  memcpy(block1, block0, RADIOLIB_AES128_BLOCK_SIZE);
-  if(this->confFCntDown != RADIOLIB_LORAWAN_FCNT_NONE) {
-    LoRaWANNode::hton<uint16_t>(&block1[RADIOLIB_LORAWAN_BLOCK_CONF_FCNT_POS], (uint16_t)this->confFCntDown);
-  }
-  block1[RADIOLIB_LORAWAN_MIC_DATA_RATE_POS] = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
-  block1[RADIOLIB_LORAWAN_MIC_CH_INDEX_POS] = this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK].idx;
-  
-  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink (FCntUp = %lu) decoded:", (unsigned long)this->fCntUp);
+void LoRaWANNode::getFrameKeys(LoRaWANFrameKeys_t* keys) {
+  keys->devAddr = this->devAddr;
+  keys->rev = this->rev;
+  keys->appSKey = this->appSKey;
+  keys->nwkSEncKey = this->nwkSEncKey;
+  keys->fNwkSIntKey = this->fNwkSIntKey;
+  keys->sNwkSIntKey = this->sNwkSIntKey;
+}
 
-  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(uplinkMsg, uplinkMsgLen);
+void LoRaWANNode::finishUplink(uint8_t fPort, bool isConfirmed, bool isConfirmingDown, LoRaWANEvent_t* event) {
+  // the downlink confirmation was acknowledged, so clear the counter value
+  this->confFCntDown = RADIOLIB_LORAWAN_FCNT_NONE;
 
-  // calculate authentication codes
-  memcpy(uplinkMsg, block1, RADIOLIB_AES128_BLOCK_SIZE);
-  uint32_t micS = this->generateMIC(uplinkMsg, uplinkMsgLen - sizeof(uint32_t), this->sNwkSIntKey);
-  memcpy(uplinkMsg, block0, RADIOLIB_AES128_BLOCK_SIZE);
-  uint32_t micF = this->generateMIC(uplinkMsg, uplinkMsgLen - sizeof(uint32_t), this->fNwkSIntKey);
+  // the event is kept, the retransmissions only change the channel and the attempt
+  LoRaWANEvent_t* ev = &this->uplinkEvent;
+  ev->dir = RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK;
+  ev->confirmed = isConfirmed;
+  ev->confirming = isConfirmingDown;
+  ev->datarate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  ev->freq = currentChannels[ev->dir].freq;
+  ev->power = this->txPowerMax - this->txPowerSteps * 2;
+  ev->fCnt = this->fCntUp;
+  ev->fPort = fPort;
+  ev->mcGroup = RADIOLIB_LORAWAN_MC_GROUP_NONE;
+  ev->linkAdrAction = this->linkAdrAction;
+  ev->linkAdrDr = this->linkAdrDr;
+  ev->linkAdrPower = this->txPowerMax - this->linkAdrSteps * 2;
+  ev->linkMargin = this->linkAdr ? this->linkAdr->getMargin(ev->datarate, this->txPowerSteps) : 0;
+  ev->attempt = 1;
 
-  // check LoRaWAN revision
-  if(this->rev == 1) {
-    uint32_t mic = ((uint32_t)(micF & 0x0000FF00) << 16) | ((uint32_t)(micF & 0x0000000FF) << 16) | ((uint32_t)(micS & 0x0000FF00) >> 0) | ((uint32_t)(micS & 0x0000000FF) >> 0);
-    LoRaWANNode::hton<uint32_t>(&uplinkMsg[uplinkMsgLen - sizeof(uint32_t)], mic);
-  } else {
-    LoRaWANNode::hton<uint32_t>(&uplinkMsg[uplinkMsgLen - sizeof(uint32_t)], micF);
+  // pass the extra info if requested
+  if(event) {
+    *event = *ev;
   }
-
-  // perform CSMA if enabled.
-  if (enableCSMA) {
-    performCSMA();
+  if(this->uplinkCb) {
+    this->uplinkCb(this, ev, this->uplinkCbCtx);
   }
 
-  // send it (without the MIC calculation blocks)
-  state = this->phyLayer->transmit(&uplinkMsg[RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS], uplinkMsgLen - RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS);
+  // the frame is kept for the retransmissions, MAC-only uplinks are follow-ups that are not repeated
+  this->retxAttempt = 1;
+  this->retxLeft = 0;
+  if(this->retxEnabled && (fPort != RADIOLIB_LORAWAN_FPORT_MAC_COMMAND)) {
+    uint8_t numTrans = this->nbTrans;
+    if(isConfirmed) {
+      numTrans = RADIOLIB_MAX(numTrans, this->retxConfirmedMax);
+    }
+    this->retxLeft = numTrans - 1;
+  }
 
-  // set the timestamp so that we can measure when to start receiving
-  this->rxDelayStart = mod->hal->millis();
-  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink sent <-- Rx Delay start");
+  if(this->linkAdr) {
+    this->linkAdr->addUplink(this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK], this->txPowerSteps, isConfirmed);
+  }
 
-  // calculate Time on Air of this uplink in milliseconds
-  this->lastToA = this->phyLayer->getTimeOnAir(uplinkMsgLen - RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS) / 1000;
+  // increase frame counter by one for the next uplink
+  this->fCntUp += 1;
+}
 
-  #if !RADIOLIB_STATIC_ONLY
-  delete[] uplinkMsg;
-  #endif
-  RADIOLIB_ASSERT(state);
-  
-  // the downlink confirmation was acknowledged, so clear the counter value
-  this->confFCntDown = RADIOLIB_LORAWAN_FCNT_NONE;
+size_t LoRaWANNode::dequeueMacCommands(uint8_t* buff) {
+  size_t len = this->commandsUp.len;
 
-  // pass the extra info if requested
-  if(event) {
-    event->dir = RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK;
-    event->confirmed = isConfirmed;
-    event->confirming = isConfirmingDown;
-    event->datarate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
-    event->freq = currentChannels[event->dir].freq;
-    event->power = this->txPowerMax - this->txPowerSteps * 2;
-    event->fCnt = this->fCntUp;
-    event->fPort = fPort;
+  // append all MAC replies into the buffer
+  uint8_t* ptr = buff;
+  int16_t i = 0;
+  for (; i < this->commandsUp.numCommands; i++) {
+    LoRaWANMacCommand_t cmd = this->commandsUp.commands[i];
+    memcpy(ptr, &cmd, 1 + cmd.len);
+    ptr += cmd.len + 1;
   }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink MAC payload (%d commands):", this->commandsUp.numCommands);
+  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(buff, len);
 
-  // increase frame counter by one for the next uplink
-  this->fCntUp += 1;
+  // pop the commands from back to front
+  for (; i >= 0; i--) {
+    if(this->commandsUp.commands[i].repeat > 0) {
+      this->commandsUp.commands[i].repeat--;
+    } else {
+      deleteMacCommand(this->commandsUp.commands[i].cid, &this->commandsUp);
+    }
+  }
 
-  return(RADIOLIB_ERR_NONE);
+  return(len);
 }
 
 int16_t LoRaWANNode::downlinkCommon() {
   Module* mod = this->phyLayer->getMod();
 
+  // the Rx windows are already handled by poll()
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
   // check if there are any upcoming Rx windows
   // if the Rx1 window has already started, you're too late, because most downlinks happen in Rx1
   RadioLibTime_t now = mod->hal->millis();  // fix the current timestamp to prevent negative delays
@@ -1209,35 +1478,32 @@ int16_t LoRaWANNode::downlinkCommon() {
   uint32_t irqMask = 0;
   this->phyLayer->irqRxDoneRxTimeout(irqFlags, irqMask);
 
-  this->phyLayer->setPacketReceivedAction(LoRaWANNodeOnDownlinkAction);
+  this->phyLayer->setPacketReceivedAction(this->getAction());
 
   // perform listening in the two Rx windows
   for(uint8_t i = 0; i < 2; i++) {
-    downlinkAction = false;
+    downlinkActions[this->actionSlot] = false;
 
     // calculate the Rx timeout
-    RadioLibTime_t timeoutHost = this->phyLayer->getTimeOnAir(0) + 2*this->scanGuard*1000;
+    RadioLibTime_t guard = this->rxGuard(this->rxDelays[i]);
+    RadioLibTime_t timeoutHost = this->phyLayer->getTimeOnAir(0) + 2*guard*1000;
     RadioLibTime_t timeoutMod  = this->phyLayer->calculateRxTimeout(timeoutHost);
 
-    // wait for the start of the Rx window
-    RadioLibTime_t waitLen = this->rxDelayStart + this->rxDelays[i] - mod->hal->millis();
+    // wait for the start of the Rx window, which is a bit early to cover any possible timing errors
+    RadioLibTime_t waitLen = this->rxWindowStart(i) - mod->hal->millis();
     // make sure that no underflow occured; if so, clip the delay (although this will likely miss any downlink)
     if(waitLen > this->rxDelays[i]) {
       waitLen = this->rxDelays[i];
     }
-    // the waiting duration is shortened a bit to cover any possible timing errors
-    if(waitLen > this->scanGuard) {
-      waitLen -= this->scanGuard;
-    }
     mod->hal->delay(waitLen);
 
     // open Rx window by starting receive with specified timeout
     state = this->phyLayer->startReceive(timeoutMod, irqFlags, irqMask, 0);
     RADIOLIB_ASSERT(state);
-    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening Rx%d window (%d ms timeout)... <-- Rx Delay end ", i+1, (int)(timeoutHost / 1000 + scanGuard / 2));
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening Rx%d window (%d ms timeout)... <-- Rx Delay end ", i+1, (int)(timeoutHost / 1000 + guard / 2));
     
     // wait for the timeout to complete (and a small additional delay)
-    mod->hal->delay(timeoutHost / 1000 + this->scanGuard / 2);
+    mod->hal->delay(timeoutHost / 1000 + guard / 2);
     RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Closing Rx%d window", i+1);
 
     // check if the IRQ bit for Rx Timeout is set
@@ -1247,14 +1513,7 @@ int16_t LoRaWANNode::downlinkCommon() {
     } else if(i == 0) {
       // nothing in the first window, configure for the second
       this->phyLayer->standby();
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PHY: Frequency %cL = %6.3f MHz", 'D', this->rx2.freq);
-      state = this->phyLayer->setFrequency(this->rx2.freq);
-      RADIOLIB_ASSERT(state);
-
-      DataRate_t dataRate;
-      state = findDataRate(this->rx2.drMax, &dataRate);
-      RADIOLIB_ASSERT(state);
-      state = this->phyLayer->setDataRate(dataRate);
+      state = this->setRx2Properties();
       RADIOLIB_ASSERT(state);
     }
     
@@ -1275,7 +1534,7 @@ int16_t LoRaWANNode::downlinkCommon() {
   // wait for the DIO to fire indicating a downlink is received
   now = mod->hal->millis();
   bool downlinkComplete = true;
-  while(!downlinkAction) {
+  while(!downlinkActions[this->actionSlot]) {
     mod->hal->yield();
     // this should never happen, but if it does this would be an infinite loop
     if(mod->hal->millis() - now > 3000UL) {
@@ -1340,122 +1599,119 @@ int16_t LoRaWANNode::downlink(LoRaWANEvent_t* event) {
 int16_t LoRaWANNode::downlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event) {
   // handle Rx1 and Rx2 windows - returns RADIOLIB_ERR_NONE if a downlink is received
   int16_t state = downlinkCommon();
-  RADIOLIB_ASSERT(state);
+  if(state == RADIOLIB_ERR_OPERATION_PENDING) {
+    return(state);
+  }
 
-  // get the packet length
-  size_t downlinkMsgLen = this->phyLayer->getPacketLength();
+  // read and process the received frame
+  if(state == RADIOLIB_ERR_NONE) {
+    state = this->parseDownlink(data, len, event);
+  }
 
-  // check the minimum required frame length
-  // an extra byte is subtracted because downlink frames may not have a fPort
-  if(downlinkMsgLen < RADIOLIB_LORAWAN_FRAME_LEN(0, 0) - 1 - RADIOLIB_AES128_BLOCK_SIZE) {
-    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink message too short (%lu bytes)", (unsigned long)downlinkMsgLen);
-    return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
+  // if fOptsLen for the next uplink is larger than can be piggybacked onto an uplink, send separate uplink
+  // unless the last uplink is still to be sent again, then the commands go with the next one
+  if((state == RADIOLIB_ERR_NONE) && (this->commandsUp.len > RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN) && (this->retxLeft == 0)) {
+    state = this->uplinkMacOnly(false);
+    if(state == RADIOLIB_ERR_NONE) {
+      #if RADIOLIB_STATIC_ONLY
+        uint8_t strDown[RADIOLIB_STATIC_ARRAY_SIZE];
+      #else
+        uint8_t* strDown = new uint8_t[this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK]]];
+      #endif
+      size_t lenDown = 0;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Receiving after MAC-only uplink .. ");
+      state = this->downlink(strDown, &lenDown);
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN(" .. state: %d", state);
+      #if !RADIOLIB_STATIC_ONLY
+        delete[] strDown;
+      #endif
+    }
   }
 
-  // build the buffer for the downlink message
-  // the first 16 bytes are reserved for MIC calculation block
-  #if !RADIOLIB_STATIC_ONLY
-    uint8_t* downlinkMsg = new uint8_t[RADIOLIB_AES128_BLOCK_SIZE + downlinkMsgLen];
+  // Class C devices keep listening until the next uplink
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_C) {
+    int16_t stateClassC = this->startReceiveClassC();
+    RADIOLIB_ASSERT(stateClassC);
+  }
+
+  return(state);
+}
+
+int16_t LoRaWANNode::uplinkMacOnly(bool async) {
+  size_t fOptsBufSize = this->commandsUp.len;
+  #if RADIOLIB_STATIC_ONLY
+    uint8_t fOptsBuff[RADIOLIB_STATIC_ARRAY_SIZE];
   #else
-    uint8_t downlinkMsg[RADIOLIB_STATIC_ARRAY_SIZE];
+    uint8_t* fOptsBuff = new uint8_t[fOptsBufSize];
+  #endif
+
+  // append all MAC replies into fOpts buffer
+  this->dequeueMacCommands(fOptsBuff);
+
+  this->isMACPayload = true;
+  // temporarily lift dutyCycle restrictions to allow immediate MAC response
+  bool prevDC = this->dutyCycleEnabled;
+  this->dutyCycleEnabled = false;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Sending MAC-only uplink .. ");
+  int16_t state;
+  if(async) {
+    state = this->startUplink(fOptsBuff, fOptsBufSize, RADIOLIB_LORAWAN_FPORT_MAC_COMMAND);
+  } else {
+    state = this->uplink(fOptsBuff, fOptsBufSize, RADIOLIB_LORAWAN_FPORT_MAC_COMMAND);
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN(" .. state: %d", state);
+  this->dutyCycleEnabled = prevDC;
+  #if !RADIOLIB_STATIC_ONLY
+    delete[] fOptsBuff;
   #endif
+  return(state);
+}
+
+int16_t LoRaWANNode::parseDownlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event) {
+  int16_t state = RADIOLIB_ERR_UNKNOWN;
+
+  // get the packet length
+  size_t downlinkMsgLen = this->phyLayer->getPacketLength();
+  if(downlinkMsgLen > RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN) {
+    return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
+  }
 
   // read the data
-  state = this->phyLayer->readData(&downlinkMsg[RADIOLIB_AES128_BLOCK_SIZE], downlinkMsgLen);
+  uint8_t downlinkMsg[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN];
+  state = this->phyLayer->readData(downlinkMsg, downlinkMsgLen);
   // downlink frames are sent without CRC, which will raise error on SX127x
   // we can ignore that error
   if(state == RADIOLIB_ERR_LORA_HEADER_DAMAGED) {
     state = RADIOLIB_ERR_NONE;
   }
-  
-  if(state != RADIOLIB_ERR_NONE) {
-    #if !RADIOLIB_STATIC_ONLY
-      delete[] downlinkMsg;
-    #endif
-    return(state);
-  }
+  RADIOLIB_ASSERT(state);
 
-  // check the address
-  uint32_t addr = LoRaWANNode::ntoh<uint32_t>(&downlinkMsg[RADIOLIB_LORAWAN_FHDR_DEV_ADDR_POS]);
-  if(addr != this->devAddr) {
-    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Device address mismatch, expected 0x%08X, got 0x%08X", this->devAddr, addr);
-    #if !RADIOLIB_STATIC_ONLY
-      delete[] downlinkMsg;
-    #endif
+  // check the minimum required frame length and the frame header
+  // downlink frames may not have a fPort
+  LoRaWANFrame_t frame;
+  if(LoRaWANFrame::parse(downlinkMsg, downlinkMsgLen, &frame) != RADIOLIB_ERR_NONE) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink message malformed (%lu bytes)", (unsigned long)downlinkMsgLen);
     return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
   }
 
-  // calculate length of FOpts and payload
-  uint8_t fOptsLen = downlinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] & RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK;
-
-  // check if the ACK bit is set, indicating this frame acknowledges the previous uplink
-  bool isConfirmingUp = false;
-  if((downlinkMsg[RADIOLIB_LORAWAN_FHDR_FCTRL_POS] & RADIOLIB_LORAWAN_FCTRL_ACK)) {
-    isConfirmingUp = true;
+  // check the address, frames that are not for this device may still be for one of its multicast groups
+  if(frame.devAddr != this->devAddr) {
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_MC_GROUPS; i++) {
+      if(this->mcGroups[i].defined && (this->mcGroups[i].mcAddr == frame.devAddr)) {
+        return(this->parseMulticast(downlinkMsg, downlinkMsgLen, &frame, i, data, len, event));
+      }
+    }
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Device address mismatch, expected 0x%08X, got 0x%08X", this->devAddr, frame.devAddr);
+    return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
   }
 
-  // total - MHDR(1) - DevAddr(4) - FCtrl(1) - FCnt(2) - FOpts - MIC(4)
-  // potentially also an FPort, but we'll find out soon enough
-  uint8_t payLen = downlinkMsgLen - 1 - 4 - 1 - 2 - fOptsLen - 4;
-
-  // get the frame counter
-  uint16_t fCnt16 = LoRaWANNode::ntoh<uint16_t>(&downlinkMsg[RADIOLIB_LORAWAN_FHDR_FCNT_POS]);
-
-  // set the MIC calculation blocks
-  memset(downlinkMsg, 0x00, RADIOLIB_AES128_BLOCK_SIZE);
-  downlinkMsg[RADIOLIB_LORAWAN_BLOCK_MAGIC_POS] = RADIOLIB_LORAWAN_MIC_BLOCK_MAGIC;
-  // if this downlink is confirming an uplink, the MIC was generated with the least-significant 16 bits of that fCntUp
-  if(isConfirmingUp && (this->rev == 1)) {
-    LoRaWANNode::hton<uint16_t>(&downlinkMsg[RADIOLIB_LORAWAN_BLOCK_CONF_FCNT_POS], (uint16_t)this->confFCntUp);
-  }
-  downlinkMsg[RADIOLIB_LORAWAN_BLOCK_DIR_POS] = RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK;
-  LoRaWANNode::hton<uint32_t>(&downlinkMsg[RADIOLIB_LORAWAN_BLOCK_DEV_ADDR_POS], this->devAddr);
-  LoRaWANNode::hton<uint16_t>(&downlinkMsg[RADIOLIB_LORAWAN_BLOCK_FCNT_POS], fCnt16);
-  downlinkMsg[RADIOLIB_LORAWAN_MIC_BLOCK_LEN_POS] = downlinkMsgLen - sizeof(uint32_t);
- 
-  // check the MIC
-  if(!verifyMIC(downlinkMsg, RADIOLIB_AES128_BLOCK_SIZE + downlinkMsgLen, this->sNwkSIntKey)) {
-    #if !RADIOLIB_STATIC_ONLY
-      delete[] downlinkMsg;
-    #endif
-    return(RADIOLIB_ERR_CRC_MISMATCH);
-  }
+  // check if the ACK bit is set, indicating this frame acknowledges the previous uplink
+  bool isConfirmingUp = (frame.fCtrl & RADIOLIB_LORAWAN_FCTRL_ACK);
 
   // in LoRaWAN v1.1, a frame is a Network frame if there is no Application payload
   // i.e.: either no payload at all (empty frame or FOpts only), or MAC only payload (FPort = 0)
-  uint8_t fPort = RADIOLIB_LORAWAN_FPORT_MAC_COMMAND;
-  bool isAppDownlink = false;
-  if(this->rev == 0) {
-    isAppDownlink = true;
-  }
-  if(payLen > 0) {
-    payLen -= 1;  // subtract one as fPort is set
-    fPort = downlinkMsg[RADIOLIB_LORAWAN_FHDR_FPORT_POS(fOptsLen)];
-    // check if fPort value is actually allowed
-    if(fPort > RADIOLIB_LORAWAN_FPORT_RESERVED) {
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Received downlink at FPort %d - rejected! This FPort is RFU!", fPort);
-      #if !RADIOLIB_STATIC_ONLY
-        delete[] downlinkMsg;
-      #endif
-      return(RADIOLIB_ERR_INVALID_PORT);
-    }
-    if(fPort == RADIOLIB_LORAWAN_FPORT_TS009 && this->TS009 == false) {
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Received downlink at FPort %d - rejected! TS009 was not enabled.", fPort);
-      #if !RADIOLIB_STATIC_ONLY
-        delete[] downlinkMsg;
-      #endif
-      return(RADIOLIB_ERR_INVALID_PORT);
-    }
-
-    if(fPort > RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) {
-      isAppDownlink = true;
-    } else {
-      fOptsLen = payLen;
-    }
-  }
-
-  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink (%sFCntDown = %d) encoded:", isAppDownlink ? "A" : "N", fCnt16);
-  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(downlinkMsg, RADIOLIB_AES128_BLOCK_SIZE + downlinkMsgLen);
+  uint8_t fPort = frame.hasFPort ? frame.fPort : RADIOLIB_LORAWAN_FPORT_MAC_COMMAND;
+  bool isAppDownlink = (this->rev == 0) || (fPort > RADIOLIB_LORAWAN_FPORT_MAC_COMMAND);
 
   // check the fCntDown value (Network or Application)
   uint32_t fCntDownPrev = 0;
@@ -1465,23 +1721,49 @@ int16_t LoRaWANNode::downlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event)
     fCntDownPrev = this->nFCntDown;
   }
 
+  // only the 16 least significant bits are sent, take the rest from the last heard fCnt
   // if this is not the first downlink...
   // assume a 16-bit to 32-bit rollover if difference between counters in LSB is smaller than MAX_FCNT_GAP
   // if that isn't the case and the received fCnt is smaller or equal to the last heard fCnt, then error
-  uint32_t fCnt32 = fCnt16;
+  uint16_t fCnt16 = (uint16_t)frame.fCnt;
+  uint32_t fCnt32 = (fCntDownPrev & 0xFFFF0000) | fCnt16;
+  bool fCntValid = true;
   if(fCntDownPrev > 0) {
-    if((fCnt16 <= fCntDownPrev) && ((0xFFFF - (uint16_t)fCntDownPrev + fCnt16) > RADIOLIB_LORAWAN_MAX_FCNT_GAP)) {
-      #if !RADIOLIB_STATIC_ONLY
-        delete[] downlinkMsg;
-      #endif
-      if (isAppDownlink) {
-        return(RADIOLIB_ERR_A_FCNT_DOWN_INVALID);
-      } else {
-        return(RADIOLIB_ERR_N_FCNT_DOWN_INVALID);
-      }
-    } else if (fCnt16 <= fCntDownPrev) {
-      uint16_t msb = (fCntDownPrev >> 16) + 1;  // assume a rollover
-      fCnt32 |= ((uint32_t)msb << 16);          // add back the MSB part
+    if((fCnt16 <= (uint16_t)fCntDownPrev) && ((0xFFFF - (uint16_t)fCntDownPrev + fCnt16) > RADIOLIB_LORAWAN_MAX_FCNT_GAP)) {
+      fCntValid = false;
+    } else if (fCnt16 <= (uint16_t)fCntDownPrev) {
+      fCnt32 += 0x10000;  // assume a rollover
+    }
+  }
+
+  // check the MIC
+  // if this downlink is confirming an uplink, the MIC was generated with the least-significant 16 bits of that fCntUp
+  LoRaWANFrameKeys_t keys;
+  this->getFrameKeys(&keys);
+  frame.fCnt = fCnt32;
+  frame.confFCnt = (uint16_t)this->confFCntUp;
+  if(!LoRaWANFrame::verifyMIC(downlinkMsg, downlinkMsgLen, &frame, &keys)) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+
+  // check if fPort value is actually allowed
+  if(fPort > RADIOLIB_LORAWAN_FPORT_RESERVED) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Received downlink at FPort %d - rejected! This FPort is RFU!", fPort);
+    return(RADIOLIB_ERR_INVALID_PORT);
+  }
+  if(fPort == RADIOLIB_LORAWAN_FPORT_TS009 && this->TS009 == false) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Received downlink at FPort %d - rejected! TS009 was not enabled.", fPort);
+    return(RADIOLIB_ERR_INVALID_PORT);
+  }
+
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink (%sFCntDown = %d) encoded:", isAppDownlink ? "A" : "N", fCnt16);
+  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(downlinkMsg, downlinkMsgLen);
+
+  if(!fCntValid) {
+    if (isAppDownlink) {
+      return(RADIOLIB_ERR_A_FCNT_DOWN_INVALID);
+    } else {
+      return(RADIOLIB_ERR_N_FCNT_DOWN_INVALID);
     }
   }
   
@@ -1492,38 +1774,38 @@ int16_t LoRaWANNode::downlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event)
     this->nFCntDown = fCnt32;
   }
 
+  // the network heard the uplink, so it is not sent again - unless it was confirmed and this is not the acknowledgement
+  if(isConfirmingUp || (this->retxFrame.mType != RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP)) {
+    this->retxLeft = 0;
+  }
+
+  // the downlink tells how good the link is, Rx1 and Rx2 use the same bandwidth in all the regions
+  if(this->linkAdr) {
+    this->linkAdr->addDownlink(this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK], this->phyLayer->getSNR(), this->phyLayer->getRSSI(), isConfirmingUp);
+  }
+
   // if this is a confirmed frame, save the downlink number (only app frames can be confirmed)
   bool isConfirmedDown = false;
-  if((downlinkMsg[RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS] & 0xFE) == RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_DOWN) {
+  if(frame.mType == RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_DOWN) {
     this->confFCntDown = this->aFCntDown;
     isConfirmedDown = true;
   }
 
+  // decrypt the FOpts and the payload in place
+  // TODO it COULD be the case that the assumed FCnt rollover is incorrect, if possible figure out a way to catch this and retry with just fCnt16
+  uint8_t* payload = &downlinkMsg[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(frame.fOptsLen)];
+  LoRaWANFrame::decrypt(downlinkMsg, &frame, &keys, payload);
+
+  // the MAC commands are either piggy-backed in the FOpts, or they are the payload of a frame on fPort 0
+  uint8_t* fOpts = frame.fOpts;
+  uint8_t fOptsLen = frame.fOptsLen;
+  if((fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) && (frame.payloadLen > 0)) {
+    fOpts = payload;
+    fOptsLen = frame.payloadLen;
+  }
+
   // process FOpts (if there are any)
   if(fOptsLen > 0) {
-    // there are some Fopts, decrypt them
-    #if !RADIOLIB_STATIC_ONLY
-      uint8_t* fOpts = new uint8_t[RADIOLIB_MAX(RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK, (int)fOptsLen)];
-    #else
-      uint8_t fOpts[RADIOLIB_STATIC_ARRAY_SIZE];
-    #endif
-
-    // TODO it COULD be the case that the assumed FCnt rollover is incorrect, if possible figure out a way to catch this and retry with just fCnt16
-    // if there are <= 15 bytes of FOpts, they are in the FHDR, otherwise they are in the payload
-    // in case of the latter, process AES is if it were a normal payload but using the NwkSEncKey
-    if(fOptsLen <= RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK) {
-      if(this->rev == 1) {
-        // in LoRaWAN v1.1, the piggy-backed FOpts are encrypted using the NwkSEncKey
-        uint8_t ctrId = 0x01 + isAppDownlink; // see LoRaWAN v1.1 errata
-        processAES(&downlinkMsg[RADIOLIB_LORAWAN_FHDR_FOPTS_POS], (size_t)fOptsLen, this->nwkSEncKey, fOpts, fCnt32, RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK, ctrId, true);
-      } else {
-        // in LoRaWAN v1.0.x, the piggy-backed FOpts are unencrypted
-        memcpy(fOpts, &downlinkMsg[RADIOLIB_LORAWAN_FHDR_FOPTS_POS], (size_t)fOptsLen);
-      }
-    } else {
-      processAES(&downlinkMsg[RADIOLIB_LORAWAN_FRAME_PAYLOAD_POS(0)], (size_t)fOptsLen, this->nwkSEncKey, fOpts, fCnt32, RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK, 0x00, true);
-    }
-
     bool hasADR = false;
     uint8_t numADR = 0;
     uint8_t lastCID = 0;
@@ -1568,67 +1850,6 @@ int16_t LoRaWANNode::downlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event)
       fOptsPtrDn += (macLen + 1);
       lastCID = cid;
     }
-
-    #if !RADIOLIB_STATIC_ONLY
-      delete[] fOpts;
-    #endif
-
-    // if fOptsLen for the next uplink is larger than can be piggybacked onto an uplink, send separate uplink
-    if(this->commandsUp.len > RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN) {
-      size_t fOptsBufSize = this->commandsUp.len;
-      #if RADIOLIB_STATIC_ONLY
-        uint8_t fOptsBuff[RADIOLIB_STATIC_ARRAY_SIZE];
-      #else
-        uint8_t* fOptsBuff = new uint8_t[fOptsBufSize];
-      #endif
-      uint8_t* fOptsPtrUp = fOptsBuff;
-      // append all MAC replies into fOpts buffer
-      int16_t i = 0;
-      for (; i < this->commandsUp.numCommands; i++) {
-        LoRaWANMacCommand_t cmd = this->commandsUp.commands[i];
-        memcpy(fOptsPtrUp, &cmd, 1 + cmd.len);
-        fOptsPtrUp += cmd.len + 1;
-      }
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink MAC payload (%d commands):", this->commandsUp.numCommands);
-      RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(fOptsBuff, fOptsBufSize);
-
-      // pop the commands from back to front
-      for (; i >= 0; i--) {
-        if(this->commandsUp.commands[i].repeat > 0) {
-          this->commandsUp.commands[i].repeat--;
-        } else {
-          deleteMacCommand(this->commandsUp.commands[i].cid, &this->commandsUp);
-        }
-      }
-
-      this->isMACPayload = true;
-      // temporarily lift dutyCycle restrictions to allow immediate MAC response
-      bool prevDC = this->dutyCycleEnabled;
-      this->dutyCycleEnabled = false;
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Sending MAC-only uplink .. ");
-      state = this->uplink(fOptsBuff, fOptsBufSize, RADIOLIB_LORAWAN_FPORT_MAC_COMMAND);
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN(" .. state: %d", state);
-      this->dutyCycleEnabled = prevDC;
-      #if !RADIOLIB_STATIC_ONLY
-        delete[] fOptsBuff;
-      #endif
-      RADIOLIB_ASSERT(state);
-
-      #if RADIOLIB_STATIC_ONLY
-        uint8_t strDown[RADIOLIB_STATIC_ARRAY_SIZE];
-      #else
-        uint8_t* strDown = new uint8_t[this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK]]];
-      #endif
-      size_t lenDown = 0;
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Receiving after MAC-only uplink .. ");
-      state = this->downlink(strDown, &lenDown);
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN(" .. state: %d", state);
-      #if !RADIOLIB_STATIC_ONLY
-        delete[] strDown;
-      #endif
-      RADIOLIB_ASSERT(state);
-    }
-
   }
 
   // a downlink was received, so reset the ADR counter to the last uplink's fCnt
@@ -1644,72 +1865,1834 @@ int16_t LoRaWANNode::downlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event)
     event->power = this->txPowerMax - this->txPowerSteps * 2;
     event->fCnt = isAppDownlink ? this->aFCntDown : this->nFCntDown;
     event->fPort = fPort;
+    event->mcGroup = RADIOLIB_LORAWAN_MC_GROUP_NONE;
+    event->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE;
+    event->linkAdrDr = event->datarate;
+    event->linkAdrPower = event->power;
+    event->linkMargin = 0;
+    event->attempt = 0;
   }
 
   // if MAC-only payload, return now
   if(fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) {
     // no payload
-    *len = 0;
-    #if !RADIOLIB_STATIC_ONLY
-      delete[] downlinkMsg;
-    #endif
+    if(len) {
+      *len = 0;
+    }
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  // pass the Application payload, unless the caller is not interested in it
+  if(len) {
+    *len = frame.payloadLen;
+  }
+  if(data) {
+    memcpy(data, payload, frame.payloadLen);
+  }
+
+  // application layer packages must be processed even if the caller is not interested in the payload
+  if(this->isPackagePort(fPort)) {
+    this->execPackage(fPort, payload, frame.payloadLen, RADIOLIB_LORAWAN_MC_GROUP_NONE);
+  }
+
+  return(RADIOLIB_ERR_NONE);
+}
+
+#if defined(RADIOLIB_BUILD_ARDUINO)
+int16_t LoRaWANNode::sendReceive(String& strUp, uint8_t fPort, String& strDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  // build a temporary buffer
+  // LoRaWAN downlinks can have 250 bytes at most with 1 extra byte for NULL
+  size_t length = 0;
+  uint8_t data[251];
+
+  // send the uplink and wait for the downlink
+  int16_t state = this->sendReceive((uint8_t*)strUp.c_str(), strUp.length(), fPort, data, &length, isConfirmed, eventUp, eventDown);
+  if(state == RADIOLIB_ERR_NONE) {
+    // add null terminator
+    data[length] = '\0';
+
+    // initialize Arduino String class
+    strDown = String((char*)data);
+  }
+
+  return(state);
+}
+#endif
+
+int16_t LoRaWANNode::sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  return(this->sendReceive(dataUp, lenUp, fPort, NULL, NULL, isConfirmed, eventUp, eventDown));
+}
+
+int16_t LoRaWANNode::sendReceive(const char* strUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  return(this->sendReceive((uint8_t*)strUp, strlen(strUp), fPort, dataDown, lenDown, isConfirmed, eventUp, eventDown));
+}
+
+int16_t LoRaWANNode::sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  // send the uplink
+  int16_t state = this->uplink(dataUp, lenUp, fPort, isConfirmed, eventUp);
+  RADIOLIB_ASSERT(state);
+
+  // wait for the downlink
+  state = this->downlink(dataDown, lenDown, eventDown);
+
+  // send the same frame again until the network answers or the transmissions run out
+  while(this->scheduleRetransmission(state)) {
+    this->phyLayer->getMod()->hal->delay(this->timeUntilRetransmit());
+    state = this->retransmit(eventUp, false);
+    RADIOLIB_ASSERT(state);
+    state = this->downlink(dataDown, lenDown, eventDown);
+  }
+  return(state);
+}
+
+int16_t LoRaWANNode::startUplink(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  // check the uplink can be sent and configure the physical layer for it
+  uint8_t fOptsLen = 0;
+  bool adrAckReq = false;
+  int16_t state = this->prepareUplink(&dataUp, &lenUp, fPort, &fOptsLen, &adrAckReq);
+  RADIOLIB_ASSERT(state);
+
+  // build the uplink message
+  bool isConfirmingDown = false;
+  state = this->buildUplink(dataUp, lenUp, fPort, isConfirmed, fOptsLen, adrAckReq, &isConfirmingDown);
+  RADIOLIB_ASSERT(state);
+
+  // perform CSMA if enabled.
+  if (enableCSMA) {
+    performCSMA();
+  }
+
+  // start transmitting, the frame is in the radio buffer once this returns
+  downlinkActions[this->actionSlot] = false;
+  this->phyLayer->setPacketSentAction(this->getAction());
+  state = this->phyLayer->startTransmit(this->retxMsg, this->retxLen);
+  this->lastToA = this->phyLayer->getTimeOnAir(this->retxLen) / 1000;
+  if(state != RADIOLIB_ERR_NONE) {
+    this->phyLayer->clearPacketSentAction();
+    return(state);
+  }
+  this->consumeDutyCycle(this->channelLast, this->lastToA);
+
+  // the frame counter is used up even if the transmission fails later on
+  this->finishUplink(fPort, isConfirmed, isConfirmingDown, eventUp);
+
+  this->asyncEventUp = eventUp;
+  this->asyncDataDown = dataDown;
+  this->asyncLenDown = lenDown;
+  this->asyncEventDown = eventDown;
+  this->asyncMacOnly = false;
+  this->asyncStart = this->phyLayer->getMod()->hal->millis();
+  // in case the interrupt never comes, give up after a generous multiple of the time-on-air
+  this->asyncTimeout = 5*this->lastToA + this->scanGuard;
+  this->asyncState = RADIOLIB_LORAWAN_ASYNC_TX;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::poll() {
+  Module* mod = this->phyLayer->getMod();
+  RadioLibTime_t now = mod->hal->millis();
+  int16_t state = RADIOLIB_ERR_NONE;
+
+  switch(this->asyncState) {
+    case(RADIOLIB_LORAWAN_ASYNC_IDLE):
+      // Class B beacons and ping slots are scheduled in between the exchanges
+      if(this->lwClass == RADIOLIB_LORAWAN_CLASS_B) {
+        return(this->pollClassB(now));
+      }
+      return(RADIOLIB_ERR_NONE);
+
+    case(RADIOLIB_LORAWAN_ASYNC_TX): {
+      if(!downlinkActions[this->actionSlot]) {
+        if(now - this->asyncStart <= this->asyncTimeout) {
+          return(RADIOLIB_ERR_OPERATION_PENDING);
+        }
+        this->phyLayer->finishTransmit();
+        this->phyLayer->clearPacketSentAction();
+        return(this->completeAsync(RADIOLIB_ERR_TX_TIMEOUT));
+      }
+
+      // set the timestamp so that we can measure when to start receiving
+      // poll() may come long after the transmission ended, in that case count from the end of the time-on-air
+      RadioLibTime_t txEnd = this->asyncStart + this->lastToA;
+      this->rxDelayStart = RADIOLIB_MIN(now, txEnd);
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink sent <-- Rx Delay start");
+      this->phyLayer->finishTransmit();
+      this->phyLayer->clearPacketSentAction();
+
+      // set the physical layer configuration for downlink
+      state = this->setPhyProperties(RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK);
+      if(state != RADIOLIB_ERR_NONE) {
+        return(this->completeAsync(state));
+      }
+      this->asyncIrqFlags = 0;
+      this->asyncIrqMask = 0;
+      this->phyLayer->irqRxDoneRxTimeout(this->asyncIrqFlags, this->asyncIrqMask);
+      this->phyLayer->setPacketReceivedAction(this->getAction());
+      this->asyncWindow = 0;
+      this->asyncState = RADIOLIB_LORAWAN_ASYNC_RX_WAIT;
+      return(this->pollRxWindow(now));
+    }
+
+    case(RADIOLIB_LORAWAN_ASYNC_RX_WAIT):
+      return(this->pollRxWindow(now));
+
+    case(RADIOLIB_LORAWAN_ASYNC_RX): {
+      // a received packet ends the window early, otherwise wait for the timeout to complete
+      if(!downlinkActions[this->actionSlot] && (now - this->asyncStart < this->asyncTimeout)) {
+        return(RADIOLIB_ERR_OPERATION_PENDING);
+      }
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Closing Rx%d window", this->asyncWindow + 1);
+
+      // check if the IRQ bit for Rx Timeout is set
+      if(!this->phyLayer->isRxTimeout()) {
+        this->asyncStart = now;
+        this->asyncState = RADIOLIB_LORAWAN_ASYNC_RX_DONE;
+        return(this->poll());
+      }
+
+      return(this->nextRxWindow(now));
+    }
+
+    case(RADIOLIB_LORAWAN_ASYNC_RX_DONE): {
+      // wait for the DIO to fire indicating a downlink is received
+      if(!downlinkActions[this->actionSlot]) {
+        // this should never happen, but if it does, do not wait forever
+        if(now - this->asyncStart <= 3000UL) {
+          return(RADIOLIB_ERR_OPERATION_PENDING);
+        }
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink missing!");
+        this->rxDelayEnd = now;
+        return(this->completeAsync(RADIOLIB_LORAWAN_NO_DOWNLINK));
+      }
+
+      // Rx windows are now closed, go to standby and reset the IQ inversion
+      this->rxDelayEnd = now;
+      this->phyLayer->standby();
+      this->phyLayer->clearPacketReceivedAction();
+      if(this->modulation == RADIOLIB_LORAWAN_MODULATION_LORA) {
+        state = this->phyLayer->invertIQ(false);
+        if(state != RADIOLIB_ERR_NONE) {
+          return(this->completeAsync(state));
+        }
+      }
+
+      // the follow-up exchange does not overwrite the user's downlink
+      if(this->asyncMacOnly) {
+        state = this->parseDownlink(NULL, NULL, NULL);
+      } else {
+        state = this->parseDownlink(this->asyncDataDown, this->asyncLenDown, this->asyncEventDown);
+      }
+      if((state != RADIOLIB_ERR_NONE) || this->asyncMacOnly || (this->retxLeft > 0) || (this->commandsUp.len <= RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN)) {
+        return(this->completeAsync(state));
+      }
+
+      // the MAC replies do not fit into FOpts, send them in a separate exchange
+      this->asyncState = RADIOLIB_LORAWAN_ASYNC_IDLE;
+      state = this->uplinkMacOnly(true);
+      if(state != RADIOLIB_ERR_NONE) {
+        return(this->completeAsync(state));
+      }
+      this->asyncMacOnly = true;
+      return(RADIOLIB_ERR_OPERATION_PENDING);
+    }
+
+    case(RADIOLIB_LORAWAN_ASYNC_RETX_WAIT): {
+      if(this->timeUntilRetransmit() > 0) {
+        return(RADIOLIB_ERR_OPERATION_PENDING);
+      }
+      state = this->retransmit(this->asyncEventUp, true);
+      if(state != RADIOLIB_ERR_NONE) {
+        return(this->completeAsync(state));
+      }
+      return(RADIOLIB_ERR_OPERATION_PENDING);
+    }
+  }
+
+  return(RADIOLIB_ERR_UNKNOWN);
+}
+
+RadioLibTime_t LoRaWANNode::rxWindowStart(uint8_t window) {
+  // the window is opened a bit early to cover any possible timing errors
+  RadioLibTime_t guard = this->rxGuard(this->rxDelays[window]);
+  RadioLibTime_t windowStart = this->rxDelayStart + this->clockDelay(this->rxDelays[window]);
+  if(this->rxDelays[window] > guard) {
+    windowStart -= guard;
+  }
+  return(windowStart);
+}
+
+RadioLibTime_t LoRaWANNode::rxGuard(RadioLibTime_t delay) {
+  // without a measured drift, the padding has to cover all timing errors
+  if(!this->clockDriftValid) {
+    return(this->scanGuard);
+  }
+
+  // otherwise only the residual drift adds to the timing errors of the host
+  return(RADIOLIB_MIN(this->scanGuardSync + this->clockResidual(delay), this->scanGuard));
+}
+
+int16_t LoRaWANNode::pollRxWindow(RadioLibTime_t now) {
+  RadioLibTime_t windowStart = this->rxWindowStart(this->asyncWindow);
+  if(now < windowStart) {
+    if(this->lwClass != RADIOLIB_LORAWAN_CLASS_C) {
+      return(RADIOLIB_ERR_OPERATION_PENDING);
+    }
+
+    // Class C devices listen with the Rx2 parameters outside of the Rx windows
+    if(downlinkActions[this->actionSlot]) {
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Downlink received in RxC window");
+      this->asyncStart = now;
+      this->asyncState = RADIOLIB_LORAWAN_ASYNC_RX_DONE;
+      return(this->poll());
+    }
+    if(!this->asyncRxC) {
+      int16_t state = this->startReceiveClassC();
+      if(state != RADIOLIB_ERR_NONE) {
+        return(this->completeAsync(state));
+      }
+      this->asyncRxC = true;
+    }
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  // Rx1 takes precedence over the continuous reception
+  if(this->asyncRxC) {
+    this->phyLayer->standby();
+    this->asyncRxC = false;
+    if(this->asyncWindow == 0) {
+      int16_t state = this->setPhyProperties(RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK);
+      if(state != RADIOLIB_ERR_NONE) {
+        return(this->completeAsync(state));
+      }
+    }
+  }
+
+  // calculate the Rx timeout
+  RadioLibTime_t guard = this->rxGuard(this->rxDelays[this->asyncWindow]);
+  RadioLibTime_t timeoutHost = this->phyLayer->getTimeOnAir(0) + 2*guard*1000;
+  RadioLibTime_t timeoutMod  = this->phyLayer->calculateRxTimeout(timeoutHost);
+
+  // if poll() was not called in time, it is pointless to open this window
+  if(now >= windowStart + timeoutHost / 1000) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Missed Rx%d window", this->asyncWindow + 1);
+    return(this->nextRxWindow(now));
+  }
+
+  // open Rx window by starting receive with specified timeout
+  downlinkActions[this->actionSlot] = false;
+  int16_t state = this->phyLayer->startReceive(timeoutMod, this->asyncIrqFlags, this->asyncIrqMask, 0);
+  if(state != RADIOLIB_ERR_NONE) {
+    return(this->completeAsync(state));
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening Rx%d window (%d ms timeout)... <-- Rx Delay end ", this->asyncWindow + 1, (int)(timeoutHost / 1000 + guard / 2));
+
+  // wait for the timeout to complete (and a small additional delay)
+  this->asyncStart = now;
+  this->asyncTimeout = timeoutHost / 1000 + guard / 2;
+  this->asyncState = RADIOLIB_LORAWAN_ASYNC_RX;
+  return(RADIOLIB_ERR_OPERATION_PENDING);
+}
+
+int16_t LoRaWANNode::nextRxWindow(RadioLibTime_t now) {
+  this->phyLayer->standby();
+  if(this->asyncWindow > 0) {
+    // Rx windows are now closed
+    this->rxDelayEnd = now;
+    return(this->completeAsync(RADIOLIB_LORAWAN_NO_DOWNLINK));
+  }
+
+  // nothing in the first window, configure for the second
+  int16_t state = this->setRx2Properties();
+  if(state != RADIOLIB_ERR_NONE) {
+    return(this->completeAsync(state));
+  }
+  this->asyncWindow = 1;
+  this->asyncState = RADIOLIB_LORAWAN_ASYNC_RX_WAIT;
+  return(this->pollRxWindow(now));
+}
+
+int16_t LoRaWANNode::completeAsync(int16_t state) {
+  // stop ongoing activities and reset the IQ inversion
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_TX) {
+    this->phyLayer->standby();
+    this->phyLayer->clearPacketReceivedAction();
+    if(this->modulation == RADIOLIB_LORAWAN_MODULATION_LORA) {
+      this->phyLayer->invertIQ(false);
+    }
+  }
+
+  this->asyncRxC = false;
+
+  // the exchange goes on with a retransmission, if the network did not answer
+  if(this->scheduleRetransmission(state)) {
+    this->asyncState = RADIOLIB_LORAWAN_ASYNC_RETX_WAIT;
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  this->asyncState = RADIOLIB_LORAWAN_ASYNC_IDLE;
+  this->asyncMacOnly = false;
+
+  // Class C devices keep listening until the next uplink
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_C) {
+    int16_t stateClassC = this->startReceiveClassC();
+    if(state == RADIOLIB_ERR_NONE) {
+      state = stateClassC;
+    }
+  }
+
+  if(this->asyncCb) {
+    this->asyncCb(this, state, this->asyncCbCtx);
+  }
+  return(state);
+}
+
+void LoRaWANNode::setEventAction(LoRaWANEventCb_t func, void* ctx) {
+  this->asyncCb = func;
+  this->asyncCbCtx = ctx;
+}
+
+void LoRaWANNode::setUplinkAction(LoRaWANUplinkCb_t func, void* ctx) {
+  this->uplinkCb = func;
+  this->uplinkCbCtx = ctx;
+}
+
+void LoRaWANNode::setRetransmissions(bool enable, uint8_t maxConfirmed) {
+  this->retxEnabled = enable;
+  this->retxConfirmedMax = RADIOLIB_MIN(maxConfirmed, RADIOLIB_LORAWAN_RETRANSMIT_MAX);
+  if(!enable) {
+    this->retxLeft = 0;
+  }
+}
+
+bool LoRaWANNode::scheduleRetransmission(int16_t state) {
+  // a frame that was corrupted or not for this device is not an answer, anything else is an error
+  bool noAnswer = (state == RADIOLIB_ERR_NONE) || (state == RADIOLIB_LORAWAN_NO_DOWNLINK) ||
+                  (state == RADIOLIB_ERR_DOWNLINK_MALFORMED) || (state == RADIOLIB_ERR_CRC_MISMATCH);
+  if(!noAnswer) {
+    this->retxLeft = 0;
+  }
+  if(this->retxLeft == 0) {
+    return(false);
+  }
+
+  // the random delay keeps devices that lost their frames in the same collision from colliding again
+  this->retxNext = this->rxDelayEnd + this->phyLayer->random(RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MIN_MS, RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MAX_MS + 1);
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Retransmission %d of FCntUp = %lu in %lu ms", this->retxAttempt + 1, (unsigned long)this->retxFrame.fCnt, (unsigned long)this->timeUntilRetransmit());
+  return(true);
+}
+
+RadioLibTime_t LoRaWANNode::timeUntilRetransmit() {
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  RadioLibTime_t wait = (this->retxNext > now) ? this->retxNext - now : 0;
+  if(this->dutyCycleEnabled) {
+    wait = RADIOLIB_MAX(wait, this->timeUntilUplink());
+  }
+  return(wait);
+}
+
+int16_t LoRaWANNode::retransmit(LoRaWANEvent_t* event, bool async) {
+  // whatever happens, this transmission counts
+  this->retxLeft--;
+  this->retxAttempt++;
+
+  // hop to another channel, the datarate and power stay the same
+  int16_t state = this->selectChannels(true);
+  RADIOLIB_ASSERT(state);
+  state = this->setPhyProperties(RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK);
+  RADIOLIB_ASSERT(state);
+
+  // perform CSMA if enabled.
+  if (enableCSMA) {
+    performCSMA();
+  }
+
+  // in LoRaWAN v1.1, the MIC covers the channel and the datarate, the encrypted frame itself does not change
+  if(this->rev == 1) {
+    LoRaWANFrameKeys_t keys;
+    this->getFrameKeys(&keys);
+    this->retxFrame.dataRate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+    this->retxFrame.chIndex = this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK].idx;
+    size_t micPos = this->retxLen - sizeof(uint32_t);
+    this->retxFrame.mic = LoRaWANFrame::calculateMIC(this->retxMsg, micPos, &this->retxFrame, &keys);
+    LoRaWANNode::hton<uint32_t>(&this->retxMsg[micPos], this->retxFrame.mic);
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Retransmission %d of FCntUp = %lu", this->retxAttempt, (unsigned long)this->retxFrame.fCnt);
+
+  this->lastToA = this->phyLayer->getTimeOnAir(this->retxLen) / 1000;
+  if(async) {
+    // start transmitting, the same way as startUplink does
+    downlinkActions[this->actionSlot] = false;
+    this->phyLayer->setPacketSentAction(this->getAction());
+    state = this->phyLayer->startTransmit(this->retxMsg, this->retxLen);
+    if(state != RADIOLIB_ERR_NONE) {
+      this->phyLayer->clearPacketSentAction();
+      return(state);
+    }
+    this->asyncStart = this->phyLayer->getMod()->hal->millis();
+    this->asyncTimeout = 5*this->lastToA + this->scanGuard;
+    this->asyncState = RADIOLIB_LORAWAN_ASYNC_TX;
+
+  } else {
+    state = this->phyLayer->transmit(this->retxMsg, this->retxLen);
+    this->rxDelayStart = this->phyLayer->getMod()->hal->millis();
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Uplink sent <-- Rx Delay start");
+    RADIOLIB_ASSERT(state);
+  }
+  this->consumeDutyCycle(this->channelLast, this->lastToA);
+
+  // update the uplink event, a downlink in between may have changed the datarate or power
+  this->uplinkEvent.datarate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  this->uplinkEvent.freq = this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK].freq;
+  this->uplinkEvent.power = this->txPowerMax - this->txPowerSteps * 2;
+  this->uplinkEvent.attempt = this->retxAttempt;
+  if(event) {
+    *event = this->uplinkEvent;
+  }
+  if(this->uplinkCb) {
+    this->uplinkCb(this, &this->uplinkEvent, this->uplinkCbCtx);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+RadioLibTime_t LoRaWANNode::timeUntilPoll() {
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  RadioLibTime_t deadline = now;
+  switch(this->asyncState) {
+    case(RADIOLIB_LORAWAN_ASYNC_TX):
+      // transmission should end after the time-on-air
+      deadline = this->asyncStart + this->lastToA;
+      break;
+    case(RADIOLIB_LORAWAN_ASYNC_RX_WAIT):
+      deadline = this->rxWindowStart(this->asyncWindow);
+      break;
+    case(RADIOLIB_LORAWAN_ASYNC_RX):
+      deadline = this->asyncStart + this->asyncTimeout;
+      break;
+    case(RADIOLIB_LORAWAN_ASYNC_RETX_WAIT):
+      deadline = now + this->timeUntilRetransmit();
+      break;
+    case(RADIOLIB_LORAWAN_ASYNC_IDLE):
+      if(this->lwClass != RADIOLIB_LORAWAN_CLASS_B) {
+        break;
+      }
+      if(this->classBState == RADIOLIB_LORAWAN_CLASS_B_WAIT) {
+        deadline = this->classBNext;
+      } else if(this->classBState != RADIOLIB_LORAWAN_CLASS_B_PING_DONE) {
+        deadline = this->classBStart + this->classBTimeout;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if(deadline <= now) {
+    return(0);
+  }
+  return(deadline - now);
+}
+
+bool LoRaWANNode::isBusy() {
+  return(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE);
+}
+
+int16_t LoRaWANNode::setClass(uint8_t cls) {
+  // the device class can only be switched within an active session
+  if(!this->isActivated()) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  if((cls != RADIOLIB_LORAWAN_CLASS_A) && (cls != RADIOLIB_LORAWAN_CLASS_B) && (cls != RADIOLIB_LORAWAN_CLASS_C)) {
+    return(RADIOLIB_LORAWAN_INVALID_CLASS);
+  }
+
+  // Class B needs the beacon timing to schedule the ping slots
+  if((cls == RADIOLIB_LORAWAN_CLASS_B) && !this->beaconLocked) {
+    return(RADIOLIB_LORAWAN_NO_BEACON);
+  }
+
+  // stop listening in the current class
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_C) {
+    this->phyLayer->standby();
+    this->phyLayer->clearPacketReceivedAction();
+    if(this->modulation == RADIOLIB_LORAWAN_MODULATION_LORA) {
+      this->phyLayer->invertIQ(false);
+    }
+  }
+  this->stopClassB();
+
+  this->lwClass = cls;
+  if(cls == RADIOLIB_LORAWAN_CLASS_C) {
+    return(this->startReceiveClassC());
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+uint8_t LoRaWANNode::getClass() {
+  return(this->lwClass);
+}
+
+int16_t LoRaWANNode::getDownlinkClassC(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventDown) {
+  if(this->lwClass != RADIOLIB_LORAWAN_CLASS_C) {
+    return(RADIOLIB_LORAWAN_INVALID_CLASS);
+  }
+
+  // downlinks during an uplink/downlink exchange are handled by poll()
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_LORAWAN_NO_DOWNLINK);
+  }
+
+  // follow the start and end of multicast Class C sessions
+  if(!downlinkActions[this->actionSlot] && (this->getMulticastClassC() != this->rxCGroup)) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast Class C session of group %d", this->getMulticastClassC());
+    return(this->startReceiveClassC());
+  }
+
+  if(!downlinkActions[this->actionSlot]) {
+    return(RADIOLIB_LORAWAN_NO_DOWNLINK);
+  }
+  downlinkActions[this->actionSlot] = false;
+
+  // process the frame received on the Class C channel
+  int16_t state = this->parseDownlink(dataDown, lenDown, eventDown);
+  if(eventDown) {
+    eventDown->datarate = this->rxCDr;
+    eventDown->freq = this->rxCFreq;
+  }
+
+  // restart reception, even if the frame was not valid
+  int16_t stateClassC = this->startReceiveClassC();
+  RADIOLIB_ASSERT(state);
+  return(stateClassC);
+}
+
+int16_t LoRaWANNode::startReceiveClassC() {
+  // listen with the downlink configuration, on the Rx2 channel and datarate
+  // unless a multicast session takes over, zero frequency means the Rx2 frequency
+  this->rxCFreq = this->rx2.freq;
+  this->rxCDr = this->rx2.drMax;
+  this->rxCGroup = this->getMulticastClassC();
+  if(this->rxCGroup != RADIOLIB_LORAWAN_MC_GROUP_NONE) {
+    LoRaWANMulticastGroup_t* group = &this->mcGroups[this->rxCGroup];
+    if(group->freq > 0) {
+      this->rxCFreq = group->freq;
+    }
+    this->rxCDr = group->dr;
+  }
+  int16_t state = this->setPhyPropertiesDn(this->rxCFreq, this->rxCDr);
+  RADIOLIB_ASSERT(state);
+
+  downlinkActions[this->actionSlot] = false;
+  this->phyLayer->setPacketReceivedAction(this->getAction());
+  state = this->phyLayer->startReceive();
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening RxC window");
+  return(state);
+}
+
+int16_t LoRaWANNode::setRx2Properties() {
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PHY: Frequency %cL = %6.3f MHz", 'D', this->rx2.freq);
+  int16_t state = this->phyLayer->setFrequency(this->rx2.freq);
+  RADIOLIB_ASSERT(state);
+
+  DataRate_t dataRate;
+  state = findDataRate(this->rx2.drMax, &dataRate);
+  RADIOLIB_ASSERT(state);
+  state = this->phyLayer->setDataRate(dataRate);
+  return(state);
+}
+int16_t LoRaWANNode::setPhyPropertiesDn(float freq, uint8_t dr) {
+  // temporarily replace the Rx1 channel, as it may still be needed in an ongoing exchange
+  LoRaWANChannel_t chnlRx1 = this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK];
+  uint8_t drRx1 = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK];
+  this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK].freq = freq;
+  this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK] = dr;
+  int16_t state = this->setPhyProperties(RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK);
+  this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK] = chnlRx1;
+  this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK] = drRx1;
+  return(state);
+}
+
+int16_t LoRaWANNode::setPingSlotPeriodicity(uint8_t periodicity) {
+  if(periodicity > RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_MAX) {
+    return(RADIOLIB_LORAWAN_INVALID_PERIODICITY);
+  }
+
+  // delete any prior request, in case this is requested more than once
+  (void)deleteMacCommand(RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO, &this->commandsUp);
+
+  // check there is space for the request in the FOpts
+  uint8_t len = MacTable[RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO].lenUp;
+  if(this->commandsUp.len + 1 + len > RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("The maximum number of FOpts payload was reached");
+    return(RADIOLIB_ERR_COMMAND_QUEUE_FULL);
+  }
+
+  LoRaWANMacCommand_t cmd = {
+    .cid = RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO,
+    .payload = { 0 }, 
+    .len = len,
+    .repeat = 0,
+  };
+  cmd.payload[0] = periodicity;
+  int16_t state = pushMacCommand(&cmd, &this->commandsUp);
+  RADIOLIB_ASSERT(state);
+
+  // the new periodicity is only applied once the network answers
+  this->pingPeriodicityReq = periodicity;
+  return(state);
+}
+
+int16_t LoRaWANNode::acquireBeacon() {
+  if(!this->isActivated()) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  // suspend any Class B or Class C reception
+  this->stopClassB();
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_C) {
+    this->phyLayer->standby();
+    this->phyLayer->clearPacketReceivedAction();
+  }
+
+  Module* mod = this->phyLayer->getMod();
+  int16_t state = RADIOLIB_LORAWAN_NO_BEACON;
+
+  // the listening time around the expected beacon covers the error of the network time
+  // with a measured drift, it can be much shorter than the default guard
+  RadioLibTime_t guard = RADIOLIB_LORAWAN_BEACON_GUARD;
+  if(this->clockDriftValid) {
+    guard = this->scanGuard + this->clockResidual(mod->hal->millis() - this->gpsRefLocal);
+  }
+  guard += this->gpsRefRes;
+
+  if(this->gpsRefValid && (guard < RADIOLIB_LORAWAN_BEACON_INTERVAL / 4)) {
+    // the network time is known, so only listen around the next two beacons
+    for(uint8_t i = 0; (i < 2) && (state == RADIOLIB_LORAWAN_NO_BEACON); i++) {
+      RadioLibTime_t now = mod->hal->millis();
+      uint64_t gpsNow = this->getGpsTime(now);
+      uint32_t gpsNext = (uint32_t)(gpsNow / RADIOLIB_LORAWAN_BEACON_INTERVAL + 1) * RADIOLIB_LORAWAN_BEACON_PERIOD_SEC;
+      RadioLibTime_t waitLen = this->clockDelay((uint64_t)gpsNext*1000 - gpsNow);
+      if(waitLen < guard) {
+        gpsNext += RADIOLIB_LORAWAN_BEACON_PERIOD_SEC;
+        waitLen += this->clockDelay(RADIOLIB_LORAWAN_BEACON_INTERVAL);
+      }
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Waiting %lu ms for beacon at %lu", (unsigned long)waitLen, (unsigned long)gpsNext);
+      mod->hal->delay(waitLen - guard);
+
+      state = this->startReceiveBeacon(this->getBeaconFreq(gpsNext), 2*guard, false);
+      if(state != RADIOLIB_ERR_NONE) {
+        this->stopClassB();
+        break;
+      }
+      while(!downlinkActions[this->actionSlot] && (mod->hal->millis() - this->classBStart < this->classBTimeout)) {
+        mod->hal->yield();
+      }
+      state = this->readBeacon(mod->hal->millis());
+    }
+
+  } else {
+    // the beacon may come at any time, so listen for a full period on each of the beacon channels
+    uint8_t numChannels = (this->beaconFreq > 0) ? 1 : this->band->beaconSpan.numChannels;
+    for(uint8_t i = 0; (i < numChannels) && (state == RADIOLIB_LORAWAN_NO_BEACON); i++) {
+      float freq = this->getBeaconFreq(i * RADIOLIB_LORAWAN_BEACON_PERIOD_SEC);
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Searching for beacon at %6.3f MHz", freq);
+      state = this->startReceiveBeacon(freq, RADIOLIB_LORAWAN_BEACON_INTERVAL + RADIOLIB_LORAWAN_BEACON_GUARD, true);
+      if(state != RADIOLIB_ERR_NONE) {
+        this->stopClassB();
+        break;
+      }
+      while(!downlinkActions[this->actionSlot] && (mod->hal->millis() - this->classBStart < this->classBTimeout)) {
+        mod->hal->yield();
+      }
+      state = this->readBeacon(mod->hal->millis());
+    }
+  }
+
+  // Class C reception continues with or without the beacon
+  if(this->lwClass == RADIOLIB_LORAWAN_CLASS_C) {
+    int16_t stateClassC = this->startReceiveClassC();
+    RADIOLIB_ASSERT(state);
+    return(stateClassC);
+  }
+  return(state);
+}
+
+uint32_t LoRaWANNode::getBeaconTime() {
+  if(!this->beaconLocked) {
+    return(0);
+  }
+  return(this->beaconTime);
+}
+
+int16_t LoRaWANNode::getDownlinkClassB(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventDown) {
+  if(this->lwClass != RADIOLIB_LORAWAN_CLASS_B) {
+    return(RADIOLIB_LORAWAN_INVALID_CLASS);
+  }
+
+  // ping slots are not opened during an uplink/downlink exchange
+  if(this->asyncState != RADIOLIB_LORAWAN_ASYNC_IDLE) {
+    return(RADIOLIB_LORAWAN_NO_DOWNLINK);
+  }
+
+  int16_t state = this->pollClassB(this->phyLayer->getMod()->hal->millis());
+  RADIOLIB_ASSERT(state);
+  if(this->classBState != RADIOLIB_LORAWAN_CLASS_B_PING_DONE) {
+    return(RADIOLIB_LORAWAN_NO_DOWNLINK);
+  }
+
+  // close the ping slot and process the frame
+  float freq = 0;
+  uint8_t dr = 0;
+  this->getPingChannel(&freq, &dr);
+  this->stopClassB();
+  this->pingIndex++;
+  state = this->parseDownlink(dataDown, lenDown, eventDown);
+  if(eventDown) {
+    eventDown->datarate = dr;
+    eventDown->freq = freq;
+  }
+  return(state);
+}
+
+size_t LoRaWANNode::getBeaconLen(uint8_t dr, size_t* rfuLen) {
+  DataRate_t dataRate;
+  if((dr == RADIOLIB_LORAWAN_DATA_RATE_UNUSED) || (this->findDataRate(dr, &dataRate) != RADIOLIB_ERR_NONE)) {
+    return(0);
+  }
+
+  // RFU1 | Time | CRC | GwSpecific | RFU2 | CRC, the RFU fields depend on the spreading factor
+  uint8_t sf = dataRate.lora.spreadingFactor;
+  size_t rfu1 = sf - 7;
+  size_t rfu2 = (sf > 9) ? (sf - 9) : 0;
+  if(rfuLen) {
+    *rfuLen = rfu1;
+  }
+  return(rfu1 + 4 + 2 + 7 + rfu2 + 2);
+}
+
+float LoRaWANNode::getBeaconFreq(uint32_t gpsTime) {
+  if(this->beaconFreq > 0) {
+    return(this->beaconFreq);
+  }
+
+  // on bands with multiple beacon channels, the channel hops every beacon period
+  const LoRaWANChannelSpan_t* span = &this->band->beaconSpan;
+  uint8_t chIndex = (gpsTime / RADIOLIB_LORAWAN_BEACON_PERIOD_SEC) % span->numChannels;
+  return(span->freqStart + chIndex*span->freqStep);
+}
+
+void LoRaWANNode::getPingChannel(float* freq, uint8_t* dr) {
+  const LoRaWANChannelSpan_t* span = &this->band->beaconSpan;
+  *dr = (this->pingDr != RADIOLIB_LORAWAN_DATA_RATE_UNUSED) ? this->pingDr : span->drMax;
+  if(this->pingFreq > 0) {
+    *freq = this->pingFreq;
+  } else if(span->numChannels > 1) {
+    // the ping slot channel hops with the beacon period and is different for each device
+    uint8_t chIndex = (this->beaconTime / RADIOLIB_LORAWAN_BEACON_PERIOD_SEC + this->devAddr) % span->numChannels;
+    *freq = span->freqStart + chIndex*span->freqStep;
+  } else {
+    *freq = this->getBeaconFreq(this->beaconTime);
+  }
+}
+
+int16_t LoRaWANNode::startReceiveBeacon(float freq, RadioLibTime_t timeout, bool continuous) {
+  uint8_t dr = this->band->beaconSpan.drMax;
+  size_t len = this->getBeaconLen(dr);
+  this->classBState = RADIOLIB_LORAWAN_CLASS_B_BEACON;
+  int16_t state = this->setPhyPropertiesDn(freq, dr);
+  RADIOLIB_ASSERT(state);
+
+  // beacons are sent without IQ inversion, with a longer preamble and without a header
+  state = this->phyLayer->invertIQ(false);
+  RADIOLIB_ASSERT(state);
+  state = this->phyLayer->setPreambleLength(RADIOLIB_LORAWAN_BEACON_PREAMBLE_LEN);
+  RADIOLIB_ASSERT(state);
+  state = this->phyLayer->implicitHeader(len);
+  RADIOLIB_ASSERT(state);
+
+  // the window is kept open until the whole beacon can be received
+  this->classBStart = this->phyLayer->getMod()->hal->millis();
+  this->classBTimeout = timeout + this->phyLayer->getTimeOnAir(len) / 1000 + this->scanGuard;
+
+  downlinkActions[this->actionSlot] = false;
+  this->phyLayer->setPacketReceivedAction(this->getAction());
+  if(continuous) {
+    state = this->phyLayer->startReceive();
+  } else {
+    uint32_t irqFlags = 0;
+    uint32_t irqMask = 0;
+    this->phyLayer->irqRxDoneRxTimeout(irqFlags, irqMask);
+    RadioLibTime_t timeoutMod = this->phyLayer->calculateRxTimeout(timeout*1000);
+    state = this->phyLayer->startReceive(timeoutMod, irqFlags, irqMask, 0);
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening beacon window (%d ms)", (int)this->classBTimeout);
+  return(state);
+}
+
+int16_t LoRaWANNode::readBeacon(RadioLibTime_t now) {
+  if(!downlinkActions[this->actionSlot] || this->phyLayer->isRxTimeout()) {
+    this->stopClassB();
+    return(RADIOLIB_LORAWAN_NO_BEACON);
+  }
+
+  // the beacon started one time-on-air before it was received
+  // this has to be calculated while the beacon configuration is still active
+  size_t rfuLen = 0;
+  size_t len = this->getBeaconLen(this->band->beaconSpan.drMax, &rfuLen);
+  RadioLibTime_t start = now - this->phyLayer->getTimeOnAir(len) / 1000;
+
+  // the beacon has its own CRCs, so a CRC error reported by the radio can be ignored
+  uint8_t beacon[RADIOLIB_LORAWAN_BEACON_LEN_MAX] = { 0 };
+  int16_t state = this->phyLayer->readData(beacon, len);
+  this->stopClassB();
+  if((state != RADIOLIB_ERR_NONE) && (state != RADIOLIB_ERR_CRC_MISMATCH) && (state != RADIOLIB_ERR_LORA_HEADER_DAMAGED)) {
+    return(state);
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Beacon:");
+  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(beacon, len);
+
+  // check the CRC-16/XMODEM of the network common part
+  RadioLibCRCInstance.size = 16;
+  RadioLibCRCInstance.poly = RADIOLIB_CRC_CCITT_POLY;
+  RadioLibCRCInstance.init = 0x0000;
+  RadioLibCRCInstance.out = 0x0000;
+  RadioLibCRCInstance.refIn = false;
+  RadioLibCRCInstance.refOut = false;
+  uint16_t crc = (uint16_t)RadioLibCRCInstance.checksum(beacon, rfuLen + sizeof(uint32_t));
+  uint16_t crcBeacon = LoRaWANNode::ntoh<uint16_t>(&beacon[rfuLen + sizeof(uint32_t)]);
+  uint32_t time = LoRaWANNode::ntoh<uint32_t>(&beacon[rfuLen]);
+  if((crc != crcBeacon) || (time % RADIOLIB_LORAWAN_BEACON_PERIOD_SEC != 0)) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Invalid beacon, CRC expected %04x, got %04x", crc, crcBeacon);
+    return(RADIOLIB_LORAWAN_NO_BEACON);
+  }
+
+  // the beacon is the most accurate network time reference, limited only by the local clock
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Beacon time = %lu", (unsigned long)time);
+  this->setGpsTime((uint64_t)time*1000, start, 1);
+
+  this->beaconLocked = true;
+  this->beaconMissed = 0;
+  this->beaconTime = time;
+  this->beaconStart = start;
+  this->calculatePingOffset();
+  this->pingIndex = 0;
+  return(RADIOLIB_ERR_NONE);
+}
+
+void LoRaWANNode::calculatePingOffset() {
+  // Rand = aes128_encrypt(16 x 0x00, beaconTime | DevAddr | pad16)
+  uint8_t key[RADIOLIB_AES128_KEY_SIZE] = { 0 };
+  uint8_t block[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  uint8_t rand[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  LoRaWANNode::hton<uint32_t>(&block[0], this->beaconTime);
+  LoRaWANNode::hton<uint32_t>(&block[4], this->devAddr);
+  RadioLibAES128Instance.init(key);
+  RadioLibAES128Instance.encryptECB(block, RADIOLIB_AES128_BLOCK_SIZE, rand);
+
+  uint16_t pingPeriod = (uint16_t)1 << (5 + this->pingPeriodicity);
+  this->pingOffset = (rand[0] + rand[1]*256) % pingPeriod;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Ping offset = %d, period = %d", this->pingOffset, pingPeriod);
+}
+
+RadioLibTime_t LoRaWANNode::clockDelay(RadioLibTime_t delay) {
+  return((RadioLibTime_t)((int64_t)delay + (int64_t)delay * this->clockDrift / 1000000));
+}
+
+RadioLibTime_t LoRaWANNode::clockResidual(RadioLibTime_t delay) {
+  return((RadioLibTime_t)(((uint64_t)delay * RADIOLIB_LORAWAN_CLOCK_DRIFT_RESIDUAL + 999999) / 1000000));
+}
+
+uint64_t LoRaWANNode::getGpsTime(RadioLibTime_t now) {
+  // the local clock runs fast by the drift, so the elapsed time is scaled down accordingly
+  int64_t elapsed = (int64_t)now - (int64_t)this->gpsRefLocal;
+  elapsed -= elapsed * this->clockDrift / 1000000;
+  return(this->gpsRefTime + elapsed);
+}
+
+void LoRaWANNode::setGpsTime(uint64_t gpsTime, RadioLibTime_t local, RadioLibTime_t res) {
+  // the difference to the time predicted from the previous reference is the remaining drift
+  // it is only meaningful when the interval is long compared to the resolution of the references
+  if(this->gpsRefValid && (local > this->gpsRefLocal)) {
+    RadioLibTime_t interval = local - this->gpsRefLocal;
+    if(interval >= RADIOLIB_MAX(res, this->gpsRefRes) * RADIOLIB_LORAWAN_CLOCK_SYNC_RATIO) {
+      int64_t error = (int64_t)(this->getGpsTime(local) - gpsTime);
+      int32_t drift = this->clockDrift + (int32_t)(error * 1000000 / (int64_t)interval);
+      if((drift <= RADIOLIB_LORAWAN_CLOCK_DRIFT_MAX) && (drift >= -RADIOLIB_LORAWAN_CLOCK_DRIFT_MAX)) {
+        this->clockDrift = this->clockDriftValid ? (3*this->clockDrift + drift) / 4 : drift;
+        this->clockDriftValid = true;
+      }
+    }
+  }
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Network time = %lu.%03u, drift = %ld ppm", (unsigned long)(gpsTime / 1000), (unsigned)(gpsTime % 1000), (long)this->clockDrift);
+
+  this->gpsRefTime = gpsTime;
+  this->gpsRefLocal = local;
+  this->gpsRefRes = res;
+  this->gpsRefValid = true;
+}
+
+int16_t LoRaWANNode::missedBeacon() {
+  // keep tracking the expected beacon timing
+  this->beaconMissed++;
+  this->beaconTime += RADIOLIB_LORAWAN_BEACON_PERIOD_SEC;
+  this->beaconStart += this->clockDelay(RADIOLIB_LORAWAN_BEACON_INTERVAL);
+  this->calculatePingOffset();
+  this->pingIndex = 0;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Missed beacon (%d)", this->beaconMissed);
+
+  // without the beacon for too long, fall back to Class A
+  if(this->beaconMissed >= RADIOLIB_LORAWAN_BEACON_LOST) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Beacon lost");
+    this->beaconLocked = false;
+    if(this->lwClass == RADIOLIB_LORAWAN_CLASS_B) {
+      this->lwClass = RADIOLIB_LORAWAN_CLASS_A;
+    }
+    return(RADIOLIB_LORAWAN_NO_BEACON);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+void LoRaWANNode::stopClassB() {
+  if(this->classBState == RADIOLIB_LORAWAN_CLASS_B_WAIT) {
+    return;
+  }
+
+  // stop listening and restore the configuration used for the other frames
+  this->phyLayer->standby();
+  this->phyLayer->clearPacketReceivedAction();
+  if(this->classBState == RADIOLIB_LORAWAN_CLASS_B_BEACON) {
+    this->phyLayer->explicitHeader();
+  }
+  if(this->modulation == RADIOLIB_LORAWAN_MODULATION_LORA) {
+    this->phyLayer->invertIQ(false);
+  }
+  this->classBState = RADIOLIB_LORAWAN_CLASS_B_WAIT;
+}
+
+int16_t LoRaWANNode::pollClassB(RadioLibTime_t now) {
+  int16_t state = RADIOLIB_ERR_NONE;
+  switch(this->classBState) {
+    case(RADIOLIB_LORAWAN_CLASS_B_BEACON):
+      if(!downlinkActions[this->actionSlot] && (now - this->classBStart < this->classBTimeout)) {
+        return(RADIOLIB_ERR_NONE);
+      }
+      if(this->readBeacon(now) != RADIOLIB_ERR_NONE) {
+        state = this->missedBeacon();
+        RADIOLIB_ASSERT(state);
+      }
+      break;
+
+    case(RADIOLIB_LORAWAN_CLASS_B_PING):
+      if(!downlinkActions[this->actionSlot] && (now - this->classBStart < this->classBTimeout)) {
+        return(RADIOLIB_ERR_NONE);
+      }
+      if(downlinkActions[this->actionSlot] && !this->phyLayer->isRxTimeout()) {
+        // keep the frame until it is processed by getDownlinkClassB
+        this->classBState = RADIOLIB_LORAWAN_CLASS_B_PING_DONE;
+        return(RADIOLIB_ERR_NONE);
+      }
+      this->stopClassB();
+      this->pingIndex++;
+      break;
+
+    case(RADIOLIB_LORAWAN_CLASS_B_PING_DONE):
+      return(RADIOLIB_ERR_NONE);
+  }
+
+  // all windows are closed, find the next one
+  while(true) {
+    // the windows are widened for every missed beacon to account for the drift
+    // once the drift was measured, only the residual error has to be covered
+    RadioLibTime_t widening = this->beaconMissed * RADIOLIB_LORAWAN_BEACON_WIDENING;
+    if(this->clockDriftValid) {
+      widening = this->beaconMissed * this->clockResidual(RADIOLIB_LORAWAN_BEACON_INTERVAL);
+    }
+
+    // ping slots of the current beacon period
+    uint16_t pingNb = (uint16_t)1 << (RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_MAX - this->pingPeriodicity);
+    uint16_t pingPeriod = RADIOLIB_LORAWAN_PING_SLOT_WINDOW / pingNb;
+    if(this->pingIndex < pingNb) {
+      RadioLibTime_t slotDelay = RADIOLIB_LORAWAN_BEACON_RESERVED +
+        (RadioLibTime_t)(this->pingOffset + this->pingIndex*pingPeriod) * RADIOLIB_LORAWAN_PING_SLOT_LEN;
+      RadioLibTime_t guard = this->rxGuard(slotDelay) + widening;
+      RadioLibTime_t slotStart = this->beaconStart + this->clockDelay(slotDelay);
+      if(now + guard < slotStart) {
+        this->classBNext = slotStart - guard;
+        return(RADIOLIB_ERR_NONE);
+      }
+      if(now > slotStart + guard) {
+        // too late for this one
+        this->pingIndex++;
+        continue;
+      }
+
+      // open the ping slot
+      float freq = 0;
+      uint8_t dr = 0;
+      this->getPingChannel(&freq, &dr);
+      this->classBState = RADIOLIB_LORAWAN_CLASS_B_PING;
+      state = this->setPhyPropertiesDn(freq, dr);
+      if(state == RADIOLIB_ERR_NONE) {
+        uint32_t irqFlags = 0;
+        uint32_t irqMask = 0;
+        this->phyLayer->irqRxDoneRxTimeout(irqFlags, irqMask);
+        RadioLibTime_t timeoutHost = this->phyLayer->getTimeOnAir(0) + 2*guard*1000;
+        RadioLibTime_t timeoutMod = this->phyLayer->calculateRxTimeout(timeoutHost);
+        downlinkActions[this->actionSlot] = false;
+        this->phyLayer->setPacketReceivedAction(this->getAction());
+        state = this->phyLayer->startReceive(timeoutMod, irqFlags, irqMask, 0);
+        this->classBStart = now;
+        this->classBTimeout = timeoutHost / 1000 + guard / 2;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Opening ping slot %d at %6.3f MHz", this->pingIndex, freq);
+      }
+      if(state != RADIOLIB_ERR_NONE) {
+        this->stopClassB();
+        this->pingIndex++;
+      }
+      return(state);
+    }
+
+    // next beacon
+    RadioLibTime_t guard = RADIOLIB_LORAWAN_BEACON_GUARD + widening;
+    if(this->clockDriftValid) {
+      guard = this->rxGuard(RADIOLIB_LORAWAN_BEACON_INTERVAL) + widening;
+    }
+    RadioLibTime_t beaconOpen = this->beaconStart + this->clockDelay(RADIOLIB_LORAWAN_BEACON_INTERVAL) - guard;
+    if(now < beaconOpen) {
+      this->classBNext = beaconOpen;
+      return(RADIOLIB_ERR_NONE);
+    }
+    if(now > beaconOpen + guard) {
+      // too late for this one
+      state = this->missedBeacon();
+      RADIOLIB_ASSERT(state);
+      continue;
+    }
+
+    state = this->startReceiveBeacon(this->getBeaconFreq(this->beaconTime + RADIOLIB_LORAWAN_BEACON_PERIOD_SEC), beaconOpen + 2*guard - now, false);
+    if(state != RADIOLIB_ERR_NONE) {
+      this->stopClassB();
+    }
+    return(state);
+  }
+}
+
+int16_t LoRaWANNode::addMulticastGroup(uint8_t id, uint32_t mcAddr, uint8_t* mcAppSKey, uint8_t* mcNwkSKey, uint32_t fCntMin, uint32_t fCntMax) {
+  #if !RADIOLIB_LORAWAN_MULTICAST
+  // a group that cannot be saved in the session buffer would be lost after a restart
+  return(RADIOLIB_ERR_UNSUPPORTED);
+  #endif
+
+  if((id >= RADIOLIB_LORAWAN_NUM_MC_GROUPS) || (fCntMin > fCntMax)) {
+    return(RADIOLIB_LORAWAN_INVALID_MC_GROUP);
+  }
+
+  LoRaWANMulticastGroup_t* group = &this->mcGroups[id];
+  memset(group, 0, sizeof(LoRaWANMulticastGroup_t));
+  group->defined = true;
+  group->mcAddr = mcAddr;
+  memcpy(group->mcAppSKey, mcAppSKey, RADIOLIB_AES128_KEY_SIZE);
+  memcpy(group->mcNwkSKey, mcNwkSKey, RADIOLIB_AES128_KEY_SIZE);
+  group->fCntMin = fCntMin;
+  group->fCntMax = fCntMax;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast group %d: 0x%08X, FCnt %lu - %lu", id, mcAddr, (unsigned long)fCntMin, (unsigned long)fCntMax);
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::removeMulticastGroup(uint8_t id) {
+  if((id >= RADIOLIB_LORAWAN_NUM_MC_GROUPS) || !this->mcGroups[id].defined) {
+    return(RADIOLIB_LORAWAN_INVALID_MC_GROUP);
+  }
+  memset(&this->mcGroups[id], 0, sizeof(LoRaWANMulticastGroup_t));
+  return(RADIOLIB_ERR_NONE);
+}
+
+void LoRaWANNode::setGenAppKey(const uint8_t* genAppKey) {
+  this->genAppKeySet = (genAppKey != NULL);
+  if(genAppKey) {
+    memcpy(this->genAppKey, genAppKey, RADIOLIB_AES128_KEY_SIZE);
+  } else {
+    memset(this->genAppKey, 0, RADIOLIB_AES128_KEY_SIZE);
+  }
+}
+
+const LoRaWANMulticastGroup_t* LoRaWANNode::getMulticastGroup(uint8_t id) {
+  if((id >= RADIOLIB_LORAWAN_NUM_MC_GROUPS) || !this->mcGroups[id].defined) {
+    return(NULL);
+  }
+  return(&this->mcGroups[id]);
+}
+
+size_t LoRaWANNode::getPackageAns(uint8_t* data, uint8_t* fPort) {
+  // a clock synchronization request can go along with the answers of its own package only
+  if(this->TS003 && ((this->pkgAnsLen == 0) || (this->pkgAnsPort == RADIOLIB_LORAWAN_FPORT_TS003))) {
+    this->addAppTimeReq();
+  }
+
+  size_t len = this->pkgAnsLen;
+  if(len == 0) {
+    return(0);
+  }
+  memcpy(data, this->pkgAns, len);
+  if(fPort) {
+    *fPort = this->pkgAnsPort;
+  }
+  this->pkgAnsLen = 0;
+  return(len);
+}
+
+int16_t LoRaWANNode::parseMulticast(uint8_t* msg, size_t msgLen, LoRaWANFrame_t* frame, uint8_t id, uint8_t* data, size_t* len, LoRaWANEvent_t* event) {
+  LoRaWANMulticastGroup_t* group = &this->mcGroups[id];
+
+  // multicast frames are always unconfirmed and carry neither acknowledgement nor MAC commands
+  if((frame->mType != RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_DOWN) || (frame->fCtrl & RADIOLIB_LORAWAN_FCTRL_ACK) || (frame->fOptsLen > 0)) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast frame with MHDR 0x%02X, FCtrl 0x%02X rejected", msg[RADIOLIB_LORAWAN_DATA_FRAME_MHDR_POS], msg[RADIOLIB_LORAWAN_DATA_FRAME_FCTRL_POS]);
+    return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
+  }
+
+  // the frame must have an fPort, MAC commands cannot be sent to a group
+  if(!frame->hasFPort) {
+    return(RADIOLIB_ERR_DOWNLINK_MALFORMED);
+  }
+  uint8_t fPort = frame->fPort;
+  if((fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) || (fPort > RADIOLIB_LORAWAN_FPORT_RESERVED)) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Received multicast downlink at FPort %d - rejected!", fPort);
+    return(RADIOLIB_ERR_INVALID_PORT);
+  }
+
+  // extend the frame counter from the next expected value, the group only accepts counters within its range
+  uint32_t fCnt32 = (group->fCntMin & 0xFFFF0000) | (uint16_t)frame->fCnt;
+  if((fCnt32 < group->fCntMin) && ((group->fCntMin >> 16) != 0xFFFF)) {
+    fCnt32 += 0x10000;
+  }
+  if((fCnt32 < group->fCntMin) || (fCnt32 > group->fCntMax)) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast FCnt %lu outside of %lu - %lu", (unsigned long)fCnt32, (unsigned long)group->fCntMin, (unsigned long)group->fCntMax);
+    return(RADIOLIB_ERR_A_FCNT_DOWN_INVALID);
+  }
+
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Multicast downlink (group %d, FCnt = %lu) encoded:", id, (unsigned long)fCnt32);
+  RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(msg, msgLen);
+
+  // the group session only has one network key, using the group address and the full frame counter
+  LoRaWANFrameKeys_t keys = {
+    .devAddr = group->mcAddr,
+    .rev = 0,
+    .appSKey = group->mcAppSKey,
+    .nwkSEncKey = group->mcNwkSKey,
+    .fNwkSIntKey = group->mcNwkSKey,
+    .sNwkSIntKey = group->mcNwkSKey,
+  };
+  frame->fCnt = fCnt32;
+  if(!LoRaWANFrame::verifyMIC(msg, msgLen, frame, &keys)) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+
+  // the frame is authentic, so only counters above this one will be accepted from now on
+  // once the counter space is exhausted, the group does not accept anything anymore
+  if(fCnt32 == 0xFFFFFFFF) {
+    group->fCntMax = 0;
+  } else {
+    group->fCntMin = fCnt32 + 1;
+  }
+
+  if(event) {
+    event->dir = RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK;
+    event->confirmed = false;
+    event->confirming = false;
+    event->datarate = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK];
+    event->freq = currentChannels[event->dir].freq;
+    event->power = this->txPowerMax - this->txPowerSteps * 2;
+    event->fCnt = fCnt32;
+    event->fPort = fPort;
+    event->mcGroup = id;
+    event->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE;
+    event->linkAdrDr = event->datarate;
+    event->linkAdrPower = event->power;
+    event->linkMargin = 0;
+    event->attempt = 0;
+  }
+
+  // decrypt the payload in place
+  uint8_t* payload = &msg[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(0)];
+  LoRaWANFrame::decrypt(msg, frame, &keys, payload);
+  if(len) {
+    *len = frame->payloadLen;
+  }
+  if(data) {
+    memcpy(data, payload, frame->payloadLen);
+  }
+
+  // data fragments are usually sent to a group
+  if(this->isPackagePort(fPort)) {
+    this->execPackage(fPort, payload, frame->payloadLen, id);
+  }
+
+  return(RADIOLIB_ERR_NONE);
+}
+
+bool LoRaWANNode::isPackagePort(uint8_t fPort) {
+  return(((fPort == RADIOLIB_LORAWAN_FPORT_TS003) && this->TS003) ||
+         ((fPort == RADIOLIB_LORAWAN_FPORT_TS005) && this->TS005) ||
+         ((fPort == RADIOLIB_LORAWAN_FPORT_TS004) && this->fragDecoder));
+}
+
+void LoRaWANNode::execPackage(uint8_t fPort, uint8_t* cmds, size_t len, uint8_t mcGroup) {
+  switch(fPort) {
+    case(RADIOLIB_LORAWAN_FPORT_TS003):
+      // the clock is only synchronized through the unicast session
+      if(mcGroup == RADIOLIB_LORAWAN_MC_GROUP_NONE) {
+        this->execClockSync(cmds, len);
+      }
+      break;
+    case(RADIOLIB_LORAWAN_FPORT_TS005):
+      // multicast groups can only be set up through the unicast session
+      if(mcGroup == RADIOLIB_LORAWAN_MC_GROUP_NONE) {
+        this->execMulticastSetup(cmds, len);
+      }
+      break;
+    case(RADIOLIB_LORAWAN_FPORT_TS004):
+      this->execFragmentation(cmds, len, mcGroup);
+      break;
+    default:
+      break;
+  }
+}
+
+void LoRaWANNode::execMulticastSetup(uint8_t* cmds, size_t len) {
+  // a new request replaces any answer that was not collected
+  this->pkgAnsLen = 0;
+  this->pkgAnsPort = RADIOLIB_LORAWAN_FPORT_TS005;
+
+  // current network time in seconds, needed to schedule the sessions
+  uint32_t gpsNow = 0;
+  if(this->gpsRefValid) {
+    gpsNow = this->getGpsTime(this->phyLayer->getMod()->hal->millis()) / 1000;
+  }
+
+  size_t i = 0;
+  while(i < len) {
+    uint8_t cid = cmds[i++];
+    uint8_t ans[1 + RADIOLIB_LORAWAN_NUM_MC_GROUPS*5 + 1] = { cid };
+    size_t ansLen = 1;
+
+    switch(cid) {
+      case(RADIOLIB_LORAWAN_TS005_PACKAGE_VERSION_REQ): {
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PackageVersionReq");
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS005_PACKAGE_ID;
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS005_PACKAGE_VERSION;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS005_MC_GROUP_STATUS_REQ): {
+        if(i + 1 > len) {
+          return;
+        }
+        uint8_t reqMask = cmds[i++] & 0x0F;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("McGroupStatusReq: mask = 0x%X", reqMask);
+
+        // status byte: total number of defined groups and the groups that are answered
+        uint8_t nbTotal = 0;
+        uint8_t ansMask = 0;
+        ansLen++;
+        for(uint8_t id = 0; id < RADIOLIB_LORAWAN_NUM_MC_GROUPS; id++) {
+          if(!this->mcGroups[id].defined) {
+            continue;
+          }
+          nbTotal++;
+          if(reqMask & (1 << id)) {
+            ansMask |= (1 << id);
+            ans[ansLen++] = id;
+            LoRaWANNode::hton<uint32_t>(&ans[ansLen], this->mcGroups[id].mcAddr);
+            ansLen += 4;
+          }
+        }
+        ans[1] = (nbTotal << 4) | ansMask;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS005_MC_GROUP_SETUP_REQ): {
+        if(i + 29 > len) {
+          return;
+        }
+        uint8_t id = cmds[i] & 0x03;
+        uint32_t mcAddr = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 1]);
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("McGroupSetupReq: group %d, McAddr = 0x%08X", id, mcAddr);
+
+        // the McRootKey comes from the AppKey on LoRaWAN 1.1 and from the GenAppKey on 1.0.x
+        // ABP devices have no AppKey, without a root key the group cannot be set up
+        const uint8_t* rootKey = NULL;
+        if(this->rev == 1) {
+          if(this->lwMode == RADIOLIB_LORAWAN_MODE_OTAA) {
+            rootKey = this->appKey;
+          }
+        } else if(this->genAppKeySet) {
+          rootKey = this->genAppKey;
+        }
+        if(!rootKey) {
+          RADIOLIB_DEBUG_PROTOCOL_PRINTLN("No McRootKey available for group %d", id);
+          ans[ansLen++] = (1 << 2) | id;
+          i += 29;
+          break;
+        }
+
+        // derive the McKEKey from the root key, and use it to unwrap the McKey
+        uint8_t keyDerivationBuff[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+        uint8_t mcRootKey[RADIOLIB_AES128_KEY_SIZE];
+        uint8_t mcKEKey[RADIOLIB_AES128_KEY_SIZE];
+        uint8_t mcKey[RADIOLIB_AES128_KEY_SIZE];
+        uint8_t mcAppSKey[RADIOLIB_AES128_KEY_SIZE];
+        uint8_t mcNwkSKey[RADIOLIB_AES128_KEY_SIZE];
+        keyDerivationBuff[0] = (this->rev == 1) ? 0x20 : 0x00;
+        RadioLibAES128Instance.init(rootKey);
+        RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, mcRootKey);
+        keyDerivationBuff[0] = 0x00;
+        RadioLibAES128Instance.init(mcRootKey);
+        RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, mcKEKey);
+        RadioLibAES128Instance.init(mcKEKey);
+        RadioLibAES128Instance.encryptECB(&cmds[i + 5], RADIOLIB_AES128_BLOCK_SIZE, mcKey);
+
+        // derive the group session keys
+        keyDerivationBuff[0] = 0x01;
+        LoRaWANNode::hton<uint32_t>(&keyDerivationBuff[1], mcAddr);
+        RadioLibAES128Instance.init(mcKey);
+        RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, mcAppSKey);
+        keyDerivationBuff[0] = 0x02;
+        RadioLibAES128Instance.encryptECB(keyDerivationBuff, RADIOLIB_AES128_BLOCK_SIZE, mcNwkSKey);
+
+        uint32_t fCntMin = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 21]);
+        uint32_t fCntMax = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 25]);
+        uint8_t idError = (this->addMulticastGroup(id, mcAddr, mcAppSKey, mcNwkSKey, fCntMin, fCntMax) != RADIOLIB_ERR_NONE);
+        ans[ansLen++] = (idError << 2) | id;
+        i += 29;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS005_MC_GROUP_DELETE_REQ): {
+        if(i + 1 > len) {
+          return;
+        }
+        uint8_t id = cmds[i++] & 0x03;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("McGroupDeleteReq: group %d", id);
+        uint8_t undefined = (this->removeMulticastGroup(id) != RADIOLIB_ERR_NONE);
+        ans[ansLen++] = (undefined << 2) | id;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS005_MC_CLASS_C_SESSION_REQ):
+      case(RADIOLIB_LORAWAN_TS005_MC_CLASS_B_SESSION_REQ): {
+        if(i + 10 > len) {
+          return;
+        }
+        uint8_t id = cmds[i] & 0x03;
+        uint32_t sessionTime = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 1]);
+        uint8_t timeout = cmds[i + 5] & 0x0F;
+        uint8_t periodicity = (cmds[i + 5] >> 4) & 0x07;
+        uint32_t freqRaw = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 6], 3);
+        float freq = (float)freqRaw/10000.0;
+        uint8_t dr = cmds[i + 9] & 0x0F;
+        i += 10;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("McClass%cSessionReq: group %d, time = %lu, timeout = %d, freq = %f, dr = %d", 
+                                        (cid == RADIOLIB_LORAWAN_TS005_MC_CLASS_C_SESSION_REQ) ? 'C' : 'B', id, (unsigned long)sessionTime, timeout, freq, dr);
+
+        // check the group and the channel, zero frequency means the default channel
+        uint8_t undefined = !this->mcGroups[id].defined;
+        uint8_t freqError = 0;
+        if(freqRaw != 0) {
+          freqError = (this->phyLayer->setFrequency(freq) != RADIOLIB_ERR_NONE);
+          this->phyLayer->setFrequency(this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK].freq);
+        }
+        DataRate_t dataRate;
+        uint8_t drError = (this->band->dataRates[dr] == RADIOLIB_LORAWAN_DATA_RATE_UNUSED) || (findDataRate(dr, &dataRate) != RADIOLIB_ERR_NONE);
+        ans[ansLen++] = (undefined << 4) | (freqError << 3) | (drError << 2) | id;
+        if(undefined || freqError || drError) {
+          break;
+        }
+
+        LoRaWANMulticastGroup_t* group = &this->mcGroups[id];
+        group->sessionClass = (cid == RADIOLIB_LORAWAN_TS005_MC_CLASS_C_SESSION_REQ) ? RADIOLIB_LORAWAN_CLASS_C : RADIOLIB_LORAWAN_CLASS_B;
+        group->sessionTime = sessionTime;
+        group->sessionTimeout = timeout;
+        group->freq = freq;
+        group->dr = dr;
+        group->periodicity = periodicity;
+
+        // time until the session starts, zero if it already started or the network time is unknown
+        uint32_t timeToStart = 0;
+        if(this->gpsRefValid && ((int32_t)(sessionTime - gpsNow) > 0)) {
+          timeToStart = sessionTime - gpsNow;
+        }
+        LoRaWANNode::hton<uint32_t>(&ans[ansLen], timeToStart, 3);
+        ansLen += 3;
+      } break;
+
+      default:
+        // unknown command, the rest of the frame cannot be parsed
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Unknown TS005 command 0x%02X", cid);
+        return;
+    }
+
+    // only complete answers are queued
+    if(this->pkgAnsLen + ansLen <= RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN) {
+      memcpy(&this->pkgAns[this->pkgAnsLen], ans, ansLen);
+      this->pkgAnsLen += ansLen;
+    }
+  }
+}
+
+void LoRaWANNode::requestAppTime() {
+  this->appTimeReq = true;
+}
+
+int16_t LoRaWANNode::setAppTimePeriodicity(uint8_t periodicity) {
+  if((periodicity > RADIOLIB_LORAWAN_TS003_PERIODICITY_MAX) && (periodicity != RADIOLIB_LORAWAN_TS003_PERIODICITY_NONE)) {
+    return(RADIOLIB_LORAWAN_INVALID_PERIODICITY);
+  }
+  this->appTimePeriodicity = periodicity;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANNode::getNetworkTime(uint32_t* gpsEpoch, uint16_t* ms, bool returnUnix) {
+  if(!this->gpsRefValid) {
+    return(RADIOLIB_LORAWAN_NO_NETWORK_TIME);
+  }
+
+  uint64_t gpsNow = this->getGpsTime(this->phyLayer->getMod()->hal->millis());
+  if(gpsEpoch) {
+    *gpsEpoch = gpsNow / 1000;
+    if(returnUnix) {
+      uint32_t unixOffset = 315964800UL - 18UL; // 18 leap seconds since GPS epoch (Jan. 6th 1980)
+      *gpsEpoch += unixOffset;
+    }
+  }
+  if(ms) {
+    *ms = gpsNow % 1000;
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+int32_t LoRaWANNode::getClockDrift() {
+  return(this->clockDrift);
+}
+
+void LoRaWANNode::execClockSync(uint8_t* cmds, size_t len) {
+  // a new request replaces any answer that was not collected
+  bool isNewAns = true;
+
+  size_t i = 0;
+  while(i < len) {
+    uint8_t cid = cmds[i++];
+    uint8_t ans[6] = { cid };
+    size_t ansLen = 1;
+
+    switch(cid) {
+      case(RADIOLIB_LORAWAN_TS003_PACKAGE_VERSION_REQ): {
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PackageVersionReq");
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS003_PACKAGE_ID;
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS003_PACKAGE_VERSION;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS003_APP_TIME): {
+        if(i + 5 > len) {
+          return;
+        }
+        int32_t correction = (int32_t)LoRaWANNode::ntoh<uint32_t>(&cmds[i]);
+        uint8_t token = cmds[i + 4] & 0x0F;
+        i += 5;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("AppTimeAns: correction = %ld s, token = %d", (long)correction, token);
+
+        // only the answer to the last request may be applied
+        if(token != this->appTimeToken) {
+          continue;
+        }
+        this->appTimeToken = (this->appTimeToken + 1) & 0x0F;
+        this->appTimeResync = 0;
+
+        // the correction is the difference to the clock of the device when the request was received
+        // so it can be applied to the clock at any time, with the resolution of a whole second
+        if((correction != 0) || !this->gpsRefValid) {
+          RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+          this->setGpsTime(this->getGpsTime(now) + (int64_t)correction*1000, now, 1000);
+        }
+        continue;
+      }
+
+      case(RADIOLIB_LORAWAN_TS003_DEVICE_APP_TIME_PERIODICITY): {
+        if(i + 1 > len) {
+          return;
+        }
+        uint8_t periodicity = cmds[i++] & 0x0F;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("DeviceAppTimePeriodicityReq: %d", periodicity);
+        this->appTimePeriodicity = periodicity;
+
+        // the answer carries the current time of the device
+        uint32_t deviceTime = this->getGpsTime(this->phyLayer->getMod()->hal->millis()) / 1000;
+        ans[ansLen++] = 0x00;
+        LoRaWANNode::hton<uint32_t>(&ans[ansLen], deviceTime);
+        ansLen += 4;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS003_FORCE_DEVICE_RESYNC): {
+        if(i + 1 > len) {
+          return;
+        }
+        this->appTimeResync = cmds[i++] & 0x07;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("ForceDeviceResyncReq: %d", this->appTimeResync);
+        continue;
+      }
+
+      default:
+        // unknown command, the rest of the frame cannot be parsed
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Unknown TS003 command 0x%02X", cid);
+        return;
+    }
+
+    if(isNewAns) {
+      this->pkgAnsLen = 0;
+      this->pkgAnsPort = RADIOLIB_LORAWAN_FPORT_TS003;
+      isNewAns = false;
+    }
+    if(this->pkgAnsLen + ansLen <= RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN) {
+      memcpy(&this->pkgAns[this->pkgAnsLen], ans, ansLen);
+      this->pkgAnsLen += ansLen;
+    }
+  }
+}
 
-    return(RADIOLIB_ERR_NONE);
+void LoRaWANNode::addAppTimeReq() {
+  // requests are sent when asked for by the user or the network, or periodically
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  bool ansRequired = this->appTimeReq;
+  bool isDue = ansRequired || (this->appTimeResync > 0);
+  if(!isDue && (this->appTimePeriodicity != RADIOLIB_LORAWAN_TS003_PERIODICITY_NONE)) {
+    isDue = (now - this->appTimeLast) / 1000 >= ((RadioLibTime_t)RADIOLIB_LORAWAN_TS003_PERIOD_SEC << this->appTimePeriodicity);
+  }
+  if(!isDue || (this->pkgAnsLen + 6 > RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN)) {
+    return;
   }
 
-  // process Application payload
-  *len = payLen;
+  // the device time is sampled as late as possible, right before the uplink
+  uint32_t deviceTime = this->getGpsTime(now) / 1000;
+  this->pkgAnsPort = RADIOLIB_LORAWAN_FPORT_TS003;
+  this->pkgAns[this->pkgAnsLen++] = RADIOLIB_LORAWAN_TS003_APP_TIME;
+  LoRaWANNode::hton<uint32_t>(&this->pkgAns[this->pkgAnsLen], deviceTime);
+  this->pkgAnsLen += 4;
+  this->pkgAns[this->pkgAnsLen++] = (ansRequired << 4) | this->appTimeToken;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("AppTimeReq: time = %lu, token = %d", (unsigned long)deviceTime, this->appTimeToken);
 
-  // TODO it COULD be the case that the assumed rollover is incorrect, then figure out a way to catch this and retry with just fCnt16
-  processAES(&downlinkMsg[RADIOLIB_LORAWAN_FRAME_PAYLOAD_POS(fOptsLen)], payLen, this->appSKey, data, fCnt32, RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK, 0x00, true);
-  
-  #if !RADIOLIB_STATIC_ONLY
-    delete[] downlinkMsg;
-  #endif
+  this->appTimeReq = false;
+  if(this->appTimeResync > 0) {
+    this->appTimeResync--;
+  }
+  this->appTimeLast = now;
+}
 
-  return(RADIOLIB_ERR_NONE);
+void LoRaWANNode::setFragDecoder(LoRaWANFragDecoder* decoder) {
+  this->fragDecoder = decoder;
 }
 
-#if defined(RADIOLIB_BUILD_ARDUINO)
-int16_t LoRaWANNode::sendReceive(String& strUp, uint8_t fPort, String& strDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
-  // send the uplink
-  int16_t state = this->uplink(strUp, fPort, isConfirmed, eventUp);
-  RADIOLIB_ASSERT(state);
+uint32_t LoRaWANNode::getFragDescriptor() {
+  return(this->fragDescriptor);
+}
 
-  // wait for the downlink
-  state = this->downlink(strDown, eventDown);
-  return(state);
+void LoRaWANNode::setCompression(RadioLibLZ* codec, uint8_t fPort) {
+  this->compression = codec;
+  this->compressionPort = fPort;
 }
-#endif
 
-int16_t LoRaWANNode::sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
-  // send the uplink
-  int16_t state = this->uplink(dataUp, lenUp, fPort, isConfirmed, eventUp);
-  RADIOLIB_ASSERT(state);
+void LoRaWANNode::setLinkAdr(LoRaWANLinkAdr* linkAdr) {
+  this->linkAdr = linkAdr;
+  this->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE;
+  if(!linkAdr) {
+    return;
+  }
+
+  // the tracker needs the modulation of every datarate to compare the margins
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES; i++) {
+    uint8_t dataRateBand = this->band->dataRates[i];
+    DataRate_t dataRate;
+    if((dataRateBand == RADIOLIB_LORAWAN_DATA_RATE_UNUSED) || (dataRateBand & RADIOLIB_LORAWAN_DATA_RATE_FSK_50_K) ||
+       (this->findDataRate(i, &dataRate) != RADIOLIB_ERR_NONE)) {
+      linkAdr->setDataRate(i, 0, 0);
+      continue;
+    }
+    linkAdr->setDataRate(i, dataRate.lora.spreadingFactor, dataRate.lora.bandwidth);
+  }
+}
 
-  // wait for the downlink
-  state = this->downlink(eventDown);
-  return(state);
+void LoRaWANNode::updateLinkAdr(size_t len) {
+  this->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE;
+  this->linkAdrDr = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  this->linkAdrSteps = this->txPowerSteps;
+  if(!this->linkAdr || (this->linkAdr->getMode() == RADIOLIB_LORAWAN_LINK_ADR_OFF)) {
+    return;
+  }
+
+  // only datarates that some enabled channel allows and that fit the payload
+  uint16_t enabled = 0;
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES; i++) {
+    if((this->band->dataRates[i] != RADIOLIB_LORAWAN_DATA_RATE_UNUSED) && (this->channelMasks[i] != 0) &&
+       (len <= this->band->payloadLenMax[i])) {
+      enabled |= (1UL << i);
+    }
+  }
+
+  if(!this->linkAdr->recommend(this->linkAdrDr, this->linkAdrSteps, this->band->powerNumSteps, enabled, &this->linkAdrDr, &this->linkAdrSteps)) {
+    return;
+  }
+  this->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_RECOMMENDED;
+  if(this->linkAdr->getMode() != RADIOLIB_LORAWAN_LINK_ADR_APPLY) {
+    return;
+  }
+
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Link ADR: datarate %d -> %d, Tx power steps %d -> %d",
+    this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK], this->linkAdrDr, this->txPowerSteps, this->linkAdrSteps);
+  if(this->setDatarate(this->linkAdrDr) != RADIOLIB_ERR_NONE) {
+    return;
+  }
+  if(this->setTxPower(this->txPowerMax - this->linkAdrSteps * 2) != RADIOLIB_ERR_NONE) {
+    return;
+  }
+  this->linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_APPLIED;
 }
 
-int16_t LoRaWANNode::sendReceive(const char* strUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
-  // send the uplink
-  int16_t state = this->uplink(strUp, fPort, isConfirmed, eventUp);
-  RADIOLIB_ASSERT(state);
+void LoRaWANNode::execFragmentation(uint8_t* cmds, size_t len, uint8_t mcGroup) {
+  LoRaWANFragDecoder* dec = this->fragDecoder;
 
-  // wait for the downlink
-  state = this->downlink(dataDown, lenDown, eventDown);
-  return(state);
+  // fragments of a multicast group are only accepted if the session was set up for that group
+  bool isAllowed = (mcGroup == RADIOLIB_LORAWAN_MC_GROUP_NONE) || (this->fragMcMask & (1 << mcGroup));
+
+  // a new request replaces any answer that was not collected
+  bool isNewAns = true;
+
+  size_t i = 0;
+  while(i < len) {
+    uint8_t cid = cmds[i++];
+    uint8_t ans[5] = { cid };
+    size_t ansLen = 1;
+
+    switch(cid) {
+      case(RADIOLIB_LORAWAN_TS004_PACKAGE_VERSION_REQ): {
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PackageVersionReq");
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS004_PACKAGE_ID;
+        ans[ansLen++] = RADIOLIB_LORAWAN_TS004_PACKAGE_VERSION;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS004_FRAG_SESSION_STATUS_REQ): {
+        if(i + 1 > len) {
+          return;
+        }
+        bool participants = cmds[i] & 0x01;
+        uint8_t index = (cmds[i] >> 1) & 0x03;
+        i++;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("FragSessionStatusReq: session %d, participants = %d", index, participants);
+
+        // only devices that miss fragments answer, unless all participants are asked to
+        uint16_t missing = dec->getNbMissing();
+        if((index != 0) || !dec->isActive() || (!participants && (missing == 0))) {
+          continue;
+        }
+        LoRaWANNode::hton<uint16_t>(&ans[ansLen], ((uint16_t)index << 14) | (dec->getNbReceived() & 0x3FFF));
+        ansLen += 2;
+        ans[ansLen++] = RADIOLIB_MIN(missing, 0xFF);
+        ans[ansLen++] = dec->isMemoryError();
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS004_FRAG_SESSION_SETUP_REQ): {
+        if(i + 10 > len) {
+          return;
+        }
+        uint8_t index = (cmds[i] >> 4) & 0x03;
+        uint8_t mcMask = cmds[i] & 0x0F;
+        uint16_t nbFrag = LoRaWANNode::ntoh<uint16_t>(&cmds[i + 1]);
+        uint8_t fragSize = cmds[i + 3];
+        uint8_t fragAlgo = (cmds[i + 4] >> 3) & 0x07;
+        uint8_t padding = cmds[i + 5];
+        uint32_t descriptor = LoRaWANNode::ntoh<uint32_t>(&cmds[i + 6]);
+        i += 10;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("FragSessionSetupReq: session %d, %d x %d bytes, algo %d, groups 0x%X", index, nbFrag, fragSize, fragAlgo, mcMask);
+
+        // only a single session with the parity matrix of the specification is supported
+        uint8_t status = (index << 6);
+        if(fragAlgo != 0) {
+          status |= 0x01;
+        }
+        if(index != 0) {
+          status |= 0x04;
+        }
+        if(status == (index << 6)) {
+          if(dec->begin(nbFrag, fragSize, padding) != RADIOLIB_ERR_NONE) {
+            status |= 0x02;
+          } else {
+            this->fragMcMask = mcMask;
+            this->fragDescriptor = descriptor;
+          }
+        }
+        ans[ansLen++] = status;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS004_FRAG_SESSION_DELETE_REQ): {
+        if(i + 1 > len) {
+          return;
+        }
+        uint8_t index = cmds[i++] & 0x03;
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("FragSessionDeleteReq: session %d", index);
+        uint8_t undefined = (index != 0) || !dec->isActive();
+        dec->end();
+        ans[ansLen++] = (undefined << 2) | index;
+      } break;
+
+      case(RADIOLIB_LORAWAN_TS004_DATA_FRAGMENT): {
+        // the fragment takes the rest of the frame
+        if(i + 2 > len) {
+          return;
+        }
+        uint16_t indexAndN = LoRaWANNode::ntoh<uint16_t>(&cmds[i]);
+        uint8_t index = indexAndN >> 14;
+        uint16_t n = indexAndN & 0x3FFF;
+        if(isAllowed && (index == 0) && dec->isActive()) {
+          int16_t state = dec->push(n, &cmds[i + 2], len - i - 2);
+          RADIOLIB_DEBUG_PROTOCOL_PRINTLN("DataFragment %d: %d, missing %d", n, state, dec->getNbMissing());
+          (void)state;
+        }
+        return;
+      }
+
+      default:
+        // unknown command, the rest of the frame cannot be parsed
+        RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Unknown TS004 command 0x%02X", cid);
+        return;
+    }
+
+    if(isNewAns) {
+      this->pkgAnsLen = 0;
+      this->pkgAnsPort = RADIOLIB_LORAWAN_FPORT_TS004;
+      isNewAns = false;
+    }
+    if(this->pkgAnsLen + ansLen <= RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN) {
+      memcpy(&this->pkgAns[this->pkgAnsLen], ans, ansLen);
+      this->pkgAnsLen += ansLen;
+    }
+  }
 }
 
-int16_t LoRaWANNode::sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown, size_t* lenDown, bool isConfirmed, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
-  // send the uplink
-  int16_t state = this->uplink(dataUp, lenUp, fPort, isConfirmed, eventUp);
-  RADIOLIB_ASSERT(state);
+uint8_t LoRaWANNode::getMulticastClassC() {
+  if(!this->gpsRefValid) {
+    return(RADIOLIB_LORAWAN_MC_GROUP_NONE);
+  }
 
-  // wait for the downlink
-  state = this->downlink(dataDown, lenDown, eventDown);
-  return(state);
+  uint32_t gpsNow = this->getGpsTime(this->phyLayer->getMod()->hal->millis()) / 1000;
+  for(uint8_t id = 0; id < RADIOLIB_LORAWAN_NUM_MC_GROUPS; id++) {
+    LoRaWANMulticastGroup_t* group = &this->mcGroups[id];
+    if(!group->defined || (group->sessionClass != RADIOLIB_LORAWAN_CLASS_C)) {
+      continue;
+    }
+    int32_t elapsed = (int32_t)(gpsNow - group->sessionTime);
+    if((elapsed >= 0) && ((uint32_t)elapsed < ((uint32_t)1 << group->sessionTimeout))) {
+      return(id);
+    }
+  }
+  return(RADIOLIB_LORAWAN_MC_GROUP_NONE);
 }
 
 void LoRaWANNode::setDeviceStatus(uint8_t battLevel) {
@@ -1748,6 +3731,17 @@ uint32_t LoRaWANNode::generateMIC(uint8_t* msg, size_t len, uint8_t* key) {
   return(((uint32_t)cmac[0]) | ((uint32_t)cmac[1] << 8) | ((uint32_t)cmac[2] << 16) | ((uint32_t)cmac[3]) << 24);
 }
 
+uint32_t LoRaWANNode::generateMIC(uint8_t* msg, size_t len, const RadioLibAES128Key_t* key) {
+  if((msg == NULL) || (len == 0)) {
+    return(0);
+  }
+
+  RadioLibAES128Instance.init(key);
+  uint8_t cmac[RADIOLIB_AES128_BLOCK_SIZE];
+  RadioLibAES128Instance.generateCMAC(msg, len, cmac);
+  return(((uint32_t)cmac[0]) | ((uint32_t)cmac[1] << 8) | ((uint32_t)cmac[2] << 16) | ((uint32_t)cmac[3]) << 24);
+}
+
 bool LoRaWANNode::verifyMIC(uint8_t* msg, size_t len, uint8_t* key) {
   if((msg == NULL) || (len < sizeof(uint32_t))) {
     return(0);
@@ -1766,6 +3760,24 @@ bool LoRaWANNode::verifyMIC(uint8_t* msg, size_t len, uint8_t* key) {
   return(true);
 }
 
+bool LoRaWANNode::verifyMIC(uint8_t* msg, size_t len, const RadioLibAES128Key_t* key) {
+  if((msg == NULL) || (len < sizeof(uint32_t))) {
+    return(0);
+  }
+
+  // extract MIC from the message
+  uint32_t micReceived = LoRaWANNode::ntoh<uint32_t>(&msg[len - sizeof(uint32_t)]);
+
+  // calculate the expected value and compare
+  uint32_t micCalculated = generateMIC(msg, len - sizeof(uint32_t), key);
+  if(micCalculated != micReceived) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("MIC mismatch, expected %08x, got %08x", micCalculated, micReceived);
+    return(false);
+  }
+
+  return(true);
+}
+
 int16_t LoRaWANNode::setPhyProperties(uint8_t dir) {
   // set the physical layer configuration
   RADIOLIB_DEBUG_PROTOCOL_PRINTLN("");
@@ -1872,6 +3884,7 @@ int16_t LoRaWANNode::setupChannelsDyn(bool joinRequest) {
   for(; num < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; num++) {
     this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][num] = RADIOLIB_LORAWAN_CHANNEL_NONE;
   }
+  this->updateChannelMasks();
 
   #if RADIOLIB_DEBUG_PROTOCOL
   this->printChannels();
@@ -1975,24 +3988,42 @@ int16_t LoRaWANNode::processCFList(uint8_t* cfList) {
   return(RADIOLIB_ERR_NONE);
 }
 
-int16_t LoRaWANNode::selectChannels() {
-  // figure out which channel IDs are enabled (chMask may have disabled some) and are valid for the current datarate
-  uint8_t numChannels = 0;
-  uint8_t channelsEnabled[RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS];
-  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
-    if(this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].enabled) {
-      if(this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK] >= this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].drMin
-         && this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK] <= this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i].drMax) {
-          channelsEnabled[numChannels] = i;
-          numChannels++;
-      }
-    }
+int16_t LoRaWANNode::selectChannels(bool hop) {
+  // the channels that are enabled (chMask may have disabled some) and are valid for the current datarate
+  uint8_t drUp = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  uint16_t mask = 0;
+  if(drUp < RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) {
+    mask = this->channelMasks[drUp];
   }
-  if(numChannels == 0) {
+  if(mask == 0) {
     return(RADIOLIB_ERR_NO_CHANNEL_AVAILABLE);
   }
-  // select a random ID & channel from the list of enabled and possible channels
-  uint8_t channelID = channelsEnabled[this->phyLayer->random(numChannels)];
+
+  // when adhering to dutyCycle, only pick from the sub-bands that have enough airtime left
+  if(this->dutyCycleEnabled) {
+    uint16_t ready = 0;
+    (void)this->dutyCycleWait(mask, &ready, this->lastToA);
+    if(ready == 0) {
+      return(RADIOLIB_ERR_UPLINK_UNAVAILABLE);
+    }
+    mask = ready;
+  }
+
+  // a retransmission goes out on another channel than the previous transmission, if there is one
+  if(hop && (mask & ~(1UL << this->channelLast))) {
+    mask &= ~(1UL << this->channelLast);
+  }
+
+  uint8_t channelID = 0;
+  if(this->channelPolicy == RADIOLIB_LORAWAN_CHANNEL_POLICY_ROUND_ROBIN) {
+    // the first channel after the last used one is the one that was used least recently
+    uint16_t next = mask & ~(uint16_t)((2UL << this->channelLast) - 1);
+    channelID = selectChannel(next ? next : mask, 0);
+  } else {
+    // select a random channel from the enabled and possible channels
+    channelID = selectChannel(mask, this->phyLayer->random(countChannels(mask)));
+  }
+  this->channelLast = channelID;
   this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK] = this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][channelID];
   
   if(this->band->bandType == RADIOLIB_LORAWAN_BAND_DYNAMIC) {
@@ -2018,18 +4049,8 @@ int16_t LoRaWANNode::selectChannels() {
 }
 
 int16_t LoRaWANNode::setDatarate(uint8_t drUp) {
-  // scan through all enabled channels and check if the requested datarate is available
-  bool isValidDR = false;
-  for(size_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
-    LoRaWANChannel_t *chnl = &(this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i]);
-    if(chnl->enabled) {
-      if(drUp >= chnl->drMin && drUp <= chnl->drMax) {
-        isValidDR = true;
-        break;
-      }
-    }
-  }
-  if(!isValidDR) {
+  // check if any of the enabled channels allows the requested datarate
+  if((drUp >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) || (this->channelMasks[drUp] == 0)) {
     RADIOLIB_DEBUG_PROTOCOL_PRINTLN("No defined channel allows datarate %d", drUp);
     return(RADIOLIB_ERR_INVALID_DATA_RATE);
   }
@@ -2046,8 +4067,8 @@ int16_t LoRaWANNode::setDatarate(uint8_t drUp) {
   cmd.payload[3] |= 0;                  // keep NbTrans the same
   (void)execMacCommand(&cmd);
 
-  // check if ACK is set for Tx Power
-  if((cmd.payload[0] >> 1) != 1) {
+  // check if ACK is set for the datarate
+  if(((cmd.payload[0] >> 1) & 0x01) != 1) {
     return(RADIOLIB_ERR_INVALID_DATA_RATE);
   }
   
@@ -2058,6 +4079,14 @@ void LoRaWANNode::setADR(bool enable) {
   this->adrEnabled = enable;
 }
 
+int16_t LoRaWANNode::setChannelPolicy(uint8_t policy) {
+  if(policy > RADIOLIB_LORAWAN_CHANNEL_POLICY_ROUND_ROBIN) {
+    return(RADIOLIB_LORAWAN_INVALID_CHANNEL_POLICY);
+  }
+  this->channelPolicy = policy;
+  return(RADIOLIB_ERR_NONE);
+}
+
 void LoRaWANNode::setDutyCycle(bool enable, RadioLibTime_t msPerHour) {
   this->dutyCycleEnabled = enable;
   if(!enable) {
@@ -2083,12 +4112,180 @@ RadioLibTime_t LoRaWANNode::dutyCycleInterval(RadioLibTime_t msPerHour, RadioLib
 }
 
 RadioLibTime_t LoRaWANNode::timeUntilUplink() {
-  Module* mod = this->phyLayer->getMod();
-  RadioLibTime_t nextUplink = this->rxDelayStart + dutyCycleInterval(this->dutyCycle, this->lastToA);
-  if(mod->hal->millis() > nextUplink){
+  uint8_t drUp = this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK];
+  if(drUp >= RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES) {
+    return(0);
+  }
+  return(this->dutyCycleWait(this->channelMasks[drUp], NULL, this->lastToA));
+}
+
+void LoRaWANNode::setJoinBackoff(bool enable) {
+  this->joinBackoffEnabled = enable;
+}
+
+RadioLibTime_t LoRaWANNode::timeUntilJoin() {
+  // nothing to wait for before the first join-request
+  if(this->joinToA == 0) {
+    return(0);
+  }
+  this->updateJoinBackoff();
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  RadioLibTime_t elapsed = now - this->joinLast;
+  RadioLibTime_t wait = (elapsed < this->joinDelay) ? this->joinDelay - elapsed : 0;
+
+  // if another join-request as long as the last one does not fit in this period, wait for the next one
+  RadioLibTime_t airtime = 0;
+  RadioLibTime_t length = LoRaWANNode::joinBackoffPeriod(this->joinPeriod, &airtime);
+  if(this->joinAirtime + this->joinToA > airtime) {
+    wait = RADIOLIB_MAX(wait, length - (now - this->joinPeriodStart));
+  }
+  return(wait);
+}
+
+RadioLibTime_t LoRaWANNode::joinBackoffPeriod(uint8_t period, RadioLibTime_t* airtime) {
+  switch(period) {
+    case(0):
+      *airtime = RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_0;
+      return(RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_0);
+    case(1):
+      *airtime = RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_1;
+      return(RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_1);
+    default:
+      *airtime = RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_2;
+      return(RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_2);
+  }
+}
+
+void LoRaWANNode::updateJoinBackoff() {
+  // periods are advanced one by one rather than computed from the first join-request, so that millis() may roll over
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  RadioLibTime_t airtime = 0;
+  RadioLibTime_t length = LoRaWANNode::joinBackoffPeriod(this->joinPeriod, &airtime);
+  while(now - this->joinPeriodStart >= length) {
+    this->joinPeriodStart += length;
+    this->joinAirtime = 0;
+    if(this->joinPeriod < 2) {
+      this->joinPeriod++;
+    }
+    length = LoRaWANNode::joinBackoffPeriod(this->joinPeriod, &airtime);
+  }
+}
+
+void LoRaWANNode::consumeJoinBackoff(RadioLibTime_t airtime, uint32_t seed) {
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  if(this->joinToA == 0) {
+    // first join-request, the backoff periods start now
+    this->joinPeriod = 0;
+    this->joinPeriodStart = now;
+    this->joinAirtime = 0;
+  }
+  this->updateJoinBackoff();
+  this->joinAirtime += airtime;
+  this->joinToA = airtime;
+  this->joinLast = now;
+
+  // on average, join-requests are spaced so that the airtime allowed in the period is spread over all of it
+  // the delay is randomized between half and one and a half of that interval
+  RadioLibTime_t allowed = 0;
+  RadioLibTime_t length = LoRaWANNode::joinBackoffPeriod(this->joinPeriod, &allowed);
+  uint64_t interval = (uint64_t)airtime * length / allowed;
+  this->joinDelay = interval / 2 + ((interval * (seed & 0xFFFF)) >> 16);
+  this->saveJoinBackoff();
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Join backoff: %lu ms used in period %d, next join-request in %lu ms", 
+                                  (unsigned long)this->joinAirtime, this->joinPeriod, (unsigned long)this->joinDelay);
+}
+
+void LoRaWANNode::saveJoinBackoff() {
+  // the period may have been advanced past the last Join-Request, so its start is saved as a signed offset
+  LoRaWANNode::hton<uint16_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_PERIOD], this->joinPeriod);
+  int32_t start = (int32_t)(this->joinLast - this->joinPeriodStart);
+  LoRaWANNode::hton<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_START], (uint32_t)start);
+  LoRaWANNode::hton<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_AIRTIME], this->joinAirtime);
+  LoRaWANNode::hton<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_TOA], this->joinToA);
+  LoRaWANNode::hton<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_DELAY], this->joinDelay);
+}
+
+void LoRaWANNode::restoreJoinBackoff(RadioLibTime_t offTime) {
+  // the clock restarted, so the last Join-Request is placed offTime before now
+  RadioLibTime_t now = this->phyLayer->getMod()->hal->millis();
+  int32_t start = (int32_t)LoRaWANNode::ntoh<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_START]);
+  this->joinPeriod = LoRaWANNode::ntoh<uint16_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_PERIOD]);
+  this->joinAirtime = LoRaWANNode::ntoh<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_AIRTIME]);
+  this->joinToA = LoRaWANNode::ntoh<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_TOA]);
+  this->joinDelay = LoRaWANNode::ntoh<uint32_t>(&this->bufferNonces[RADIOLIB_LORAWAN_NONCES_JOIN_DELAY]);
+  this->joinLast = now - offTime;
+  this->joinPeriodStart = this->joinLast - start;
+}
+
+RadioLibTime_t LoRaWANNode::getDutyCycleLimit(uint8_t bucket) {
+  if(bucket < RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS) {
+    return(this->band->dutyCycleBands[bucket].dutyCycle);
+  }
+  if(bucket == RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS) {
+    return(this->band->dutyCycle);
+  }
+
+  // the overall limit only applies when it was changed from the regional default
+  if(this->dutyCycle == this->band->dutyCycle) {
+    return(0);
+  }
+  return(this->dutyCycle);
+}
+
+void LoRaWANNode::updateDutyCycle() {
+  // move on by the number of slots that are over, clearing the ones that are reused
+  const RadioLibTime_t slotLen = RADIOLIB_LORAWAN_DUTY_CYCLE_PERIOD / RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS;
+  RadioLibTime_t steps = (this->phyLayer->getMod()->hal->millis() - this->dutyCycleSlotStart) / slotLen;
+  this->dutyCycleSlotStart += steps * slotLen;
+  steps = RADIOLIB_MIN(steps, (RadioLibTime_t)RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS + 1);
+  for(; steps > 0; steps--) {
+    this->dutyCycleSlot = (this->dutyCycleSlot + 1) % (RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS + 1);
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS + 2; i++) {
+      this->dutyCycleUsed[i][this->dutyCycleSlot] = 0;
+    }
+  }
+}
+
+void LoRaWANNode::consumeDutyCycle(uint8_t channelID, RadioLibTime_t airtime) {
+  this->updateDutyCycle();
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS + 2; i++) {
+    // every channel is in exactly one of the sub-band buckets, and always in the overall one
+    // the time-on-air was rounded down to milliseconds, so one more is charged
+    bool inBucket = (i > RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS) || (this->dutyCycleMasks[i] & (1UL << channelID));
+    if(inBucket && (this->getDutyCycleLimit(i) != 0)) {
+      this->dutyCycleUsed[i][this->dutyCycleSlot] += airtime + 1;
+    }
+  }
+}
+
+RadioLibTime_t LoRaWANNode::dutyCycleWait(uint16_t mask, uint16_t* ready, RadioLibTime_t airtime) {
+  this->updateDutyCycle();
+  RadioLibTime_t elapsed = this->phyLayer->getMod()->hal->millis() - this->dutyCycleSlotStart;
+  const uint8_t overall = RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS + 1;
+  RadioLibTime_t waitAll = dutyCycleDrain(this->dutyCycleUsed[overall], this->dutyCycleSlot, elapsed, this->getDutyCycleLimit(overall), airtime);
+
+  // the earliest sub-band to become available, but no earlier than the overall limit allows
+  RadioLibTime_t wait = (RadioLibTime_t)-1;
+  uint16_t readyMask = 0;
+  for(uint8_t i = 0; i <= RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS; i++) {
+    uint16_t chMask = mask & this->dutyCycleMasks[i];
+    if(chMask == 0) {
+      continue;
+    }
+    RadioLibTime_t waitBand = dutyCycleDrain(this->dutyCycleUsed[i], this->dutyCycleSlot, elapsed, this->getDutyCycleLimit(i), airtime);
+    if(waitBand == 0) {
+      readyMask |= chMask;
+    }
+    wait = RADIOLIB_MIN(wait, RADIOLIB_MAX(waitBand, waitAll));
+  }
+
+  if(ready) {
+    *ready = (waitAll == 0) ? readyMask : 0;
+  }
+  if(wait == (RadioLibTime_t)-1) {
     return(0);
   }
-  return(nextUplink - mod->hal->millis() + 1);
+  return(wait);
 }
 
 void LoRaWANNode::setDwellTime(bool enable, RadioLibTime_t msPerUplink) {
@@ -2111,14 +4308,28 @@ uint8_t LoRaWANNode::maxPayloadDwellTime() {
   uint8_t payLen = (minPayLen + maxPayLen) / 2;
   // do some binary search to find maximum allowed payload length
   while(payLen != minPayLen && payLen != maxPayLen) {
-    if(this->phyLayer->getTimeOnAir(payLen) > this->dwellTimeUp) {
+    if(this->phyLayer->getTimeOnAir(payLen)/1000 > this->dwellTimeUp) {
       maxPayLen = payLen;
     } else {
       minPayLen = payLen;
     }
     payLen = (minPayLen + maxPayLen) / 2;
   }
-  return(payLen - 13);  // fixed 13-byte header
+  // fixed 13-byte header, at slow datarates not even that may fit
+  return(payLen > 13 ? payLen - 13 : 0);
+}
+
+uint8_t LoRaWANNode::getMaxPayloadLen() {
+  uint8_t maxLen = this->band->payloadLenMax[this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK]];
+  if(!this->dwellTimeEnabledUp) {
+    return(maxLen);
+  }
+
+  // pending MAC commands are piggybacked in FOpts and take up airtime too
+  uint8_t dwellLen = this->maxPayloadDwellTime();
+  uint8_t fOptsLen = this->commandsUp.numCommands > 0 ? this->commandsUp.len : 0;
+  dwellLen = (dwellLen > fOptsLen) ? dwellLen - fOptsLen : 0;
+  return(RADIOLIB_MIN(maxLen, dwellLen));
 }
 
 int16_t LoRaWANNode::setTxPower(int8_t txPower) {
@@ -2307,8 +4518,14 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       // delete any existing response (does nothing if there is none)
       deleteMacCommand(RADIOLIB_LORAWAN_MAC_LINK_CHECK, &this->commandsDown);
 
+      // the margin is how well the gateways received the last uplink
+      if(this->linkAdr) {
+        this->linkAdr->addLinkCheck(cmd->payload[0], cmd->payload[1]);
+      }
+
       // insert response into MAC downlink queue
       pushMacCommand(cmd, &this->commandsDown);
+
       return(false);
     } break;
 
@@ -2381,8 +4598,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
             for(size_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
               this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i] = RADIOLIB_LORAWAN_CHANNEL_NONE;
             }
-            // clear all previous channel masks
-            memset(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS], 0, 16*8);
           } else {
             // if this is not the first ADR command, clear the ADR response that was in the queue
             (void)deleteMacCommand(RADIOLIB_LORAWAN_MAC_LINK_ADR, &this->commandsUp);
@@ -2396,51 +4611,9 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
         this->nbTrans = nbTransMac;
       }
 
-      // replace 'placeholder' or failed values with the current values for saving
-      // per spec, all these configuration should only be set if all ACKs are set, otherwise retain previous state
-      // but we don't bother and try to set each individual command
-      if(drUp == 0x0F || !drAck) {
-        cmd->payload[0] = (cmd->payload[0] & 0x0F) | (this->dataRates[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK] << 4);
-      }
-      if(txSteps == 0x0F || !pwrAck) {
-        cmd->payload[0] = (cmd->payload[0] & 0xF0) | this->txPowerSteps;
-      }
-      if(nbTransMac == 0) {
-        cmd->payload[3] = (cmd->payload[3] & 0xF0) | this->nbTrans;
-      }
-
-      if(this->band->bandType == RADIOLIB_LORAWAN_BAND_DYNAMIC) {
-        // if RFU bit is set, this is just a change in Datarate or TxPower, so read ADR command and overwrite first byte
-        if(isInternalTxDr) {
-          memcpy(&(cmd->payload[1]), &this->bufferSession[RADIOLIB_LORAWAN_SESSION_LINK_ADR] + 1, 3);
-        }
-        
-        // if there was no channel mask (all zeroes), we should never apply that channel mask, so set RFU bit again
-        if(cmd->payload[1] == 0 && cmd->payload[2] == 0) {
-          cmd->payload[3] |= (1 << 7);
-        }
-
-        // save to the single ADR MAC location
-        memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_LINK_ADR], &(cmd->payload[0]), cmd->len);
-      
-      } else {                // RADIOLIB_LORAWAN_BAND_FIXED
-
-        // save Tx/Dr to the Link ADR position in the session buffer 
-        uint8_t bufTxDr[RADIOLIB_LORAWAN_MAX_MAC_COMMAND_LEN_DOWN] = { 0 };
-        bufTxDr[0] = cmd->payload[0];
-        bufTxDr[3] = 1 << 7;
-        memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_LINK_ADR], bufTxDr, cmd->len);
-        
-        // if RFU bit is set, this is just a change in Datarate or TxPower, in which case we don't save the channel masks
-        // if the RFU bit is not set, we must save this channel mask
-        if(!isInternalTxDr) {
-          // save the channel mask to the uplink channels position in session buffer, with Tx and DR set to 'same'
-          cmd->payload[0] = 0xFF;
-          memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS] + (cmd->repeat - 1) * cmd->len, cmd->payload, cmd->len);
-          RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Saving mask to ULChannels[%d]:", (cmd->repeat - 1) * cmd->len);
-          RADIOLIB_DEBUG_PROTOCOL_HEXDUMP(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS] + (cmd->repeat - 1) * cmd->len, cmd->len);
-        }
-
+      // the network took over the datarate and power, so leave them alone for a while
+      if(!isInternalTxDr && this->linkAdr) {
+        this->linkAdr->holdOff();
       }
 
       // send the reply
@@ -2460,7 +4633,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
         this->dutyCycle = (RadioLibTime_t)60 * (RadioLibTime_t)60 * (RadioLibTime_t)1000 / (RadioLibTime_t)(1UL << maxDutyCycle);
       }
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_DUTY_CYCLE], cmd->payload, cmd->len);
 
       cmd->len = 0;
       return(true);
@@ -2483,7 +4655,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
         this->phyLayer->setFrequency(this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK].freq);
       }
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_RX_PARAM_SETUP], cmd->payload, cmd->len);
 
       // TODO this should be sent repeatedly until the next downlink
       cmd->len = 1;
@@ -2523,6 +4694,7 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       
       // downlink channel is identical to uplink channel
       this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK][chIndex] = this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][chIndex];
+      this->updateChannelMasks();
       newChAck = 1;
       
       // check if the frequency is possible
@@ -2546,7 +4718,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
                               this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK][chIndex].drMax
                             );
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_UL_CHANNELS] + chIndex * cmd->len, cmd->payload, cmd->len);
 
       // send the reply
       cmd->len = 1;
@@ -2582,7 +4753,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
         }
       }
       
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_DL_CHANNELS] + chIndex * cmd->len, cmd->payload, cmd->len);
 
       // TODO send this repeatedly until a downlink is received
       cmd->len = 1;
@@ -2604,7 +4774,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       this->rxDelays[0] = delay * 1000;
       this->rxDelays[1] = this->rxDelays[0] + 1000;
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_RX_TIMING_SETUP], cmd->payload, cmd->len);
 
       // send the reply
       cmd->len = 0;
@@ -2629,7 +4798,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       this->dwellTimeEnabledDn = dlDwell ? true : false;
       this->dwellTimeDn = dlDwell ? RADIOLIB_LORAWAN_DWELL_TIME : 0;
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_TX_PARAM_SETUP], cmd->payload, cmd->len);
 
       cmd->len = 0;
       return(true);
@@ -2651,7 +4819,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       this->adrDelayExp = cmd->payload[0] & 0x0F;
       RADIOLIB_DEBUG_PROTOCOL_PRINTLN("ADRParamSetupReq: limitExp = %d, delayExp = %d", this->adrLimitExp, this->adrDelayExp);
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_ADR_PARAM_SETUP], cmd->payload, cmd->len);
 
       cmd->len = 0;
       return(true);
@@ -2664,6 +4831,10 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
 
       // insert response into MAC downlink queue
       pushMacCommand(cmd, &this->commandsDown);
+
+      // keep the network time for beacon acquisition, it refers to the end of the uplink
+      uint64_t gpsTime = (uint64_t)LoRaWANNode::ntoh<uint32_t>(&cmd->payload[0])*1000 + ((uint16_t)cmd->payload[4] * 1000) / 256;
+      this->setGpsTime(gpsTime, this->rxDelayStart, 4);
       return(false);
     } break;
 
@@ -2688,7 +4859,6 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       uint8_t maxCount = cmd->payload[0] & 0x0F;
       RADIOLIB_DEBUG_PROTOCOL_PRINTLN("RejoinParamSetupReq: maxTime = %d, maxCount = %d", maxTime, maxCount);
 
-      memcpy(&this->bufferSession[RADIOLIB_LORAWAN_SESSION_REJOIN_PARAM_SETUP], cmd->payload, cmd->len);
 
       cmd->len = 0;
       cmd->payload[0] = (1 << 1) | 1;
@@ -2698,6 +4868,85 @@ bool LoRaWANNode::execMacCommand(LoRaWANMacCommand_t* cmd) {
       (void)maxCount;
       return(true);
     } break;
+
+    case(RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO): {
+      // the network accepted the requested periodicity
+      this->pingPeriodicity = this->pingPeriodicityReq;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PingSlotInfoAns: periodicity = %d", this->pingPeriodicity);
+      this->bufferSession[RADIOLIB_LORAWAN_SESSION_PERIODICITY] = this->pingPeriodicity;
+
+      // the ping slots change from now on
+      if(this->beaconLocked) {
+        this->calculatePingOffset();
+        this->pingIndex = 0;
+      }
+      return(false);
+    } break;
+
+    case(RADIOLIB_LORAWAN_MAC_PING_SLOT_CHANNEL): {
+      // get the configuration
+      uint32_t freqRaw = LoRaWANNode::ntoh<uint32_t>(&cmd->payload[0], 3);
+      float freq = (float)freqRaw/10000.0;
+      uint8_t dr = cmd->payload[3] & 0x0F;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PingSlotChannelReq: freq = %f MHz, dr = %d", freq, dr);
+      uint8_t freqAck = 0;
+      uint8_t drAck = 0;
+
+      // check if the frequency is possible, zero means the default channel
+      if(freqRaw == 0) {
+        freqAck = 1;
+      } else if(this->phyLayer->setFrequency(freq) == RADIOLIB_ERR_NONE) {
+        freqAck = 1;
+        this->phyLayer->setFrequency(this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK].freq);
+      }
+
+      // check if the datarate is possible
+      DataRate_t dataRate;
+      if((this->band->dataRates[dr] != RADIOLIB_LORAWAN_DATA_RATE_UNUSED) && (findDataRate(dr, &dataRate) == RADIOLIB_ERR_NONE)) {
+        drAck = 1;
+      }
+
+      // the configuration is only applied if it is fully accepted
+      if(freqAck && drAck) {
+        this->pingFreq = freq;
+        this->pingDr = dr;
+      }
+
+      cmd->len = 1;
+      cmd->payload[0] = (drAck << 1) | (freqAck << 0);
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("PingSlotChannelAns: status = 0x%02x", cmd->payload[0]);
+      return(true);
+    } break;
+
+    case(RADIOLIB_LORAWAN_MAC_BEACON_TIMING): {
+      // deprecated since LoRaWAN v1.0.3, the beacon is acquired using the DeviceTimeAns instead
+      return(false);
+    } break;
+
+    case(RADIOLIB_LORAWAN_MAC_BEACON_FREQ): {
+      // get the configuration
+      uint32_t freqRaw = LoRaWANNode::ntoh<uint32_t>(&cmd->payload[0], 3);
+      float freq = (float)freqRaw/10000.0;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("BeaconFreqReq: freq = %f MHz", freq);
+      uint8_t freqAck = 0;
+
+      // check if the frequency is possible, zero means the default channel(s)
+      if(freqRaw == 0) {
+        freqAck = 1;
+      } else if(this->phyLayer->setFrequency(freq) == RADIOLIB_ERR_NONE) {
+        freqAck = 1;
+        this->phyLayer->setFrequency(this->currentChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK].freq);
+      }
+
+      if(freqAck) {
+        this->beaconFreq = freq;
+      }
+
+      cmd->len = 1;
+      cmd->payload[0] = freqAck;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("BeaconFreqAns: status = 0x%02x", cmd->payload[0]);
+      return(true);
+    } break;
   }
 
   return(false);
@@ -2745,6 +4994,7 @@ bool LoRaWANNode::applyChannelMaskDyn(uint8_t chMaskCntl, uint16_t chMask) {
     }
   
   }
+  this->updateChannelMasks();
 
   #if RADIOLIB_DEBUG_PROTOCOL
   this->printChannels();
@@ -2874,6 +5124,7 @@ bool LoRaWANNode::applyChannelMaskFix(uint8_t chMaskCntl, uint16_t chMask) {
     }
 
   }
+  this->updateChannelMasks();
 
   #if RADIOLIB_DEBUG_PROTOCOL
   this->printChannels();
@@ -2882,6 +5133,30 @@ bool LoRaWANNode::applyChannelMaskFix(uint8_t chMaskCntl, uint16_t chMask) {
   return(true);
 }
 
+void LoRaWANNode::updateChannelMasks() {
+  memset(this->channelMasks, 0, sizeof(this->channelMasks));
+  memset(this->dutyCycleMasks, 0, sizeof(this->dutyCycleMasks));
+  for(uint8_t i = 0; i < RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS; i++) {
+    LoRaWANChannel_t* chnl = &(this->availableChannels[RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK][i]);
+    if(!chnl->enabled) {
+      continue;
+    }
+    for(uint8_t dr = chnl->drMin; (dr <= chnl->drMax) && (dr < RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES); dr++) {
+      this->channelMasks[dr] |= (1UL << i);
+    }
+
+    // the first duty cycle sub-band that contains the channel, otherwise the rest of the band
+    uint8_t bucket = 0;
+    for(; bucket < RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS; bucket++) {
+      const LoRaWANDutyCycleBand_t* dcBand = &(this->band->dutyCycleBands[bucket]);
+      if((dcBand->dutyCycle != 0) && (chnl->freq >= dcBand->freqStart) && (chnl->freq <= dcBand->freqEnd)) {
+        break;
+      }
+    }
+    this->dutyCycleMasks[bucket] |= (1UL << i);
+  }
+}
+
 uint8_t LoRaWANNode::getMacPayloadLength(uint8_t cid) {
   for (LoRaWANMacSpec_t entry : MacTable) {
     // cppcheck warns here we should use std::find_if, but some platforms may not have that
@@ -2973,47 +5248,6 @@ bool LoRaWANNode::performCAD() {
     return false; // Channel is free
 }
 
-void LoRaWANNode::processAES(const uint8_t* in, size_t len, uint8_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter) {
-  // figure out how many encryption blocks are there
-  size_t numBlocks = len/RADIOLIB_AES128_BLOCK_SIZE;
-  if(len % RADIOLIB_AES128_BLOCK_SIZE) {
-    numBlocks++;
-  }
-
-  // generate the encryption blocks
-  uint8_t encBuffer[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
-  uint8_t encBlock[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
-  encBlock[RADIOLIB_LORAWAN_BLOCK_MAGIC_POS] = RADIOLIB_LORAWAN_ENC_BLOCK_MAGIC;
-  encBlock[RADIOLIB_LORAWAN_ENC_BLOCK_COUNTER_ID_POS] = ctrId;
-  encBlock[RADIOLIB_LORAWAN_BLOCK_DIR_POS] = dir;
-  LoRaWANNode::hton<uint32_t>(&encBlock[RADIOLIB_LORAWAN_BLOCK_DEV_ADDR_POS], this->devAddr);
-  LoRaWANNode::hton<uint32_t>(&encBlock[RADIOLIB_LORAWAN_BLOCK_FCNT_POS], fCnt);
-
-  // now encrypt the input
-  // on downlink frames, this has a decryption effect because server actually "decrypts" the plaintext
-  size_t remLen = len;
-  for(size_t i = 0; i < numBlocks; i++) {
-
-    if(counter) {
-      encBlock[RADIOLIB_LORAWAN_ENC_BLOCK_COUNTER_POS] = i + 1;
-    }
-
-    // encrypt the buffer
-    RadioLibAES128Instance.init(key);
-    RadioLibAES128Instance.encryptECB(encBlock, RADIOLIB_AES128_BLOCK_SIZE, encBuffer);
-
-    // now xor the buffer with the input
-    size_t xorLen = remLen;
-    if(xorLen > RADIOLIB_AES128_BLOCK_SIZE) {
-      xorLen = RADIOLIB_AES128_BLOCK_SIZE;
-    }
-    for(uint8_t j = 0; j < xorLen; j++) {
-      out[i*RADIOLIB_AES128_BLOCK_SIZE + j] = in[i*RADIOLIB_AES128_BLOCK_SIZE + j] ^ encBuffer[j];
-    }
-    remLen -= xorLen;
-  }
-}
-
 uint16_t LoRaWANNode::checkSum16(uint8_t *key, uint16_t keyLen) {
   uint16_t checkSum = 0;
   for(uint16_t i = 0; i < keyLen; i += 2) {
@@ -4,6 +4,12 @@
 #include "../../TypeDef.h"
 #include "../PhysicalLayer/PhysicalLayer.h"
 #include "../../utils/Cryptography.h"
+#include "../../utils/CRC.h"
+#include "../../utils/Compression.h"
+#include "LoRaWANFragDecoder.h"
+#include "LoRaWANFrame.h"
+#include "LoRaWANLinkAdr.h"
+#include "LoRaWANVerifier.h"
 
 // activation mode
 #define RADIOLIB_LORAWAN_MODE_OTAA                              (0x07AA)
@@ -15,6 +21,39 @@
 #define RADIOLIB_LORAWAN_CLASS_B                                (0x0B)
 #define RADIOLIB_LORAWAN_CLASS_C                                (0x0C)
 
+// state of the non-blocking uplink/downlink exchange
+#define RADIOLIB_LORAWAN_ASYNC_IDLE                             (0)
+#define RADIOLIB_LORAWAN_ASYNC_TX                               (1)
+#define RADIOLIB_LORAWAN_ASYNC_RX_WAIT                          (2)
+#define RADIOLIB_LORAWAN_ASYNC_RX                               (3)
+#define RADIOLIB_LORAWAN_ASYNC_RX_DONE                          (4)
+#define RADIOLIB_LORAWAN_ASYNC_RETX_WAIT                        (5)
+
+// Class B beacon and ping slot timing
+#define RADIOLIB_LORAWAN_BEACON_INTERVAL                        (128000)  // ms
+#define RADIOLIB_LORAWAN_BEACON_RESERVED                        (2120)    // ms
+#define RADIOLIB_LORAWAN_BEACON_PERIOD_SEC                      (128)
+#define RADIOLIB_LORAWAN_BEACON_PREAMBLE_LEN                    (10)
+#define RADIOLIB_LORAWAN_BEACON_LEN_MAX                         (23)      // bytes, at SF12
+#define RADIOLIB_LORAWAN_BEACON_GUARD                           (100)     // ms, extra listening time around the expected beacon
+#define RADIOLIB_LORAWAN_BEACON_WIDENING                        (4)       // ms, widening of the beacon window per missed beacon
+#define RADIOLIB_LORAWAN_BEACON_LOST                            (56)      // number of missed beacons after which the device falls back to Class A
+#define RADIOLIB_LORAWAN_PING_SLOT_LEN                          (30)      // ms
+#define RADIOLIB_LORAWAN_PING_SLOT_WINDOW                       (4096)    // number of ping slots in the beacon window
+#define RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_MAX              (7)
+#define RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_DEFAULT          (7)
+
+// local clock synchronization
+#define RADIOLIB_LORAWAN_CLOCK_DRIFT_MAX                        (500)     // ppm, larger measured drift is discarded
+#define RADIOLIB_LORAWAN_CLOCK_DRIFT_RESIDUAL                   (10)      // ppm, remaining error of the drift compensated clock
+#define RADIOLIB_LORAWAN_CLOCK_SYNC_RATIO                       (10000)   // minimum ratio of the interval between two time references and their resolution to measure the drift
+
+// state of the Class B scheduler
+#define RADIOLIB_LORAWAN_CLASS_B_WAIT                           (0)
+#define RADIOLIB_LORAWAN_CLASS_B_BEACON                         (1)
+#define RADIOLIB_LORAWAN_CLASS_B_PING                           (2)
+#define RADIOLIB_LORAWAN_CLASS_B_PING_DONE                      (3)
+
 // modulation type
 #define RADIOLIB_LORAWAN_MODULATION_LORA                        (0)
 #define RADIOLIB_LORAWAN_MODULATION_GFSK                        (1)
@@ -44,9 +83,13 @@
 #define RADIOLIB_LORAWAN_FCTRL_ADR_ACK_REQ                      (0x01 << 6) //  6     6     adaptive data rate ACK request
 #define RADIOLIB_LORAWAN_FCTRL_ACK                              (0x01 << 5) //  5     5     confirmed message acknowledge
 #define RADIOLIB_LORAWAN_FCTRL_FRAME_PENDING                    (0x01 << 4) //  4     4     downlink frame is pending
+#define RADIOLIB_LORAWAN_FCTRL_CLASS_B                          (0x01 << 4) //  4     4     uplink from a class B device
 
 // fPort field
 #define RADIOLIB_LORAWAN_FPORT_MAC_COMMAND                      (0x00 << 0) //  7     0     payload contains MAC commands only
+#define RADIOLIB_LORAWAN_FPORT_TS003                            (0xCA << 0) //  7     0     fPort used for TS003 application layer clock synchronization
+#define RADIOLIB_LORAWAN_FPORT_TS005                            (0xC8 << 0) //  7     0     fPort used for TS005 remote multicast setup
+#define RADIOLIB_LORAWAN_FPORT_TS004                            (0xC9 << 0) //  7     0     fPort used for TS004 fragmented data block transport
 #define RADIOLIB_LORAWAN_FPORT_TS009                            (0xE0 << 0) //  7     0     fPort used for TS009 testing
 #define RADIOLIB_LORAWAN_FPORT_RESERVED                         (0xE0 << 0) //  7     0     fPort values equal to and larger than this are reserved
 
@@ -99,6 +142,7 @@
 #define RADIOLIB_LORAWAN_ADR_ACK_DELAY_EXP                      (0x05)
 #define RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MIN_MS              (1000)
 #define RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MAX_MS              (3000)
+#define RADIOLIB_LORAWAN_RETRANSMIT_MAX                         (15)  // same as the largest NbTrans
 #define RADIOLIB_LORAWAN_POWER_STEP_SIZE_DBM                    (-2)
 #define RADIOLIB_LORAWAN_REJOIN_MAX_COUNT_N                     (10)  // send rejoin request 16384 uplinks
 #define RADIOLIB_LORAWAN_REJOIN_MAX_TIME_N                      (15)  // once every year, not actually implemented
@@ -136,18 +180,6 @@
 #define RADIOLIB_LORAWAN_JOIN_ACCEPT_JS_ENC_KEY                 (0x05)
 #define RADIOLIB_LORAWAN_JOIN_ACCEPT_JS_INT_KEY                 (0x06)
 
-// frame header layout
-#define RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS                    (16)
-#define RADIOLIB_LORAWAN_FHDR_DEV_ADDR_POS                      (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 1)
-#define RADIOLIB_LORAWAN_FHDR_FCTRL_POS                         (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 5)
-#define RADIOLIB_LORAWAN_FHDR_FCNT_POS                          (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 6)
-#define RADIOLIB_LORAWAN_FHDR_FOPTS_POS                         (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 8)
-#define RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK                    (0x0F)
-#define RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN                     (15)
-#define RADIOLIB_LORAWAN_FHDR_FPORT_POS(FOPTS)                  (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 8 + (FOPTS))
-#define RADIOLIB_LORAWAN_FRAME_PAYLOAD_POS(FOPTS)               (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 9 + (FOPTS))
-#define RADIOLIB_LORAWAN_FRAME_LEN(PAYLOAD, FOPTS)              (16 + 13 + (PAYLOAD) + (FOPTS))
-
 // payload encryption/MIC blocks common layout
 #define RADIOLIB_LORAWAN_BLOCK_MAGIC_POS                        (0)
 #define RADIOLIB_LORAWAN_BLOCK_CONF_FCNT_POS                    (1)
@@ -173,7 +205,7 @@
 #define RADIOLIB_LORAWAN_FCNT_NONE                              (0xFFFFFFFF)
 
 // MAC commands
-#define RADIOLIB_LORAWAN_NUM_MAC_COMMANDS                       (16)
+#define RADIOLIB_LORAWAN_NUM_MAC_COMMANDS                       (20)
 
 #define RADIOLIB_LORAWAN_MAC_RESET                              (0x01)
 #define RADIOLIB_LORAWAN_MAC_LINK_CHECK                         (0x02)
@@ -190,14 +222,80 @@
 #define RADIOLIB_LORAWAN_MAC_DEVICE_TIME                        (0x0D)
 #define RADIOLIB_LORAWAN_MAC_FORCE_REJOIN                       (0x0E)
 #define RADIOLIB_LORAWAN_MAC_REJOIN_PARAM_SETUP                 (0x0F)
+#define RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO                     (0x10)
+#define RADIOLIB_LORAWAN_MAC_PING_SLOT_CHANNEL                  (0x11)
+#define RADIOLIB_LORAWAN_MAC_BEACON_TIMING                      (0x12)
+#define RADIOLIB_LORAWAN_MAC_BEACON_FREQ                        (0x13)
 #define RADIOLIB_LORAWAN_MAC_PROPRIETARY                        (0x80)
 
+// multicast groups
+#define RADIOLIB_LORAWAN_NUM_MC_GROUPS                          (4)
+#define RADIOLIB_LORAWAN_MC_GROUP_NONE                          (0xFF)
+#define RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN                       (56)
+
+// the multicast groups only take up space in the session buffer when multicast is enabled
+#if RADIOLIB_LORAWAN_MULTICAST
+#define RADIOLIB_LORAWAN_SESSION_MC_GROUPS_LEN                  (RADIOLIB_LORAWAN_NUM_MC_GROUPS*RADIOLIB_LORAWAN_MC_GROUP_BUF_LEN)
+#else
+#define RADIOLIB_LORAWAN_SESSION_MC_GROUPS_LEN                  (0)
+#endif
+
+// TS003 application layer clock synchronization commands
+#define RADIOLIB_LORAWAN_TS003_PACKAGE_ID                       (1)
+#define RADIOLIB_LORAWAN_TS003_PACKAGE_VERSION                  (1)
+#define RADIOLIB_LORAWAN_TS003_PACKAGE_VERSION_REQ              (0x00)
+#define RADIOLIB_LORAWAN_TS003_APP_TIME                         (0x01)
+#define RADIOLIB_LORAWAN_TS003_DEVICE_APP_TIME_PERIODICITY      (0x02)
+#define RADIOLIB_LORAWAN_TS003_FORCE_DEVICE_RESYNC              (0x03)
+#define RADIOLIB_LORAWAN_TS003_PERIODICITY_MAX                  (15)
+#define RADIOLIB_LORAWAN_TS003_PERIODICITY_NONE                 (0xFF)
+#define RADIOLIB_LORAWAN_TS003_PERIOD_SEC                       (128)     // s, multiplied by 2^periodicity
+
+// TS005 remote multicast setup commands
+#define RADIOLIB_LORAWAN_TS005_PACKAGE_ID                       (2)
+#define RADIOLIB_LORAWAN_TS005_PACKAGE_VERSION                  (1)
+#define RADIOLIB_LORAWAN_TS005_PACKAGE_VERSION_REQ              (0x00)
+#define RADIOLIB_LORAWAN_TS005_MC_GROUP_STATUS_REQ              (0x01)
+#define RADIOLIB_LORAWAN_TS005_MC_GROUP_SETUP_REQ               (0x02)
+#define RADIOLIB_LORAWAN_TS005_MC_GROUP_DELETE_REQ              (0x03)
+#define RADIOLIB_LORAWAN_TS005_MC_CLASS_C_SESSION_REQ           (0x04)
+#define RADIOLIB_LORAWAN_TS005_MC_CLASS_B_SESSION_REQ           (0x05)
+
+// TS004 fragmented data block transport commands
+#define RADIOLIB_LORAWAN_TS004_PACKAGE_ID                       (3)
+#define RADIOLIB_LORAWAN_TS004_PACKAGE_VERSION                  (1)
+#define RADIOLIB_LORAWAN_TS004_PACKAGE_VERSION_REQ              (0x00)
+#define RADIOLIB_LORAWAN_TS004_FRAG_SESSION_STATUS_REQ          (0x01)
+#define RADIOLIB_LORAWAN_TS004_FRAG_SESSION_SETUP_REQ           (0x02)
+#define RADIOLIB_LORAWAN_TS004_FRAG_SESSION_DELETE_REQ          (0x03)
+#define RADIOLIB_LORAWAN_TS004_DATA_FRAGMENT                    (0x08)
+
+// maximum length of the answers to the application layer packages
+#define RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN                    (51)
+
 // the length of internal MAC command queue - hopefully this is enough for most use cases
 #define RADIOLIB_LORAWAN_MAC_COMMAND_QUEUE_SIZE                 (9)
 
 // the maximum number of simultaneously available channels
+// at most 16, as the enabled channels are kept in 16-bit masks
 #define RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS                 (16)
 
+// uplink channel hopping policies
+#define RADIOLIB_LORAWAN_CHANNEL_POLICY_RANDOM                  (0)       // random channel for each uplink
+#define RADIOLIB_LORAWAN_CHANNEL_POLICY_ROUND_ROBIN             (1)       // least recently used channel for each uplink
+
+// duty cycle sub-bands and the period over which the airtime is accounted
+#define RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS                   (5)
+#define RADIOLIB_LORAWAN_DUTY_CYCLE_PERIOD                      (3600000UL)   // one hour in ms
+
+// join backoff periods after the first Join-Request and the Join-Request airtime allowed in each of them
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_0                  (3600000UL)   // first hour
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_1                  (36000000UL)  // next 10 hours
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_PERIOD_2                  (86400000UL)  // every 24 hours after that
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_0                 (36000UL)
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_1                 (36000UL)
+#define RADIOLIB_LORAWAN_JOIN_BACKOFF_AIRTIME_2                 (8700UL)
+
 // maximum MAC command sizes
 #define RADIOLIB_LORAWAN_MAX_MAC_COMMAND_LEN_DOWN               (5)
 #define RADIOLIB_LORAWAN_MAX_MAC_COMMAND_LEN_UP                 (2)
@@ -238,6 +336,10 @@ constexpr LoRaWANMacSpec_t MacTable[RADIOLIB_LORAWAN_NUM_MAC_COMMANDS + 1] = {
   { RADIOLIB_LORAWAN_MAC_DEVICE_TIME,         5, 0, true  },
   { RADIOLIB_LORAWAN_MAC_FORCE_REJOIN,        2, 0, false },
   { RADIOLIB_LORAWAN_MAC_REJOIN_PARAM_SETUP,  1, 1, false },
+  { RADIOLIB_LORAWAN_MAC_PING_SLOT_INFO,      0, 1, false },
+  { RADIOLIB_LORAWAN_MAC_PING_SLOT_CHANNEL,   4, 1, false },
+  { RADIOLIB_LORAWAN_MAC_BEACON_TIMING,       3, 0, false },
+  { RADIOLIB_LORAWAN_MAC_BEACON_FREQ,         3, 1, false },
   { RADIOLIB_LORAWAN_MAC_PROPRIETARY,         5, 0, true  } 
 };
 
@@ -274,7 +376,7 @@ struct LoRaWANMacCommandQueue_t {
   LoRaWANMacCommand_t commands[RADIOLIB_LORAWAN_MAC_COMMAND_QUEUE_SIZE];
 };
 
-#define RADIOLIB_LORAWAN_NONCES_VERSION_VAL (0x0001)
+#define RADIOLIB_LORAWAN_NONCES_VERSION_VAL (0x0002)
 
 enum LoRaWANSchemeBase_t {
   RADIOLIB_LORAWAN_NONCES_START       = 0x00,
@@ -286,10 +388,45 @@ enum LoRaWANSchemeBase_t {
   RADIOLIB_LORAWAN_NONCES_DEV_NONCE   = RADIOLIB_LORAWAN_NONCES_CHECKSUM + sizeof(uint16_t),  // 2 bytes
   RADIOLIB_LORAWAN_NONCES_JOIN_NONCE  = RADIOLIB_LORAWAN_NONCES_DEV_NONCE + sizeof(uint16_t), // 3 bytes
   RADIOLIB_LORAWAN_NONCES_ACTIVE      = RADIOLIB_LORAWAN_NONCES_JOIN_NONCE + 3,               // 1 byte
-  RADIOLIB_LORAWAN_NONCES_SIGNATURE   = RADIOLIB_LORAWAN_NONCES_ACTIVE + sizeof(uint8_t),     // 2 bytes
+  RADIOLIB_LORAWAN_NONCES_JOIN_PERIOD = RADIOLIB_LORAWAN_NONCES_ACTIVE + sizeof(uint8_t),     // 2 bytes (keeps the buffer even)
+  RADIOLIB_LORAWAN_NONCES_JOIN_START  = RADIOLIB_LORAWAN_NONCES_JOIN_PERIOD + sizeof(uint16_t), // 4 bytes
+  RADIOLIB_LORAWAN_NONCES_JOIN_AIRTIME = RADIOLIB_LORAWAN_NONCES_JOIN_START + sizeof(uint32_t), // 4 bytes
+  RADIOLIB_LORAWAN_NONCES_JOIN_TOA    = RADIOLIB_LORAWAN_NONCES_JOIN_AIRTIME + sizeof(uint32_t), // 4 bytes
+  RADIOLIB_LORAWAN_NONCES_JOIN_DELAY  = RADIOLIB_LORAWAN_NONCES_JOIN_TOA + sizeof(uint32_t),  // 4 bytes
+  RADIOLIB_LORAWAN_NONCES_SIGNATURE   = RADIOLIB_LORAWAN_NONCES_JOIN_DELAY + sizeof(uint32_t), // 2 bytes
   RADIOLIB_LORAWAN_NONCES_BUF_SIZE    = RADIOLIB_LORAWAN_NONCES_SIGNATURE + sizeof(uint16_t)  // Nonces buffer size
 };
 
+// Nonces buffers saved before the join backoff was added end with the signature right after NONCES_ACTIVE
+#define RADIOLIB_LORAWAN_NONCES_VERSION_1       (0x0001)
+#define RADIOLIB_LORAWAN_NONCES_VERSION_1_SIZE  (RADIOLIB_LORAWAN_NONCES_ACTIVE + sizeof(uint8_t) + sizeof(uint16_t))
+
+// snapshot of the MAC state in the session buffer, in the form it is used in
+// so that a session is restored without running the MAC commands that built it again
+// version 2 is the first one saved in place of the MAC commands
+#define RADIOLIB_LORAWAN_STATE_VERSION_VAL (0x02)
+#define RADIOLIB_LORAWAN_STATE_CHANNEL_LEN (6)
+
+enum LoRaWANSchemeState_t {
+  RADIOLIB_LORAWAN_STATE_VERSION              = 0x00,                                             // 1 byte
+  RADIOLIB_LORAWAN_STATE_PLAN                 = RADIOLIB_LORAWAN_STATE_VERSION + sizeof(uint8_t),           // 1 byte
+  RADIOLIB_LORAWAN_STATE_SUB_BAND             = RADIOLIB_LORAWAN_STATE_PLAN + sizeof(uint8_t),              // 1 byte
+  RADIOLIB_LORAWAN_STATE_DATA_RATES           = RADIOLIB_LORAWAN_STATE_SUB_BAND + sizeof(uint8_t),          // 2 bytes
+  RADIOLIB_LORAWAN_STATE_TX_POWER_STEPS       = RADIOLIB_LORAWAN_STATE_DATA_RATES + 2*sizeof(uint8_t),      // 1 byte
+  RADIOLIB_LORAWAN_STATE_TX_POWER_MAX         = RADIOLIB_LORAWAN_STATE_TX_POWER_STEPS + sizeof(uint8_t),    // 1 byte
+  RADIOLIB_LORAWAN_STATE_NB_TRANS             = RADIOLIB_LORAWAN_STATE_TX_POWER_MAX + sizeof(uint8_t),      // 1 byte
+  RADIOLIB_LORAWAN_STATE_DUTY_CYCLE           = RADIOLIB_LORAWAN_STATE_NB_TRANS + sizeof(uint8_t),          // 4 bytes
+  RADIOLIB_LORAWAN_STATE_DWELL_TIME           = RADIOLIB_LORAWAN_STATE_DUTY_CYCLE + sizeof(uint32_t),       // 1 byte
+  RADIOLIB_LORAWAN_STATE_RX1_DR_OFFSET        = RADIOLIB_LORAWAN_STATE_DWELL_TIME + sizeof(uint8_t),        // 1 byte
+  RADIOLIB_LORAWAN_STATE_RX2                  = RADIOLIB_LORAWAN_STATE_RX1_DR_OFFSET + sizeof(uint8_t),     // 6 bytes
+  RADIOLIB_LORAWAN_STATE_RX_DELAYS            = RADIOLIB_LORAWAN_STATE_RX2 + RADIOLIB_LORAWAN_STATE_CHANNEL_LEN, // 2*2 bytes
+  RADIOLIB_LORAWAN_STATE_ADR_PARAM            = RADIOLIB_LORAWAN_STATE_RX_DELAYS + 2*sizeof(uint16_t),      // 1 byte
+  RADIOLIB_LORAWAN_STATE_PING_SLOT            = RADIOLIB_LORAWAN_STATE_ADR_PARAM + sizeof(uint8_t),         // 4 bytes
+  RADIOLIB_LORAWAN_STATE_BEACON_FREQ          = RADIOLIB_LORAWAN_STATE_PING_SLOT + 4,                       // 3 bytes
+  RADIOLIB_LORAWAN_STATE_CHANNELS             = RADIOLIB_LORAWAN_STATE_BEACON_FREQ + 3,                     // 2*16*6 bytes
+  RADIOLIB_LORAWAN_STATE_BUF_SIZE             = RADIOLIB_LORAWAN_STATE_CHANNELS + 2*RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS*RADIOLIB_LORAWAN_STATE_CHANNEL_LEN
+};
+
 enum LoRaWANSchemeSession_t {
   RADIOLIB_LORAWAN_SESSION_START              = 0x00,
   RADIOLIB_LORAWAN_SESSION_NWK_SENC_KEY       = RADIOLIB_LORAWAN_SESSION_START,                 // 16 bytes
@@ -305,24 +442,15 @@ enum LoRaWANSchemeSession_t {
   RADIOLIB_LORAWAN_SESSION_RJ_COUNT1          = RADIOLIB_LORAWAN_SESSION_RJ_COUNT0 + sizeof(uint16_t), 	      // 2 bytes
   RADIOLIB_LORAWAN_SESSION_HOMENET_ID         = RADIOLIB_LORAWAN_SESSION_RJ_COUNT1 + sizeof(uint16_t), 	      // 4 bytes
   RADIOLIB_LORAWAN_SESSION_VERSION            = RADIOLIB_LORAWAN_SESSION_HOMENET_ID + sizeof(uint32_t), 	    // 1 byte
-  RADIOLIB_LORAWAN_SESSION_DUTY_CYCLE         = RADIOLIB_LORAWAN_SESSION_VERSION + sizeof(uint8_t), 	        // 1 byte
-  RADIOLIB_LORAWAN_SESSION_RX_PARAM_SETUP     = RADIOLIB_LORAWAN_SESSION_DUTY_CYCLE + MacTable[RADIOLIB_LORAWAN_MAC_DUTY_CYCLE].lenDn, 	// 4 bytes
-  RADIOLIB_LORAWAN_SESSION_RX_TIMING_SETUP    = RADIOLIB_LORAWAN_SESSION_RX_PARAM_SETUP + MacTable[RADIOLIB_LORAWAN_MAC_RX_PARAM_SETUP].lenDn, 	// 1 byte
-  RADIOLIB_LORAWAN_SESSION_TX_PARAM_SETUP     = RADIOLIB_LORAWAN_SESSION_RX_TIMING_SETUP + MacTable[RADIOLIB_LORAWAN_MAC_RX_TIMING_SETUP].lenDn, 	// 1 byte
-  RADIOLIB_LORAWAN_SESSION_ADR_PARAM_SETUP    = RADIOLIB_LORAWAN_SESSION_TX_PARAM_SETUP + MacTable[RADIOLIB_LORAWAN_MAC_TX_PARAM_SETUP].lenDn, 	// 1 byte
-  RADIOLIB_LORAWAN_SESSION_REJOIN_PARAM_SETUP = RADIOLIB_LORAWAN_SESSION_ADR_PARAM_SETUP + MacTable[RADIOLIB_LORAWAN_MAC_ADR_PARAM_SETUP].lenDn, 	// 1 byte
-  RADIOLIB_LORAWAN_SESSION_BEACON_FREQ        = RADIOLIB_LORAWAN_SESSION_REJOIN_PARAM_SETUP + MacTable[RADIOLIB_LORAWAN_MAC_REJOIN_PARAM_SETUP].lenDn, 	// 3 bytes
-  RADIOLIB_LORAWAN_SESSION_PING_SLOT_CHANNEL  = RADIOLIB_LORAWAN_SESSION_BEACON_FREQ + 3, 	    // 4 bytes
-  RADIOLIB_LORAWAN_SESSION_PERIODICITY        = RADIOLIB_LORAWAN_SESSION_PING_SLOT_CHANNEL + 4, // 1 byte
+  RADIOLIB_LORAWAN_SESSION_PERIODICITY        = RADIOLIB_LORAWAN_SESSION_VERSION + sizeof(uint8_t), 	        // 1 byte
   RADIOLIB_LORAWAN_SESSION_LAST_TIME          = RADIOLIB_LORAWAN_SESSION_PERIODICITY + 1, 	    // 4 bytes
-  RADIOLIB_LORAWAN_SESSION_UL_CHANNELS        = RADIOLIB_LORAWAN_SESSION_LAST_TIME + 4, 	      // 16*5 bytes
-  RADIOLIB_LORAWAN_SESSION_DL_CHANNELS        = RADIOLIB_LORAWAN_SESSION_UL_CHANNELS + 16*MacTable[RADIOLIB_LORAWAN_MAC_NEW_CHANNEL].lenDn, // 16*4 bytes
-  RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL       = RADIOLIB_LORAWAN_SESSION_DL_CHANNELS + 16*MacTable[RADIOLIB_LORAWAN_MAC_DL_CHANNEL].lenDn,  // 9*8+2 bytes
+  RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL       = RADIOLIB_LORAWAN_SESSION_LAST_TIME + 4,         // 9*8+2 bytes
   RADIOLIB_LORAWAN_SESSION_N_FCNT_DOWN        = RADIOLIB_LORAWAN_SESSION_MAC_QUEUE_UL + sizeof(LoRaWANMacCommandQueue_t), // 4 bytes
   RADIOLIB_LORAWAN_SESSION_ADR_FCNT           = RADIOLIB_LORAWAN_SESSION_N_FCNT_DOWN + sizeof(uint32_t),      // 4 bytes
-  RADIOLIB_LORAWAN_SESSION_LINK_ADR           = RADIOLIB_LORAWAN_SESSION_ADR_FCNT + sizeof(uint32_t),         // 4 bytes
-  RADIOLIB_LORAWAN_SESSION_FCNT_UP            = RADIOLIB_LORAWAN_SESSION_LINK_ADR + MacTable[RADIOLIB_LORAWAN_MAC_LINK_ADR].lenDn,  // 4 bytes
-  RADIOLIB_LORAWAN_SESSION_SIGNATURE          = RADIOLIB_LORAWAN_SESSION_FCNT_UP + sizeof(uint32_t),          // 2 bytes
+  RADIOLIB_LORAWAN_SESSION_FCNT_UP            = RADIOLIB_LORAWAN_SESSION_ADR_FCNT + sizeof(uint32_t),         // 4 bytes
+  RADIOLIB_LORAWAN_SESSION_STATE              = RADIOLIB_LORAWAN_SESSION_FCNT_UP + sizeof(uint32_t),          // see LoRaWANSchemeState_t
+  RADIOLIB_LORAWAN_SESSION_MC_GROUPS          = RADIOLIB_LORAWAN_SESSION_STATE + RADIOLIB_LORAWAN_STATE_BUF_SIZE, // 4*56 bytes with multicast enabled
+  RADIOLIB_LORAWAN_SESSION_SIGNATURE          = RADIOLIB_LORAWAN_SESSION_MC_GROUPS + RADIOLIB_LORAWAN_SESSION_MC_GROUPS_LEN, // 2 bytes
   RADIOLIB_LORAWAN_SESSION_BUF_SIZE           = RADIOLIB_LORAWAN_SESSION_SIGNATURE + sizeof(uint16_t)         // Session buffer size
 };
 
@@ -379,6 +507,24 @@ struct LoRaWANChannelSpan_t {
 // alias for unused channel span
 #define RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE    { .numChannels = 0, .freqStart = 0, .freqStep = 0, .drMin = 0, .drMax = 0, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED }
 
+/*!
+  \struct LoRaWANDutyCycleBand_t
+  \brief Structure to save the duty cycle limit of a regulatory sub-band.
+*/
+struct LoRaWANDutyCycleBand_t {
+  /*! \brief Lowest channel frequency in the sub-band */
+  float freqStart;
+
+  /*! \brief Highest channel frequency in the sub-band (inclusive) */
+  float freqEnd;
+
+  /*! \brief Number of milliseconds per hour of allowed Time-on-Air in this sub-band */
+  RadioLibTime_t dutyCycle;
+};
+
+// alias for unused duty cycle sub-band
+#define RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE    { .freqStart = 0, .freqEnd = 0, .dutyCycle = 0 }
+
 /*!
   \struct LoRaWANBand_t
   \brief Structure to save information about LoRaWAN band
@@ -402,6 +548,9 @@ struct LoRaWANBand_t {
   /*! \brief Number of milliseconds per hour of allowed Time-on-Air */
   RadioLibTime_t dutyCycle;
 
+  /*! \brief Regulatory sub-bands with their own duty cycle, channels outside of these are limited by dutyCycle */
+  LoRaWANDutyCycleBand_t dutyCycleBands[RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS];
+
   /*! \brief Maximum dwell time per uplink message in milliseconds */
   RadioLibTime_t dwellTimeUp;
 
@@ -428,6 +577,9 @@ struct LoRaWANBand_t {
 
   /*! \brief Backup channel for downlink (RX2) window */
   LoRaWANChannel_t rx2;
+
+  /*! \brief Class B beacon channel(s); the ping slots default to the same channels and datarate */
+  LoRaWANChannelSpan_t beaconSpan;
   
   /*! \brief The corresponding datarates, bandwidths and coding rates for DR index */
   uint8_t dataRates[RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES];
@@ -515,11 +667,92 @@ struct LoRaWANEvent_t {
   
   /*! \brief Port number */
   uint8_t fPort;
+
+  /*! \brief Multicast group of the downlink, RADIOLIB_LORAWAN_MC_GROUP_NONE for unicast frames and uplinks */
+  uint8_t mcGroup;
+
+  /*! \brief What the link margin ADR did before this uplink, one of RADIOLIB_LORAWAN_LINK_ADR_ACTION_* */
+  uint8_t linkAdrAction;
+
+  /*! \brief Datarate chosen by the link margin ADR, used for this uplink if the action was RADIOLIB_LORAWAN_LINK_ADR_ACTION_APPLIED */
+  uint8_t linkAdrDr;
+
+  /*! \brief Transmit power in dBm chosen by the link margin ADR */
+  int16_t linkAdrPower;
+
+  /*! \brief Estimated link margin of this uplink in dB, 0 if the link margin ADR has no samples yet */
+  float linkMargin;
+
+  /*! \brief Transmission of the uplink frame, 1 for the first one and higher for retransmissions, 0 for downlinks */
+  uint8_t attempt;
+};
+
+/*!
+  \struct LoRaWANMulticastGroup_t
+  \brief Structure to save the multicast group session and its Class B or C session parameters.
+*/
+struct LoRaWANMulticastGroup_t {
+  /*! \brief Whether this group is set up */
+  bool defined;
+
+  /*! \brief Multicast address shared by the group */
+  uint32_t mcAddr;
+
+  /*! \brief Multicast application session key */
+  uint8_t mcAppSKey[RADIOLIB_AES128_KEY_SIZE];
+
+  /*! \brief Multicast network session key */
+  uint8_t mcNwkSKey[RADIOLIB_AES128_KEY_SIZE];
+
+  /*! \brief Lowest frame counter that will be accepted (last received + 1) */
+  uint32_t fCntMin;
+
+  /*! \brief Highest frame counter that will be accepted */
+  uint32_t fCntMax;
+
+  /*! \brief Class of the scheduled session, RADIOLIB_LORAWAN_CLASS_B or RADIOLIB_LORAWAN_CLASS_C, 0 if none */
+  uint8_t sessionClass;
+
+  /*! \brief Start of the session, in seconds since GPS epoch */
+  uint32_t sessionTime;
+
+  /*! \brief Session length as a power of 2 in seconds (Class C) or beacon periods (Class B) */
+  uint8_t sessionTimeout;
+
+  /*! \brief Downlink frequency in MHz of the session, 0 for the default channel */
+  float freq;
+
+  /*! \brief Downlink datarate of the session */
+  uint8_t dr;
+
+  /*! \brief Ping slot periodicity of a Class B session */
+  uint8_t periodicity;
 };
 
+class LoRaWANNode;
+
+/*!
+  \brief Callback invoked when a non-blocking uplink/downlink exchange completes.
+  Called from LoRaWANNode::poll(), never from interrupt context.
+  \param node The node that finished the exchange.
+  \param state Result of the exchange, same as returned by sendReceive.
+  \param ctx User context passed to LoRaWANNode::setEventAction.
+*/
+typedef void (*LoRaWANEventCb_t)(LoRaWANNode* node, int16_t state, void* ctx);
+
+/*!
+  \brief Callback invoked after every transmission of an uplink frame, including its retransmissions.
+  Called from the blocking uplink functions or from LoRaWANNode::startUplink and LoRaWANNode::poll,
+  never from interrupt context. In the non-blocking mode, it is called once the transmission was started.
+  \param node The node that sent the frame.
+  \param event Uplink event of this transmission, the attempt field counts the transmissions.
+  \param ctx User context passed to LoRaWANNode::setUplinkAction.
+*/
+typedef void (*LoRaWANUplinkCb_t)(LoRaWANNode* node, const LoRaWANEvent_t* event, void* ctx);
+
 /*!
   \class LoRaWANNode
-  \brief LoRaWAN-compatible node (class A device).
+  \brief LoRaWAN-compatible node (class A, B and C device).
 */
 class LoRaWANNode {
   public:
@@ -532,6 +765,11 @@ class LoRaWANNode {
     */
     LoRaWANNode(PhysicalLayer* phy, const LoRaWANBand_t* band, uint8_t subBand = 0);
 
+    /*!
+      \brief Default destructor, frees the interrupt action of the node for other nodes.
+    */
+    ~LoRaWANNode();
+
     /*!
       \brief Clear an active session, so that the device will have to rejoin the network.
     */
@@ -546,9 +784,14 @@ class LoRaWANNode {
     /*!
       \brief Fill the internal buffer that holds the LW base parameters with a supplied buffer
       \param persistentBuffer Buffer that should match the internal format (previously extracted using getBufferNonces)
+      \param offTime Time in milliseconds the device was powered down or in deep sleep since the buffer was saved.
+      The buffer also holds the join backoff, which continues from the last join-request as if that was offTime ago.
+      Leaving it at 0 is always safe, but the device then waits again for the time it already spent powered down.
+      Buffers of the previous version (RADIOLIB_LORAWAN_NONCES_VERSION_1_SIZE bytes) are accepted as well,
+      their DevNonce and JoinNonce are kept and the join backoff starts from its defaults.
       \returns \ref status_codes
     */
-    int16_t setBufferNonces(uint8_t* persistentBuffer);
+    int16_t setBufferNonces(uint8_t* persistentBuffer, RadioLibTime_t offTime = 0);
 
     /*!
       \brief Returns the pointer to the internal buffer that holds the LW session parameters
@@ -569,6 +812,8 @@ class LoRaWANNode {
       \param devEUI 8-byte device identifier.
       \param nwkKey Pointer to the network AES-128 key.
       \param appKey Pointer to the application AES-128 key.
+      The keys are expanded and the Join-Request is prepared here, so that join attempts only add the DevNonce and MIC.
+      This also restarts the join backoff, as after a power-up.
     */
     void beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey);
 
@@ -576,7 +821,7 @@ class LoRaWANNode {
       \brief Join network by restoring OTAA session or performing over-the-air activation. By this procedure,
       the device will perform an exchange with the network server and set all necessary configuration. 
       \param joinDr The datarate at which to send the join-request and any subsequent uplinks (unless ADR is enabled)
-      \returns \ref status_codes
+      \returns \ref status_codes, RADIOLIB_ERR_UPLINK_UNAVAILABLE if the join backoff does not allow a Join-Request yet.
     */
     int16_t activateOTAA(uint8_t initialDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED, LoRaWANJoinEvent_t *joinEvent = NULL);
 
@@ -745,6 +990,250 @@ class LoRaWANNode {
     */
     int16_t sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort = 1, bool isConfirmed = false, LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
 
+    /*!
+      \brief Start a non-blocking uplink/downlink exchange. The uplink is handed over to the radio
+      and the method returns immediately; transmission end and the Rx1/Rx2 windows are then
+      handled by calling poll() from the main loop. Buffers passed in must stay valid until the exchange completes.
+      \param dataUp Data to send.
+      \param lenUp Length of the data.
+      \param fPort Port number to send the message to.
+      \param dataDown Buffer to save the received downlink data to, or NULL to discard the payload.
+      \param lenDown Pointer to variable to save the received downlink length to, or NULL.
+      \param isConfirmed Whether to send a confirmed uplink or not.
+      \param eventUp Pointer to a structure to store extra information about the uplink event
+      (fPort, frame counter, etc.). If set to NULL, no extra information will be passed to the user.
+      \param eventDown Pointer to a structure to store extra information about the downlink event
+      (fPort, frame counter, etc.). If set to NULL, no extra information will be passed to the user.
+      \returns \ref status_codes
+    */
+    int16_t startUplink(uint8_t* dataUp, size_t lenUp, uint8_t fPort = 1, uint8_t* dataDown = NULL, size_t* lenDown = NULL, bool isConfirmed = false, LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
+
+    /*!
+      \brief Advance the exchange started by startUplink. Never blocks, so it can be called as often as needed.
+      The Rx windows are timed from the end of the time-on-air, not from the call that notices the transmission ended,
+      so poll() may come late as long as it is called before the window opens (see timeUntilPoll).
+      \returns RADIOLIB_ERR_OPERATION_PENDING while the exchange is in progress, its final result once it completes
+      (the same codes as sendReceive, e.g. RADIOLIB_LORAWAN_NO_DOWNLINK) and RADIOLIB_ERR_NONE when idle.
+    */
+    int16_t poll();
+
+    /*!
+      \brief Set a callback invoked from poll() when the exchange started by startUplink completes.
+      \param func Callback to call, or NULL to disable.
+      \param ctx User context passed to the callback.
+    */
+    void setEventAction(LoRaWANEventCb_t func, void* ctx = NULL);
+
+    /*!
+      \brief Set a callback invoked after every transmission of an uplink frame, including its retransmissions.
+      \param func Callback to call, or NULL to disable.
+      \param ctx User context passed to the callback.
+    */
+    void setUplinkAction(LoRaWANUplinkCb_t func, void* ctx = NULL);
+
+    /*!
+      \brief Enable the retransmission of uplinks by sendReceive and startUplink. Unconfirmed uplinks are sent
+      NbTrans times (as set by the network in LinkADRReq) unless a downlink is received, confirmed uplinks
+      are sent until a downlink acknowledges them or the transmissions run out. Every retransmission goes out
+      on another channel if possible, after a random delay between RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MIN_MS
+      and RADIOLIB_LORAWAN_RETRANSMIT_TIMEOUT_MAX_MS following the Rx windows, and later if the duty cycle
+      requires so. The frame is not built again: in LoRaWAN v1.0.x it is sent as it is,
+      in v1.1 only its MIC is updated for the new channel.
+      \param enable Whether to retransmit uplinks.
+      \param maxConfirmed Number of transmissions of a confirmed uplink, if higher than NbTrans.
+      LoRaWAN v1.0.4 and v1.1 use NbTrans for confirmed uplinks too, v1.0.3 and earlier recommended up to 8.
+    */
+    void setRetransmissions(bool enable = true, uint8_t maxConfirmed = 0);
+
+    /*!
+      \brief Get the time until poll() has some work to do, e.g. to sleep or arm a timer until then.
+      The radio interrupts (transmission or reception done) may require earlier attention.
+      \returns Time in milliseconds, 0 if poll() should be called right away or no exchange is in progress.
+    */
+    RadioLibTime_t timeUntilPoll();
+
+    /*!
+      \brief Check whether a non-blocking exchange is in progress.
+      \returns True if startUplink was called and the exchange did not complete yet.
+    */
+    bool isBusy();
+
+    /*!
+      \brief Switch the device class. The session must be active. In Class C, the device listens
+      continuously with the Rx2 parameters whenever it is not transmitting or in the Rx1 window;
+      received frames are retrieved by getDownlinkClassC. In Class B, the device tracks the beacon
+      and opens the ping slots on time, which requires a prior call to acquireBeacon;
+      received frames are retrieved by getDownlinkClassB. Switching is not communicated to the network,
+      this has to be agreed on by the application (e.g. by an uplink on an application port).
+      \param cls Device class, RADIOLIB_LORAWAN_CLASS_A, RADIOLIB_LORAWAN_CLASS_B or RADIOLIB_LORAWAN_CLASS_C.
+      \returns \ref status_codes
+    */
+    int16_t setClass(uint8_t cls);
+
+    /*!
+      \brief Get the current device class.
+      \returns Device class, one of RADIOLIB_LORAWAN_CLASS_*.
+    */
+    uint8_t getClass();
+
+    /*!
+      \brief Get a downlink received in Class C outside of the Rx1 and Rx2 windows. Does not block,
+      so it can be called on every iteration of the main loop; the check is a simple flag
+      set by the radio interrupt.
+      \param dataDown Buffer to save the received downlink data to, or NULL to discard the payload.
+      \param lenDown Pointer to variable to save the received downlink length to, or NULL.
+      \param eventDown Pointer to a structure to store extra information about the downlink event
+      (fPort, frame counter, etc.). If set to NULL, no extra information will be passed to the user.
+      \returns RADIOLIB_ERR_NONE if a downlink was processed, RADIOLIB_LORAWAN_NO_DOWNLINK if there is none,
+      otherwise \ref status_codes
+    */
+    int16_t getDownlinkClassC(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventDown = NULL);
+
+    /*!
+      \brief Request a new Class B ping slot periodicity from the network (PingSlotInfoReq).
+      The request is sent with the next uplink and applied once the network answers it.
+      \param periodicity Ping slot periodicity, 0 (every second) to 7 (every 128 seconds).
+      \returns \ref status_codes
+    */
+    int16_t setPingSlotPeriodicity(uint8_t periodicity);
+
+    /*!
+      \brief Search for the Class B beacon and lock onto it. This method blocks!
+      If the network time is known (from a DeviceTimeAns or a previous beacon), only the expected
+      beacon is listened for. Otherwise the device listens for a full beacon period on each beacon channel.
+      \returns RADIOLIB_ERR_NONE if a beacon was received, RADIOLIB_LORAWAN_NO_BEACON if not,
+      otherwise \ref status_codes
+    */
+    int16_t acquireBeacon();
+
+    /*!
+      \brief Get the GPS time of the last beacon (received or expected while tracking).
+      \returns Number of seconds since GPS epoch (Jan. 6th 1980), 0 if no beacon was acquired.
+    */
+    uint32_t getBeaconTime();
+
+    /*!
+      \brief Run the Class B scheduler and get a downlink received in a ping slot. Does not block,
+      but must be called often (at least every few milliseconds around the scheduled slots,
+      see timeUntilPoll) to open the beacon and ping slot windows on time. A frame received in a ping slot
+      must be collected before the next uplink, which fails with RADIOLIB_ERR_UPLINK_UNAVAILABLE until then.
+      \param dataDown Buffer to save the received downlink data to, or NULL to discard the payload.
+      \param lenDown Pointer to variable to save the received downlink length to, or NULL.
+      \param eventDown Pointer to a structure to store extra information about the downlink event
+      (fPort, frame counter, etc.). If set to NULL, no extra information will be passed to the user.
+      \returns RADIOLIB_ERR_NONE if a downlink was processed, RADIOLIB_LORAWAN_NO_DOWNLINK if there is none,
+      RADIOLIB_LORAWAN_NO_BEACON if the beacon was lost and the device reverted to Class A,
+      otherwise \ref status_codes
+    */
+    int16_t getDownlinkClassB(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventDown = NULL);
+
+    /*!
+      \brief Set up a multicast group locally (as opposed to remote setup through TS005).
+      Downlinks to the multicast address are then accepted alongside the unicast ones.
+      \param id Group ID, 0 to RADIOLIB_LORAWAN_NUM_MC_GROUPS - 1.
+      \param mcAddr Multicast address of the group.
+      \param mcAppSKey Multicast application session key.
+      \param mcNwkSKey Multicast network session key.
+      \param fCntMin Lowest frame counter that will be accepted.
+      \param fCntMax Highest frame counter that will be accepted.
+      \returns \ref status_codes, RADIOLIB_ERR_UNSUPPORTED unless RADIOLIB_LORAWAN_MULTICAST is enabled.
+    */
+    int16_t addMulticastGroup(uint8_t id, uint32_t mcAddr, uint8_t* mcAppSKey, uint8_t* mcNwkSKey, uint32_t fCntMin = 0, uint32_t fCntMax = 0xFFFFFFFF);
+
+    /*!
+      \brief Delete a multicast group and its session.
+      \param id Group ID, 0 to RADIOLIB_LORAWAN_NUM_MC_GROUPS - 1.
+      \returns \ref status_codes
+    */
+    int16_t removeMulticastGroup(uint8_t id);
+
+    /*!
+      \brief Set the GenAppKey for TS005 remote multicast setup on LoRaWAN 1.0.x.
+      The McRootKey is derived from the AppKey on LoRaWAN 1.1 devices, but from this separate key on 1.0.x ones.
+      Without it, a 1.0.x device (or any ABP device) answers McGroupSetupReq with an error.
+      The key is not saved in the persistent buffers, so it must be set again after every restart.
+      \param genAppKey GenAppKey of the device, or NULL to remove it.
+    */
+    void setGenAppKey(const uint8_t* genAppKey);
+
+    /*!
+      \brief Get the parameters of a multicast group.
+      \param id Group ID, 0 to RADIOLIB_LORAWAN_NUM_MC_GROUPS - 1.
+      \returns Pointer to the group, or NULL if the group is not set up.
+    */
+    const LoRaWANMulticastGroup_t* getMulticastGroup(uint8_t id);
+
+    /*!
+      \brief Get the answer generated by an application layer package (e.g. TS005 remote multicast setup).
+      The answer should be sent as an uplink on the returned fPort; it is cleared by this call.
+      With TS003 enabled, a clock synchronization request that is due is returned here as well.
+      \param data Buffer to save the answer to, at least RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN bytes.
+      \param fPort Pointer to variable to save the fPort of the answer to.
+      \returns Length of the answer, 0 if there is none.
+    */
+    size_t getPackageAns(uint8_t* data, uint8_t* fPort);
+
+    /*!
+      \brief Request a TS003 clock synchronization, the AppTimeReq is returned by the next call to getPackageAns.
+      The network will answer even if the clock of the device is correct.
+    */
+    void requestAppTime();
+
+    /*!
+      \brief Set the interval of the TS003 clock synchronization requests, the network may change it later.
+      \param periodicity Requests are sent every 128*2^periodicity seconds,
+      RADIOLIB_LORAWAN_TS003_PERIODICITY_NONE to only send them on request.
+      \returns \ref status_codes
+    */
+    int16_t setAppTimePeriodicity(uint8_t periodicity);
+
+    /*!
+      \brief Get the network time, kept by the local clock since the last DeviceTimeAns, beacon or TS003 AppTimeAns.
+      \param gpsEpoch Number of seconds since GPS epoch (Jan. 6th 1980)
+      \param ms Milliseconds of the current second
+      \param returnUnix If true, returns Unix timestamp instead of GPS (default true)
+      \returns \ref status_codes
+    */
+    int16_t getNetworkTime(uint32_t* gpsEpoch, uint16_t* ms = NULL, bool returnUnix = true);
+
+    /*!
+      \brief Get the drift of the local clock, measured between consecutive network time references.
+      \returns Drift in ppm, positive if the local clock runs fast, 0 if it was not measured yet.
+    */
+    int32_t getClockDrift();
+
+    /*!
+      \brief Enable TS004 fragmented data block transport on FPort 201 by attaching a fragment decoder.
+      Sessions are set up by the network, the data block is reassembled into the storage of the decoder.
+      Fragments sent to a multicast group are accepted if the session was set up for that group.
+      \param decoder Fragment decoder with the storage configured, NULL to disable.
+    */
+    void setFragDecoder(LoRaWANFragDecoder* decoder);
+
+    /*!
+      \brief Get the descriptor of the data block, as sent by the network in the fragmentation session setup.
+      \returns Data block descriptor, meaning is up to the application.
+    */
+    uint32_t getFragDescriptor();
+
+    /*!
+      \brief Enable the device-side link margin ADR by attaching a link quality tracker. Before every uplink,
+      the tracker picks the fastest datarate and lowest power with enough margin, and these are either
+      applied or only reported in the uplink event, depending on the mode of the tracker.
+      Best used together with setADR(false), a LinkADRReq from the network holds off the tracker for a while.
+      \param linkAdr Link quality tracker, configured by LoRaWANLinkAdr::begin, NULL to disable.
+    */
+    void setLinkAdr(LoRaWANLinkAdr* linkAdr);
+
+    /*!
+      \brief Compress the application payload of uplinks on one port before the frame is built,
+      which shortens the time-on-air of payloads with repeated content. The network server has to
+      decompress the frame payloads of that port with the same codec settings.
+      \param codec Codec, configured by RadioLibLZ::begin, NULL to disable.
+      \param fPort Port number of the compressed uplinks.
+    */
+    void setCompression(RadioLibLZ* codec, uint8_t fPort = 1);
+
     /*!
       \brief Set device status.
       \param battLevel Battery level to set. 0 for external power source, 1 for lowest battery,
@@ -790,6 +1279,14 @@ class LoRaWANNode {
     */
     void setADR(bool enable = true);
 
+    /*!
+      \brief Set how the uplink channel is selected among the enabled channels.
+      \param policy RADIOLIB_LORAWAN_CHANNEL_POLICY_RANDOM (default) to pick a random channel for each uplink,
+      RADIOLIB_LORAWAN_CHANNEL_POLICY_ROUND_ROBIN to cycle through the channels so the least recently used one is picked.
+      \returns \ref status_codes
+    */
+    int16_t setChannelPolicy(uint8_t policy);
+
     /*!
       \brief Toggle adherence to dutyCycle limits to on or off.
       \param enable Whether to adhere to dutyCycle limits or not (default true).
@@ -807,9 +1304,29 @@ class LoRaWANNode {
     */
     RadioLibTime_t dutyCycleInterval(RadioLibTime_t msPerHour, RadioLibTime_t airtime);
 
-    /*! \brief Returns time in milliseconds until next uplink is available under dutyCycle limits */
+    /*!
+      \brief Returns time in milliseconds until next uplink is available under dutyCycle limits.
+      The airtime is accounted per regulatory sub-band, so this is the time until the first of the channels
+      enabled for the current datarate has enough airtime left for an uplink as long as the previous one.
+    */
     RadioLibTime_t timeUntilUplink();
 
+    /*!
+      \brief Toggle adherence to the join backoff on or off.
+      \param enable Whether to adhere to the join backoff or not (default true).
+    */
+    void setJoinBackoff(bool enable = true);
+
+    /*!
+      \brief Returns time in milliseconds until the next Join-Request is allowed by the join backoff.
+      Join-Requests may use at most 36 seconds of airtime in the first hour after the first one,
+      36 seconds in the following 10 hours and 8.7 seconds in every 24 hours after that.
+      Within these limits, each Join-Request is followed by a random delay around the average interval
+      that the limit allows, so that devices which start to join at the same time spread out.
+      The backoff is only reset on power-up, and it is kept in the Nonces buffer across deep sleep (see setBufferNonces).
+    */
+    RadioLibTime_t timeUntilJoin();
+
     /*!
       \brief Toggle adherence to dwellTime limits to on or off.
       \param enable Whether to adhere to dwellTime limits or not (default true).
@@ -825,6 +1342,13 @@ class LoRaWANNode {
     */
     uint8_t maxPayloadDwellTime();
 
+    /*!
+      \brief Returns the maximum application payload length of the next uplink at the current datarate,
+      taking into account the dwell time limits (if enabled) and the MAC commands that will be piggybacked.
+      \returns Maximum payload length in bytes.
+    */
+    uint8_t getMaxPayloadLen();
+
     /*!
       \brief Configure TX power of the radio module.
       \param txPower Output power during TX mode to be set in dBm.
@@ -871,6 +1395,18 @@ class LoRaWANNode {
     */
     bool TS009 = false;
 
+    /*! 
+      \brief TS005 Remote Multicast Setup switch
+      (processes the multicast setup commands received on FPort 200, answers are retrieved by getPackageAns).
+    */
+    bool TS005 = false;
+
+    /*! 
+      \brief TS003 Application Layer Clock Synchronization switch
+      (processes the clock synchronization commands received on FPort 202, requests and answers are retrieved by getPackageAns).
+    */
+    bool TS003 = false;
+
     /*!
       \brief Rx window padding in milliseconds
       according to the spec, the Rx window must be at least enough time to effectively detect a preamble
@@ -885,6 +1421,14 @@ class LoRaWANNode {
     */
     RadioLibTime_t scanGuard = 10;
 
+    /*!
+      \brief Rx window padding in milliseconds once the drift of the local clock was measured
+      With a known drift, the Rx delays are compensated so the padding only has to cover
+      the timing errors of the host. It is never larger than scanGuard, so by default
+      nothing changes - lower it to shorten the Rx windows of a well synchronized device.
+    */
+    RadioLibTime_t scanGuardSync = 10;
+
 #if !RADIOLIB_GODMODE
   private:
 #endif
@@ -921,6 +1465,17 @@ class LoRaWANNode {
     uint8_t nwkKey[RADIOLIB_AES128_KEY_SIZE] = { 0 };
     uint8_t appKey[RADIOLIB_AES128_KEY_SIZE] = { 0 };
 
+    // root key of the TS005 multicast keys on LoRaWAN 1.0.x
+    uint8_t genAppKey[RADIOLIB_AES128_KEY_SIZE] = { 0 };
+    bool genAppKeySet = false;
+
+    // root keys expanded by beginOTAA, so that join attempts do not repeat the key schedule
+    RadioLibAES128Key_t nwkKeyExp;
+    RadioLibAES128Key_t appKeyExp;
+
+    // Join-Request with the EUIs filled in by beginOTAA
+    uint8_t joinRequestMsg[RADIOLIB_LORAWAN_JOIN_REQUEST_LEN] = { 0 };
+
     // the following is either provided by the network server (OTAA)
     // or directly entered by the user (ABP)
     uint32_t devAddr = 0;
@@ -960,6 +1515,26 @@ class LoRaWANNode {
     bool dutyCycleEnabled = false;
     uint32_t dutyCycle = 0;
 
+    // airtime in milliseconds used in the duty cycle sub-bands, the rest of the band and the overall limit
+    // kept in a ring of slots that together cover at least the last hour, dutyCycleSlot is the current one
+    // and dutyCycleSlotStart the time it started
+    uint32_t dutyCycleUsed[RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS + 2][RADIOLIB_LORAWAN_DUTY_CYCLE_SLOTS + 1] = { { 0 } };
+    uint8_t dutyCycleSlot = 0;
+    RadioLibTime_t dutyCycleSlotStart = 0;
+
+    // uplink channels in each of the duty cycle sub-bands and the rest of the band
+    uint16_t dutyCycleMasks[RADIOLIB_LORAWAN_NUM_DUTY_CYCLE_BANDS + 1] = { 0 };
+
+    // join backoff: the current period, when it started and the Join-Request airtime used in it,
+    // and the last Join-Request with its airtime and the delay until the next one is allowed
+    bool joinBackoffEnabled = true;
+    uint8_t joinPeriod = 0;
+    RadioLibTime_t joinPeriodStart = 0;
+    RadioLibTime_t joinAirtime = 0;
+    RadioLibTime_t joinLast = 0;
+    RadioLibTime_t joinToA = 0;
+    RadioLibTime_t joinDelay = 0;
+
     // dwell time is set upon initialization and activated in regions that impose this
     bool dwellTimeEnabledUp = false;
     uint16_t dwellTimeUp = 0;
@@ -980,6 +1555,13 @@ class LoRaWANNode {
     // available channel frequencies from list passed during OTA activation
     LoRaWANChannel_t availableChannels[2][RADIOLIB_LORAWAN_NUM_AVAILABLE_CHANNELS];
 
+    // enabled uplink channels for each datarate, bit N is set if channel N can be used
+    uint16_t channelMasks[RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES] = { 0 };
+
+    // uplink channel hopping policy and the last used channel
+    uint8_t channelPolicy = RADIOLIB_LORAWAN_CHANNEL_POLICY_RANDOM;
+    uint8_t channelLast = 0;
+
     // currently configured channels for TX and RX1
     LoRaWANChannel_t currentChannels[2] = { RADIOLIB_LORAWAN_CHANNEL_NONE, RADIOLIB_LORAWAN_CHANNEL_NONE };
 
@@ -1019,19 +1601,294 @@ class LoRaWANNode {
     // initalize the Nonces buffer after beginX() has been called
     void createNonces();
 
+    // save the MAC state snapshot into the session buffer
+    void saveState(uint8_t* buff);
+
+    // restore the MAC state from the snapshot, returns false if the snapshot can not be used
+    bool restoreState(uint8_t* buff);
+
+    // (de)serialize a channel in the MAC state snapshot
+    static void saveChannel(uint8_t* buff, const LoRaWANChannel_t* chnl);
+    static void restoreChannel(uint8_t* buff, LoRaWANChannel_t* chnl);
+
     // this will reset the device credentials, so the device starts completely new
     void clearNonces();
 
+    // slot of the interrupt action and flag of this node, RADIOLIB_LORAWAN_NODES_MAX if it has none
+    size_t actionSlot = RADIOLIB_LORAWAN_NODES_MAX;
+
+    // take a free slot, unless the node has one already, returns false if all of them are taken
+    bool claimAction();
+
+    // interrupt action that sets the flag of this node
+    void (*getAction())(void);
+
+    // state of the non-blocking exchange, one of RADIOLIB_LORAWAN_ASYNC_*
+    uint8_t asyncState = RADIOLIB_LORAWAN_ASYNC_IDLE;
+
+    // index of the Rx window that is awaited or open
+    uint8_t asyncWindow = 0;
+
+    // whether the current exchange is the MAC-only follow-up of a previous one
+    bool asyncMacOnly = false;
+
+    // whether Class C continuous reception is running between the Rx windows
+    bool asyncRxC = false;
+
+    // start and length of the current step of the exchange (in ms)
+    RadioLibTime_t asyncStart = 0;
+    RadioLibTime_t asyncTimeout = 0;
+
+    // receive IRQ configuration of the current exchange
+    uint32_t asyncIrqFlags = 0;
+    uint32_t asyncIrqMask = 0;
+
+    // where to put the downlink of the current exchange
+    uint8_t* asyncDataDown = NULL;
+    size_t* asyncLenDown = NULL;
+    LoRaWANEvent_t* asyncEventDown = NULL;
+
+    // user callback for exchange completion
+    LoRaWANEventCb_t asyncCb = NULL;
+    void* asyncCbCtx = NULL;
+
+    // where to put the uplink event of the current exchange, updated by the retransmissions
+    LoRaWANEvent_t* asyncEventUp = NULL;
+
+    // user callback for every transmission of an uplink frame
+    LoRaWANUplinkCb_t uplinkCb = NULL;
+    void* uplinkCbCtx = NULL;
+
+    // retransmissions: whether they are enabled and the number of transmissions of confirmed uplinks
+    bool retxEnabled = false;
+    uint8_t retxConfirmedMax = 0;
+
+    // the last uplink frame as sent and its event, kept to send it again
+    // the frame is built in place, so a new uplink replaces it as soon as its payload is compressed or encoded
+    LoRaWANFrame_t retxFrame;
+    uint8_t retxMsg[RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN] = { 0 };
+    size_t retxLen = 0;
+    LoRaWANEvent_t uplinkEvent;
+
+    // number of transmissions done and left, and the earliest time for the next one
+    uint8_t retxAttempt = 0;
+    uint8_t retxLeft = 0;
+    RadioLibTime_t retxNext = 0;
+
+    // network time reference from DeviceTimeAns, a beacon or AppTimeAns (GPS milliseconds at local time)
+    // and its resolution in milliseconds
+    bool gpsRefValid = false;
+    uint64_t gpsRefTime = 0;
+    RadioLibTime_t gpsRefLocal = 0;
+    RadioLibTime_t gpsRefRes = 0;
+
+    // local clock drift in ppm, measured between the network time references
+    bool clockDriftValid = false;
+    int32_t clockDrift = 0;
+
+    // TS003 clock synchronization: periodicity, pending requests and the token of the next request
+    uint8_t appTimePeriodicity = RADIOLIB_LORAWAN_TS003_PERIODICITY_NONE;
+    bool appTimeReq = false;
+    uint8_t appTimeResync = 0;
+    uint8_t appTimeToken = 0;
+    RadioLibTime_t appTimeLast = 0;
+
+    // Class B ping slot configuration, zero frequency or unused datarate mean the beacon channel
+    uint8_t pingPeriodicity = RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_DEFAULT;
+    uint8_t pingPeriodicityReq = RADIOLIB_LORAWAN_PING_SLOT_PERIODICITY_DEFAULT;
+    float pingFreq = 0;
+    uint8_t pingDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED;
+
+    // Class B beacon frequency, zero means the band default
+    float beaconFreq = 0;
+
+    // beacon tracking: GPS time and local start of the current beacon period
+    bool beaconLocked = false;
+    uint32_t beaconTime = 0;
+    RadioLibTime_t beaconStart = 0;
+
+    // number of consecutive missed beacons
+    uint8_t beaconMissed = 0;
+
+    // state of the Class B scheduler, one of RADIOLIB_LORAWAN_CLASS_B_*
+    uint8_t classBState = RADIOLIB_LORAWAN_CLASS_B_WAIT;
+
+    // ping slot offset in the current beacon period and index of the next ping slot
+    uint16_t pingOffset = 0;
+    uint16_t pingIndex = 0;
+
+    // start and length of the open beacon or ping slot window, and the next scheduled event
+    RadioLibTime_t classBStart = 0;
+    RadioLibTime_t classBTimeout = 0;
+    RadioLibTime_t classBNext = 0;
+
+    // multicast groups, kept in the session buffer whenever it is requested
+    LoRaWANMulticastGroup_t mcGroups[RADIOLIB_LORAWAN_NUM_MC_GROUPS];
+
+    // channel and multicast group of the running Class C reception
+    float rxCFreq = 0;
+    uint8_t rxCDr = RADIOLIB_LORAWAN_DATA_RATE_UNUSED;
+    uint8_t rxCGroup = RADIOLIB_LORAWAN_MC_GROUP_NONE;
+
+    // pending answer of an application layer package
+    uint8_t pkgAns[RADIOLIB_LORAWAN_PACKAGE_ANS_MAX_LEN] = { 0 };
+    size_t pkgAnsLen = 0;
+    uint8_t pkgAnsPort = 0;
+
+    // fragmentation session: the decoder, its multicast groups and the data block descriptor
+    LoRaWANFragDecoder* fragDecoder = NULL;
+    uint8_t fragMcMask = 0;
+    uint32_t fragDescriptor = 0;
+
+    // link margin ADR and its decision for the next uplink
+    LoRaWANLinkAdr* linkAdr = NULL;
+    uint8_t linkAdrAction = RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE;
+    uint8_t linkAdrDr = 0;
+    uint8_t linkAdrSteps = 0;
+
+    // payload compression and the port it applies to
+    RadioLibLZ* compression = NULL;
+    uint8_t compressionPort = 0;
+
+    // let the link margin ADR pick the datarate and power of the next uplink
+    void updateLinkAdr(size_t len);
+
+    // compress the application payload into the payload field of the frame buffer, if enabled for the port
+    int16_t compressUplink(uint8_t** data, size_t* len, uint8_t fPort);
+
+    // checks, payload compression and physical layer configuration done before every uplink
+    int16_t prepareUplink(uint8_t** data, size_t* len, uint8_t fPort, uint8_t* fOptsLen, bool* adrAckReq);
+
+    // build the uplink frame into the frame buffer that is also used for the retransmissions
+    int16_t buildUplink(uint8_t* data, size_t len, uint8_t fPort, bool isConfirmed, uint8_t fOptsLen, bool adrAckReq, bool* isConfirmingDown);
+
+    // the current session, as needed by the frame codec
+    void getFrameKeys(LoRaWANFrameKeys_t* keys);
+
+    // update the counters and the uplink event after a successful transmission, and keep the frame for retransmissions
+    void finishUplink(uint8_t fPort, bool isConfirmed, bool isConfirmingDown, LoRaWANEvent_t* event);
+
+    // check whether the last uplink has to be sent again after its exchange ended with the given state, and schedule it
+    bool scheduleRetransmission(int16_t state);
+
+    // time in milliseconds until the scheduled retransmission can be sent
+    RadioLibTime_t timeUntilRetransmit();
+
+    // send the last uplink frame again on another channel
+    int16_t retransmit(LoRaWANEvent_t* event, bool async);
+
+    // move the queued MAC commands to the buffer, returns the number of bytes written
+    size_t dequeueMacCommands(uint8_t* buff);
+
+    // send the queued MAC commands in a separate uplink on fPort 0
+    int16_t uplinkMacOnly(bool async);
+
     // wait for, open and listen during Rx1 and Rx2 windows; only performs listening
     int16_t downlinkCommon();
 
+    // read, verify and process the received downlink frame
+    int16_t parseDownlink(uint8_t* data, size_t* len, LoRaWANEvent_t* event);
+
+    // verify and decrypt a received multicast frame of a group
+    int16_t parseMulticast(uint8_t* msg, size_t msgLen, LoRaWANFrame_t* frame, uint8_t id, uint8_t* data, size_t* len, LoRaWANEvent_t* event);
+
+    // check whether the fPort belongs to an enabled application layer package
+    bool isPackagePort(uint8_t fPort);
+
+    // process the decrypted payload of an application layer package, received unicast or by a multicast group
+    void execPackage(uint8_t fPort, uint8_t* cmds, size_t len, uint8_t mcGroup);
+
+    // process the TS005 remote multicast setup commands and prepare the answer
+    void execMulticastSetup(uint8_t* cmds, size_t len);
+
+    // process the TS003 clock synchronization commands and prepare the answer
+    void execClockSync(uint8_t* cmds, size_t len);
+
+    // add a TS003 AppTimeReq to the package answer if one is due
+    void addAppTimeReq();
+
+    // process the TS004 fragmentation commands and data fragments
+    void execFragmentation(uint8_t* cmds, size_t len, uint8_t mcGroup);
+
+    // the multicast group with a Class C session running at the moment, RADIOLIB_LORAWAN_MC_GROUP_NONE if none
+    uint8_t getMulticastClassC();
+
+    // local time at which the Rx window should be opened
+    RadioLibTime_t rxWindowStart(uint8_t window);
+
+    // Rx window padding for a window the given time after the reference
+    RadioLibTime_t rxGuard(RadioLibTime_t delay);
+
+    // open the Rx window when its time comes
+    int16_t pollRxWindow(RadioLibTime_t now);
+
+    // close the current Rx window and move on to the next one, if there is any
+    int16_t nextRxWindow(RadioLibTime_t now);
+
+    // finish the non-blocking exchange and notify the user
+    int16_t completeAsync(int16_t state);
+
     // method to generate message integrity code
     uint32_t generateMIC(uint8_t* msg, size_t len, uint8_t* key);
 
+    // method to generate message integrity code with a key that was already expanded
+    uint32_t generateMIC(uint8_t* msg, size_t len, const RadioLibAES128Key_t* key);
+
     // method to verify message integrity code
     // it assumes that the MIC is the last 4 bytes of the message
     bool verifyMIC(uint8_t* msg, size_t len, uint8_t* key);
 
+    // method to verify message integrity code with a key that was already expanded
+    bool verifyMIC(uint8_t* msg, size_t len, const RadioLibAES128Key_t* key);
+
+    // start Class C continuous reception with the Rx2 parameters, or those of an active multicast session
+    int16_t startReceiveClassC();
+
+    // switch the physical layer to the Rx2 frequency and datarate
+    int16_t setRx2Properties();
+
+    // configure the downlink physical layer properties on an arbitrary channel and datarate
+    int16_t setPhyPropertiesDn(float freq, uint8_t dr);
+
+    // length of the beacon frame (and its first RFU field) for the given datarate, 0 if the datarate is invalid
+    size_t getBeaconLen(uint8_t dr, size_t* rfuLen = NULL);
+
+    // beacon frequency for the beacon sent at the given GPS time
+    float getBeaconFreq(uint32_t gpsTime);
+
+    // ping slot frequency and datarate in the current beacon period
+    void getPingChannel(float* freq, uint8_t* dr);
+
+    // configure the physical layer for the beacon and start listening for the given time (ms)
+    int16_t startReceiveBeacon(float freq, RadioLibTime_t timeout, bool continuous);
+
+    // close the beacon window, read and verify the beacon and update the tracking state
+    int16_t readBeacon(RadioLibTime_t now);
+
+    // calculate the ping slot offset for the current beacon period
+    void calculatePingOffset();
+
+    // convert a network time interval to the local clock, compensating for the measured drift
+    RadioLibTime_t clockDelay(RadioLibTime_t delay);
+
+    // timing error of the drift compensated clock that accumulates over the given time
+    RadioLibTime_t clockResidual(RadioLibTime_t delay);
+
+    // network time in GPS milliseconds at the given local time
+    uint64_t getGpsTime(RadioLibTime_t now);
+
+    // take a new network time reference and update the drift estimate
+    void setGpsTime(uint64_t gpsTime, RadioLibTime_t local, RadioLibTime_t res);
+
+    // move the beacon tracking to the next beacon period after a missed beacon
+    int16_t missedBeacon();
+
+    // close any open Class B window and reset the physical layer
+    void stopClassB();
+
+    // the Class B beacon and ping slot scheduler
+    int16_t pollClassB(RadioLibTime_t now);
+
     // configure the common physical layer properties (preamble, sync word etc.)
     // channels must be configured separately by setupChannelsDyn()!
     int16_t setPhyProperties(uint8_t dir);
@@ -1051,8 +1908,38 @@ class LoRaWANNode {
     // a join-accept can piggy-back a set of channels or channel masks
     int16_t processCFList(uint8_t* cfList);
 
-    // select a set of random TX/RX channels for up- and downlink
-    int16_t selectChannels();
+    // select a set of random TX/RX channels for up- and downlink, with hop set the last channel is avoided if possible
+    int16_t selectChannels(bool hop = false);
+
+    // rebuild the enabled channel masks after the available channels were changed
+    void updateChannelMasks();
+
+    // duty cycle limit of a bucket in milliseconds per hour, 0 if it is not limited
+    RadioLibTime_t getDutyCycleLimit(uint8_t bucket);
+
+    // move the buckets on to the current slot, dropping the airtime that is more than an hour old
+    void updateDutyCycle();
+
+    // charge the airtime of an uplink on the given channel to its buckets
+    void consumeDutyCycle(uint8_t channelID, RadioLibTime_t airtime);
+
+    // time in milliseconds until the given uplink channels have the airtime left, mask of the ready ones
+    RadioLibTime_t dutyCycleWait(uint16_t mask, uint16_t* ready, RadioLibTime_t airtime);
+
+    // length of a join backoff period in milliseconds, and the Join-Request airtime allowed in it
+    static RadioLibTime_t joinBackoffPeriod(uint8_t period, RadioLibTime_t* airtime);
+
+    // move on to the next join backoff period when the current one is over
+    void updateJoinBackoff();
+
+    // charge the airtime of a Join-Request, and delay the next one by the interval seeded with its MIC
+    void consumeJoinBackoff(RadioLibTime_t airtime, uint32_t seed);
+
+    // save the join backoff to the Nonces buffer, relative to the last Join-Request so that it only changes with a new one
+    void saveJoinBackoff();
+
+    // restore the join backoff from the Nonces buffer, with the last Join-Request the given time ago
+    void restoreJoinBackoff(RadioLibTime_t offTime);
 
     // find the first usable data rate for the given band
     int16_t findDataRate(uint8_t dr, DataRate_t* dataRate);
@@ -1093,9 +1980,6 @@ class LoRaWANNode {
     // perform a single CAD operation for the under SF/CH combination. Returns either busy or otherwise.
     bool performCAD();
 
-    // function to encrypt and decrypt payloads
-    void processAES(const uint8_t* in, size_t len, uint8_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter);
-
     // 16-bit checksum method that takes a uint8_t array of even length and calculates the checksum
     static uint16_t checkSum16(uint8_t *key, uint16_t keyLen);
 
@@ -1106,6 +1990,12 @@ class LoRaWANNode {
     // host-to-network conversion method - takes data from host variable and and converts it to network packet endians
     template<typename T>
     static void hton(uint8_t* buff, T val, size_t size = 0);
+
+    // allow the journal to access the frame counter and the buffer checksum
+    friend class LoRaWANJournal;
+
+    // allow the aggregator to access the clock and the frame counter
+    friend class LoRaWANAggregator;
 };
 
 #endif
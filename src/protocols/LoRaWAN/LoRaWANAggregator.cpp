@@ -0,0 +1,171 @@
+#include "LoRaWANAggregator.h"
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+LoRaWANAggregator::LoRaWANAggregator() {
+
+}
+
+void LoRaWANAggregator::begin(LoRaWANNode* node, uint8_t fPort, RadioLibTime_t maxDelay, bool confirmed) {
+  this->node = node;
+  this->fPort = fPort;
+  this->maxDelay = maxDelay;
+  this->confirmed = confirmed;
+  this->clear();
+}
+
+void LoRaWANAggregator::clear() {
+  this->buffLen = 0;
+  this->numRecords = 0;
+}
+
+int16_t LoRaWANAggregator::push(uint8_t type, const uint8_t* data, size_t len) {
+  if(!this->node) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  // header: small types and lengths share a single byte, larger ones follow in extra bytes
+  uint8_t header[RADIOLIB_LORAWAN_AGGREGATOR_HEADER_MAX_LEN];
+  size_t headerLen = 1;
+  uint8_t typeNibble = RADIOLIB_MIN(type, RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT);
+  uint8_t lenNibble = (uint8_t)RADIOLIB_MIN(len, (size_t)RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT);
+  header[0] = (typeNibble << 4) | lenNibble;
+  if(typeNibble == RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT) {
+    header[headerLen++] = type;
+  }
+  if(lenNibble == RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT) {
+    header[headerLen++] = (uint8_t)len;
+  }
+
+  // a record that does not fit into a single uplink would block the queue
+  size_t recordLen = headerLen + len;
+  if((len > 0xFF) || (recordLen > this->node->getMaxPayloadLen())) {
+    return(RADIOLIB_ERR_PACKET_TOO_LONG);
+  }
+  if((this->numRecords >= RADIOLIB_LORAWAN_AGGREGATOR_MAX_RECORDS) || (this->buffLen + recordLen > RADIOLIB_LORAWAN_AGGREGATOR_BUFFER_SIZE)) {
+    return(RADIOLIB_ERR_COMMAND_QUEUE_FULL);
+  }
+
+  memcpy(&this->buff[this->buffLen], header, headerLen);
+  memcpy(&this->buff[this->buffLen + headerLen], data, len);
+  this->buffLen += recordLen;
+  this->recordLens[this->numRecords] = (uint8_t)recordLen;
+  this->recordTimes[this->numRecords] = this->node->phyLayer->getMod()->hal->millis();
+  this->numRecords++;
+  return(RADIOLIB_ERR_NONE);
+}
+
+bool LoRaWANAggregator::isDue() {
+  if(this->numRecords == 0) {
+    return(false);
+  }
+  if((this->buffLen >= this->node->getMaxPayloadLen()) || (this->numRecords >= RADIOLIB_LORAWAN_AGGREGATOR_MAX_RECORDS)) {
+    return(true);
+  }
+  return(this->timeUntilDue() == 0);
+}
+
+RadioLibTime_t LoRaWANAggregator::timeUntilDue() {
+  if(this->numRecords == 0) {
+    return(this->maxDelay);
+  }
+  RadioLibTime_t waited = this->node->phyLayer->getMod()->hal->millis() - this->recordTimes[0];
+  if(waited >= this->maxDelay) {
+    return(0);
+  }
+  return(this->maxDelay - waited);
+}
+
+size_t LoRaWANAggregator::getNumRecords() const {
+  return(this->numRecords);
+}
+
+size_t LoRaWANAggregator::getQueuedLen() const {
+  return(this->buffLen);
+}
+
+int16_t LoRaWANAggregator::sendReceive(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  size_t len = 0;
+  size_t num = this->fit(&len);
+  if(num == 0) {
+    return((this->numRecords == 0) ? RADIOLIB_LORAWAN_NO_RECORDS : RADIOLIB_ERR_PACKET_TOO_LONG);
+  }
+
+  // the frame counter only moves if the uplink was actually sent
+  uint32_t fCntUp = this->node->fCntUp;
+  int16_t state = this->node->sendReceive(this->buff, len, this->fPort, dataDown, lenDown, this->confirmed, eventUp, eventDown);
+  if(this->node->fCntUp != fCntUp) {
+    this->drop(num);
+  }
+  return(state);
+}
+
+int16_t LoRaWANAggregator::startUplink(uint8_t* dataDown, size_t* lenDown, LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+  size_t len = 0;
+  size_t num = this->fit(&len);
+  if(num == 0) {
+    return((this->numRecords == 0) ? RADIOLIB_LORAWAN_NO_RECORDS : RADIOLIB_ERR_PACKET_TOO_LONG);
+  }
+
+  // the frame is in the radio buffer once this returns, so the records can go
+  int16_t state = this->node->startUplink(this->buff, len, this->fPort, dataDown, lenDown, this->confirmed, eventUp, eventDown);
+  RADIOLIB_ASSERT(state);
+  this->drop(num);
+  return(state);
+}
+
+int16_t LoRaWANAggregator::unpack(const uint8_t* payload, size_t len, size_t* offset, uint8_t* type, const uint8_t** data, size_t* dataLen) {
+  size_t pos = *offset;
+  if(pos >= len) {
+    return(RADIOLIB_LORAWAN_NO_RECORDS);
+  }
+
+  uint8_t header = payload[pos++];
+  *type = header >> 4;
+  *dataLen = header & 0x0F;
+  if(*type == RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT) {
+    if(pos >= len) {
+      return(RADIOLIB_LORAWAN_INVALID_FRAME);
+    }
+    *type = payload[pos++];
+  }
+  if(*dataLen == RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT) {
+    if(pos >= len) {
+      return(RADIOLIB_LORAWAN_INVALID_FRAME);
+    }
+    *dataLen = payload[pos++];
+  }
+  if(pos + *dataLen > len) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+
+  *data = &payload[pos];
+  *offset = pos + *dataLen;
+  return(RADIOLIB_ERR_NONE);
+}
+
+size_t LoRaWANAggregator::fit(size_t* len) {
+  size_t maxLen = this->node->getMaxPayloadLen();
+  size_t num = 0;
+  *len = 0;
+  while((num < this->numRecords) && (*len + this->recordLens[num] <= maxLen)) {
+    *len += this->recordLens[num];
+    num++;
+  }
+  return(num);
+}
+
+void LoRaWANAggregator::drop(size_t num) {
+  size_t len = 0;
+  for(size_t i = 0; i < num; i++) {
+    len += this->recordLens[i];
+  }
+  memmove(this->buff, &this->buff[len], this->buffLen - len);
+  memmove(this->recordLens, &this->recordLens[num], (this->numRecords - num) * sizeof(this->recordLens[0]));
+  memmove(this->recordTimes, &this->recordTimes[num], (this->numRecords - num) * sizeof(this->recordTimes[0]));
+  this->buffLen -= len;
+  this->numRecords -= num;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#if !defined(_RADIOLIB_LORAWAN_AGGREGATOR_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_AGGREGATOR_H
+
+#include "../../TypeDef.h"
+#include "LoRaWAN.h"
+
+// size of the record queue in bytes, as encoded, and the maximum number of queued records
+#define RADIOLIB_LORAWAN_AGGREGATOR_BUFFER_SIZE                 (256)
+#define RADIOLIB_LORAWAN_AGGREGATOR_MAX_RECORDS                 (32)
+
+// default time in milliseconds a record may wait in the queue
+#define RADIOLIB_LORAWAN_AGGREGATOR_MAX_DELAY                   (60000)
+
+// record header: type in the upper nibble, length in the lower one,
+// a nibble set to 0x0F means the value follows in an extra byte (type first, then length)
+#define RADIOLIB_LORAWAN_AGGREGATOR_NIBBLE_EXT                  (0x0F)
+#define RADIOLIB_LORAWAN_AGGREGATOR_HEADER_MAX_LEN              (3)
+
+/*!
+  \class LoRaWANAggregator
+  \brief Packs small application records into shared uplinks, so that the frame overhead
+  (13 bytes of headers and MIC, plus the preamble) is paid once for several of them.
+  Records are queued with a type and a value, and encoded with a compact type-length-value
+  framing: a single header byte for types and lengths below 15, up to three bytes otherwise.
+  An uplink is due when the queued records fill the largest payload allowed at the current datarate
+  (and within the dwell time limit, if enabled), or when the oldest record has waited for too long.
+  Every uplink carries as many whole records as fit, in the order they were queued.
+  The network side unpacks the frame payload with LoRaWANAggregator::unpack.
+*/
+class LoRaWANAggregator {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    LoRaWANAggregator();
+
+    /*!
+      \brief Set up the aggregator and clear the queue.
+      \param node The node to send the uplinks with, the session must be active before sending.
+      \param fPort Port number of the uplinks.
+      \param maxDelay Time in milliseconds a record may wait in the queue before an uplink is due.
+      \param confirmed Whether to send confirmed uplinks.
+    */
+    void begin(LoRaWANNode* node, uint8_t fPort = 1, RadioLibTime_t maxDelay = RADIOLIB_LORAWAN_AGGREGATOR_MAX_DELAY, bool confirmed = false);
+
+    /*!
+      \brief Drop all queued records.
+    */
+    void clear();
+
+    /*!
+      \brief Queue a record.
+      \param type Record type, meaning is up to the application.
+      \param data Record value.
+      \param len Length of the value.
+      \returns \ref status_codes, RADIOLIB_ERR_PACKET_TOO_LONG if the record does not fit into an uplink
+      at the current datarate, RADIOLIB_ERR_COMMAND_QUEUE_FULL if the queue has no room left.
+    */
+    int16_t push(uint8_t type, const uint8_t* data, size_t len);
+
+    /*!
+      \brief Check whether an uplink should be sent, because the queue holds a full payload,
+      has no free record slots left, or the oldest record waited for too long.
+      \returns Whether an uplink is due.
+    */
+    bool isDue();
+
+    /*!
+      \brief Get the time until the oldest record has waited for too long.
+      \returns Time in milliseconds, 0 if an uplink is due, and the maximum delay if the queue is empty.
+    */
+    RadioLibTime_t timeUntilDue();
+
+    /*!
+      \brief Get the number of queued records.
+      \returns Number of records.
+    */
+    size_t getNumRecords() const;
+
+    /*!
+      \brief Get the length of the queued records, as they will be sent.
+      \returns Length in bytes.
+    */
+    size_t getQueuedLen() const;
+
+    /*!
+      \brief Send the queued records that fit into one uplink and wait for the downlink, see LoRaWANNode::sendReceive.
+      The records are removed from the queue once the uplink was sent, even if the downlink fails.
+      \param dataDown Buffer to save the received downlink data to, or NULL to discard the payload.
+      \param lenDown Pointer to variable to save the received downlink length to, or NULL.
+      \param eventUp Pointer to a structure to store extra information about the uplink event, or NULL.
+      \param eventDown Pointer to a structure to store extra information about the downlink event, or NULL.
+      \returns \ref status_codes, RADIOLIB_LORAWAN_NO_RECORDS if the queue is empty.
+    */
+    int16_t sendReceive(uint8_t* dataDown = NULL, size_t* lenDown = NULL, LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
+
+    /*!
+      \brief Start sending the queued records that fit into one uplink, see LoRaWANNode::startUplink.
+      The records are removed from the queue once the transmission was started.
+      \param dataDown Buffer to save the received downlink data to, or NULL to discard the payload.
+      \param lenDown Pointer to variable to save the received downlink length to, or NULL.
+      \param eventUp Pointer to a structure to store extra information about the uplink event, or NULL.
+      \param eventDown Pointer to a structure to store extra information about the downlink event, or NULL.
+      \returns \ref status_codes, RADIOLIB_LORAWAN_NO_RECORDS if the queue is empty.
+    */
+    int16_t startUplink(uint8_t* dataDown = NULL, size_t* lenDown = NULL, LoRaWANEvent_t* eventUp = NULL, LoRaWANEvent_t* eventDown = NULL);
+
+    /*!
+      \brief Get the next record from a received frame payload.
+      \param payload Frame payload, as sent by the aggregator.
+      \param len Length of the frame payload.
+      \param offset Position of the next record, start with 0. Moved past the record.
+      \param type Type of the record.
+      \param data Pointer to the value of the record, within the payload.
+      \param dataLen Length of the value.
+      \returns \ref status_codes, RADIOLIB_LORAWAN_NO_RECORDS at the end of the payload,
+      RADIOLIB_LORAWAN_INVALID_FRAME if a record is truncated.
+    */
+    static int16_t unpack(const uint8_t* payload, size_t len, size_t* offset, uint8_t* type, const uint8_t** data, size_t* dataLen);
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    LoRaWANNode* node = NULL;
+    uint8_t fPort = 1;
+    RadioLibTime_t maxDelay = RADIOLIB_LORAWAN_AGGREGATOR_MAX_DELAY;
+    bool confirmed = false;
+
+    // the queued records as they are sent, and the encoded length and queueing time of each
+    uint8_t buff[RADIOLIB_LORAWAN_AGGREGATOR_BUFFER_SIZE] = { 0 };
+    size_t buffLen = 0;
+    uint8_t recordLens[RADIOLIB_LORAWAN_AGGREGATOR_MAX_RECORDS] = { 0 };
+    RadioLibTime_t recordTimes[RADIOLIB_LORAWAN_AGGREGATOR_MAX_RECORDS] = { 0 };
+    size_t numRecords = 0;
+
+    // number of records and their length that fit into the next uplink
+    size_t fit(size_t* len);
+
+    // remove records from the front of the queue
+    void drop(size_t num);
+};
+
+#endif
@@ -24,6 +24,13 @@ const LoRaWANBand_t EU868 = {
   .powerMax = 16,
   .powerNumSteps = 7,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    { .freqStart = 863.000, .freqEnd = 865.000, .dutyCycle = 3600 },    // ETSI EN 300 220 band K, 0.1 %
+    { .freqStart = 865.000, .freqEnd = 868.000, .dutyCycle = 36000 },   // band L, 1 %
+    { .freqStart = 868.000, .freqEnd = 868.600, .dutyCycle = 36000 },   // band M, 1 %
+    { .freqStart = 868.700, .freqEnd = 869.200, .dutyCycle = 3600 },    // band N, 0.1 %
+    { .freqStart = 869.400, .freqEnd = 869.650, .dutyCycle = 360000 },  // band P, 10 %
+  },
   .dwellTimeUp = 0,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -44,6 +51,7 @@ const LoRaWANBand_t EU868 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 869.525, .drMin = 0, .drMax = 0 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 869.525, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -70,6 +78,13 @@ const LoRaWANBand_t US915 = {
   .powerMax = 30,
   .powerNumSteps = 10,
   .dutyCycle = 0,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -111,6 +126,7 @@ const LoRaWANBand_t US915 = {
   },
   .rx1DataRateBase = 10,
   .rx2 = { .enabled = true, .idx = 0, .freq = 923.300, .drMin = 8, .drMax = 8 },
+  .beaconSpan = { .numChannels = 8, .freqStart = 923.300, .freqStep = 0.600, .drMin = 8, .drMax = 8, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_10 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_9 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -137,6 +153,13 @@ const LoRaWANBand_t EU433 = {
   .powerMax = 12,
   .powerNumSteps = 5,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = 0,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -157,6 +180,7 @@ const LoRaWANBand_t EU433 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 434.665, .drMin = 0, .drMax = 0 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 434.665, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -183,6 +207,13 @@ const LoRaWANBand_t AU915 = {
   .powerMax = 30,
   .powerNumSteps = 10,
   .dutyCycle = 0,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -224,6 +255,7 @@ const LoRaWANBand_t AU915 = {
   },
   .rx1DataRateBase = 8,
   .rx2 = { .enabled = true, .idx = 0, .freq = 923.300, .drMin = 8, .drMax = 8 },
+  .beaconSpan = { .numChannels = 8, .freqStart = 923.300, .freqStep = 0.600, .drMin = 8, .drMax = 8, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -250,6 +282,13 @@ const LoRaWANBand_t CN500 = {
   .powerMax = 19,
   .powerNumSteps = 7,
   .dutyCycle = 0,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = 0,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -284,6 +323,7 @@ const LoRaWANBand_t CN500 = {
   },
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 505.300, .drMin = 0, .drMax = 0 },
+  .beaconSpan = { .numChannels = 8, .freqStart = 508.300, .freqStep = 0.200, .drMin = 2, .drMax = 2, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -310,6 +350,13 @@ const LoRaWANBand_t AS923 = {
   .powerMax = 16,
   .powerNumSteps = 7,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = RADIOLIB_LORAWAN_DWELL_TIME,
   .txFreqs = {
@@ -330,6 +377,7 @@ const LoRaWANBand_t AS923 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 923.200, .drMin = 2, .drMax = 2 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 923.400, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -356,6 +404,13 @@ const LoRaWANBand_t AS923_2 = {
   .powerMax = 16,
   .powerNumSteps = 7,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = RADIOLIB_LORAWAN_DWELL_TIME,
   .txFreqs = {
@@ -376,6 +431,7 @@ const LoRaWANBand_t AS923_2 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 921.400, .drMin = 2, .drMax = 2 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 921.600, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -402,6 +458,13 @@ const LoRaWANBand_t AS923_3 = {
   .powerMax = 16,
   .powerNumSteps = 7,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = RADIOLIB_LORAWAN_DWELL_TIME,
   .txFreqs = {
@@ -422,6 +485,7 @@ const LoRaWANBand_t AS923_3 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 916.600, .drMin = 2, .drMax = 2 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 916.800, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -448,6 +512,13 @@ const LoRaWANBand_t AS923_4 = {
   .powerMax = 16,
   .powerNumSteps = 7,
   .dutyCycle = 36000,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = RADIOLIB_LORAWAN_DWELL_TIME,
   .dwellTimeDn = RADIOLIB_LORAWAN_DWELL_TIME,
   .txFreqs = {
@@ -468,6 +539,7 @@ const LoRaWANBand_t AS923_4 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 917.300, .drMin = 2, .drMax = 2 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 917.500, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -494,6 +566,13 @@ const LoRaWANBand_t KR920 = {
   .powerMax = 14,
   .powerNumSteps = 7,
   .dutyCycle = 0,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = 0,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -514,6 +593,7 @@ const LoRaWANBand_t KR920 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 921.900, .drMin = 0, .drMax = 0 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 923.100, .freqStep = 0, .drMin = 3, .drMax = 3, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
@@ -540,6 +620,13 @@ const LoRaWANBand_t IN865 = {
   .powerMax = 30,
   .powerNumSteps = 10,
   .dutyCycle = 0,
+  .dutyCycleBands = {
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+    RADIOLIB_LORAWAN_DUTY_CYCLE_BAND_NONE,
+  },
   .dwellTimeUp = 0,
   .dwellTimeDn = 0,
   .txFreqs = {
@@ -560,6 +647,7 @@ const LoRaWANBand_t IN865 = {
   .rx1Span = RADIOLIB_LORAWAN_CHANNEL_SPAN_NONE,
   .rx1DataRateBase = 0,
   .rx2 = { .enabled = true, .idx = 0, .freq = 866.550, .drMin = 2, .drMax = 2 },
+  .beaconSpan = { .numChannels = 1, .freqStart = 866.550, .freqStep = 0, .drMin = 4, .drMax = 4, .joinRequestDataRate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED },
   .dataRates = {
     RADIOLIB_LORAWAN_DATA_RATE_SF_12 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
     RADIOLIB_LORAWAN_DATA_RATE_SF_11 | RADIOLIB_LORAWAN_DATA_RATE_BW_125_KHZ | RADIOLIB_LORAWAN_DATA_RATE_CR_4_5,
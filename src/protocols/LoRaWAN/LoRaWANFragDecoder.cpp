@@ -0,0 +1,282 @@
+#include "LoRaWANFragDecoder.h"
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+static inline bool getBit(const uint8_t* bits, size_t i) {
+  return((bits[i / 8] >> (i % 8)) & 0x01);
+}
+
+static inline void setBit(uint8_t* bits, size_t i) {
+  bits[i / 8] |= (1 << (i % 8));
+}
+
+LoRaWANFragDecoder::LoRaWANFragDecoder() {
+
+}
+
+void LoRaWANFragDecoder::setStorage(LoRaWANFragReadCb_t read, LoRaWANFragWriteCb_t write, void* ctx) {
+  this->readCb = read;
+  this->writeCb = write;
+  this->cbCtx = ctx;
+}
+
+int16_t LoRaWANFragDecoder::begin(uint16_t nbFrag, uint8_t fragSize, uint8_t padding) {
+  this->end();
+  if(!this->readCb || !this->writeCb) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+  if((nbFrag == 0) || (nbFrag > RADIOLIB_LORAWAN_FRAG_MAX_NB) || (fragSize == 0) ||
+     (fragSize > RADIOLIB_LORAWAN_FRAG_MAX_SIZE) || (padding >= fragSize)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAGMENT);
+  }
+
+  this->nbFrag = nbFrag;
+  this->fragSize = fragSize;
+  this->padding = padding;
+  this->active = true;
+  return(RADIOLIB_ERR_NONE);
+}
+
+void LoRaWANFragDecoder::end() {
+  this->active = false;
+  this->complete = false;
+  this->memoryError = false;
+  this->coded = false;
+  this->nbReceived = 0;
+  this->nbUncoded = 0;
+  this->nbMissing = 0;
+  this->nbRows = 0;
+  memset(this->received, 0, sizeof(this->received));
+  memset(this->pivots, 0, sizeof(this->pivots));
+}
+
+int16_t LoRaWANFragDecoder::push(uint16_t n, const uint8_t* data, size_t len) {
+  if(!this->active) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAGMENT);
+  }
+  if((n == 0) || (len < this->fragSize)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAGMENT);
+  }
+
+  // nothing left to do, or nothing that can be done
+  if(this->complete) {
+    return(RADIOLIB_ERR_NONE);
+  }
+  if(this->memoryError) {
+    return(RADIOLIB_LORAWAN_FRAG_TOO_MANY_LOST);
+  }
+  this->nbReceived++;
+
+  int16_t state = RADIOLIB_ERR_NONE;
+  uint16_t frag = n - 1;
+  if((n <= this->nbFrag) && !this->coded) {
+    // as long as no coded fragment was received, uncoded fragments are simply stored
+    if(getBit(this->received, frag)) {
+      return(RADIOLIB_ERR_NONE);
+    }
+    state = this->writeCb((uint32_t)frag * this->fragSize, data, this->fragSize, this->cbCtx);
+    RADIOLIB_ASSERT(state);
+    setBit(this->received, frag);
+    this->nbUncoded++;
+    if(this->nbUncoded == this->nbFrag) {
+      this->complete = true;
+    }
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  // from the first coded fragment on, the decoder works on the missing fragments only
+  if(!this->coded) {
+    state = this->startCoded();
+    RADIOLIB_ASSERT(state);
+  }
+
+  memset(this->rowBits, 0, sizeof(this->rowBits));
+  memcpy(this->rowData, data, this->fragSize);
+
+  if(n <= this->nbFrag) {
+    // late uncoded fragment, it is a row with a single missing fragment
+    if(getBit(this->received, frag)) {
+      return(RADIOLIB_ERR_NONE);
+    }
+    uint16_t lo = 0;
+    uint16_t hi = this->nbMissing;
+    while(lo < hi) {
+      uint16_t mid = (lo + hi) / 2;
+      if(this->missing[mid] < frag) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    setBit(this->rowBits, lo);
+
+  } else {
+    // the coded fragment is the XOR of the fragments on its parity matrix line
+    // remove the ones that were received, and keep the missing ones in the row
+    LoRaWANFragDecoder::getParityLine(n - this->nbFrag, this->nbFrag, this->line);
+    uint16_t m = 0;
+    for(uint16_t i = 0; i < this->nbFrag; i++) {
+      bool isMissing = (m < this->nbMissing) && (this->missing[m] == i);
+      if(getBit(this->line, i)) {
+        if(isMissing) {
+          setBit(this->rowBits, m);
+        } else {
+          state = this->xorSlot(i);
+          RADIOLIB_ASSERT(state);
+        }
+      }
+      if(isMissing) {
+        m++;
+      }
+    }
+  }
+
+  state = this->addRow();
+  RADIOLIB_ASSERT(state);
+
+  // once there are as many independent rows as missing fragments, the system can be solved
+  if(this->nbRows == this->nbMissing) {
+    state = this->solve();
+  }
+  return(state);
+}
+
+bool LoRaWANFragDecoder::isActive() const {
+  return(this->active);
+}
+
+bool LoRaWANFragDecoder::isComplete() const {
+  return(this->complete);
+}
+
+uint16_t LoRaWANFragDecoder::getNbReceived() const {
+  return(this->nbReceived);
+}
+
+uint16_t LoRaWANFragDecoder::getNbMissing() const {
+  if(this->complete) {
+    return(0);
+  }
+  if(this->coded) {
+    return(this->nbMissing - this->nbRows);
+  }
+  return(this->nbFrag - this->nbUncoded);
+}
+
+uint32_t LoRaWANFragDecoder::getSize() const {
+  return((uint32_t)this->nbFrag * this->fragSize - this->padding);
+}
+
+bool LoRaWANFragDecoder::isMemoryError() const {
+  return(this->memoryError);
+}
+
+void LoRaWANFragDecoder::getParityLine(uint16_t n, uint16_t m, uint8_t* line) {
+  memset(line, 0, (m + 7) / 8);
+
+  // see LoRaWAN TS004 Fragmented Data Block Transport, chapter 4
+  // the same index may come up more than once, so a row can have fewer than m/2 fragments
+  uint32_t mm = m;
+  if((m & (m - 1)) == 0) {
+    mm++;
+  }
+  uint32_t x = 1 + 1001*(uint32_t)n;
+  for(uint16_t i = 0; i < m/2; i++) {
+    uint32_t r = 0;
+    do {
+      x = LoRaWANFragDecoder::prbs23(x);
+      r = x % mm;
+    } while(r >= m);
+    setBit(line, r);
+  }
+}
+
+int16_t LoRaWANFragDecoder::startCoded() {
+  this->nbMissing = this->nbFrag - this->nbUncoded;
+  if(this->nbMissing > RADIOLIB_LORAWAN_FRAG_MAX_MISSING) {
+    this->memoryError = true;
+    return(RADIOLIB_LORAWAN_FRAG_TOO_MANY_LOST);
+  }
+
+  uint16_t m = 0;
+  for(uint16_t i = 0; i < this->nbFrag; i++) {
+    if(!getBit(this->received, i)) {
+      this->missing[m++] = i;
+    }
+  }
+  this->coded = true;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANFragDecoder::addRow() {
+  const size_t rowLen = (this->nbMissing + 7) / 8;
+  for(;;) {
+    // find the first missing fragment in this row
+    uint16_t pivot = this->nbMissing;
+    for(size_t i = 0; i < rowLen; i++) {
+      if(this->rowBits[i]) {
+        pivot = i*8;
+        while(!getBit(this->rowBits, pivot)) {
+          pivot++;
+        }
+        break;
+      }
+    }
+
+    // all missing fragments were eliminated, so this row brings nothing new
+    if(pivot == this->nbMissing) {
+      return(RADIOLIB_ERR_NONE);
+    }
+
+    // a new row, keep it and its data
+    if(!getBit(this->pivots, pivot)) {
+      memcpy(this->rows[pivot], this->rowBits, rowLen);
+      setBit(this->pivots, pivot);
+      this->nbRows++;
+      return(this->writeCb((uint32_t)this->missing[pivot] * this->fragSize, this->rowData, this->fragSize, this->cbCtx));
+    }
+
+    // eliminate the pivot with the row that is already stored
+    for(size_t i = 0; i < rowLen; i++) {
+      this->rowBits[i] ^= this->rows[pivot][i];
+    }
+    int16_t state = this->xorSlot(this->missing[pivot]);
+    RADIOLIB_ASSERT(state);
+  }
+}
+
+int16_t LoRaWANFragDecoder::solve() {
+  // the rows form an upper triangular matrix, so solve it from the last missing fragment back
+  for(int32_t p = this->nbMissing - 1; p >= 0; p--) {
+    int16_t state = this->readCb((uint32_t)this->missing[p] * this->fragSize, this->rowData, this->fragSize, this->cbCtx);
+    RADIOLIB_ASSERT(state);
+    for(uint16_t q = p + 1; q < this->nbMissing; q++) {
+      if(getBit(this->rows[p], q)) {
+        state = this->xorSlot(this->missing[q]);
+        RADIOLIB_ASSERT(state);
+      }
+    }
+    state = this->writeCb((uint32_t)this->missing[p] * this->fragSize, this->rowData, this->fragSize, this->cbCtx);
+    RADIOLIB_ASSERT(state);
+  }
+  this->complete = true;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANFragDecoder::xorSlot(uint16_t frag) {
+  int16_t state = this->readCb((uint32_t)frag * this->fragSize, this->fragBuff, this->fragSize, this->cbCtx);
+  RADIOLIB_ASSERT(state);
+  for(uint8_t i = 0; i < this->fragSize; i++) {
+    this->rowData[i] ^= this->fragBuff[i];
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+uint32_t LoRaWANFragDecoder::prbs23(uint32_t x) {
+  uint32_t b0 = x & 0x01;
+  uint32_t b1 = (x & 0x20) >> 5;
+  return((x >> 1) + ((b0 ^ b1) << 22));
+}
+
+#endif
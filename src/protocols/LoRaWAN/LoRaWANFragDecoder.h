@@ -0,0 +1,174 @@
+#if !defined(_RADIOLIB_LORAWAN_FRAG_DECODER_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_FRAG_DECODER_H
+
+#include "../../TypeDef.h"
+
+/*!
+  \typedef LoRaWANFragReadCb_t
+  \brief Callback to read back a part of the data block from the user storage.
+  \param offset Offset from the start of the data block, in bytes.
+  \param data Buffer to read the data into.
+  \param len Number of bytes to read.
+  \param ctx User context passed to setStorage.
+  \returns \ref status_codes
+*/
+typedef int16_t (*LoRaWANFragReadCb_t)(uint32_t offset, uint8_t* data, size_t len, void* ctx);
+
+/*!
+  \typedef LoRaWANFragWriteCb_t
+  \brief Callback to write a part of the data block to the user storage.
+  \param offset Offset from the start of the data block, in bytes.
+  \param data Data to write.
+  \param len Number of bytes to write.
+  \param ctx User context passed to setStorage.
+  \returns \ref status_codes
+*/
+typedef int16_t (*LoRaWANFragWriteCb_t)(uint32_t offset, const uint8_t* data, size_t len, void* ctx);
+
+/*!
+  \class LoRaWANFragDecoder
+  \brief Reassembles a data block sent in fragments as per LoRaWAN TS004 Fragmented Data Block Transport.
+  Fragments are written to the user storage as they arrive, the lost ones are recovered from the coded
+  (parity) fragments using the low-density parity check matrix of the specification.
+  RAM usage is bounded by RADIOLIB_LORAWAN_FRAG_MAX_NB, RADIOLIB_LORAWAN_FRAG_MAX_SIZE
+  and RADIOLIB_LORAWAN_FRAG_MAX_MISSING, the data block itself is only kept in the storage.
+*/
+class LoRaWANFragDecoder {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    LoRaWANFragDecoder();
+
+    /*!
+      \brief Set the storage of the data block. The storage must hold the number of fragments
+      times the fragment size, the recovered fragments are written in place.
+      \param read Callback to read from the storage.
+      \param write Callback to write to the storage.
+      \param ctx User context passed to the callbacks.
+    */
+    void setStorage(LoRaWANFragReadCb_t read, LoRaWANFragWriteCb_t write, void* ctx = NULL);
+
+    /*!
+      \brief Start a new fragmentation session, any previous progress is discarded.
+      \param nbFrag Number of uncoded fragments of the data block.
+      \param fragSize Size of each fragment in bytes.
+      \param padding Number of padding bytes at the end of the last fragment.
+      \returns \ref status_codes
+    */
+    int16_t begin(uint16_t nbFrag, uint8_t fragSize, uint8_t padding = 0);
+
+    /*!
+      \brief Stop the fragmentation session.
+    */
+    void end();
+
+    /*!
+      \brief Process a received fragment.
+      \param n Fragment counter, starting at 1. Counters above the number of fragments are coded fragments.
+      \param data Fragment payload.
+      \param len Length of the payload, at least the fragment size of the session.
+      \returns \ref status_codes
+    */
+    int16_t push(uint16_t n, const uint8_t* data, size_t len);
+
+    /*!
+      \brief Check whether a fragmentation session is running.
+      \returns True if begin was called and the session was not ended.
+    */
+    bool isActive() const;
+
+    /*!
+      \brief Check whether the whole data block was received or recovered.
+      \returns True if the data block in the storage is complete.
+    */
+    bool isComplete() const;
+
+    /*!
+      \brief Get the number of fragments (uncoded and coded) received in this session.
+      \returns Number of received fragments.
+    */
+    uint16_t getNbReceived() const;
+
+    /*!
+      \brief Get the number of fragments that are still needed to complete the data block.
+      \returns Number of fragments that must still be received, at least.
+    */
+    uint16_t getNbMissing() const;
+
+    /*!
+      \brief Get the size of the data block without padding.
+      \returns Data block size in bytes.
+    */
+    uint32_t getSize() const;
+
+    /*!
+      \brief Check whether more fragments were lost than the decoder is able to recover.
+      \returns True if RADIOLIB_LORAWAN_FRAG_MAX_MISSING was exceeded, the session can not be completed.
+    */
+    bool isMemoryError() const;
+
+    /*!
+      \brief Get the row of the parity matrix of a coded fragment, as defined by TS004 (matrix_line).
+      \param n Coded fragment index, starting at 1.
+      \param m Number of uncoded fragments.
+      \param line Bitmap of at least m bits to save the row to, bit i set means fragment i (from 0) is included.
+    */
+    static void getParityLine(uint16_t n, uint16_t m, uint8_t* line);
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    // user storage
+    LoRaWANFragReadCb_t readCb = NULL;
+    LoRaWANFragWriteCb_t writeCb = NULL;
+    void* cbCtx = NULL;
+
+    // session parameters
+    bool active = false;
+    bool complete = false;
+    bool memoryError = false;
+    uint16_t nbFrag = 0;
+    uint8_t fragSize = 0;
+    uint8_t padding = 0;
+
+    // number of received fragments, and of uncoded fragments received before the first coded one
+    uint16_t nbReceived = 0;
+    uint16_t nbUncoded = 0;
+
+    // uncoded fragments that were received before the first coded one
+    uint8_t received[(RADIOLIB_LORAWAN_FRAG_MAX_NB + 7) / 8] = { 0 };
+
+    // uncoded fragments that were missing when the first coded fragment arrived (in ascending order)
+    bool coded = false;
+    uint16_t nbMissing = 0;
+    uint16_t missing[RADIOLIB_LORAWAN_FRAG_MAX_MISSING] = { 0 };
+
+    // reduced equations, each row has its first missing fragment (pivot) at the row index
+    // the data of a row is stored in the storage slot of its pivot fragment, which is otherwise empty
+    uint8_t rows[RADIOLIB_LORAWAN_FRAG_MAX_MISSING][(RADIOLIB_LORAWAN_FRAG_MAX_MISSING + 7) / 8] = { { 0 } };
+    uint8_t pivots[(RADIOLIB_LORAWAN_FRAG_MAX_MISSING + 7) / 8] = { 0 };
+    uint16_t nbRows = 0;
+
+    // buffers for the row being processed
+    uint8_t line[(RADIOLIB_LORAWAN_FRAG_MAX_NB + 7) / 8] = { 0 };
+    uint8_t rowBits[(RADIOLIB_LORAWAN_FRAG_MAX_MISSING + 7) / 8] = { 0 };
+    uint8_t rowData[RADIOLIB_LORAWAN_FRAG_MAX_SIZE] = { 0 };
+    uint8_t fragBuff[RADIOLIB_LORAWAN_FRAG_MAX_SIZE] = { 0 };
+
+    // start the decoding phase with the list of missing fragments
+    int16_t startCoded();
+
+    // reduce a row by the stored ones and store it, if it is not redundant
+    int16_t addRow();
+
+    // solve the complete system and write the recovered fragments
+    int16_t solve();
+
+    // XOR a fragment from the storage into the row data
+    int16_t xorSlot(uint16_t frag);
+
+    static uint32_t prbs23(uint32_t x);
+};
+
+#endif
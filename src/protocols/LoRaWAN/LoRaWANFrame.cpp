@@ -0,0 +1,258 @@
+#include "LoRaWAN.h"
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+static inline void putU16(uint8_t* buff, uint16_t val) {
+  buff[0] = val & 0xFF;
+  buff[1] = (val >> 8) & 0xFF;
+}
+
+static inline void putU32(uint8_t* buff, uint32_t val) {
+  for(uint8_t i = 0; i < sizeof(uint32_t); i++) {
+    buff[i] = (val >> (8*i)) & 0xFF;
+  }
+}
+
+static inline uint32_t getU32(const uint8_t* buff) {
+  return((uint32_t)buff[0] | ((uint32_t)buff[1] << 8) | ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24));
+}
+
+// CMAC of the MIC block followed by the message, without copying the two into one buffer
+// the key is either a plain one, or one that was already expanded
+static uint32_t blockCMAC(const uint8_t* key, const RadioLibAES128Key_t* keyExp, const uint8_t* block, const uint8_t* msg, size_t len) {
+  uint8_t cmac[RADIOLIB_AES128_BLOCK_SIZE];
+  if(keyExp) {
+    RadioLibAES128Instance.init(keyExp);
+  } else {
+    RadioLibAES128Instance.init(key);
+  }
+  RadioLibAES128Instance.initCMAC();
+  RadioLibAES128Instance.updateCMAC(block, RADIOLIB_AES128_BLOCK_SIZE);
+  RadioLibAES128Instance.updateCMAC(msg, len);
+  RadioLibAES128Instance.finishCMAC(cmac);
+  return(getU32(cmac));
+}
+
+// the FOpts counter identifier, for downlinks it depends on the frame counter in use (see LoRaWAN v1.1 errata)
+static uint8_t fOptsCtrId(const LoRaWANFrame_t* frame) {
+  if(LoRaWANFrame::isUplink(frame->mType)) {
+    return(0x01);
+  }
+  return((frame->hasFPort && (frame->fPort != RADIOLIB_LORAWAN_FPORT_MAC_COMMAND)) ? 0x02 : 0x01);
+}
+
+int16_t LoRaWANFrame::encode(LoRaWANFrame_t* frame, const uint8_t* payload, const LoRaWANFrameKeys_t* keys, uint8_t* out, size_t* len) {
+  // a payload can not be sent without a port
+  if((frame->fOptsLen > RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN) || ((frame->payloadLen > 0) && !frame->hasFPort)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+  size_t frameLen = RADIOLIB_LORAWAN_DATA_FRAME_FPORT_POS(frame->fOptsLen) + (frame->hasFPort ? 1 : 0) + frame->payloadLen + sizeof(uint32_t);
+  if((frameLen > *len) || (frameLen > RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+  uint8_t dir = LoRaWANFrame::isUplink(frame->mType) ? RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK : RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK;
+
+  // headers
+  out[RADIOLIB_LORAWAN_DATA_FRAME_MHDR_POS] = (frame->mType & RADIOLIB_LORAWAN_MHDR_MTYPE_MASK) | RADIOLIB_LORAWAN_MHDR_MAJOR_R1;
+  putU32(&out[RADIOLIB_LORAWAN_DATA_FRAME_DEV_ADDR_POS], frame->devAddr);
+  out[RADIOLIB_LORAWAN_DATA_FRAME_FCTRL_POS] = (frame->fCtrl & ~RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK) | frame->fOptsLen;
+  putU16(&out[RADIOLIB_LORAWAN_DATA_FRAME_FCNT_POS], (uint16_t)frame->fCnt);
+
+  // in LoRaWAN v1.1, the FOpts are encrypted using the NwkSEncKey, in v1.0.x they are sent in plaintext
+  if(keys->rev == 1) {
+    LoRaWANFrame::processAES(frame->fOpts, frame->fOptsLen, keys->nwkSEncKey, &out[RADIOLIB_LORAWAN_DATA_FRAME_FOPTS_POS], frame->fCnt, dir, fOptsCtrId(frame), true, frame->devAddr);
+  } else {
+    memcpy(&out[RADIOLIB_LORAWAN_DATA_FRAME_FOPTS_POS], frame->fOpts, frame->fOptsLen);
+  }
+
+  // port and payload, MAC commands in the payload are encrypted using the NwkSEncKey
+  if(frame->hasFPort) {
+    out[RADIOLIB_LORAWAN_DATA_FRAME_FPORT_POS(frame->fOptsLen)] = frame->fPort;
+    const uint8_t* encKey = (frame->fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) ? keys->nwkSEncKey : keys->appSKey;
+    LoRaWANFrame::processAES(payload, frame->payloadLen, encKey, &out[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(frame->fOptsLen)], frame->fCnt, dir, 0x00, true, frame->devAddr);
+  }
+
+  frame->mic = LoRaWANFrame::calculateMIC(out, frameLen - sizeof(uint32_t), frame, keys);
+  putU32(&out[frameLen - sizeof(uint32_t)], frame->mic);
+  *len = frameLen;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANFrame::decode(const uint8_t* in, size_t len, const LoRaWANFrameKeys_t* keys, LoRaWANFrame_t* frame, uint8_t* payload) {
+  uint32_t fCntLast = frame->fCnt;
+  int16_t state = LoRaWANFrame::parse(in, len, frame);
+  RADIOLIB_ASSERT(state);
+
+  frame->fCnt = LoRaWANFrame::expandFCnt(fCntLast, (uint16_t)frame->fCnt);
+
+  if(!LoRaWANFrame::verifyMIC(in, len, frame, keys)) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+  LoRaWANFrame::decrypt(in, frame, keys, payload);
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANFrame::parse(const uint8_t* in, size_t len, LoRaWANFrame_t* frame) {
+  if((len < RADIOLIB_LORAWAN_DATA_FRAME_MIN_LEN) || (len > RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+
+  // only data frames have the frame header
+  frame->mType = in[RADIOLIB_LORAWAN_DATA_FRAME_MHDR_POS] & RADIOLIB_LORAWAN_MHDR_MTYPE_MASK;
+  switch(frame->mType) {
+    case(RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP):
+    case(RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_DOWN):
+    case(RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP):
+    case(RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_DOWN):
+      break;
+    default:
+      return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+
+  frame->devAddr = getU32(&in[RADIOLIB_LORAWAN_DATA_FRAME_DEV_ADDR_POS]);
+  frame->fCtrl = in[RADIOLIB_LORAWAN_DATA_FRAME_FCTRL_POS] & ~RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK;
+  frame->fOptsLen = in[RADIOLIB_LORAWAN_DATA_FRAME_FCTRL_POS] & RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK;
+  frame->fCnt = (uint32_t)in[RADIOLIB_LORAWAN_DATA_FRAME_FCNT_POS] | ((uint32_t)in[RADIOLIB_LORAWAN_DATA_FRAME_FCNT_POS + 1] << 8);
+  if(len < (size_t)RADIOLIB_LORAWAN_DATA_FRAME_MIN_LEN + frame->fOptsLen) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+  memcpy(frame->fOpts, &in[RADIOLIB_LORAWAN_DATA_FRAME_FOPTS_POS], frame->fOptsLen);
+
+  // whatever is left between the FOpts and the MIC is the port and the payload
+  size_t rem = len - RADIOLIB_LORAWAN_DATA_FRAME_MIN_LEN - frame->fOptsLen;
+  frame->hasFPort = (rem > 0);
+  frame->fPort = frame->hasFPort ? in[RADIOLIB_LORAWAN_DATA_FRAME_FPORT_POS(frame->fOptsLen)] : 0;
+  frame->payloadLen = frame->hasFPort ? rem - 1 : 0;
+  frame->mic = getU32(&in[len - sizeof(uint32_t)]);
+  return(RADIOLIB_ERR_NONE);
+}
+
+bool LoRaWANFrame::verifyMIC(const uint8_t* in, size_t len, const LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys) {
+  if(len < RADIOLIB_LORAWAN_DATA_FRAME_MIN_LEN) {
+    return(false);
+  }
+  uint32_t mic = LoRaWANFrame::calculateMIC(in, len - sizeof(uint32_t), frame, keys);
+  if(mic != getU32(&in[len - sizeof(uint32_t)])) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("MIC mismatch, expected %08lx, got %08lx", (unsigned long)mic, (unsigned long)getU32(&in[len - sizeof(uint32_t)]));
+    return(false);
+  }
+  return(true);
+}
+
+void LoRaWANFrame::decrypt(const uint8_t* in, LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys, uint8_t* payload) {
+  uint8_t dir = LoRaWANFrame::isUplink(frame->mType) ? RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK : RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK;
+  if(keys->rev == 1) {
+    LoRaWANFrame::processAES(frame->fOpts, frame->fOptsLen, keys->nwkSEncKey, frame->fOpts, frame->fCnt, dir, fOptsCtrId(frame), true, frame->devAddr);
+  }
+
+  if(payload && frame->hasFPort) {
+    const uint8_t* encKey = (frame->fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) ? keys->nwkSEncKey : keys->appSKey;
+    LoRaWANFrame::processAES(&in[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(frame->fOptsLen)], frame->payloadLen, encKey, payload, frame->fCnt, dir, 0x00, true, frame->devAddr);
+  }
+}
+
+// MIC of a data frame, with either the plain or the expanded network keys
+static uint32_t frameMIC(const uint8_t* msg, size_t len, const LoRaWANFrame_t* frame, uint8_t rev,
+                         const uint8_t* fKey, const uint8_t* sKey, const RadioLibAES128Key_t* fKeyExp, const RadioLibAES128Key_t* sKeyExp) {
+  bool isUplink = LoRaWANFrame::isUplink(frame->mType);
+  bool isConfirming = (frame->fCtrl & RADIOLIB_LORAWAN_FCTRL_ACK) && (rev == 1);
+
+  uint8_t block[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  block[RADIOLIB_LORAWAN_BLOCK_MAGIC_POS] = RADIOLIB_LORAWAN_MIC_BLOCK_MAGIC;
+  block[RADIOLIB_LORAWAN_BLOCK_DIR_POS] = isUplink ? RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK : RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK;
+  putU32(&block[RADIOLIB_LORAWAN_BLOCK_DEV_ADDR_POS], frame->devAddr);
+  putU32(&block[RADIOLIB_LORAWAN_BLOCK_FCNT_POS], frame->fCnt);
+  block[RADIOLIB_LORAWAN_MIC_BLOCK_LEN_POS] = len;
+
+  // downlinks are authenticated by the serving network server only
+  if(!isUplink) {
+    if(isConfirming) {
+      putU16(&block[RADIOLIB_LORAWAN_BLOCK_CONF_FCNT_POS], frame->confFCnt);
+    }
+    return(blockCMAC(sKey, sKeyExp, block, msg, len));
+  }
+
+  uint32_t micF = blockCMAC(fKey, fKeyExp, block, msg, len);
+  if(rev == 0) {
+    return(micF);
+  }
+
+  // in LoRaWAN v1.1, half of the uplink MIC is for the serving network server
+  if(isConfirming) {
+    putU16(&block[RADIOLIB_LORAWAN_BLOCK_CONF_FCNT_POS], frame->confFCnt);
+  }
+  block[RADIOLIB_LORAWAN_MIC_DATA_RATE_POS] = frame->dataRate;
+  block[RADIOLIB_LORAWAN_MIC_CH_INDEX_POS] = frame->chIndex;
+  uint32_t micS = blockCMAC(sKey, sKeyExp, block, msg, len);
+  return(((micF & 0x0000FFFF) << 16) | (micS & 0x0000FFFF));
+}
+
+uint32_t LoRaWANFrame::calculateMIC(const uint8_t* msg, size_t len, const LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys) {
+  return(frameMIC(msg, len, frame, keys->rev, keys->fNwkSIntKey, keys->sNwkSIntKey, NULL, NULL));
+}
+
+uint32_t LoRaWANFrame::calculateMIC(const uint8_t* msg, size_t len, const LoRaWANFrame_t* frame, uint8_t rev,
+                                    const RadioLibAES128Key_t* fNwkSIntKey, const RadioLibAES128Key_t* sNwkSIntKey) {
+  return(frameMIC(msg, len, frame, rev, NULL, NULL, fNwkSIntKey, sNwkSIntKey));
+}
+
+// AES counter mode with the key the AES was initialized with
+static void ctrAES(const uint8_t* in, size_t len, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter, uint32_t addr) {
+  // generate the encryption blocks
+  uint8_t encBuffer[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  uint8_t encBlock[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+  encBlock[RADIOLIB_LORAWAN_BLOCK_MAGIC_POS] = RADIOLIB_LORAWAN_ENC_BLOCK_MAGIC;
+  encBlock[RADIOLIB_LORAWAN_ENC_BLOCK_COUNTER_ID_POS] = ctrId;
+  encBlock[RADIOLIB_LORAWAN_BLOCK_DIR_POS] = dir;
+  putU32(&encBlock[RADIOLIB_LORAWAN_BLOCK_DEV_ADDR_POS], addr);
+  putU32(&encBlock[RADIOLIB_LORAWAN_BLOCK_FCNT_POS], fCnt);
+
+  // now encrypt the input
+  // on downlink frames, this has a decryption effect because server actually "decrypts" the plaintext
+  for(size_t i = 0; i < len; i += RADIOLIB_AES128_BLOCK_SIZE) {
+    if(counter) {
+      encBlock[RADIOLIB_LORAWAN_ENC_BLOCK_COUNTER_POS] = i/RADIOLIB_AES128_BLOCK_SIZE + 1;
+    }
+    RadioLibAES128Instance.encryptECB(encBlock, RADIOLIB_AES128_BLOCK_SIZE, encBuffer);
+
+    // now xor the buffer with the input
+    size_t xorLen = RADIOLIB_MIN(len - i, (size_t)RADIOLIB_AES128_BLOCK_SIZE);
+    for(size_t j = 0; j < xorLen; j++) {
+      out[i + j] = in[i + j] ^ encBuffer[j];
+    }
+  }
+}
+
+void LoRaWANFrame::processAES(const uint8_t* in, size_t len, const uint8_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter, uint32_t addr) {
+  if(len == 0) {
+    return;
+  }
+
+  // the key is expanded only once for all of the blocks
+  RadioLibAES128Instance.init(key);
+  ctrAES(in, len, out, fCnt, dir, ctrId, counter, addr);
+}
+
+void LoRaWANFrame::processAES(const uint8_t* in, size_t len, const RadioLibAES128Key_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter, uint32_t addr) {
+  if(len == 0) {
+    return;
+  }
+  RadioLibAES128Instance.init(key);
+  ctrAES(in, len, out, fCnt, dir, ctrId, counter, addr);
+}
+
+uint32_t LoRaWANFrame::expandFCnt(uint32_t fCntLast, uint16_t fCnt) {
+  // the upper bits of the frame counter are the ones of the last frame, unless the lower ones rolled over
+  uint32_t fCnt32 = (fCntLast & 0xFFFF0000UL) | fCnt;
+  if((fCnt32 < fCntLast) && ((fCntLast >> 16) != 0xFFFF)) {
+    fCnt32 += 0x10000UL;
+  }
+  return(fCnt32);
+}
+
+bool LoRaWANFrame::isUplink(uint8_t mType) {
+  return((mType == RADIOLIB_LORAWAN_MHDR_MTYPE_UNCONF_DATA_UP) || (mType == RADIOLIB_LORAWAN_MHDR_MTYPE_CONF_DATA_UP));
+}
+
+#endif
@@ -0,0 +1,232 @@
+#if !defined(_RADIOLIB_LORAWAN_FRAME_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_FRAME_H
+
+#include "../../TypeDef.h"
+#include "../../utils/Cryptography.h"
+
+// frame header layout, with the first 16 bytes reserved for the MIC calculation block
+#define RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS                    (16)
+#define RADIOLIB_LORAWAN_FHDR_DEV_ADDR_POS                      (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 1)
+#define RADIOLIB_LORAWAN_FHDR_FCTRL_POS                         (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 5)
+#define RADIOLIB_LORAWAN_FHDR_FCNT_POS                          (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 6)
+#define RADIOLIB_LORAWAN_FHDR_FOPTS_POS                         (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 8)
+#define RADIOLIB_LORAWAN_FHDR_FOPTS_LEN_MASK                    (0x0F)
+#define RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN                     (15)
+#define RADIOLIB_LORAWAN_FHDR_FPORT_POS(FOPTS)                  (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 8 + (FOPTS))
+#define RADIOLIB_LORAWAN_FRAME_PAYLOAD_POS(FOPTS)               (RADIOLIB_LORAWAN_FHDR_LEN_START_OFFS + 9 + (FOPTS))
+#define RADIOLIB_LORAWAN_FRAME_LEN(PAYLOAD, FOPTS)              (16 + 13 + (PAYLOAD) + (FOPTS))
+
+// data frame layout, as it is sent over the air
+#define RADIOLIB_LORAWAN_DATA_FRAME_MHDR_POS                    (0)
+#define RADIOLIB_LORAWAN_DATA_FRAME_DEV_ADDR_POS                (1)
+#define RADIOLIB_LORAWAN_DATA_FRAME_FCTRL_POS                   (5)
+#define RADIOLIB_LORAWAN_DATA_FRAME_FCNT_POS                    (6)
+#define RADIOLIB_LORAWAN_DATA_FRAME_FOPTS_POS                   (8)
+#define RADIOLIB_LORAWAN_DATA_FRAME_FPORT_POS(FOPTS)            (8 + (FOPTS))
+#define RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(FOPTS)          (9 + (FOPTS))
+#define RADIOLIB_LORAWAN_DATA_FRAME_MIN_LEN                     (12)      // MHDR, FHDR without FOpts and MIC
+#define RADIOLIB_LORAWAN_DATA_FRAME_MAX_LEN                     (255)
+
+/*!
+  \struct LoRaWANFrameKeys_t
+  \brief Session of a device, as needed to encode and decode its data frames.
+  The keys are not copied, so they must remain valid for as long as the session is used.
+  In LoRaWAN v1.0.x, all three network keys are the NwkSKey.
+*/
+struct LoRaWANFrameKeys_t {
+  /*! \brief Device address of the session */
+  uint32_t devAddr;
+
+  /*! \brief LoRaWAN revision, 0 for v1.0.x, 1 for v1.1 */
+  uint8_t rev;
+
+  /*! \brief Application session key */
+  const uint8_t* appSKey;
+
+  /*! \brief Network session encryption key */
+  const uint8_t* nwkSEncKey;
+
+  /*! \brief Forwarding network session integrity key */
+  const uint8_t* fNwkSIntKey;
+
+  /*! \brief Serving network session integrity key */
+  const uint8_t* sNwkSIntKey;
+};
+
+/*!
+  \struct LoRaWANFrame_t
+  \brief Structure to save the fields of a data frame. The frame payload is kept separately.
+*/
+struct LoRaWANFrame_t {
+  /*! \brief Message type, one of the RADIOLIB_LORAWAN_MHDR_MTYPE_*_DATA_* values */
+  uint8_t mType;
+
+  /*! \brief Device address */
+  uint32_t devAddr;
+
+  /*! \brief Frame control flags, the length of FOpts is taken from fOptsLen */
+  uint8_t fCtrl;
+
+  /*! \brief Frame counter, only the 16 least significant bits are sent */
+  uint32_t fCnt;
+
+  /*! \brief Length of the piggy-backed MAC commands */
+  uint8_t fOptsLen;
+
+  /*! \brief Piggy-backed MAC commands, in plaintext */
+  uint8_t fOpts[RADIOLIB_LORAWAN_FHDR_FOPTS_MAX_LEN];
+
+  /*! \brief Whether the frame has a port, frames without payload may omit it */
+  bool hasFPort;
+
+  /*! \brief Port of the frame payload */
+  uint8_t fPort;
+
+  /*! \brief Length of the frame payload */
+  size_t payloadLen;
+
+  /*! \brief 16 least significant bits of the frame counter of the acknowledged frame (LoRaWAN v1.1 only) */
+  uint16_t confFCnt;
+
+  /*! \brief Datarate index of the uplink (LoRaWAN v1.1 uplinks only) */
+  uint8_t dataRate;
+
+  /*! \brief Channel index of the uplink (LoRaWAN v1.1 uplinks only) */
+  uint8_t chIndex;
+
+  /*! \brief Message integrity code, as received or as sent */
+  uint32_t mic;
+};
+
+/*!
+  \class LoRaWANFrame
+  \brief Encoder and decoder of LoRaWAN data frames, including encryption and message integrity codes.
+  It only works on the buffers and sessions passed by the caller and does not allocate any memory,
+  so it can be used without a radio, e.g. to decode captured traffic on a gateway or a host computer.
+  The fields that are not sent over the air (upper bits of the frame counter, confFCnt, dataRate
+  and chIndex) must be set by the caller.
+*/
+class LoRaWANFrame {
+  public:
+    /*!
+      \brief Encode a data frame: build the headers, encrypt the FOpts and the frame payload, and add the MIC.
+      \param frame Fields of the frame, the FOpts are in plaintext.
+      \param payload Frame payload in plaintext, frame->payloadLen bytes long.
+      \param keys Session of the device.
+      \param out Buffer to save the frame into.
+      \param len Size of the output buffer, will be set to the length of the encoded frame.
+      \returns \ref status_codes
+    */
+    static int16_t encode(LoRaWANFrame_t* frame, const uint8_t* payload, const LoRaWANFrameKeys_t* keys, uint8_t* out, size_t* len);
+
+    /*!
+      \brief Decode a data frame: parse it, check the MIC and decrypt it.
+      \param in Received frame.
+      \param len Length of the received frame.
+      \param keys Session of the device.
+      \param frame Fields of the frame. The upper 16 bits of fCnt must be set to those of the last received
+      frame counter, they are incremented if the received 16 bits rolled over.
+      \param payload Buffer to save the decrypted frame payload into, may be the same as the input frame.
+      \returns \ref status_codes
+    */
+    static int16_t decode(const uint8_t* in, size_t len, const LoRaWANFrameKeys_t* keys, LoRaWANFrame_t* frame, uint8_t* payload);
+
+    /*!
+      \brief Parse the header of a data frame, without authenticating or decrypting it.
+      This is enough to find the session of the device, e.g. by its address.
+      \param in Received frame.
+      \param len Length of the received frame.
+      \param frame Fields of the frame. fCnt is set to the 16 bits that were received,
+      the FOpts are kept as they were received.
+      \returns \ref status_codes
+    */
+    static int16_t parse(const uint8_t* in, size_t len, LoRaWANFrame_t* frame);
+
+    /*!
+      \brief Check the MIC of a parsed data frame.
+      \param in Received frame.
+      \param len Length of the received frame.
+      \param frame Fields of the parsed frame, with the full frame counter.
+      \param keys Session of the device.
+      \returns Whether the MIC is correct.
+    */
+    static bool verifyMIC(const uint8_t* in, size_t len, const LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys);
+
+    /*!
+      \brief Decrypt the FOpts and the payload of a parsed data frame.
+      \param in Received frame.
+      \param frame Fields of the parsed frame, with the full frame counter. The FOpts are decrypted in place.
+      \param keys Session of the device.
+      \param payload Buffer to save the decrypted frame payload into, may be the same as the input frame.
+    */
+    static void decrypt(const uint8_t* in, LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys, uint8_t* payload);
+
+    /*!
+      \brief Calculate the MIC of a data frame.
+      \param msg Frame without the MIC.
+      \param len Length of the frame without the MIC.
+      \param frame Fields of the frame.
+      \param keys Session of the device.
+      \returns The MIC of the frame.
+    */
+    static uint32_t calculateMIC(const uint8_t* msg, size_t len, const LoRaWANFrame_t* frame, const LoRaWANFrameKeys_t* keys);
+
+    /*!
+      \brief Calculate the MIC of a data frame with network keys that were already expanded.
+      \param msg Frame without the MIC.
+      \param len Length of the frame without the MIC.
+      \param frame Fields of the frame.
+      \param rev LoRaWAN revision, 0 for v1.0.x, 1 for v1.1.
+      \param fNwkSIntKey Expanded forwarding network session integrity key.
+      \param sNwkSIntKey Expanded serving network session integrity key, same as fNwkSIntKey in v1.0.x.
+      \returns The MIC of the frame.
+    */
+    static uint32_t calculateMIC(const uint8_t* msg, size_t len, const LoRaWANFrame_t* frame, uint8_t rev,
+                                 const RadioLibAES128Key_t* fNwkSIntKey, const RadioLibAES128Key_t* sNwkSIntKey);
+
+    /*!
+      \brief Encrypt or decrypt data with the AES counter mode of LoRaWAN.
+      \param in Input data.
+      \param len Length of the data.
+      \param key Key to use.
+      \param out Buffer to save the output into, may be the same as the input.
+      \param fCnt Frame counter.
+      \param dir Direction of the frame, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK or RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK.
+      \param ctrId Counter identifier, 0x00 for the frame payload.
+      \param counter Whether to count the blocks, starting from 1.
+      \param addr Device address.
+    */
+    static void processAES(const uint8_t* in, size_t len, const uint8_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter, uint32_t addr);
+
+    /*!
+      \brief Encrypt or decrypt data with the AES counter mode of LoRaWAN, using a key that was already expanded.
+      \param in Input data.
+      \param len Length of the data.
+      \param key Expanded key to use.
+      \param out Buffer to save the output into, may be the same as the input.
+      \param fCnt Frame counter.
+      \param dir Direction of the frame, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK or RADIOLIB_LORAWAN_CHANNEL_DIR_DOWNLINK.
+      \param ctrId Counter identifier, 0x00 for the frame payload.
+      \param counter Whether to count the blocks, starting from 1.
+      \param addr Device address.
+    */
+    static void processAES(const uint8_t* in, size_t len, const RadioLibAES128Key_t* key, uint8_t* out, uint32_t fCnt, uint8_t dir, uint8_t ctrId, bool counter, uint32_t addr);
+
+    /*!
+      \brief Get the full frame counter from the 16 bits that are sent over the air.
+      \param fCntLast Last full frame counter of the session.
+      \param fCnt Received 16 least significant bits.
+      \returns The full frame counter. It is the same as fCntLast for a repeated frame,
+      and lower than fCntLast if the counter would not fit into 32 bits.
+    */
+    static uint32_t expandFCnt(uint32_t fCntLast, uint16_t fCnt);
+
+    /*!
+      \brief Check whether a message type is an uplink data frame.
+      \param mType Message type.
+      \returns True for confirmed and unconfirmed data up.
+    */
+    static bool isUplink(uint8_t mType);
+};
+
+#endif
@@ -0,0 +1,424 @@
+#include "LoRaWANJournal.h"
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+// offsets of the uplink frame counter and the session signature in the image
+#define RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS    ((size_t)RADIOLIB_LORAWAN_NONCES_BUF_SIZE + RADIOLIB_LORAWAN_SESSION_FCNT_UP)
+#define RADIOLIB_LORAWAN_JOURNAL_SIGNATURE_POS  ((size_t)RADIOLIB_LORAWAN_NONCES_BUF_SIZE + RADIOLIB_LORAWAN_SESSION_SIGNATURE)
+
+static inline void putU16(uint8_t* buff, uint16_t val) {
+  buff[0] = val & 0xFF;
+  buff[1] = (val >> 8) & 0xFF;
+}
+
+static inline void putU32(uint8_t* buff, uint32_t val) {
+  for(uint8_t i = 0; i < sizeof(uint32_t); i++) {
+    buff[i] = (val >> (8*i)) & 0xFF;
+  }
+}
+
+static inline uint16_t getU16(const uint8_t* buff) {
+  return((uint16_t)buff[0] | ((uint16_t)buff[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t* buff) {
+  return((uint32_t)buff[0] | ((uint32_t)buff[1] << 8) | ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24));
+}
+
+// byte of the state as it is saved: the reserved frame counter in place of the current one,
+// and the signature as it was, since that is only calculated on restore
+static uint8_t journalByte(size_t i, const uint8_t* nonces, const uint8_t* session, const uint8_t* fCnt, const uint8_t* image) {
+  if((i >= RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS) && (i < RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS + sizeof(uint32_t))) {
+    return(fCnt[i - RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS]);
+  }
+  if(i >= RADIOLIB_LORAWAN_JOURNAL_SIGNATURE_POS) {
+    return(image[i]);
+  }
+  if(i < RADIOLIB_LORAWAN_NONCES_BUF_SIZE) {
+    return(nonces[i]);
+  }
+  return(session[i - RADIOLIB_LORAWAN_NONCES_BUF_SIZE]);
+}
+
+LoRaWANJournal::LoRaWANJournal() {
+
+}
+
+void LoRaWANJournal::setStorage(LoRaWANJournalReadCb_t read, LoRaWANJournalWriteCb_t write, LoRaWANJournalEraseCb_t erase, void* ctx) {
+  this->readCb = read;
+  this->writeCb = write;
+  this->eraseCb = erase;
+  this->cbCtx = ctx;
+}
+
+int16_t LoRaWANJournal::begin(uint32_t pageSize, uint8_t numPages, uint32_t fCntGap) {
+  this->valid = false;
+  this->dirty = false;
+  this->pageSeq = 0;
+  this->lastSeq = 0;
+  this->writePos = 0;
+  if(!this->readCb || !this->writeCb) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  // a page must hold the image and at least one change after it
+  uint32_t minPageSize = RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN + 2*RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD +
+                         RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE + RADIOLIB_LORAWAN_JOURNAL_MAX_DELTA;
+  if((numPages < 2) || (pageSize < minPageSize) || (fCntGap < 2) || (fCntGap > RADIOLIB_LORAWAN_MAX_FCNT_GAP)) {
+    return(RADIOLIB_LORAWAN_INVALID_JOURNAL_SIZE);
+  }
+  this->pageSize = pageSize;
+  this->numPages = numPages;
+  this->fCntGap = fCntGap;
+  this->page = numPages - 1;
+
+  // try the pages from the newest one, until one with a complete image is found
+  uint32_t below = 0xFFFFFFFF;
+  while(true) {
+    uint8_t newest = 0;
+    uint32_t newestSeq = 0;
+    for(uint8_t i = 0; i < numPages; i++) {
+      uint32_t seq = 0;
+      int16_t state = this->readHeader(i, &seq);
+      RADIOLIB_ASSERT(state);
+      if((seq > newestSeq) && (seq < below)) {
+        newest = i;
+        newestSeq = seq;
+      }
+      if(seq > this->lastSeq) {
+        this->lastSeq = seq;
+      }
+    }
+    if(newestSeq == 0) {
+      break;
+    }
+
+    int16_t state = this->loadPage(newest, newestSeq);
+    RADIOLIB_ASSERT(state);
+    if(this->valid) {
+      this->page = newest;
+      this->pageSeq = newestSeq;
+      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Journal restored from page %d (seq %lu), FCntUp reserved up to %lu", newest,
+        (unsigned long)newestSeq, (unsigned long)getU32(&this->image[RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS]));
+      break;
+    }
+    below = newestSeq;
+  }
+
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::restore(LoRaWANNode* node) {
+  if(!this->valid) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+
+  // the session continues at the reserved frame counter, so the signature must be updated to match
+  uint8_t* session = &this->image[RADIOLIB_LORAWAN_NONCES_BUF_SIZE];
+  uint16_t signature = LoRaWANNode::checkSum16(session, RADIOLIB_LORAWAN_SESSION_BUF_SIZE - 2);
+  putU16(&this->image[RADIOLIB_LORAWAN_JOURNAL_SIGNATURE_POS], signature);
+
+  int16_t state = node->setBufferNonces(this->image);
+  RADIOLIB_ASSERT(state);
+  state = node->setBufferSession(session);
+  RADIOLIB_ASSERT(state);
+
+  // the restored counters must not be used before the next block is reserved,
+  // otherwise a power loss before the next save would restore the same counters again
+  uint32_t reserved = getU32(&this->image[RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS]);
+  uint8_t delta[3 + sizeof(uint32_t)];
+  putU16(&delta[0], RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS);
+  delta[2] = sizeof(uint32_t);
+  putU32(&delta[3], reserved + this->fCntGap);
+  return(this->append(delta, sizeof(delta)));
+}
+
+int16_t LoRaWANJournal::save(LoRaWANNode* node) {
+  if(this->pageSize == 0) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+  if(!node->isActivated()) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+  uint8_t* nonces = node->getBufferNonces();
+  uint8_t* session = node->getBufferSession();
+
+  // reserve the next block of frame counters once half of the current one is used,
+  // so that a save may be missed without the counter ever going back after a restore
+  // a counter that went back by more than a block is a new session
+  uint32_t reserved = getU32(&this->image[RADIOLIB_LORAWAN_JOURNAL_FCNT_UP_POS]);
+  if(!this->valid || (node->fCntUp + this->fCntGap/2 > reserved) || (node->fCntUp + this->fCntGap < reserved)) {
+    reserved = node->fCntUp + this->fCntGap;
+  }
+  uint8_t fCntBuff[sizeof(uint32_t)];
+  putU32(fCntBuff, reserved);
+
+  // collect the changed runs as offset, length and data
+  // runs are merged over up to 3 unchanged bytes, as that is what another run header would take
+  uint8_t delta[RADIOLIB_LORAWAN_JOURNAL_MAX_DELTA];
+  size_t deltaLen = 0;
+  bool overflow = !this->valid || this->dirty;
+  for(size_t i = 0; (i < RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE) && !overflow; i++) {
+    if(journalByte(i, nonces, session, fCntBuff, this->image) == this->image[i]) {
+      continue;
+    }
+    size_t end = i + 1;
+    for(size_t j = i + 1; (j < RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE) && (j - i < 0xFF) && (j - end <= 3); j++) {
+      if(journalByte(j, nonces, session, fCntBuff, this->image) != this->image[j]) {
+        end = j + 1;
+      }
+    }
+    size_t len = end - i;
+    if(deltaLen + 3 + len > RADIOLIB_LORAWAN_JOURNAL_MAX_DELTA) {
+      overflow = true;
+      break;
+    }
+    putU16(&delta[deltaLen], i);
+    delta[deltaLen + 2] = len;
+    for(size_t j = 0; j < len; j++) {
+      delta[deltaLen + 3 + j] = journalByte(i + j, nonces, session, fCntBuff, this->image);
+    }
+    deltaLen += 3 + len;
+    i = end - 1;
+  }
+
+  // too many changes to journal, start a new page with the complete state
+  if(overflow) {
+    for(size_t i = 0; i < RADIOLIB_LORAWAN_JOURNAL_SIGNATURE_POS; i++) {
+      this->image[i] = journalByte(i, nonces, session, fCntBuff, this->image);
+    }
+    this->valid = true;
+    return(this->compact());
+  }
+
+  if(deltaLen == 0) {
+    return(RADIOLIB_ERR_NONE);
+  }
+  return(this->append(delta, deltaLen));
+}
+
+int16_t LoRaWANJournal::compact() {
+  if(this->pageSize == 0) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+  if(!this->valid) {
+    return(RADIOLIB_ERR_NETWORK_NOT_JOINED);
+  }
+
+  // until the new page is complete, the current one must not be appended to
+  this->dirty = true;
+  uint8_t next = (this->page + 1) % this->numPages;
+  uint32_t addr = next*this->pageSize;
+  uint32_t seq = this->lastSeq + 1;
+  int16_t state;
+  if(this->eraseCb) {
+    state = this->eraseCb(addr, this->pageSize, this->cbCtx);
+  } else {
+    // without erase, the old header is invalidated first so that a partially written page is never used
+    uint8_t erased[RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN];
+    memset(erased, 0xFF, sizeof(erased));
+    state = this->writeCb(addr, erased, sizeof(erased), this->cbCtx);
+  }
+  RADIOLIB_ASSERT(state);
+
+  // the image first, the header last - a page without a valid header is ignored
+  state = this->writeRecord(addr + RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN, seq, RADIOLIB_LORAWAN_JOURNAL_RECORD_IMAGE, this->image, RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE);
+  RADIOLIB_ASSERT(state);
+
+  uint8_t header[RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN];
+  putU16(&header[0], RADIOLIB_LORAWAN_JOURNAL_MAGIC);
+  header[2] = RADIOLIB_LORAWAN_JOURNAL_VERSION;
+  header[3] = 0;
+  putU32(&header[4], seq);
+  putU16(&header[8], LoRaWANJournal::checksum(0xFFFF, header, 8));
+  state = this->writeCb(addr, header, sizeof(header), this->cbCtx);
+  RADIOLIB_ASSERT(state);
+
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("Journal compacted to page %d (seq %lu)", next, (unsigned long)seq);
+  this->page = next;
+  this->pageSeq = seq;
+  this->lastSeq = seq;
+  this->writePos = RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN + RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE;
+  this->dirty = false;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::clear() {
+  if(this->pageSize == 0) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  uint8_t erased[RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN];
+  memset(erased, 0xFF, sizeof(erased));
+  for(uint8_t i = 0; i < this->numPages; i++) {
+    int16_t state;
+    if(this->eraseCb) {
+      state = this->eraseCb(i*this->pageSize, this->pageSize, this->cbCtx);
+    } else {
+      state = this->writeCb(i*this->pageSize, erased, sizeof(erased), this->cbCtx);
+    }
+    RADIOLIB_ASSERT(state);
+  }
+
+  this->valid = false;
+  this->dirty = false;
+  memset(this->image, 0, sizeof(this->image));
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::readHeader(uint8_t page, uint32_t* seq) {
+  uint8_t header[RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN];
+  int16_t state = this->readCb(page*this->pageSize, header, sizeof(header), this->cbCtx);
+  RADIOLIB_ASSERT(state);
+
+  *seq = 0;
+  if((getU16(&header[0]) == RADIOLIB_LORAWAN_JOURNAL_MAGIC) &&
+     (header[2] == RADIOLIB_LORAWAN_JOURNAL_VERSION) &&
+     (getU16(&header[8]) == LoRaWANJournal::checksum(0xFFFF, header, 8))) {
+    *seq = getU32(&header[4]);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::loadPage(uint8_t page, uint32_t seq) {
+  this->valid = false;
+  uint32_t addr = page*this->pageSize;
+  uint32_t pos = RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN;
+  uint8_t type = RADIOLIB_LORAWAN_JOURNAL_RECORD_END;
+  size_t len = 0;
+
+  // the page starts with the complete state
+  int16_t state = this->readRecord(addr + pos, seq, this->image, RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE, &type, &len);
+  if((state != RADIOLIB_ERR_NONE) || (type != RADIOLIB_LORAWAN_JOURNAL_RECORD_IMAGE) || (len != RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE)) {
+    // only errors of the storage itself are reported
+    return((state == RADIOLIB_ERR_CRC_MISMATCH) ? RADIOLIB_ERR_NONE : state);
+  }
+  this->valid = true;
+  pos += RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + len;
+
+  // then the changes, up to the first one that is not complete
+  uint8_t delta[RADIOLIB_LORAWAN_JOURNAL_MAX_DELTA];
+  while(pos + RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD <= this->pageSize) {
+    state = this->readRecord(addr + pos, seq, delta, sizeof(delta), &type, &len);
+    if(state == RADIOLIB_ERR_CRC_MISMATCH) {
+      break;
+    }
+    RADIOLIB_ASSERT(state);
+    if((type != RADIOLIB_LORAWAN_JOURNAL_RECORD_DELTA) || !this->applyDelta(delta, len)) {
+      break;
+    }
+    pos += RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + len;
+  }
+
+  // anything but erased storage after the last record can not be written to without an erase
+  this->writePos = pos;
+  this->dirty = (pos + RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD <= this->pageSize) && (type != RADIOLIB_LORAWAN_JOURNAL_RECORD_END) && this->eraseCb;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::readRecord(uint32_t addr, uint32_t seq, uint8_t* data, size_t maxLen, uint8_t* type, size_t* len) {
+  uint8_t header[3];
+  int16_t state = this->readCb(addr, header, sizeof(header), this->cbCtx);
+  RADIOLIB_ASSERT(state);
+  *type = header[0];
+  *len = getU16(&header[1]);
+  if((*type == RADIOLIB_LORAWAN_JOURNAL_RECORD_END) || (*len > maxLen) ||
+     ((addr % this->pageSize) + RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + *len > this->pageSize)) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+
+  uint8_t crcBuff[2];
+  state = this->readCb(addr + sizeof(header), data, *len, this->cbCtx);
+  RADIOLIB_ASSERT(state);
+  state = this->readCb(addr + sizeof(header) + *len, crcBuff, sizeof(crcBuff), this->cbCtx);
+  RADIOLIB_ASSERT(state);
+
+  // the CRC includes the sequence number of the page, so records left over from its previous use never match
+  uint8_t seqBuff[sizeof(uint32_t)];
+  putU32(seqBuff, seq);
+  uint16_t crc = LoRaWANJournal::checksum(0xFFFF, seqBuff, sizeof(seqBuff));
+  crc = LoRaWANJournal::checksum(crc, header, sizeof(header));
+  crc = LoRaWANJournal::checksum(crc, data, *len);
+  if(crc != getU16(crcBuff)) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANJournal::writeRecord(uint32_t addr, uint32_t seq, uint8_t type, const uint8_t* data, size_t len) {
+  uint8_t header[3];
+  header[0] = type;
+  putU16(&header[1], len);
+
+  uint8_t seqBuff[sizeof(uint32_t)];
+  putU32(seqBuff, seq);
+  uint16_t crc = LoRaWANJournal::checksum(0xFFFF, seqBuff, sizeof(seqBuff));
+  crc = LoRaWANJournal::checksum(crc, header, sizeof(header));
+  crc = LoRaWANJournal::checksum(crc, data, len);
+  uint8_t crcBuff[2];
+  putU16(crcBuff, crc);
+
+  // the CRC goes last, so an interrupted write is never taken as a record
+  int16_t state = this->writeCb(addr, header, sizeof(header), this->cbCtx);
+  RADIOLIB_ASSERT(state);
+  state = this->writeCb(addr + sizeof(header), data, len, this->cbCtx);
+  RADIOLIB_ASSERT(state);
+  return(this->writeCb(addr + sizeof(header) + len, crcBuff, sizeof(crcBuff), this->cbCtx));
+}
+
+int16_t LoRaWANJournal::append(const uint8_t* delta, size_t len) {
+  // continue on the next page if this one is full or can not be written to
+  if(this->dirty || (this->writePos + RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + len > this->pageSize)) {
+    (void)this->applyDelta(delta, len);
+    return(this->compact());
+  }
+
+  // only apply the changes once they are in the storage
+  int16_t state = this->writeRecord(this->page*this->pageSize + this->writePos, this->pageSeq, RADIOLIB_LORAWAN_JOURNAL_RECORD_DELTA, delta, len);
+  if(state != RADIOLIB_ERR_NONE) {
+    this->dirty = true;
+    return(state);
+  }
+  this->writePos += RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD + len;
+  (void)this->applyDelta(delta, len);
+  return(RADIOLIB_ERR_NONE);
+}
+
+bool LoRaWANJournal::applyDelta(const uint8_t* delta, size_t len) {
+  // check all runs first, so a malformed record changes nothing
+  size_t pos = 0;
+  while(pos < len) {
+    if(pos + 3 > len) {
+      return(false);
+    }
+    size_t offset = getU16(&delta[pos]);
+    size_t runLen = delta[pos + 2];
+    if((runLen == 0) || (pos + 3 + runLen > len) || (offset + runLen > RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE)) {
+      return(false);
+    }
+    pos += 3 + runLen;
+  }
+
+  pos = 0;
+  while(pos < len) {
+    size_t offset = getU16(&delta[pos]);
+    size_t runLen = delta[pos + 2];
+    memcpy(&this->image[offset], &delta[pos + 3], runLen);
+    pos += 3 + runLen;
+  }
+  return(true);
+}
+
+uint16_t LoRaWANJournal::checksum(uint16_t crc, const uint8_t* data, size_t len) {
+  // CRC-16/CCITT, continued from the previous value
+  RadioLibCRCInstance.size = 16;
+  RadioLibCRCInstance.poly = RADIOLIB_CRC_CCITT_POLY;
+  RadioLibCRCInstance.init = crc;
+  RadioLibCRCInstance.out = 0x0000;
+  RadioLibCRCInstance.refIn = false;
+  RadioLibCRCInstance.refOut = false;
+  return((uint16_t)RadioLibCRCInstance.checksum(data, len));
+}
+
+#endif
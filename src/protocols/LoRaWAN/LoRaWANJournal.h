@@ -0,0 +1,180 @@
+#if !defined(_RADIOLIB_LORAWAN_JOURNAL_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_JOURNAL_H
+
+#include "../../TypeDef.h"
+#include "LoRaWAN.h"
+
+// page header: magic, version, reserved, sequence number and CRC
+#define RADIOLIB_LORAWAN_JOURNAL_MAGIC                          (0x4A4C)
+#define RADIOLIB_LORAWAN_JOURNAL_VERSION                        (0x01)
+#define RADIOLIB_LORAWAN_JOURNAL_HEADER_LEN                     (10)
+
+// record types, erased storage reads as the end of the journal
+#define RADIOLIB_LORAWAN_JOURNAL_RECORD_IMAGE                   (0x01)
+#define RADIOLIB_LORAWAN_JOURNAL_RECORD_DELTA                   (0x02)
+#define RADIOLIB_LORAWAN_JOURNAL_RECORD_END                     (0xFF)
+
+// record type and length before the data, CRC after it
+#define RADIOLIB_LORAWAN_JOURNAL_RECORD_OVERHEAD                (3 + 2)
+
+// the journaled state is the Nonces buffer followed by the session buffer
+#define RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE                     ((size_t)RADIOLIB_LORAWAN_NONCES_BUF_SIZE + RADIOLIB_LORAWAN_SESSION_BUF_SIZE)
+
+// changes larger than this are saved as a new image instead
+#define RADIOLIB_LORAWAN_JOURNAL_MAX_DELTA                      (64)
+
+// default number of uplink frame counters reserved ahead
+#define RADIOLIB_LORAWAN_JOURNAL_FCNT_GAP                       (64)
+
+/*!
+  \typedef LoRaWANJournalReadCb_t
+  \brief Callback to read from the user storage.
+  \param addr Address from the start of the journal storage, in bytes.
+  \param data Buffer to read the data into.
+  \param len Number of bytes to read.
+  \param ctx User context passed to setStorage.
+  \returns \ref status_codes
+*/
+typedef int16_t (*LoRaWANJournalReadCb_t)(uint32_t addr, uint8_t* data, size_t len, void* ctx);
+
+/*!
+  \typedef LoRaWANJournalWriteCb_t
+  \brief Callback to write to the user storage. Every byte is written at most once between two erases of its page.
+  \param addr Address from the start of the journal storage, in bytes.
+  \param data Data to write.
+  \param len Number of bytes to write.
+  \param ctx User context passed to setStorage.
+  \returns \ref status_codes
+*/
+typedef int16_t (*LoRaWANJournalWriteCb_t)(uint32_t addr, const uint8_t* data, size_t len, void* ctx);
+
+/*!
+  \typedef LoRaWANJournalEraseCb_t
+  \brief Callback to erase a page of the user storage, the erased bytes must read as 0xFF.
+  \param addr Address of the page from the start of the journal storage, in bytes.
+  \param len Page size in bytes.
+  \param ctx User context passed to setStorage.
+  \returns \ref status_codes
+*/
+typedef int16_t (*LoRaWANJournalEraseCb_t)(uint32_t addr, size_t len, void* ctx);
+
+/*!
+  \class LoRaWANJournal
+  \brief Wear-leveled persistence of the LoRaWAN Nonces and session buffers. Instead of writing
+  the whole buffers after every uplink, only the bytes that changed since the last save are appended
+  to the journal. The uplink frame counter is not saved on every uplink, a block of counters
+  is reserved ahead instead, and a restored session continues after the reserved block.
+  The storage is split into pages that are used in turn: once a page is full, the complete state
+  is written to the next one and the journal continues there. Every record is protected by a CRC,
+  so a save that was interrupted (e.g. by a power loss) is discarded at boot and the state
+  saved before it is restored.
+*/
+class LoRaWANJournal {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    LoRaWANJournal();
+
+    /*!
+      \brief Set the storage of the journal.
+      \param read Callback to read from the storage.
+      \param write Callback to write to the storage.
+      \param erase Callback to erase a page of the storage. Can be NULL for storage that can be
+      overwritten, such as EEPROM or FRAM, but must be set for flash.
+      \param ctx User context passed to the callbacks.
+    */
+    void setStorage(LoRaWANJournalReadCb_t read, LoRaWANJournalWriteCb_t write, LoRaWANJournalEraseCb_t erase = NULL, void* ctx = NULL);
+
+    /*!
+      \brief Start the journal and recover the latest complete state saved in the storage.
+      \param pageSize Size of one page in bytes, at least about 1 kB. For flash, this is the erase block size (or a multiple of it).
+      \param numPages Number of pages the storage is split into, at least 2.
+      \param fCntGap Number of uplink frame counters reserved ahead, up to RADIOLIB_LORAWAN_MAX_FCNT_GAP.
+      Larger values mean fewer writes, but more counters are skipped every time a session is restored.
+      \returns \ref status_codes
+    */
+    int16_t begin(uint32_t pageSize, uint8_t numPages, uint32_t fCntGap = RADIOLIB_LORAWAN_JOURNAL_FCNT_GAP);
+
+    /*!
+      \brief Restore the saved session into a node, in place of setBufferNonces and setBufferSession.
+      The node must be set up by beginOTAA or beginABP first, then activated as usual.
+      The next block of uplink frame counters is reserved in the storage before this returns,
+      the node must not transmit if that fails.
+      \param node Node to restore the session to.
+      \returns \ref status_codes, RADIOLIB_ERR_NETWORK_NOT_JOINED if no session was saved.
+    */
+    int16_t restore(LoRaWANNode* node);
+
+    /*!
+      \brief Save the session of a node, e.g. after every uplink.
+      Only the changes since the last save are written, most calls do not write anything.
+      \param node Node to save the session of, must be activated.
+      \returns \ref status_codes
+    */
+    int16_t save(LoRaWANNode* node);
+
+    /*!
+      \brief Write the complete saved state to the next page. This is done automatically
+      once the current page is full, it only has to be called to move on before that.
+      \returns \ref status_codes
+    */
+    int16_t compact();
+
+    /*!
+      \brief Discard the saved state, e.g. to force a new join.
+      \returns \ref status_codes
+    */
+    int16_t clear();
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    // user storage
+    LoRaWANJournalReadCb_t readCb = NULL;
+    LoRaWANJournalWriteCb_t writeCb = NULL;
+    LoRaWANJournalEraseCb_t eraseCb = NULL;
+    void* cbCtx = NULL;
+
+    uint32_t pageSize = 0;
+    uint8_t numPages = 0;
+    uint32_t fCntGap = RADIOLIB_LORAWAN_JOURNAL_FCNT_GAP;
+
+    // whether the image holds a saved state
+    bool valid = false;
+
+    // whether the current page can not be appended to, e.g. after an interrupted write
+    bool dirty = false;
+
+    // current page, its sequence number and where the next record goes
+    // and the highest sequence number found in the storage
+    uint8_t page = 0;
+    uint32_t pageSeq = 0;
+    uint32_t writePos = 0;
+    uint32_t lastSeq = 0;
+
+    // the saved state, with the reserved uplink frame counter in place of the current one
+    uint8_t image[RADIOLIB_LORAWAN_JOURNAL_IMAGE_SIZE] = { 0 };
+
+    // read the sequence number of a page, 0 if the page has no valid header
+    int16_t readHeader(uint8_t page, uint32_t* seq);
+
+    // load the image of a page and apply its changes, valid is set if the page has a complete image
+    int16_t loadPage(uint8_t page, uint32_t seq);
+
+    // read a record, len is the length of its data, state is RADIOLIB_ERR_NONE only if the CRC matches
+    int16_t readRecord(uint32_t addr, uint32_t seq, uint8_t* data, size_t maxLen, uint8_t* type, size_t* len);
+
+    // write a record
+    int16_t writeRecord(uint32_t addr, uint32_t seq, uint8_t type, const uint8_t* data, size_t len);
+
+    // write a change record and apply it, or move on to the next page if it does not fit
+    int16_t append(const uint8_t* delta, size_t len);
+
+    // apply a change record to the image, false if the record is malformed
+    bool applyDelta(const uint8_t* delta, size_t len);
+
+    static uint16_t checksum(uint16_t crc, const uint8_t* data, size_t len);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "LoRaWANLinkAdr.h"
+#include <math.h>
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+LoRaWANLinkAdr::LoRaWANLinkAdr() {
+
+}
+
+void LoRaWANLinkAdr::begin(uint8_t mode, float margin, float hysteresis, uint8_t minSamples) {
+  this->mode = mode;
+  this->margin = margin;
+  this->hysteresis = hysteresis;
+  this->minSamples = RADIOLIB_MAX(RADIOLIB_MIN(minSamples, RADIOLIB_LORAWAN_LINK_ADR_WINDOW), 1);
+  this->reset();
+}
+
+void LoRaWANLinkAdr::reset() {
+  this->numSamples = 0;
+  this->sampleIdx = 0;
+  this->numUplinks = 0;
+  this->sinceChange = 0;
+  this->ackPending = false;
+  memset(this->ackSent, 0, sizeof(this->ackSent));
+  memset(this->ackRecv, 0, sizeof(this->ackRecv));
+}
+
+void LoRaWANLinkAdr::setDownlinkOffset(float offset) {
+  this->dlOffset = offset;
+}
+
+uint8_t LoRaWANLinkAdr::getMode() const {
+  return(this->mode);
+}
+
+void LoRaWANLinkAdr::setDataRate(uint8_t dr, uint8_t sf, float bw) {
+  if(dr >= RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES) {
+    return;
+  }
+  if(sf == 0) {
+    this->loraMask &= ~(1UL << dr);
+    return;
+  }
+
+  // the demodulation floor drops by 2.5 dB per spreading factor, from -7.5 dB at SF7
+  // a wider channel collects more noise, so the same signal has a lower SNR in it
+  this->bwOffsets[dr] = 10.0f*log10f(bw / 125.0f);
+  this->floors[dr] = -7.5f - 2.5f*((int8_t)sf - 7) + this->bwOffsets[dr];
+  this->loraMask |= (1UL << dr);
+}
+
+void LoRaWANLinkAdr::addUplink(uint8_t dr, uint8_t txPowerSteps, bool confirmed) {
+  if(dr >= RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES) {
+    return;
+  }
+  this->lastDr = dr;
+  this->lastSteps = txPowerSteps;
+  if(this->sinceChange < 0xFF) {
+    this->sinceChange++;
+  }
+
+  // a confirmed uplink counts as lost until a downlink acknowledges it
+  this->ackPending = confirmed;
+  if(confirmed) {
+    this->ackSent[dr]++;
+  }
+
+  // forget old acknowledgements, so a datarate that had losses is tried again eventually
+  if(++this->numUplinks >= RADIOLIB_LORAWAN_LINK_ADR_WINDOW) {
+    this->numUplinks = 0;
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES; i++) {
+      this->ackSent[i] /= 2;
+      this->ackRecv[i] = RADIOLIB_MIN(this->ackRecv[i] / 2, this->ackSent[i]);
+    }
+  }
+}
+
+void LoRaWANLinkAdr::addDownlink(uint8_t dr, float snr, float rssi, bool ack) {
+  if(ack && this->ackPending) {
+    this->ackRecv[this->lastDr]++;
+    this->ackPending = false;
+  }
+  if((dr >= RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES) || !(this->loraMask & (1UL << dr))) {
+    return;
+  }
+
+  // the SNR reported by the radio saturates for strong signals, the RSSI is the better measure there
+  float est = snr + this->bwOffsets[dr];
+  if(snr > 0) {
+    est = RADIOLIB_MAX(est, rssi - RADIOLIB_LORAWAN_LINK_ADR_NOISE_FLOOR);
+  }
+  this->addSample(est - this->dlOffset);
+}
+
+void LoRaWANLinkAdr::addLinkCheck(uint8_t margin, uint8_t gwCnt) {
+  if((gwCnt == 0) || !(this->loraMask & (1UL << this->lastDr))) {
+    return;
+  }
+
+  // the margin is above the demodulation floor of the uplink, at the power it was sent with
+  this->addSample((float)margin + this->floors[this->lastDr] + 2.0f*this->lastSteps);
+}
+
+void LoRaWANLinkAdr::holdOff() {
+  this->sinceChange = 0;
+}
+
+bool LoRaWANLinkAdr::recommend(uint8_t dr, uint8_t txPowerSteps, uint8_t maxPowerSteps, uint16_t enabled, uint8_t* drOut, uint8_t* txPowerStepsOut) {
+  *drOut = dr;
+  *txPowerStepsOut = txPowerSteps;
+  enabled &= this->loraMask;
+  if((this->mode == RADIOLIB_LORAWAN_LINK_ADR_OFF) || (dr >= RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES) || !(enabled & (1UL << dr))) {
+    return(false);
+  }
+
+  // confirmed uplinks are getting lost, whatever the samples say: first the maximum power, then a slower datarate
+  if(this->isAckPoor(dr)) {
+    if(txPowerSteps > 0) {
+      // give the higher power a chance before the datarate is lowered too
+      *txPowerStepsOut = 0;
+      if(this->mode == RADIOLIB_LORAWAN_LINK_ADR_APPLY) {
+        this->ackSent[dr] = 0;
+        this->ackRecv[dr] = 0;
+      }
+    } else {
+      for(int8_t i = dr - 1; i >= 0; i--) {
+        if(enabled & (1UL << i)) {
+          *drOut = i;
+          break;
+        }
+      }
+    }
+  } else if(this->numSamples >= this->minSamples) {
+    // moves up need the hysteresis on top of the margin, and enough uplinks since the last change
+    bool canMoveUp = (this->sinceChange >= this->minSamples);
+    float snr = this->getSnr();
+    int8_t best = -1;
+    int8_t slowest = -1;
+    for(uint8_t i = 0; i < RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES; i++) {
+      if(!(enabled & (1UL << i))) {
+        continue;
+      }
+      if(slowest < 0) {
+        slowest = i;
+      }
+      float headroom = snr - this->floors[i] - this->margin;
+      if(i < dr) {
+        if(headroom >= 0) {
+          best = i;
+        }
+      } else if(i == dr) {
+        if(headroom >= -this->hysteresis) {
+          best = i;
+        }
+      } else if(canMoveUp && (headroom >= this->hysteresis) && !this->isAckPoor(i)) {
+        best = i;
+      }
+    }
+    *drOut = (best < 0) ? slowest : best;
+
+    // leftover margin at the chosen datarate goes into lower power, 2 dB per step
+    float headroom = snr - this->floors[*drOut] - this->margin;
+    if(*drOut != dr) {
+      float steps = floorf((headroom - this->hysteresis) / 2.0f);
+      *txPowerStepsOut = (steps > 0) ? (uint8_t)RADIOLIB_MIN(steps, (float)maxPowerSteps) : 0;
+    } else {
+      headroom -= 2.0f*txPowerSteps;
+      if(headroom < 0) {
+        uint8_t steps = (uint8_t)ceilf(-headroom / 2.0f);
+        *txPowerStepsOut = (steps < txPowerSteps) ? txPowerSteps - steps : 0;
+      } else if(canMoveUp && (headroom >= 2.0f + this->hysteresis)) {
+        uint8_t steps = (uint8_t)floorf((headroom - this->hysteresis) / 2.0f);
+        *txPowerStepsOut = RADIOLIB_MIN(txPowerSteps + steps, maxPowerSteps);
+      }
+    }
+  }
+
+  if((*drOut == dr) && (*txPowerStepsOut == txPowerSteps)) {
+    return(false);
+  }
+
+  // the hold-off only starts if the change is actually made
+  if(this->mode == RADIOLIB_LORAWAN_LINK_ADR_APPLY) {
+    this->sinceChange = 0;
+  }
+  return(true);
+}
+
+float LoRaWANLinkAdr::getMargin(uint8_t dr, uint8_t txPowerSteps) const {
+  if((this->numSamples == 0) || (dr >= RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES)) {
+    return(0);
+  }
+  return(this->getSnr() - this->floors[dr] - 2.0f*txPowerSteps);
+}
+
+uint8_t LoRaWANLinkAdr::getNumSamples() const {
+  return(this->numSamples);
+}
+
+void LoRaWANLinkAdr::addSample(float snr) {
+  this->samples[this->sampleIdx] = snr;
+  this->sampleIdx = (this->sampleIdx + 1) % RADIOLIB_LORAWAN_LINK_ADR_WINDOW;
+  if(this->numSamples < RADIOLIB_LORAWAN_LINK_ADR_WINDOW) {
+    this->numSamples++;
+  }
+}
+
+float LoRaWANLinkAdr::getSnr() const {
+  if(this->numSamples == 0) {
+    return(0);
+  }
+  float sum = 0;
+  for(uint8_t i = 0; i < this->numSamples; i++) {
+    sum += this->samples[i];
+  }
+  return(sum / this->numSamples);
+}
+
+bool LoRaWANLinkAdr::isAckPoor(uint8_t dr) const {
+  return((this->ackSent[dr] >= RADIOLIB_LORAWAN_LINK_ADR_ACK_MIN) && (2*this->ackRecv[dr] < this->ackSent[dr]));
+}
+
+#endif
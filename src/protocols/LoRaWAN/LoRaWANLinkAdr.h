@@ -0,0 +1,188 @@
+#if !defined(_RADIOLIB_LORAWAN_LINK_ADR_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_LINK_ADR_H
+
+#include "../../TypeDef.h"
+
+// operating modes of the link margin ADR
+#define RADIOLIB_LORAWAN_LINK_ADR_OFF                           (0x00)
+#define RADIOLIB_LORAWAN_LINK_ADR_RECOMMEND                     (0x01)
+#define RADIOLIB_LORAWAN_LINK_ADR_APPLY                         (0x02)
+
+// what the link margin ADR did before an uplink
+#define RADIOLIB_LORAWAN_LINK_ADR_ACTION_NONE                   (0x00)
+#define RADIOLIB_LORAWAN_LINK_ADR_ACTION_RECOMMENDED            (0x01)
+#define RADIOLIB_LORAWAN_LINK_ADR_ACTION_APPLIED                (0x02)
+
+// number of link quality samples kept
+#define RADIOLIB_LORAWAN_LINK_ADR_WINDOW                        (20)
+
+// default installation margin and hysteresis in dB, and the number of samples needed for a decision
+#define RADIOLIB_LORAWAN_LINK_ADR_MARGIN                        (10.0f)
+#define RADIOLIB_LORAWAN_LINK_ADR_HYSTERESIS                    (3.0f)
+#define RADIOLIB_LORAWAN_LINK_ADR_MIN_SAMPLES                   (4)
+
+// thermal noise in 125 kHz with a 6 dB receiver noise figure, in dBm
+#define RADIOLIB_LORAWAN_LINK_ADR_NOISE_FLOOR                   (-117.0f)
+
+// number of confirmed uplinks at a datarate before its acknowledgement ratio is taken into account
+#define RADIOLIB_LORAWAN_LINK_ADR_ACK_MIN                       (4)
+
+// number of datarates tracked, the same as RADIOLIB_LORAWAN_CHANNEL_NUM_DATARATES
+#define RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES                 (15)
+
+/*!
+  \class LoRaWANLinkAdr
+  \brief Device-side link margin ADR. Keeps a rolling window of link quality samples - the SNR and RSSI
+  of downlinks and the margins reported in LinkCheckAns - together with the acknowledgement ratio
+  of confirmed uplinks per datarate. From these, it picks the fastest datarate and the lowest
+  transmit power that still leave the installation margin, with hysteresis so that the configuration
+  does not flip back and forth. Meant for fixed devices where the network server ADR is slow or absent,
+  the ADR_ACK backoff of the node still applies when the downlinks stop.
+  All samples are converted to the SNR an uplink at the maximum power would have in a 125 kHz channel,
+  so they remain valid when the datarate or power is changed.
+*/
+class LoRaWANLinkAdr {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    LoRaWANLinkAdr();
+
+    /*!
+      \brief Configure the link margin ADR and clear all samples.
+      \param mode RADIOLIB_LORAWAN_LINK_ADR_APPLY to change the datarate and power of the node,
+      RADIOLIB_LORAWAN_LINK_ADR_RECOMMEND to only report the changes in the uplink events,
+      or RADIOLIB_LORAWAN_LINK_ADR_OFF.
+      \param margin Installation margin in dB left above the demodulation floor, to cover fading.
+      \param hysteresis Margin in dB needed on top of the installation margin before moving
+      to a faster datarate or a lower power, and lost before moving back.
+      \param minSamples Number of samples needed before the first decision,
+      and number of uplinks between two moves to a faster datarate or lower power.
+    */
+    void begin(uint8_t mode = RADIOLIB_LORAWAN_LINK_ADR_APPLY, float margin = RADIOLIB_LORAWAN_LINK_ADR_MARGIN,
+               float hysteresis = RADIOLIB_LORAWAN_LINK_ADR_HYSTERESIS, uint8_t minSamples = RADIOLIB_LORAWAN_LINK_ADR_MIN_SAMPLES);
+
+    /*!
+      \brief Clear all samples and acknowledgement statistics, the configuration is kept.
+    */
+    void reset();
+
+    /*!
+      \brief Set the difference between the downlink and the uplink budget, e.g. because the gateway
+      transmits at a higher power than the device. Subtracted from the SNR of every downlink.
+      \param offset Offset in dB, 0 by default.
+    */
+    void setDownlinkOffset(float offset);
+
+    /*!
+      \brief Get the operating mode.
+      \returns One of RADIOLIB_LORAWAN_LINK_ADR_*.
+    */
+    uint8_t getMode() const;
+
+    /*!
+      \brief Set the modulation of a datarate, this is done by LoRaWANNode::setLinkAdr.
+      \param dr Datarate index.
+      \param sf LoRa spreading factor, 0 if the datarate does not use LoRa.
+      \param bw LoRa bandwidth in kHz.
+    */
+    void setDataRate(uint8_t dr, uint8_t sf, float bw);
+
+    /*!
+      \brief Account an uplink, this is done by the node.
+      \param dr Datarate of the uplink.
+      \param txPowerSteps Transmit power steps (of 2 dB) below the maximum.
+      \param confirmed Whether the uplink was confirmed.
+    */
+    void addUplink(uint8_t dr, uint8_t txPowerSteps, bool confirmed);
+
+    /*!
+      \brief Account a downlink, this is done by the node.
+      \param dr Datarate of the downlink.
+      \param snr SNR of the downlink in dB.
+      \param rssi RSSI of the downlink in dBm.
+      \param ack Whether the downlink acknowledged the last uplink.
+    */
+    void addDownlink(uint8_t dr, float snr, float rssi, bool ack);
+
+    /*!
+      \brief Account a LinkCheckAns for the last uplink, this is done by the node.
+      \param margin Demodulation margin in dB reported by the network.
+      \param gwCnt Number of gateways that received the uplink.
+    */
+    void addLinkCheck(uint8_t margin, uint8_t gwCnt);
+
+    /*!
+      \brief Hold off any move to a faster datarate or lower power for another minSamples uplinks,
+      this is done by the node when the network changes the datarate or power.
+    */
+    void holdOff();
+
+    /*!
+      \brief Get the datarate and power the link margin ADR would use for the next uplink.
+      \param dr Current datarate.
+      \param txPowerSteps Current transmit power steps below the maximum.
+      \param maxPowerSteps Largest number of power steps allowed.
+      \param enabled Bitmask of the datarates that can be used for the next uplink.
+      \param drOut Recommended datarate.
+      \param txPowerStepsOut Recommended power steps.
+      \returns Whether the recommendation differs from the current configuration.
+    */
+    bool recommend(uint8_t dr, uint8_t txPowerSteps, uint8_t maxPowerSteps, uint16_t enabled, uint8_t* drOut, uint8_t* txPowerStepsOut);
+
+    /*!
+      \brief Get the estimated link margin, i.e. how far above the demodulation floor an uplink is received.
+      \param dr Datarate of the uplink.
+      \param txPowerSteps Transmit power steps below the maximum.
+      \returns Margin in dB, 0 if there are no samples.
+    */
+    float getMargin(uint8_t dr, uint8_t txPowerSteps) const;
+
+    /*!
+      \brief Get the number of samples in the window.
+      \returns Number of samples.
+    */
+    uint8_t getNumSamples() const;
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    uint8_t mode = RADIOLIB_LORAWAN_LINK_ADR_OFF;
+    float margin = RADIOLIB_LORAWAN_LINK_ADR_MARGIN;
+    float hysteresis = RADIOLIB_LORAWAN_LINK_ADR_HYSTERESIS;
+    uint8_t minSamples = RADIOLIB_LORAWAN_LINK_ADR_MIN_SAMPLES;
+    float dlOffset = 0;
+
+    // demodulation floor of each datarate and its bandwidth relative to 125 kHz, in dB
+    float floors[RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES] = { 0 };
+    float bwOffsets[RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES] = { 0 };
+
+    // datarates that use LoRa
+    uint16_t loraMask = 0;
+
+    // SNR samples, as received at the maximum power in 125 kHz
+    float samples[RADIOLIB_LORAWAN_LINK_ADR_WINDOW] = { 0 };
+    uint8_t numSamples = 0;
+    uint8_t sampleIdx = 0;
+
+    // the last uplink, and the number of uplinks since the last move up
+    uint8_t lastDr = 0;
+    uint8_t lastSteps = 0;
+    uint8_t numUplinks = 0;
+    uint8_t sinceChange = 0;
+
+    // confirmed uplinks and their acknowledgements per datarate, halved every window
+    uint8_t ackSent[RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES] = { 0 };
+    uint8_t ackRecv[RADIOLIB_LORAWAN_LINK_ADR_NUM_DATARATES] = { 0 };
+    bool ackPending = false;
+
+    void addSample(float snr);
+
+    // mean of the samples
+    float getSnr() const;
+
+    // whether less than half of the confirmed uplinks at a datarate were acknowledged
+    bool isAckPoor(uint8_t dr) const;
+};
+
+#endif
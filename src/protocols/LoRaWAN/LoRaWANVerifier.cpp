@@ -0,0 +1,216 @@
+#include "LoRaWAN.h"
+#include <string.h>
+
+#if !RADIOLIB_EXCLUDE_LORAWAN
+
+LoRaWANVerifier::LoRaWANVerifier() {
+
+}
+
+int16_t LoRaWANVerifier::begin(LoRaWANVerifierSession_t* table, size_t size) {
+  if(!table) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+  if((size == 0) || (size & (size - 1))) {
+    return(RADIOLIB_LORAWAN_INVALID_TABLE_SIZE);
+  }
+
+  this->table = table;
+  this->mask = size - 1;
+  this->numSessions = 0;
+  for(size_t i = 0; i < size; i++) {
+    this->table[i].slot = RADIOLIB_LORAWAN_VERIFIER_SLOT_EMPTY;
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+LoRaWANVerifierSession_t* LoRaWANVerifier::addSession(uint32_t devAddr, const uint8_t* fNwkSIntKey, const uint8_t* sNwkSIntKey, const uint8_t* nwkSEncKey, const uint8_t* appSKey, uint32_t fCntUp, void* ctx) {
+  if(!this->table || (this->numSessions > this->mask)) {
+    return(NULL);
+  }
+
+  // take the first slot that is not in use, removed sessions leave their slots in the probe sequence
+  size_t i = this->getSlot(devAddr);
+  while(this->table[i].slot == RADIOLIB_LORAWAN_VERIFIER_SLOT_USED) {
+    i = (i + 1) & this->mask;
+  }
+  LoRaWANVerifierSession_t* session = &this->table[i];
+
+  session->devAddr = devAddr;
+  session->fCntUpValid = false;
+  session->fCntUp = fCntUp;
+  session->confFCnt = 0;
+  session->ctx = ctx;
+
+  // the same as LoRaWANNode::beginABP - in LoRaWAN v1.0.x, all network keys are the NwkSKey
+  if(fNwkSIntKey && sNwkSIntKey) {
+    session->rev = 1;
+    RadioLibAES128Instance.expandKey(fNwkSIntKey, &session->fNwkSIntKey);
+    RadioLibAES128Instance.expandKey(sNwkSIntKey, &session->sNwkSIntKey);
+  } else {
+    session->rev = 0;
+    RadioLibAES128Instance.expandKey(nwkSEncKey, &session->fNwkSIntKey);
+    RadioLibAES128Instance.expandKey(nwkSEncKey, &session->sNwkSIntKey);
+  }
+  RadioLibAES128Instance.expandKey(nwkSEncKey, &session->nwkSEncKey);
+  RadioLibAES128Instance.expandKey(appSKey, &session->appSKey);
+
+  session->slot = RADIOLIB_LORAWAN_VERIFIER_SLOT_USED;
+  this->numSessions++;
+  return(session);
+}
+
+void LoRaWANVerifier::removeSession(LoRaWANVerifierSession_t* session) {
+  if(!session || (session->slot != RADIOLIB_LORAWAN_VERIFIER_SLOT_USED)) {
+    return;
+  }
+  session->slot = RADIOLIB_LORAWAN_VERIFIER_SLOT_REMOVED;
+  this->numSessions--;
+}
+
+LoRaWANVerifierSession_t* LoRaWANVerifier::findSession(uint32_t devAddr, LoRaWANVerifierSession_t* prev) {
+  if(!this->table) {
+    return(NULL);
+  }
+
+  // continue after the previous session, if there was one
+  size_t i = this->getSlot(devAddr);
+  size_t probes = 0;
+  if(prev) {
+    size_t prevSlot = prev - this->table;
+    probes = ((prevSlot - i) & this->mask) + 1;
+    i = (prevSlot + 1) & this->mask;
+  }
+
+  // the probe sequence of an address ends at the first empty slot
+  for(; probes <= this->mask; probes++) {
+    LoRaWANVerifierSession_t* session = &this->table[i];
+    if(session->slot == RADIOLIB_LORAWAN_VERIFIER_SLOT_EMPTY) {
+      break;
+    }
+    if((session->slot == RADIOLIB_LORAWAN_VERIFIER_SLOT_USED) && (session->devAddr == devAddr)) {
+      return(session);
+    }
+    i = (i + 1) & this->mask;
+  }
+  return(NULL);
+}
+
+size_t LoRaWANVerifier::getNumSessions() const {
+  return(this->numSessions);
+}
+
+int16_t LoRaWANVerifier::verify(LoRaWANVerifierUplink_t* uplink) {
+  uplink->state = this->lookup(uplink);
+  if(uplink->state == RADIOLIB_ERR_NONE) {
+    uplink->state = this->authenticate(uplink);
+  }
+  return(uplink->state);
+}
+
+size_t LoRaWANVerifier::verifyBatch(LoRaWANVerifierUplink_t* uplinks, size_t num) {
+  // look up all sessions first, so the table is walked without the AES in between
+  for(size_t i = 0; i < num; i++) {
+    uplinks[i].state = this->lookup(&uplinks[i]);
+  }
+
+  size_t accepted = 0;
+  for(size_t i = 0; i < num; i++) {
+    if(uplinks[i].state != RADIOLIB_ERR_NONE) {
+      continue;
+    }
+    uplinks[i].state = this->authenticate(&uplinks[i]);
+    if(uplinks[i].state == RADIOLIB_ERR_NONE) {
+      accepted++;
+    }
+  }
+  return(accepted);
+}
+
+size_t LoRaWANVerifier::getSlot(uint32_t devAddr) const {
+  // addresses are often assigned in sequence, so spread them with a multiplicative hash
+  // and fold the upper bits back, as the lower bits of the product only depend on the lower bits of the address
+  uint32_t hash = (uint32_t)(devAddr * 2654435761UL);
+  hash ^= hash >> 16;
+  return((size_t)hash & this->mask);
+}
+
+int16_t LoRaWANVerifier::lookup(LoRaWANVerifierUplink_t* uplink) {
+  uplink->session = NULL;
+  uplink->repeated = false;
+
+  int16_t state = LoRaWANFrame::parse(uplink->msg, uplink->len, &uplink->frame);
+  RADIOLIB_ASSERT(state);
+  if(!LoRaWANFrame::isUplink(uplink->frame.mType)) {
+    return(RADIOLIB_LORAWAN_INVALID_FRAME);
+  }
+
+  uplink->session = this->findSession(uplink->frame.devAddr);
+  if(!uplink->session) {
+    return(RADIOLIB_LORAWAN_UNKNOWN_DEVICE);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANVerifier::authenticate(LoRaWANVerifierUplink_t* uplink) {
+  // try all sessions with this address, a counter error is only reported if no MIC matched
+  LoRaWANVerifierSession_t* session = uplink->session;
+  uint32_t fCnt = 0;
+  int16_t state = RADIOLIB_ERR_CRC_MISMATCH;
+  uplink->session = NULL;
+  while(session) {
+    int16_t sessionState = this->checkSession(uplink, session, &fCnt);
+    if(sessionState == RADIOLIB_ERR_NONE) {
+      break;
+    }
+    if(sessionState == RADIOLIB_LORAWAN_FCNT_UP_INVALID) {
+      state = sessionState;
+    }
+    session = this->findSession(uplink->frame.devAddr, session);
+  }
+  if(!session) {
+    return(state);
+  }
+
+  // accepted, a repeated frame does not move the counter
+  uplink->session = session;
+  uplink->repeated = session->fCntUpValid && (fCnt == session->fCntUp);
+  uplink->frame.fCnt = fCnt;
+  session->fCntUp = fCnt;
+  session->fCntUpValid = true;
+
+  // in LoRaWAN v1.1, the FOpts are encrypted
+  LoRaWANFrame_t* frame = &uplink->frame;
+  if(session->rev == 1) {
+    LoRaWANFrame::processAES(frame->fOpts, frame->fOptsLen, &session->nwkSEncKey, frame->fOpts, fCnt, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK, 0x01, true, frame->devAddr);
+  }
+
+  // MAC commands in the payload are encrypted with the network key
+  if(uplink->payload && frame->hasFPort) {
+    const RadioLibAES128Key_t* key = (frame->fPort == RADIOLIB_LORAWAN_FPORT_MAC_COMMAND) ? &session->nwkSEncKey : &session->appSKey;
+    LoRaWANFrame::processAES(&uplink->msg[RADIOLIB_LORAWAN_DATA_FRAME_PAYLOAD_POS(frame->fOptsLen)], frame->payloadLen, key, uplink->payload, fCnt, RADIOLIB_LORAWAN_CHANNEL_DIR_UPLINK, 0x00, true, frame->devAddr);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t LoRaWANVerifier::checkSession(LoRaWANVerifierUplink_t* uplink, LoRaWANVerifierSession_t* session, uint32_t* fCnt) {
+  // the device sends the 16 least significant bits of its counter, but the MIC covers all 32
+  *fCnt = LoRaWANFrame::expandFCnt(session->fCntUp, (uint16_t)uplink->frame.fCnt);
+  if(*fCnt < session->fCntUp) {
+    return(RADIOLIB_LORAWAN_FCNT_UP_INVALID);
+  }
+
+  // the fields that are not sent over the air
+  LoRaWANFrame_t frame = uplink->frame;
+  frame.fCnt = *fCnt;
+  frame.confFCnt = session->confFCnt;
+  frame.dataRate = uplink->dataRate;
+  frame.chIndex = uplink->chIndex;
+  uint32_t mic = LoRaWANFrame::calculateMIC(uplink->msg, uplink->len - sizeof(uint32_t), &frame, session->rev, &session->fNwkSIntKey, &session->sNwkSIntKey);
+  if(mic != frame.mic) {
+    return(RADIOLIB_ERR_CRC_MISMATCH);
+  }
+  return(RADIOLIB_ERR_NONE);
+}
+
+#endif
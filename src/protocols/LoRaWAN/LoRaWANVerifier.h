@@ -0,0 +1,179 @@
+#if !defined(_RADIOLIB_LORAWAN_VERIFIER_H) && !RADIOLIB_EXCLUDE_LORAWAN
+#define _RADIOLIB_LORAWAN_VERIFIER_H
+
+#include "../../TypeDef.h"
+#include "../../utils/Cryptography.h"
+#include "LoRaWANFrame.h"
+
+// states of a slot in the session table
+#define RADIOLIB_LORAWAN_VERIFIER_SLOT_EMPTY                    (0x00)
+#define RADIOLIB_LORAWAN_VERIFIER_SLOT_USED                     (0x01)
+#define RADIOLIB_LORAWAN_VERIFIER_SLOT_REMOVED                  (0x02)
+
+/*!
+  \struct LoRaWANVerifierSession_t
+  \brief Session of a device as seen by the network, with its keys expanded once when it is added.
+  In LoRaWAN v1.0.x, all three network keys are the NwkSKey.
+*/
+struct LoRaWANVerifierSession_t {
+  /*! \brief Device address of the session */
+  uint32_t devAddr;
+
+  /*! \brief LoRaWAN revision, 0 for v1.0.x, 1 for v1.1 */
+  uint8_t rev;
+
+  /*! \brief Whether at least one uplink was accepted, so that fCntUp is the last one */
+  bool fCntUpValid;
+
+  /*! \brief Last accepted uplink frame counter, or the expected one if no uplink was accepted yet */
+  uint32_t fCntUp;
+
+  /*! \brief 16 least significant bits of the last confirmed downlink frame counter (LoRaWAN v1.1 only) */
+  uint16_t confFCnt;
+
+  /*! \brief Expanded forwarding network session integrity key */
+  RadioLibAES128Key_t fNwkSIntKey;
+
+  /*! \brief Expanded serving network session integrity key */
+  RadioLibAES128Key_t sNwkSIntKey;
+
+  /*! \brief Expanded network session encryption key */
+  RadioLibAES128Key_t nwkSEncKey;
+
+  /*! \brief Expanded application session key */
+  RadioLibAES128Key_t appSKey;
+
+  /*! \brief User context, e.g. to find the device the session belongs to */
+  void* ctx;
+
+  /*! \brief Slot state in the session table, for internal use */
+  uint8_t slot;
+};
+
+/*!
+  \struct LoRaWANVerifierUplink_t
+  \brief An uplink to verify, with the results of the verification.
+*/
+struct LoRaWANVerifierUplink_t {
+  /*! \brief Received frame */
+  const uint8_t* msg;
+
+  /*! \brief Length of the received frame */
+  size_t len;
+
+  /*! \brief Datarate index the frame was received at (LoRaWAN v1.1 only) */
+  uint8_t dataRate;
+
+  /*! \brief Channel index the frame was received on (LoRaWAN v1.1 only) */
+  uint8_t chIndex;
+
+  /*! \brief Buffer to save the decrypted frame payload into, at least frame.payloadLen bytes long. Can be NULL to only verify the frame */
+  uint8_t* payload;
+
+  /*! \brief Result of the verification, \ref status_codes */
+  int16_t state;
+
+  /*! \brief Whether the frame repeats the last accepted one (same frame counter) */
+  bool repeated;
+
+  /*! \brief Session of the device the frame was accepted for, NULL if it was not */
+  LoRaWANVerifierSession_t* session;
+
+  /*! \brief Fields of the frame, with the full frame counter and decrypted FOpts */
+  LoRaWANFrame_t frame;
+};
+
+/*!
+  \class LoRaWANVerifier
+  \brief Network side verification and decryption of uplinks from many devices, e.g. for a local
+  network server or a packet forwarder that filters traffic. Sessions are kept in a hash table
+  indexed by the device address, the table is provided by the user, so no memory is allocated.
+  Several sessions may share an address, the frame is then accepted for the one whose MIC matches.
+*/
+class LoRaWANVerifier {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    LoRaWANVerifier();
+
+    /*!
+      \brief Set the session table, any sessions in it are discarded.
+      \param table Session table, kept by the user for as long as the verifier is used.
+      \param size Number of sessions the table can hold, must be a power of 2. To keep the lookups fast,
+      the table should not be filled to more than about 3/4 of its size.
+      \returns \ref status_codes
+    */
+    int16_t begin(LoRaWANVerifierSession_t* table, size_t size);
+
+    /*!
+      \brief Add the session of a device, the keys are expanded and do not have to be kept by the user.
+      \param devAddr Device address.
+      \param fNwkSIntKey Pointer to the Forwarding network session (LoRaWAN v1.1), NULL for LoRaWAN v1.0.x.
+      \param sNwkSIntKey Pointer to the Serving network session (LoRaWAN v1.1), NULL for LoRaWAN v1.0.x.
+      \param nwkSEncKey Pointer to the MAC command network session key (LoRaWAN v1.1) or network session AES-128 key (LoRaWAN v1.0.x).
+      \param appSKey Pointer to the application session AES-128 key.
+      \param fCntUp Frame counter the device continues from, 0 for a new session.
+      \param ctx User context of the session.
+      \returns Pointer to the session, NULL if the table is full.
+    */
+    LoRaWANVerifierSession_t* addSession(uint32_t devAddr, const uint8_t* fNwkSIntKey, const uint8_t* sNwkSIntKey, const uint8_t* nwkSEncKey, const uint8_t* appSKey, uint32_t fCntUp = 0, void* ctx = NULL);
+
+    /*!
+      \brief Remove a session.
+      \param session Session to remove, as returned by addSession or findSession.
+    */
+    void removeSession(LoRaWANVerifierSession_t* session);
+
+    /*!
+      \brief Find a session by its device address.
+      \param devAddr Device address.
+      \param prev Session found by the previous call for the same address to find the next one, NULL to find the first one.
+      \returns Pointer to the session, NULL if there is none (or no other one).
+    */
+    LoRaWANVerifierSession_t* findSession(uint32_t devAddr, LoRaWANVerifierSession_t* prev = NULL);
+
+    /*!
+      \brief Get the number of sessions in the table.
+      \returns Number of sessions.
+    */
+    size_t getNumSessions() const;
+
+    /*!
+      \brief Verify an uplink: find its session, check the frame counter and the MIC, and decrypt it.
+      The frame counter of the session is updated if the uplink is accepted.
+      \param uplink Uplink to verify, the results are saved into it.
+      \returns \ref status_codes
+    */
+    int16_t verify(LoRaWANVerifierUplink_t* uplink);
+
+    /*!
+      \brief Verify a batch of uplinks, e.g. all the frames received by the gateways since the last call.
+      All frames are parsed and matched to their sessions first, then their MICs are checked.
+      \param uplinks Uplinks to verify, the result of each is saved into it.
+      \param num Number of uplinks.
+      \returns Number of accepted uplinks.
+    */
+    size_t verifyBatch(LoRaWANVerifierUplink_t* uplinks, size_t num);
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    LoRaWANVerifierSession_t* table = NULL;
+    size_t mask = 0;
+    size_t numSessions = 0;
+
+    // index of the first slot to probe for an address
+    size_t getSlot(uint32_t devAddr) const;
+
+    // parse an uplink and find the first session with its address
+    int16_t lookup(LoRaWANVerifierUplink_t* uplink);
+
+    // check the MIC against the session found by lookup and the ones sharing its address, then decrypt
+    int16_t authenticate(LoRaWANVerifierUplink_t* uplink);
+
+    // check the frame counter and the MIC against a single session, fCnt is set to the full frame counter
+    int16_t checkSession(LoRaWANVerifierUplink_t* uplink, LoRaWANVerifierSession_t* session, uint32_t* fCnt);
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "Coroutines.h"
+#include <string.h>
+
+#if RADIOLIB_COROUTINES
+
+RadioLibTask::RadioLibTask(std::coroutine_handle<promise_type> h) : handle(h) {
+
+}
+
+RadioLibTask::RadioLibTask(RadioLibTask&& task) noexcept : handle(task.handle) {
+  task.handle = nullptr;
+}
+
+RadioLibTask::~RadioLibTask() {
+  if(this->handle) {
+    this->handle.destroy();
+  }
+}
+
+RadioLibOpAwaiter::RadioLibOpAwaiter(PhysicalLayer* radio, uint8_t op, uint8_t* data, size_t len, uint8_t addr, RadioLibTime_t timeout)
+  : radio(radio), op(op), data(data), len(len), addr(addr), timeout(timeout) {
+
+}
+
+bool RadioLibOpAwaiter::await_suspend(std::coroutine_handle<RadioLibTask::promise_type> h) {
+  int16_t state = RADIOLIB_ERR_NULL_POINTER;
+  RadioLibExecutor* executor = h.promise().executor;
+  if((this->radio != nullptr) && (executor != nullptr)) {
+    switch(this->op) {
+      case(RADIOLIB_EVENT_OP_TRANSMIT):
+        state = this->radio->submitTransmit(this->data, this->len, this->addr);
+        break;
+      case(RADIOLIB_EVENT_OP_RECEIVE):
+        state = this->radio->submitReceive(this->data, this->len, this->timeout);
+        break;
+      case(RADIOLIB_EVENT_OP_CHANNEL_SCAN):
+        state = this->radio->submitChannelScan();
+        break;
+      default:
+        state = RADIOLIB_ERR_UNSUPPORTED;
+    }
+  }
+
+  // the operation could not be started, resume right away with the error
+  if(state != RADIOLIB_ERR_NONE) {
+    this->event.type = RADIOLIB_EVENT_NONE;
+    this->event.op = this->op;
+    this->event.state = state;
+    return(false);
+  }
+
+  executor->waitEvent(h, this->radio, &this->event);
+  return(true);
+}
+
+RadioLibDelay::RadioLibDelay(RadioLibTime_t ms) : ms(ms) {
+
+}
+
+bool RadioLibDelay::await_suspend(std::coroutine_handle<RadioLibTask::promise_type> h) {
+  RadioLibExecutor* executor = h.promise().executor;
+  if(executor == nullptr) {
+    return(false);
+  }
+  executor->waitDelay(h, this->ms);
+  return(true);
+}
+
+RadioLibExecutor::RadioLibExecutor(RadioLibHal* hal) : hal(hal) {
+
+}
+
+RadioLibExecutor::~RadioLibExecutor() {
+  for(size_t i = 0; i < RADIOLIB_COROUTINE_MAX_TASKS; i++) {
+    if(this->slots[i].wait != RADIOLIB_TASK_FREE) {
+      this->slots[i].handle.destroy();
+      this->slots[i].wait = RADIOLIB_TASK_FREE;
+    }
+  }
+}
+
+int16_t RadioLibExecutor::spawn(RadioLibTask&& task) {
+  if(!task.handle) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  for(size_t i = 0; i < RADIOLIB_COROUTINE_MAX_TASKS; i++) {
+    if(this->slots[i].wait == RADIOLIB_TASK_FREE) {
+      this->slots[i] = {};
+      this->slots[i].handle = task.handle;
+      this->slots[i].wait = RADIOLIB_TASK_READY;
+      task.handle.promise().executor = this;
+      task.handle = nullptr;
+      return(RADIOLIB_ERR_NONE);
+    }
+  }
+
+  // no free slot, the task is destroyed along with its owner
+  return(RADIOLIB_ERR_EVENT_LOOP_FULL);
+}
+
+size_t RadioLibExecutor::poll() {
+  size_t num = 0;
+  for(size_t i = 0; i < RADIOLIB_COROUTINE_MAX_TASKS; i++) {
+    Slot* slot = &this->slots[i];
+    bool resume = false;
+    switch(slot->wait) {
+      case(RADIOLIB_TASK_READY):
+        resume = true;
+        break;
+      case(RADIOLIB_TASK_WAIT_EVENT):
+        resume = slot->radio->pollEvent(slot->event);
+        break;
+      case(RADIOLIB_TASK_WAIT_DELAY):
+        resume = (this->hal->millis() - slot->start >= slot->delay);
+        break;
+      default:
+        break;
+    }
+
+    if(!resume) {
+      continue;
+    }
+
+    // the awaiter the task suspends on next will update the slot
+    slot->wait = RADIOLIB_TASK_READY;
+    slot->handle.resume();
+    num++;
+
+    if(slot->handle.done()) {
+      slot->handle.destroy();
+      slot->wait = RADIOLIB_TASK_FREE;
+    }
+  }
+  return(num);
+}
+
+void RadioLibExecutor::run() {
+  while(this->getTasks() > 0) {
+    if(this->poll() == 0) {
+      this->hal->yield();
+    }
+  }
+}
+
+size_t RadioLibExecutor::getTasks() const {
+  size_t num = 0;
+  for(size_t i = 0; i < RADIOLIB_COROUTINE_MAX_TASKS; i++) {
+    if(this->slots[i].wait != RADIOLIB_TASK_FREE) {
+      num++;
+    }
+  }
+  return(num);
+}
+
+RadioLibExecutor::Slot* RadioLibExecutor::findSlot(std::coroutine_handle<RadioLibTask::promise_type> h) {
+  for(size_t i = 0; i < RADIOLIB_COROUTINE_MAX_TASKS; i++) {
+    if((this->slots[i].wait != RADIOLIB_TASK_FREE) && (this->slots[i].handle == h)) {
+      return(&this->slots[i]);
+    }
+  }
+  return(nullptr);
+}
+
+void RadioLibExecutor::waitEvent(std::coroutine_handle<RadioLibTask::promise_type> h, PhysicalLayer* radio, RadioLibEvent_t* event) {
+  Slot* slot = this->findSlot(h);
+  if(slot == nullptr) {
+    return;
+  }
+  slot->wait = RADIOLIB_TASK_WAIT_EVENT;
+  slot->radio = radio;
+  slot->event = event;
+}
+
+void RadioLibExecutor::waitDelay(std::coroutine_handle<RadioLibTask::promise_type> h, RadioLibTime_t ms) {
+  Slot* slot = this->findSlot(h);
+  if(slot == nullptr) {
+    return;
+  }
+  slot->wait = RADIOLIB_TASK_WAIT_DELAY;
+  slot->start = this->hal->millis();
+  slot->delay = ms;
+}
+
+RadioLibOpAwaiter PhysicalLayer::transmitAsync(const uint8_t* data, size_t len, uint8_t addr) {
+  return(RadioLibOpAwaiter(this, RADIOLIB_EVENT_OP_TRANSMIT, const_cast<uint8_t*>(data), len, addr, 0));
+}
+
+RadioLibOpAwaiter PhysicalLayer::transmitAsync(const char* str, uint8_t addr) {
+  return(this->transmitAsync(reinterpret_cast<const uint8_t*>(str), strlen(str), addr));
+}
+
+RadioLibOpAwaiter PhysicalLayer::receiveAsync(uint8_t* data, size_t len, RadioLibTime_t timeout) {
+  return(RadioLibOpAwaiter(this, RADIOLIB_EVENT_OP_RECEIVE, data, len, 0, timeout));
+}
+
+RadioLibOpAwaiter PhysicalLayer::scanChannelAsync() {
+  return(RadioLibOpAwaiter(this, RADIOLIB_EVENT_OP_CHANNEL_SCAN, nullptr, 0, 0, 0));
+}
+
+#endif
@@ -0,0 +1,194 @@
+#if !defined(_RADIOLIB_COROUTINES_H)
+#define _RADIOLIB_COROUTINES_H
+
+#include "../../TypeDef.h"
+#include "PhysicalLayer.h"
+
+#if RADIOLIB_COROUTINES
+
+#include <coroutine>
+
+// executor task slot states
+#define RADIOLIB_TASK_FREE                                      (0x00)
+#define RADIOLIB_TASK_READY                                     (0x01)
+#define RADIOLIB_TASK_WAIT_EVENT                                (0x02)
+#define RADIOLIB_TASK_WAIT_DELAY                                (0x03)
+
+class RadioLibExecutor;
+
+/*!
+  \class RadioLibTask
+  \brief Coroutine type of tasks run by RadioLibExecutor. Any function returning RadioLibTask
+  can co_await the asynchronous PhysicalLayer operations (e.g. PhysicalLayer::transmitAsync) and RadioLibDelay.
+  The task does not start until it is passed to RadioLibExecutor::spawn.
+  Coroutine frames are allocated on the heap by the compiler.
+*/
+class RadioLibTask {
+  public:
+    /*!
+      \brief Coroutine promise, holds the executor the task is running on.
+    */
+    struct promise_type {
+      /*! \brief Executor running the task, set by RadioLibExecutor::spawn */
+      RadioLibExecutor* executor = nullptr;
+
+      RadioLibTask get_return_object() {
+        return(RadioLibTask(std::coroutine_handle<promise_type>::from_promise(*this)));
+      }
+      std::suspend_always initial_suspend() noexcept { return(std::suspend_always()); }
+      std::suspend_always final_suspend() noexcept { return(std::suspend_always()); }
+      void return_void() {}
+      void unhandled_exception() {}
+    };
+
+    /*!
+      \brief Move constructor, the task is owned by one object at a time.
+      \param task Task to move from.
+    */
+    RadioLibTask(RadioLibTask&& task) noexcept;
+
+    RadioLibTask(const RadioLibTask&) = delete;
+    RadioLibTask& operator=(const RadioLibTask&) = delete;
+
+    /*!
+      \brief Default destructor, destroys the coroutine if it was not passed to an executor.
+    */
+    ~RadioLibTask();
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    std::coroutine_handle<promise_type> handle;
+
+    explicit RadioLibTask(std::coroutine_handle<promise_type> h);
+
+    friend class RadioLibExecutor;
+};
+
+/*!
+  \class RadioLibOpAwaiter
+  \brief Awaitable PhysicalLayer operation, returned by PhysicalLayer::transmitAsync,
+  PhysicalLayer::receiveAsync and PhysicalLayer::scanChannelAsync.
+  Resumes with the RadioLibEvent_t of the operation. If the operation could not be started,
+  it resumes immediately with event type RADIOLIB_EVENT_NONE and the error in event state.
+*/
+class RadioLibOpAwaiter {
+  public:
+    /*!
+      \brief Default constructor.
+      \param radio Radio to run the operation on.
+      \param op Operation, one of RADIOLIB_EVENT_OP_*.
+      \param data Data to transmit or buffer to receive into.
+      \param len Length of data or size of the buffer.
+      \param addr Node address, only used for transmission.
+      \param timeout Reception timeout in microseconds, only used for reception.
+    */
+    RadioLibOpAwaiter(PhysicalLayer* radio, uint8_t op, uint8_t* data, size_t len, uint8_t addr, RadioLibTime_t timeout);
+
+    bool await_ready() const noexcept { return(false); }
+    bool await_suspend(std::coroutine_handle<RadioLibTask::promise_type> h);
+    RadioLibEvent_t await_resume() const noexcept { return(this->event); }
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    PhysicalLayer* radio;
+    uint8_t op;
+    uint8_t* data;
+    size_t len;
+    uint8_t addr;
+    RadioLibTime_t timeout;
+    RadioLibEvent_t event = {};
+};
+
+/*!
+  \class RadioLibDelay
+  \brief Awaitable delay, suspends the task without blocking other tasks (co_await RadioLibDelay(1000)).
+*/
+class RadioLibDelay {
+  public:
+    /*!
+      \brief Default constructor.
+      \param ms Delay in milliseconds.
+    */
+    explicit RadioLibDelay(RadioLibTime_t ms);
+
+    bool await_ready() const noexcept { return(false); }
+    bool await_suspend(std::coroutine_handle<RadioLibTask::promise_type> h);
+    void await_resume() const noexcept {}
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    RadioLibTime_t ms;
+};
+
+/*!
+  \class RadioLibExecutor
+  \brief Minimal single-threaded executor for RadioLibTask coroutines.
+  Resumes tasks when the radio operation they wait for finishes, or when their delay expires.
+  Up to RADIOLIB_COROUTINE_MAX_TASKS tasks can run at the same time.
+*/
+class RadioLibExecutor {
+  public:
+    /*!
+      \brief Default constructor.
+      \param hal Pointer to the HAL used for timing and yielding.
+    */
+    explicit RadioLibExecutor(RadioLibHal* hal);
+
+    /*!
+      \brief Default destructor, destroys all tasks that did not finish yet.
+    */
+    ~RadioLibExecutor();
+
+    /*!
+      \brief Start running a task. The task will first run on the next call to poll.
+      \param task Task to run, the executor takes its ownership.
+      \returns \ref status_codes
+    */
+    int16_t spawn(RadioLibTask&& task);
+
+    /*!
+      \brief Service all tasks once. Intended to be called periodically from the main loop.
+      \returns Number of tasks that were resumed.
+    */
+    size_t poll();
+
+    /*!
+      \brief Service all tasks until all of them finish.
+    */
+    void run();
+
+    /*!
+      \brief Get the number of tasks that did not finish yet.
+      \returns Number of tasks.
+    */
+    size_t getTasks() const;
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    struct Slot {
+      std::coroutine_handle<RadioLibTask::promise_type> handle;
+      uint8_t wait;
+      PhysicalLayer* radio;
+      RadioLibEvent_t* event;
+      RadioLibTime_t start;
+      RadioLibTime_t delay;
+    };
+
+    RadioLibHal* hal;
+    Slot slots[RADIOLIB_COROUTINE_MAX_TASKS] = {};
+
+    Slot* findSlot(std::coroutine_handle<RadioLibTask::promise_type> h);
+    void waitEvent(std::coroutine_handle<RadioLibTask::promise_type> h, PhysicalLayer* radio, RadioLibEvent_t* event);
+    void waitDelay(std::coroutine_handle<RadioLibTask::promise_type> h, RadioLibTime_t ms);
+
+    friend class RadioLibOpAwaiter;
+    friend class RadioLibDelay;
+};
+
+#endif
+
+#endif
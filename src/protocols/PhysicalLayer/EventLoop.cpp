@@ -0,0 +1,64 @@
+#include "EventLoop.h"
+
+RadioLibEventLoop::RadioLibEventLoop() {
+
+}
+
+int16_t RadioLibEventLoop::addRadio(PhysicalLayer* radio, RadioLibEventCb_t cb, void* ctx) {
+  if(radio == nullptr) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  for(size_t i = 0; i < RADIOLIB_EVENT_LOOP_MAX_RADIOS; i++) {
+    if(this->radios[i] == nullptr) {
+      this->radios[i] = radio;
+      this->callbacks[i] = cb;
+      this->contexts[i] = ctx;
+      return(RADIOLIB_ERR_NONE);
+    }
+  }
+
+  return(RADIOLIB_ERR_EVENT_LOOP_FULL);
+}
+
+int16_t RadioLibEventLoop::removeRadio(PhysicalLayer* radio) {
+  for(size_t i = 0; i < RADIOLIB_EVENT_LOOP_MAX_RADIOS; i++) {
+    if(this->radios[i] == radio) {
+      this->radios[i] = nullptr;
+      this->callbacks[i] = nullptr;
+      this->contexts[i] = nullptr;
+      return(RADIOLIB_ERR_NONE);
+    }
+  }
+
+  return(RADIOLIB_ERR_NULL_POINTER);
+}
+
+size_t RadioLibEventLoop::poll() {
+  size_t num = 0;
+  RadioLibEvent_t event;
+  for(size_t i = 0; i < RADIOLIB_EVENT_LOOP_MAX_RADIOS; i++) {
+    if(this->radios[i] == nullptr) {
+      continue;
+    }
+
+    if(!this->radios[i]->pollEvent(&event)) {
+      continue;
+    }
+
+    num++;
+    if(this->callbacks[i]) {
+      this->callbacks[i](this->radios[i], &event, this->contexts[i]);
+    }
+  }
+  return(num);
+}
+
+bool RadioLibEventLoop::isBusy() const {
+  for(size_t i = 0; i < RADIOLIB_EVENT_LOOP_MAX_RADIOS; i++) {
+    if(this->radios[i] && (this->radios[i]->getPendingOperation() != RADIOLIB_EVENT_OP_NONE)) {
+      return(true);
+    }
+  }
+  return(false);
+}
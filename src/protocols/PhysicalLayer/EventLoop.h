@@ -0,0 +1,65 @@
+#if !defined(_RADIOLIB_EVENT_LOOP_H)
+#define _RADIOLIB_EVENT_LOOP_H
+
+#include "../../TypeDef.h"
+#include "PhysicalLayer.h"
+
+/*!
+  \brief Function called when an operation submitted to one of the radios finishes.
+  \param radio Radio that reported the event.
+  \param event The event.
+  \param ctx User context passed to RadioLibEventLoop::addRadio.
+*/
+typedef void (*RadioLibEventCb_t)(PhysicalLayer* radio, const RadioLibEvent_t* event, void* ctx);
+
+/*!
+  \class RadioLibEventLoop
+  \brief Services the event-driven API of multiple radios from a single thread.
+  Operations are submitted directly to the radios (e.g. PhysicalLayer::submitTransmit),
+  the loop then polls all of them and dispatches completion events to their callbacks.
+*/
+class RadioLibEventLoop {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    RadioLibEventLoop();
+
+    /*!
+      \brief Add radio to be serviced by this loop. Up to RADIOLIB_EVENT_LOOP_MAX_RADIOS radios can be added.
+      \param radio Radio to add.
+      \param cb Function to call on events reported by the radio.
+      \param ctx User context passed to the callback.
+      \returns \ref status_codes
+    */
+    int16_t addRadio(PhysicalLayer* radio, RadioLibEventCb_t cb, void* ctx = nullptr);
+
+    /*!
+      \brief Remove radio from this loop. Operation in progress on the radio is not aborted.
+      \param radio Radio to remove.
+      \returns \ref status_codes
+    */
+    int16_t removeRadio(PhysicalLayer* radio);
+
+    /*!
+      \brief Poll all radios once and dispatch their events. Intended to be called from the main loop.
+      Callbacks may submit new operations, including to the radio that reported the event.
+      \returns Number of dispatched events.
+    */
+    size_t poll();
+
+    /*!
+      \brief Check whether any of the radios has an operation in progress.
+      \returns True if at least one operation is in progress, false otherwise.
+    */
+    bool isBusy() const;
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    PhysicalLayer* radios[RADIOLIB_EVENT_LOOP_MAX_RADIOS] = { nullptr };
+    RadioLibEventCb_t callbacks[RADIOLIB_EVENT_LOOP_MAX_RADIOS] = { nullptr };
+    void* contexts[RADIOLIB_EVENT_LOOP_MAX_RADIOS] = { nullptr };
+};
+
+#endif
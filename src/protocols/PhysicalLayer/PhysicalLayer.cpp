@@ -1,5 +1,42 @@
 #include "PhysicalLayer.h"
 #include <string.h>
+#if defined(ESP_PLATFORM)
+#include "esp_attr.h"
+#endif
+
+// radios with a receive queue, the packet received action takes no arguments,
+// so every radio has a slot with an action of its own that reads the packet into its queue
+static PhysicalLayer* rxQueueRadios[RADIOLIB_RX_QUEUE_MAX_RADIOS] = { nullptr };
+
+template<size_t N>
+#if defined(ESP8266) || defined(ESP32)
+  IRAM_ATTR
+#endif
+static void PhysicalLayerRxQueueAction(void) {
+  PhysicalLayer* radio = rxQueueRadios[N];
+  if(radio) {
+    (void)radio->pushPacket();
+  }
+}
+
+// look up the action of a slot, split in halves so that the template nesting stays shallow
+template<size_t First, size_t Num>
+struct PhysicalLayerRxQueueActions {
+  static void (*get(size_t slot))(void) {
+    if(slot < First + Num/2) {
+      return(PhysicalLayerRxQueueActions<First, Num/2>::get(slot));
+    }
+    return(PhysicalLayerRxQueueActions<First + Num/2, Num - Num/2>::get(slot));
+  }
+};
+
+template<size_t First>
+struct PhysicalLayerRxQueueActions<First, 1> {
+  static void (*get(size_t slot))(void) {
+    (void)slot;
+    return(PhysicalLayerRxQueueAction<First>);
+  }
+};
 
 PhysicalLayer::PhysicalLayer(float step, size_t maxLen) {
   this->freqStep = step;
@@ -7,9 +44,19 @@ PhysicalLayer::PhysicalLayer(float step, size_t maxLen) {
   #if !RADIOLIB_EXCLUDE_DIRECT_RECEIVE
   this->bufferBitPos = 0;
   this->bufferWritePos = 0;
+  this->bufferReadPos = 0;
   #endif
 }
 
+PhysicalLayer::~PhysicalLayer() {
+  // the module may already be gone, so only the slot is released
+  for(size_t i = 0; i < RADIOLIB_RX_QUEUE_MAX_RADIOS; i++) {
+    if(rxQueueRadios[i] == this) {
+      rxQueueRadios[i] = nullptr;
+    }
+  }
+}
+
 #if defined(RADIOLIB_BUILD_ARDUINO)
 int16_t PhysicalLayer::transmit(__FlashStringHelper* fstr, uint8_t addr) {
   // read flash string length
@@ -273,6 +320,15 @@ int16_t PhysicalLayer::setPreambleLength(size_t len) {
   return(RADIOLIB_ERR_UNSUPPORTED);
 }
 
+int16_t PhysicalLayer::implicitHeader(size_t len) {
+  (void)len;
+  return(RADIOLIB_ERR_UNSUPPORTED);
+}
+
+int16_t PhysicalLayer::explicitHeader() {
+  return(RADIOLIB_ERR_UNSUPPORTED);
+}
+
 int16_t PhysicalLayer::setDataRate(DataRate_t dr) {
   (void)dr;
   return(RADIOLIB_ERR_UNSUPPORTED);
@@ -300,6 +356,10 @@ float PhysicalLayer::getSNR() {
   return(RADIOLIB_ERR_UNSUPPORTED);
 }
 
+float PhysicalLayer::getFrequencyError() {
+  return(RADIOLIB_ERR_UNSUPPORTED);
+}
+
 RadioLibTime_t PhysicalLayer::getTimeOnAir(size_t len) {
   (void)len;
   return(0);
@@ -379,13 +439,15 @@ int16_t PhysicalLayer::startDirect() {
 
 #if !RADIOLIB_EXCLUDE_DIRECT_RECEIVE
 int16_t PhysicalLayer::available() {
-  return(this->bufferWritePos);
+  // the write position is only ever advanced by the ISR, so a single read of it is enough
+  size_t writePos = this->bufferWritePos;
+  return((writePos + this->bufferSize - this->bufferReadPos) % this->bufferSize);
 }
 
 void PhysicalLayer::dropSync() {
+  // the ISR owns the sync state, just ask it to drop it on the next bit
   if(this->directSyncWordLen > 0) {
-    this->gotSync = false;
-    this->syncBuffer = 0;
+    this->dropSyncRequest = true;
   }
 }
 
@@ -393,17 +455,59 @@ uint8_t PhysicalLayer::read(bool drop) {
   if(drop) {
     dropSync();
   }
-  this->bufferWritePos--;
-  return(this->buffer[this->bufferReadPos++]);
+
+  // nothing to read
+  size_t readPos = this->bufferReadPos;
+  if(readPos == this->bufferWritePos) {
+    return(0);
+  }
+
+  uint8_t* buff = (this->bufferExt != nullptr) ? this->bufferExt : this->buffer;
+  uint8_t b = buff[readPos];
+
+  // release the byte only after it was read
+  this->bufferReadPos = (readPos + 1) % this->bufferSize;
+  return(b);
+}
+
+int16_t PhysicalLayer::setDirectBuffer(uint8_t* buff, size_t len) {
+  if(buff == nullptr) {
+    // use the internal buffer
+    this->bufferExt = nullptr;
+    this->bufferSize = RADIOLIB_STATIC_ARRAY_SIZE;
+  } else {
+    // one byte is always kept free to tell a full buffer from an empty one
+    // the rest must fit the number of available bytes returned by available()
+    if((len < 2) || (len - 1 > INT16_MAX)) {
+      return(RADIOLIB_ERR_INVALID_QUEUE_SIZE);
+    }
+    this->bufferExt = buff;
+    this->bufferSize = len;
+  }
+
+  this->bufferWritePos = 0;
+  this->bufferReadPos = 0;
+  this->bufferOverflows = 0;
+  return(RADIOLIB_ERR_NONE);
+}
+
+uint32_t PhysicalLayer::getDirectOverflows() const {
+  return(this->bufferOverflows);
 }
 
 int16_t PhysicalLayer::setDirectSyncWord(uint32_t syncWord, uint8_t len) {
   if(len > 32) {
     return(RADIOLIB_ERR_INVALID_SYNC_WORD);
   }
+
+  // a correlator threshold of the sync word length or more would match any bits
+  if((len > 0) && (this->directSyncMaxErrors >= len)) {
+    return(RADIOLIB_ERR_INVALID_SYNC_WORD);
+  }
   this->directSyncWordMask = 0xFFFFFFFF >> (32 - len);
   this->directSyncWordLen = len;
-  this->directSyncWord = syncWord;
+  this->directSyncWords[0] = syncWord & this->directSyncWordMask;
+  this->directSyncWordsNum = 1;
 
   // override sync word matching when length is set to 0
   if(this->directSyncWordLen == 0) {
@@ -413,39 +517,145 @@ int16_t PhysicalLayer::setDirectSyncWord(uint32_t syncWord, uint8_t len) {
   return(RADIOLIB_ERR_NONE);
 }
 
-void PhysicalLayer::updateDirectBuffer(uint8_t bit) {
-  // check sync word
-  if(!this->gotSync) {
-    this->syncBuffer <<= 1;
-    this->syncBuffer |= bit;
+int16_t PhysicalLayer::addDirectSyncWord(uint32_t syncWord) {
+  if(this->directSyncWordsNum >= RADIOLIB_DIRECT_SYNC_WORDS_MAX) {
+    return(RADIOLIB_ERR_INVALID_SYNC_WORD);
+  }
 
-    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("S\t%lu", (long unsigned int)this->syncBuffer);
+  this->directSyncWords[this->directSyncWordsNum] = syncWord & this->directSyncWordMask;
+  this->directSyncWordsNum++;
+  return(RADIOLIB_ERR_NONE);
+}
 
-    if((this->syncBuffer & this->directSyncWordMask) == this->directSyncWord) {
-      this->gotSync = true;
-      this->bufferWritePos = 0;
-      this->bufferReadPos = 0;
-      this->bufferBitPos = 0;
+int16_t PhysicalLayer::setDirectSyncCorrelator(uint8_t maxErrors, bool inverted) {
+  // with the sync word length or more errors allowed, any bits would match
+  if((maxErrors > 0) && (maxErrors >= this->directSyncWordLen)) {
+    return(RADIOLIB_ERR_INVALID_SYNC_WORD);
+  }
+
+  this->directSyncMaxErrors = maxErrors;
+  this->directSyncInvert = inverted;
+  return(RADIOLIB_ERR_NONE);
+}
+
+DirectSyncStats_t PhysicalLayer::getDirectSyncStats() const {
+  return(this->directSyncStats);
+}
+
+void PhysicalLayer::resetDirectSyncStats() {
+  this->directSyncStats = {};
+}
+
+// number of bits set, loops once per set bit so it is cheap for close matches
+static uint8_t countBits(uint32_t x) {
+  uint8_t num = 0;
+  while(x) {
+    x &= x - 1;
+    num++;
+  }
+  return(num);
+}
+
+bool PhysicalLayer::findDirectSync() {
+  // wait until the whole sync word was shifted in
+  if(this->syncBufferBits < this->directSyncWordLen) {
+    this->syncBufferBits++;
+    if(this->syncBufferBits < this->directSyncWordLen) {
+      return(false);
     }
+  }
 
-  } else {
-    // save the bit
-    if(bit) {
-      this->buffer[this->bufferWritePos] |= 0x01 << this->bufferBitPos;
-    } else {
-      this->buffer[this->bufferWritePos] &= ~(0x01 << this->bufferBitPos);
+  // find the closest sync word, either direct or inverted
+  uint32_t rx = this->syncBuffer & this->directSyncWordMask;
+  uint8_t bestErrors = this->directSyncMaxErrors + 1;
+  uint8_t bestIndex = 0;
+  bool bestInverted = false;
+  for(uint8_t i = 0; i < this->directSyncWordsNum; i++) {
+    uint8_t errors = countBits(rx ^ this->directSyncWords[i]);
+    if(errors < bestErrors) {
+      bestErrors = errors;
+      bestIndex = i;
+      bestInverted = false;
+    }
+
+    // distance to the inverted word is the complement of distance to the word itself
+    if(this->directSyncInvert && (this->directSyncWordLen - errors < bestErrors)) {
+      bestErrors = this->directSyncWordLen - errors;
+      bestIndex = i;
+      bestInverted = true;
     }
-    this->bufferBitPos++;
+  }
+
+  if(bestErrors > this->directSyncMaxErrors) {
+    return(false);
+  }
+
+  // got sync, update statistics
+  this->directSyncInverted = bestInverted;
+  this->directSyncStats.acquired++;
+  if(bestErrors > 0) {
+    this->directSyncStats.corrected++;
+    this->directSyncStats.bitErrors += bestErrors;
+  }
+  if(bestInverted) {
+    this->directSyncStats.inverted++;
+  }
+  this->directSyncStats.lastIndex = bestIndex;
+  this->directSyncStats.lastErrors = bestErrors;
+  this->directSyncStats.lastInverted = bestInverted;
+  return(true);
+}
 
-    // check complete byte
-    if(this->bufferBitPos == 8) {
-      this->buffer[this->bufferWritePos] = Module::reflect(this->buffer[this->bufferWritePos], 8);
-      RADIOLIB_DEBUG_PROTOCOL_PRINTLN("R\t%X", this->buffer[this->bufferWritePos]);
+void PhysicalLayer::updateDirectBuffer(uint8_t bit) {
+  // check whether the consumer requested to drop synchronization
+  if(this->dropSyncRequest) {
+    this->dropSyncRequest = false;
+    this->gotSync = false;
+    this->syncBuffer = 0;
+    this->syncBufferBits = 0;
+  }
+
+  // data following an inverted sync word are inverted as well
+  if(this->gotSync && this->directSyncInverted) {
+    bit ^= 0x01;
+  }
+
+  // the same shift register is used to look for the sync word and to assemble data bytes
+  this->syncBuffer <<= 1;
+  this->syncBuffer |= bit;
+
+  // check sync word
+  if(!this->gotSync) {
+    RADIOLIB_DEBUG_PROTOCOL_PRINTLN("S\t%lu", (long unsigned int)this->syncBuffer);
 
-      this->bufferWritePos++;
+    this->directSyncStats.bitsSearched++;
+    if(this->findDirectSync()) {
+      this->gotSync = true;
       this->bufferBitPos = 0;
     }
+    return;
+  }
+  // check complete byte, bits are shifted in MSB first
+  this->bufferBitPos++;
+  if(this->bufferBitPos < 8) {
+    return;
+  }
+  this->bufferBitPos = 0;
+  uint8_t b = this->syncBuffer & 0xFF;
+  RADIOLIB_DEBUG_PROTOCOL_PRINTLN("R\t%X", b);
+
+  // check there is space left, drop the byte if the consumer is too slow
+  size_t writePos = this->bufferWritePos;
+  size_t next = (writePos + 1) % this->bufferSize;
+  if(next == this->bufferReadPos) {
+    this->bufferOverflows = this->bufferOverflows + 1;
+    return;
   }
+
+  // save the byte and only then publish it to the consumer
+  uint8_t* buff = (this->bufferExt != nullptr) ? this->bufferExt : this->buffer;
+  buff[writePos] = b;
+  this->bufferWritePos = next;
 }
 
 void PhysicalLayer::setDirectAction(void (*func)(void)) {
@@ -488,6 +698,245 @@ void PhysicalLayer::clearChannelScanAction() {
   
 }
 
+int16_t PhysicalLayer::setRxQueue(RadioLibPacket_t* slots, size_t num) {
+  if(slots == nullptr) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+  if(num < 2) {
+    return(RADIOLIB_ERR_INVALID_QUEUE_SIZE);
+  }
+
+  // find the slot of this radio, or a free one
+  size_t slot = RADIOLIB_RX_QUEUE_MAX_RADIOS;
+  for(size_t i = 0; i < RADIOLIB_RX_QUEUE_MAX_RADIOS; i++) {
+    if(rxQueueRadios[i] == this) {
+      slot = i;
+      break;
+    }
+    if((rxQueueRadios[i] == nullptr) && (slot == RADIOLIB_RX_QUEUE_MAX_RADIOS)) {
+      slot = i;
+    }
+  }
+  if(slot == RADIOLIB_RX_QUEUE_MAX_RADIOS) {
+    return(RADIOLIB_ERR_RX_QUEUE_FULL);
+  }
+
+  this->rxQueue = slots;
+  this->rxQueueSize = num;
+  this->rxQueueHead = 0;
+  this->rxQueueTail = 0;
+  this->rxQueueDropped = 0;
+
+  // the packets are read out by the interrupt, so the module is free for the next one right away
+  rxQueueRadios[slot] = this;
+  this->setPacketReceivedAction(PhysicalLayerRxQueueActions<0, RADIOLIB_RX_QUEUE_MAX_RADIOS>::get(slot));
+  return(RADIOLIB_ERR_NONE);
+}
+
+void PhysicalLayer::clearRxQueue() {
+  for(size_t i = 0; i < RADIOLIB_RX_QUEUE_MAX_RADIOS; i++) {
+    if(rxQueueRadios[i] == this) {
+      this->clearPacketReceivedAction();
+      rxQueueRadios[i] = nullptr;
+    }
+  }
+  this->rxQueue = nullptr;
+}
+
+int16_t PhysicalLayer::pushPacket() {
+  if(this->rxQueue == nullptr) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  // the readout is started by the interrupt, so this is the time the packet was received
+  RadioLibTime_t timestamp = this->getMod()->hal->micros();
+
+  // the slot at head is never visible to the consumer, so it is always safe to read into it,
+  // even when the queue is full (the packet has to be read out to clear the module anyway)
+  size_t head = this->rxQueueHead;
+  RadioLibPacket_t* slot = &this->rxQueue[head];
+  size_t len = this->getPacketLength();
+  if(len > RADIOLIB_RX_QUEUE_SLOT_SIZE) {
+    len = RADIOLIB_RX_QUEUE_SLOT_SIZE;
+  }
+  int16_t state = this->readData(slot->data, len);
+  RADIOLIB_ASSERT(state);
+
+  // check there is space left
+  size_t next = (head + 1) % this->rxQueueSize;
+  if(next == this->rxQueueTail) {
+    this->rxQueueDropped = this->rxQueueDropped + 1;
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  slot->len = len;
+  slot->rssi = this->getRSSI();
+  slot->snr = this->getSNR();
+  slot->freqError = this->getFrequencyError();
+  slot->timestamp = timestamp;
+
+  // publish the slot only after it was completely filled
+  this->rxQueueHead = next;
+  return(RADIOLIB_ERR_NONE);
+}
+
+RadioLibPacket_t* PhysicalLayer::peekPacket() {
+  if((this->rxQueue == nullptr) || (this->rxQueueHead == this->rxQueueTail)) {
+    return(nullptr);
+  }
+  return(&this->rxQueue[this->rxQueueTail]);
+}
+
+void PhysicalLayer::popPacket() {
+  if((this->rxQueue == nullptr) || (this->rxQueueHead == this->rxQueueTail)) {
+    return;
+  }
+  this->rxQueueTail = (this->rxQueueTail + 1) % this->rxQueueSize;
+}
+
+size_t PhysicalLayer::getQueuedPackets() const {
+  if(this->rxQueue == nullptr) {
+    return(0);
+  }
+  return((this->rxQueueHead + this->rxQueueSize - this->rxQueueTail) % this->rxQueueSize);
+}
+
+uint32_t PhysicalLayer::getDroppedPackets() const {
+  return(this->rxQueueDropped);
+}
+
+int16_t PhysicalLayer::submitTransmit(const uint8_t* data, size_t len, uint8_t addr) {
+  if(this->eventOp != RADIOLIB_EVENT_OP_NONE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  this->eventIrq = false;
+  int16_t state = this->startTransmit(data, len, addr);
+  RADIOLIB_ASSERT(state);
+
+  // same guard as the blocking transmit, 5x the expected time-on-air
+  // modules that do not report the time-on-air get a fixed timeout instead, so the operation always ends
+  this->eventOp = RADIOLIB_EVENT_OP_TRANSMIT;
+  this->eventStart = this->getMod()->hal->micros();
+  this->eventTimeout = 5 * this->getTimeOnAir(len);
+  if(this->eventTimeout == 0) {
+    this->eventTimeout = RADIOLIB_EVENT_TX_TIMEOUT;
+  }
+  return(state);
+}
+
+int16_t PhysicalLayer::submitReceive(uint8_t* data, size_t len, RadioLibTime_t timeout) {
+  if(this->eventOp != RADIOLIB_EVENT_OP_NONE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+  if(data == nullptr) {
+    return(RADIOLIB_ERR_NULL_POINTER);
+  }
+
+  this->eventIrq = false;
+  int16_t state = this->startReceive();
+  RADIOLIB_ASSERT(state);
+
+  this->eventOp = RADIOLIB_EVENT_OP_RECEIVE;
+  this->eventStart = this->getMod()->hal->micros();
+  this->eventTimeout = timeout;
+  this->eventRxData = data;
+  this->eventRxLen = len;
+  return(state);
+}
+
+int16_t PhysicalLayer::submitChannelScan() {
+  if(this->eventOp != RADIOLIB_EVENT_OP_NONE) {
+    return(RADIOLIB_ERR_OPERATION_PENDING);
+  }
+
+  this->eventIrq = false;
+  int16_t state = this->startChannelScan();
+  RADIOLIB_ASSERT(state);
+
+  this->eventOp = RADIOLIB_EVENT_OP_CHANNEL_SCAN;
+  this->eventStart = this->getMod()->hal->micros();
+  this->eventTimeout = 0;
+  return(state);
+}
+
+int16_t PhysicalLayer::abortOperation() {
+  this->eventOp = RADIOLIB_EVENT_OP_NONE;
+  this->eventIrq = false;
+  return(this->standby());
+}
+
+void PhysicalLayer::notifyIrq() {
+  // keep the timestamp of the first interrupt, it must not change while pollEvent reads it
+  // (the timestamp is wider than a single load on 8-bit platforms)
+  if(this->eventIrq) {
+    return;
+  }
+  this->eventIrqTime = this->getMod()->hal->micros();
+  this->eventIrq = true;
+}
+
+bool PhysicalLayer::pollEvent(RadioLibEvent_t* event) {
+  if((this->eventOp == RADIOLIB_EVENT_OP_NONE) || (event == nullptr)) {
+    return(false);
+  }
+
+  // nothing to do until the interrupt arrives or the operation times out
+  RadioLibTime_t now = this->getMod()->hal->micros();
+  bool timedOut = (this->eventTimeout > 0) && (now - this->eventStart > this->eventTimeout);
+  if(!this->eventIrq && !timedOut) {
+    return(false);
+  }
+
+  event->op = this->eventOp;
+  event->len = 0;
+  this->eventOp = RADIOLIB_EVENT_OP_NONE;
+
+  // handle timeout
+  if(!this->eventIrq) {
+    event->type = RADIOLIB_EVENT_TIMEOUT;
+    event->timestamp = now;
+    if(event->op == RADIOLIB_EVENT_OP_TRANSMIT) {
+      this->finishTransmit();
+      event->state = RADIOLIB_ERR_TX_TIMEOUT;
+    } else {
+      this->standby();
+      event->state = RADIOLIB_ERR_RX_TIMEOUT;
+    }
+    return(true);
+  }
+
+  this->eventIrq = false;
+  event->timestamp = this->eventIrqTime;
+  switch(event->op) {
+    case(RADIOLIB_EVENT_OP_TRANSMIT):
+      event->type = RADIOLIB_EVENT_TX_DONE;
+      event->state = this->finishTransmit();
+      break;
+
+    case(RADIOLIB_EVENT_OP_RECEIVE): {
+      event->type = RADIOLIB_EVENT_RX_DONE;
+      size_t len = this->getPacketLength();
+      if(len > this->eventRxLen) {
+        len = this->eventRxLen;
+      }
+      event->state = this->readData(this->eventRxData, len);
+      event->len = len;
+      this->standby();
+    } break;
+
+    case(RADIOLIB_EVENT_OP_CHANNEL_SCAN):
+      event->type = RADIOLIB_EVENT_SCAN_DONE;
+      event->state = this->getChannelScanResult();
+      break;
+  }
+  return(true);
+}
+
+uint8_t PhysicalLayer::getPendingOperation() const {
+  return(this->eventOp);
+}
+
 #if RADIOLIB_INTERRUPT_TIMING
 void PhysicalLayer::setInterruptSetup(void (*func)(uint32_t)) {
   Module* mod = getMod();
@@ -43,6 +43,105 @@ union DataRate_t {
   FSKRate_t fsk;
 };
 
+// operations that can be submitted to the event-driven API
+#define RADIOLIB_EVENT_OP_NONE                                  (0x00)
+#define RADIOLIB_EVENT_OP_TRANSMIT                              (0x01)
+#define RADIOLIB_EVENT_OP_RECEIVE                               (0x02)
+#define RADIOLIB_EVENT_OP_CHANNEL_SCAN                          (0x03)
+
+// events reported by the event-driven API
+#define RADIOLIB_EVENT_NONE                                     (0x00)
+#define RADIOLIB_EVENT_TX_DONE                                  (0x01)
+#define RADIOLIB_EVENT_RX_DONE                                  (0x02)
+#define RADIOLIB_EVENT_TIMEOUT                                  (0x03)
+#define RADIOLIB_EVENT_SCAN_DONE                                (0x04)
+
+/*!
+  \struct RadioLibEvent_t
+  \brief Completion event of an operation submitted to the event-driven API.
+*/
+struct RadioLibEvent_t {
+  /*! \brief Event type, one of RADIOLIB_EVENT_* */
+  uint8_t type;
+
+  /*! \brief Operation that finished, one of RADIOLIB_EVENT_OP_* */
+  uint8_t op;
+
+  /*!
+    \brief Result of the operation. For RADIOLIB_EVENT_SCAN_DONE, this is the channel scan result
+    (e.g. RADIOLIB_LORA_DETECTED or RADIOLIB_CHANNEL_FREE), otherwise one of \ref status_codes.
+  */
+  int16_t state;
+
+  /*! \brief Number of bytes received, only valid for RADIOLIB_EVENT_RX_DONE */
+  size_t len;
+
+  /*! \brief Timestamp of the interrupt (or of the timeout) in microseconds, as returned by the HAL */
+  RadioLibTime_t timestamp;
+};
+
+#if RADIOLIB_COROUTINES
+// awaitable returned by the coroutine wrappers, defined in Coroutines.h
+class RadioLibOpAwaiter;
+#endif
+
+/*!
+  \struct RadioLibPacket_t
+  \brief Slot of the receive queue, holds one received packet along with its metadata.
+*/
+struct RadioLibPacket_t {
+  /*! \brief Packet data */
+  uint8_t data[RADIOLIB_RX_QUEUE_SLOT_SIZE];
+
+  /*! \brief Packet length in bytes */
+  size_t len;
+
+  /*! \brief RSSI of the packet in dBm */
+  float rssi;
+
+  /*! \brief SNR of the packet in dB, as reported by getSNR */
+  float snr;
+
+  /*! \brief Frequency error of the packet in Hz, as reported by getFrequencyError */
+  float freqError;
+
+  /*!
+    \brief Time the readout of the packet started in microseconds, as returned by the HAL.
+    The readout is started by the packet received interrupt.
+  */
+  RadioLibTime_t timestamp;
+};
+
+/*!
+  \struct DirectSyncStats_t
+  \brief Sync word acquisition statistics of the direct reception mode correlator.
+*/
+struct DirectSyncStats_t {
+  /*! \brief Number of bits searched for sync word */
+  uint32_t bitsSearched;
+
+  /*! \brief Number of times sync was acquired */
+  uint32_t acquired;
+
+  /*! \brief Number of times sync was acquired with at least one bit error */
+  uint32_t corrected;
+
+  /*! \brief Number of times sync was acquired on an inverted sync word */
+  uint32_t inverted;
+
+  /*! \brief Total number of bit errors in all acquired sync words */
+  uint32_t bitErrors;
+
+  /*! \brief Index of the last matched sync word, in the order they were added */
+  uint8_t lastIndex;
+
+  /*! \brief Number of bit errors in the last matched sync word */
+  uint8_t lastErrors;
+
+  /*! \brief Whether the last matched sync word was inverted */
+  bool lastInverted;
+};
+
 /*!
   \class PhysicalLayer
 
@@ -63,6 +162,11 @@ class PhysicalLayer {
     */
     PhysicalLayer(float step, size_t maxLen);
 
+    /*!
+      \brief Default destructor, releases the receive queue action of this radio.
+    */
+    ~PhysicalLayer();
+
     // basic methods
 
     #if defined(RADIOLIB_BUILD_ARDUINO)
@@ -298,6 +402,21 @@ class PhysicalLayer {
       \returns \ref status_codes
     */
     virtual int16_t setPreambleLength(size_t len);
+
+    /*!
+      \brief Set implicit header mode for future reception/transmission.
+      Must be implemented in module class if the module supports it.
+      \param len Payload length in bytes.
+      \returns \ref status_codes
+    */
+    virtual int16_t implicitHeader(size_t len);
+
+    /*!
+      \brief Set explicit header mode for future reception/transmission.
+      Must be implemented in module class if the module supports it.
+      \returns \ref status_codes
+    */
+    virtual int16_t explicitHeader();
     
     /*!
       \brief Set data. Must be implemented in module class if the module supports it.
@@ -338,6 +457,12 @@ class PhysicalLayer {
     */
     virtual float getSNR();
 
+    /*!
+      \brief Gets frequency error of the last received packet.
+      \returns Frequency error in Hz.
+    */
+    virtual float getFrequencyError();
+
     /*!
       \brief Get expected time-on-air for a given size of payload
       \param len Payload length in bytes.
@@ -418,12 +543,46 @@ class PhysicalLayer {
     #if !RADIOLIB_EXCLUDE_DIRECT_RECEIVE
     /*!
       \brief Set sync word to be used to determine start of packet in direct reception mode.
+      Replaces all sync words added previously, correlator settings are kept.
       \param syncWord Sync word bits.
       \param len Sync word length in bits. Set to zero to disable sync word matching.
+      Must be higher than the correlator threshold set by setDirectSyncCorrelator, unless it is zero.
       \returns \ref status_codes
     */
     int16_t setDirectSyncWord(uint32_t syncWord, uint8_t len);
 
+    /*!
+      \brief Add another sync word to search for in direct reception mode, at the same time as the ones
+      added previously. The sync word length set by setDirectSyncWord applies to all of them.
+      Up to RADIOLIB_DIRECT_SYNC_WORDS_MAX sync words can be used.
+      \param syncWord Sync word bits.
+      \returns \ref status_codes
+    */
+    int16_t addDirectSyncWord(uint32_t syncWord);
+
+    /*!
+      \brief Configure sync word correlator in direct reception mode. Instead of an exact match,
+      sync is acquired when the Hamming distance between the received bits and a sync word is within the threshold.
+      Higher threshold improves sensitivity at the cost of more false detections.
+      \param maxErrors Maximum number of bit errors in sync word, 0 for exact match (default).
+      Must be lower than the sync word length set by setDirectSyncWord, and should be well below half of it.
+      \param inverted Also detect inverted sync words. Data received after an inverted sync word
+      is inverted back. Disabled by default.
+      \returns \ref status_codes
+    */
+    int16_t setDirectSyncCorrelator(uint8_t maxErrors, bool inverted = false);
+
+    /*!
+      \brief Get sync word acquisition statistics, useful to tune the correlator threshold.
+      \returns Statistics since the last reset.
+    */
+    DirectSyncStats_t getDirectSyncStats() const;
+
+    /*!
+      \brief Reset sync word acquisition statistics.
+    */
+    void resetDirectSyncStats();
+
     /*!
       \brief Set interrupt service routine function to call when data bit is received in direct mode.
       Must be implemented in module class.
@@ -437,12 +596,30 @@ class PhysicalLayer {
     */
     virtual void readBit(uint32_t pin);
 
+    /*!
+      \brief Set buffer to store direct mode bytes in. The buffer is a lock-free single-producer
+      single-consumer ring: bytes are written from the direct mode ISR and read by read().
+      By default, an internal buffer of RADIOLIB_STATIC_ARRAY_SIZE bytes is used.
+      Must not be called while direct mode reception is running.
+      \param buff Buffer to use, or nullptr to switch back to the internal one.
+      \param len Length of the buffer in bytes. One byte is kept free, so the buffer
+      can hold up to len - 1 bytes. Since available() returns int16_t, len must not exceed 32768.
+      \returns \ref status_codes
+    */
+    int16_t setDirectBuffer(uint8_t* buff, size_t len);
+
     /*!
       \brief Get the number of direct mode bytes currently available in buffer.
       \returns Number of available bytes.
     */
     int16_t available();
 
+    /*!
+      \brief Get the number of direct mode bytes dropped because the buffer was full.
+      \returns Number of dropped bytes since the buffer was last set up.
+    */
+    uint32_t getDirectOverflows() const;
+
     /*!
       \brief Forcefully drop synchronization.
     */
@@ -452,7 +629,7 @@ class PhysicalLayer {
       \brief Get data from direct mode buffer.
       \param drop Drop synchronization on read - next reading will require waiting for the sync word again.
       Defaults to true.
-      \returns Byte from direct mode buffer.
+      \returns Byte from direct mode buffer, or 0 if the buffer is empty.
     */
     uint8_t read(bool drop = true);
     #endif
@@ -498,6 +675,155 @@ class PhysicalLayer {
     */
     virtual void clearChannelScanAction();
 
+    /*!
+      \brief Set up the receive queue. The queue is a ring of packet slots, filled by pushPacket
+      and consumed in place by peekPacket and popPacket. This sets the packet received action
+      to one that calls pushPacket, so every packet is read out from the interrupt that reports it
+      and the module is free for the next one right away. That needs SPI transactions in interrupt
+      service routine, so the queue can only be used on platforms that allow them.
+      Must be called after the module was initialized, the packet received action must not be changed
+      until clearRxQueue is called. Up to RADIOLIB_RX_QUEUE_MAX_RADIOS radios can have a queue.
+      \param slots Array of slots to use, must be valid for as long as the queue is in use.
+      \param num Number of slots in the array. One slot is reserved for the readout in progress,
+      so the queue can hold up to num - 1 packets. Must be at least 2.
+      \returns \ref status_codes
+    */
+    int16_t setRxQueue(RadioLibPacket_t* slots, size_t num);
+
+    /*!
+      \brief Disable the receive queue and clear the packet received action set by setRxQueue.
+    */
+    void clearRxQueue();
+
+    /*!
+      \brief Read the received packet from the module into the next free slot of the receive queue.
+      Called from the packet received action set by setRxQueue, it can also be called from a custom
+      packet received action that does more than that. The packet is timestamped at the start of the readout.
+      If the queue is full, the packet is still read to clear the module, but it is dropped
+      and the drop counter is incremented.
+      \returns \ref status_codes
+    */
+    int16_t pushPacket();
+
+    /*!
+      \brief Get the oldest packet in the receive queue without removing it.
+      \returns Pointer to the slot holding the packet, or nullptr if the queue is empty.
+      The slot stays valid until popPacket is called.
+    */
+    RadioLibPacket_t* peekPacket();
+
+    /*!
+      \brief Release the oldest packet in the receive queue, so that its slot can be reused.
+    */
+    void popPacket();
+
+    /*!
+      \brief Get the number of packets currently held in the receive queue.
+      \returns Number of queued packets.
+    */
+    size_t getQueuedPackets() const;
+
+    /*!
+      \brief Get the number of packets dropped because the receive queue was full.
+      \returns Number of dropped packets since the queue was set up.
+    */
+    uint32_t getDroppedPackets() const;
+
+    /*!
+      \brief Submit packet transmission without blocking. Completion is reported by pollEvent
+      as RADIOLIB_EVENT_TX_DONE, or RADIOLIB_EVENT_TIMEOUT if the interrupt does not arrive
+      within 5x the time-on-air (RADIOLIB_EVENT_TX_TIMEOUT if the module does not report the time-on-air).
+      Requires notifyIrq to be called from the packet sent action; the drivers do not call it themselves.
+      \param data Binary data to transmit, must be valid until the operation finishes.
+      \param len Number of bytes to transmit.
+      \param addr Node address to transmit the packet to. Only used in FSK mode.
+      \returns \ref status_codes
+    */
+    int16_t submitTransmit(const uint8_t* data, size_t len, uint8_t addr = 0);
+
+    /*!
+      \brief Submit single packet reception without blocking. Completion is reported by pollEvent
+      as RADIOLIB_EVENT_RX_DONE, or RADIOLIB_EVENT_TIMEOUT when no packet was received in time.
+      Requires notifyIrq to be called from the packet received action; the drivers do not call it themselves.
+      \param data Buffer to read the packet into, must be valid until the operation finishes.
+      \param len Size of the buffer in bytes.
+      \param timeout Reception timeout in microseconds, checked when polling. Set to 0 to wait indefinitely.
+      \returns \ref status_codes
+    */
+    int16_t submitReceive(uint8_t* data, size_t len, RadioLibTime_t timeout = 0);
+
+    /*!
+      \brief Submit channel scan without blocking. Completion is reported by pollEvent
+      as RADIOLIB_EVENT_SCAN_DONE. Requires notifyIrq to be called from the channel scan action;
+      the drivers do not call it themselves.
+      \returns \ref status_codes
+    */
+    int16_t submitChannelScan();
+
+    /*!
+      \brief Abort operation submitted previously and put the module to standby. No event is reported.
+      \returns \ref status_codes
+    */
+    int16_t abortOperation();
+
+    /*!
+      \brief Notify the event-driven API that the module raised an interrupt.
+      Safe to call from interrupt service routine, all SPI communication is done later in pollEvent.
+      The drivers never call this method, it has to be called by the user from the action set by
+      e.g. setPacketSentAction or setPacketReceivedAction. Only the first interrupt of an operation is recorded.
+    */
+    void notifyIrq();
+
+    /*!
+      \brief Service the operation submitted previously. Intended to be called periodically from the main loop.
+      \param event Pointer to the event to fill when the operation finishes.
+      \returns Whether the operation finished and the event was filled.
+    */
+    bool pollEvent(RadioLibEvent_t* event);
+
+    /*!
+      \brief Get the operation in progress.
+      \returns Operation submitted previously, or RADIOLIB_EVENT_OP_NONE if the module is idle.
+    */
+    uint8_t getPendingOperation() const;
+
+    #if RADIOLIB_COROUTINES
+    /*!
+      \brief Awaitable packet transmission, for use in RadioLibTask coroutines (co_await radio.transmitAsync(...)).
+      Built on submitTransmit, so notifyIrq must be called from the packet sent action.
+      \param data Binary data to transmit, must be valid until the operation finishes.
+      \param len Number of bytes to transmit.
+      \param addr Node address to transmit the packet to. Only used in FSK mode.
+      \returns Awaitable that resumes with the RadioLibEvent_t of the operation.
+    */
+    RadioLibOpAwaiter transmitAsync(const uint8_t* data, size_t len, uint8_t addr = 0);
+
+    /*!
+      \brief Awaitable C-string transmission, for use in RadioLibTask coroutines.
+      \param str C-string that will be transmitted, must be valid until the operation finishes.
+      \param addr Node address to transmit the packet to. Only used in FSK mode.
+      \returns Awaitable that resumes with the RadioLibEvent_t of the operation.
+    */
+    RadioLibOpAwaiter transmitAsync(const char* str, uint8_t addr = 0);
+
+    /*!
+      \brief Awaitable single packet reception, for use in RadioLibTask coroutines.
+      Built on submitReceive, so notifyIrq must be called from the packet received action.
+      \param data Buffer to read the packet into, must be valid until the operation finishes.
+      \param len Size of the buffer in bytes.
+      \param timeout Reception timeout in microseconds. Set to 0 to wait indefinitely.
+      \returns Awaitable that resumes with the RadioLibEvent_t of the operation.
+    */
+    RadioLibOpAwaiter receiveAsync(uint8_t* data, size_t len, RadioLibTime_t timeout = 0);
+
+    /*!
+      \brief Awaitable channel scan, for use in RadioLibTask coroutines.
+      Built on submitChannelScan, so notifyIrq must be called from the channel scan action.
+      \returns Awaitable that resumes with the RadioLibEvent_t of the operation.
+    */
+    RadioLibOpAwaiter scanChannelAsync();
+    #endif
+
     #if RADIOLIB_INTERRUPT_TIMING
 
     /*!
@@ -519,6 +845,7 @@ class PhysicalLayer {
   protected:
 #endif
 #if !RADIOLIB_EXCLUDE_DIRECT_RECEIVE
+    bool findDirectSync();
     void updateDirectBuffer(uint8_t bit);
 #endif
 
@@ -528,16 +855,41 @@ class PhysicalLayer {
     float freqStep;
     size_t maxPacketLength;
 
+    RadioLibPacket_t* rxQueue = nullptr;
+    size_t rxQueueSize = 0;
+    volatile size_t rxQueueHead = 0;
+    volatile size_t rxQueueTail = 0;
+    volatile uint32_t rxQueueDropped = 0;
+
+    uint8_t eventOp = RADIOLIB_EVENT_OP_NONE;
+    volatile bool eventIrq = false;
+    volatile RadioLibTime_t eventIrqTime = 0;
+    RadioLibTime_t eventStart = 0;
+    RadioLibTime_t eventTimeout = 0;
+    uint8_t* eventRxData = nullptr;
+    size_t eventRxLen = 0;
+
     #if !RADIOLIB_EXCLUDE_DIRECT_RECEIVE
     uint8_t bufferBitPos = 0;
-    uint8_t bufferWritePos = 0;
-    uint8_t bufferReadPos = 0;
+    volatile size_t bufferWritePos = 0;
+    volatile size_t bufferReadPos = 0;
+    volatile uint32_t bufferOverflows = 0;
     uint8_t buffer[RADIOLIB_STATIC_ARRAY_SIZE] = { 0 };
+    uint8_t* bufferExt = nullptr;
+    size_t bufferSize = RADIOLIB_STATIC_ARRAY_SIZE;
     uint32_t syncBuffer = 0;
-    uint32_t directSyncWord = 0;
+    uint8_t syncBufferBits = 0;
+    // without setDirectSyncWord, the single zero-length sync word matches right away
+    uint32_t directSyncWords[RADIOLIB_DIRECT_SYNC_WORDS_MAX] = { 0 };
+    uint8_t directSyncWordsNum = 1;
     uint8_t directSyncWordLen = 0;
     uint32_t directSyncWordMask = 0;
-    bool gotSync = false;
+    uint8_t directSyncMaxErrors = 0;
+    bool directSyncInvert = false;
+    bool directSyncInverted = false;
+    DirectSyncStats_t directSyncStats = {};
+    volatile bool gotSync = false;
+    volatile bool dropSyncRequest = false;
     #endif
 
     virtual Module* getMod() = 0;
@@ -555,6 +907,7 @@ class PhysicalLayer {
     friend class BellClient;
     friend class FT8Client;
     friend class LoRaWANNode;
+    friend class LoRaWANAggregator;
 };
 
 #endif
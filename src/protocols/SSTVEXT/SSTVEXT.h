@@ -2,6 +2,7 @@
 #define _RADIOLIB_SSTVEXT_H
 
 #include "../../TypeDef.h"
+#include <stdlib.h>
 
 #if !RADIOLIB_EXCLUDE_SSTVEXT
 
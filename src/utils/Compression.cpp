@@ -0,0 +1,226 @@
+#include "Compression.h"
+#include <string.h>
+
+RadioLibLZ::RadioLibLZ() {
+
+}
+
+int16_t RadioLibLZ::begin(uint8_t windowBits, uint8_t lengthBits) {
+  if((windowBits < 1) || (windowBits > 8) || (lengthBits < 1) || (lengthBits > 8) || (windowBits + lengthBits < 7)) {
+    return(RADIOLIB_ERR_INVALID_ENCODING);
+  }
+  this->windowBits = windowBits;
+  this->lengthBits = lengthBits;
+
+  // a literal takes 9 bits
+  this->minMatch = (1 + windowBits + lengthBits) / 9 + 1;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t RadioLibLZ::compress(const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) const {
+  // the stream is only kept if it is shorter than the payload
+  size_t maxLen = RADIOLIB_MIN(*outLen, len);
+  size_t maxBits = 8*maxLen;
+  size_t window = (size_t)1 << this->windowBits;
+  size_t maxMatch = this->minMatch + ((size_t)1 << this->lengthBits) - 1;
+  size_t tokenBits = 1 + this->windowBits + this->lengthBits;
+
+  size_t bitPos = 0;
+  bool fits = (maxLen > 0);
+  if(fits) {
+    putBits(out, &bitPos, 1, 1);
+  }
+  size_t pos = 0;
+  while(fits && (pos < len)) {
+    // find the longest match, the nearest one of equal length is cheaper to search for
+    size_t bestLen = 0;
+    size_t bestDist = 0;
+    size_t start = (pos > window) ? pos - window : 0;
+    for(size_t i = pos; i > start; i--) {
+      size_t cand = i - 1;
+      size_t n = 0;
+      while((n < maxMatch) && (pos + n < len) && (in[cand + n] == in[pos + n])) {
+        n++;
+      }
+      if(n > bestLen) {
+        bestLen = n;
+        bestDist = pos - cand;
+        if(n == maxMatch) {
+          break;
+        }
+      }
+    }
+
+    if(bestLen >= this->minMatch) {
+      if(bitPos + tokenBits > maxBits) {
+        fits = false;
+        break;
+      }
+      putBits(out, &bitPos, 0, 1);
+      putBits(out, &bitPos, bestDist - 1, this->windowBits);
+      putBits(out, &bitPos, bestLen - this->minMatch, this->lengthBits);
+      pos += bestLen;
+    } else {
+      if(bitPos + 9 > maxBits) {
+        fits = false;
+        break;
+      }
+      putBits(out, &bitPos, 1, 1);
+      putBits(out, &bitPos, in[pos], 8);
+      pos++;
+    }
+  }
+
+  if(fits) {
+    *outLen = (bitPos + 7) / 8;
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  // incompressible, store it as it is
+  if(*outLen < len + 1) {
+    return(RADIOLIB_ERR_PACKET_TOO_LONG);
+  }
+  out[0] = RADIOLIB_LZ_HEADER_STORED;
+  memcpy(&out[1], in, len);
+  *outLen = len + 1;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t RadioLibLZ::decompress(const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) const {
+  if(len == 0) {
+    return(RADIOLIB_ERR_INVALID_ENCODING);
+  }
+  size_t maxLen = *outLen;
+
+  if(!(in[0] & RADIOLIB_LZ_HEADER_COMPRESSED)) {
+    if(len - 1 > maxLen) {
+      return(RADIOLIB_ERR_PACKET_TOO_LONG);
+    }
+    memcpy(out, &in[1], len - 1);
+    *outLen = len - 1;
+    return(RADIOLIB_ERR_NONE);
+  }
+
+  // the last byte is padded with less than a token, so a remainder shorter than any token is the end
+  size_t bitLen = 8*len;
+  size_t tokenBits = 1 + this->windowBits + this->lengthBits;
+  size_t minBits = RADIOLIB_MIN(tokenBits, (size_t)9);
+  size_t bitPos = 1;
+  size_t pos = 0;
+  while(bitLen - bitPos >= minBits) {
+    if(getBits(in, &bitPos, 1)) {
+      if(bitLen - bitPos < 8) {
+        break;
+      }
+      if(pos >= maxLen) {
+        return(RADIOLIB_ERR_PACKET_TOO_LONG);
+      }
+      out[pos++] = getBits(in, &bitPos, 8);
+      continue;
+    }
+
+    if(bitLen - bitPos < tokenBits - 1U) {
+      break;
+    }
+    size_t dist = getBits(in, &bitPos, this->windowBits) + 1;
+    size_t n = getBits(in, &bitPos, this->lengthBits) + this->minMatch;
+    if(dist > pos) {
+      return(RADIOLIB_ERR_INVALID_ENCODING);
+    }
+    if(pos + n > maxLen) {
+      return(RADIOLIB_ERR_PACKET_TOO_LONG);
+    }
+
+    // byte by byte, the match may overlap the bytes it produces
+    for(size_t i = 0; i < n; i++) {
+      out[pos] = out[pos - dist];
+      pos++;
+    }
+  }
+
+  *outLen = pos;
+  return(RADIOLIB_ERR_NONE);
+}
+
+void RadioLibLZ::putBits(uint8_t* buff, size_t* bitPos, uint32_t val, uint8_t bits) {
+  for(int8_t i = bits - 1; i >= 0; i--) {
+    size_t byte = *bitPos / 8;
+    uint8_t mask = 0x80 >> (*bitPos % 8);
+    if(mask == 0x80) {
+      buff[byte] = 0;
+    }
+    if(val & ((uint32_t)1 << i)) {
+      buff[byte] |= mask;
+    }
+    (*bitPos)++;
+  }
+}
+
+uint32_t RadioLibLZ::getBits(const uint8_t* buff, size_t* bitPos, uint8_t bits) {
+  uint32_t val = 0;
+  for(uint8_t i = 0; i < bits; i++) {
+    val <<= 1;
+    if(buff[*bitPos / 8] & (0x80 >> (*bitPos % 8))) {
+      val |= 1;
+    }
+    (*bitPos)++;
+  }
+  return(val);
+}
+
+int16_t RadioLibDelta::encode(const int32_t* values, size_t numRecords, size_t numFields, uint8_t* out, size_t* outLen) {
+  size_t maxLen = *outLen;
+  size_t pos = 0;
+  for(size_t i = 0; i < numRecords*numFields; i++) {
+    // modulo 2^32, so that steps across the whole range still round-trip
+    uint32_t prev = (i < numFields) ? 0 : (uint32_t)values[i - numFields];
+    int32_t diff = (int32_t)((uint32_t)values[i] - prev);
+    uint32_t zigzag = ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31);
+    do {
+      if(pos >= maxLen) {
+        return(RADIOLIB_ERR_PACKET_TOO_LONG);
+      }
+      out[pos++] = (zigzag & 0x7F) | ((zigzag > 0x7F) ? 0x80 : 0x00);
+      zigzag >>= 7;
+    } while(zigzag);
+  }
+  *outLen = pos;
+  return(RADIOLIB_ERR_NONE);
+}
+
+int16_t RadioLibDelta::decode(const uint8_t* in, size_t len, size_t numFields, int32_t* values, size_t* numRecords) {
+  if(numFields == 0) {
+    return(RADIOLIB_ERR_INVALID_ENCODING);
+  }
+  size_t maxValues = *numRecords * numFields;
+  size_t pos = 0;
+  size_t num = 0;
+  while(pos < len) {
+    uint32_t zigzag = 0;
+    uint8_t shift = 0;
+    uint8_t b = 0;
+    do {
+      if((pos >= len) || (shift >= 7*RADIOLIB_DELTA_VARINT_MAX_LEN)) {
+        return(RADIOLIB_ERR_INVALID_ENCODING);
+      }
+      b = in[pos++];
+      zigzag |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while(b & 0x80);
+
+    if(num >= maxValues) {
+      return(RADIOLIB_ERR_PACKET_TOO_LONG);
+    }
+    uint32_t diff = (zigzag >> 1) ^ (0 - (zigzag & 1));
+    uint32_t prev = (num < numFields) ? 0 : (uint32_t)values[num - numFields];
+    values[num] = (int32_t)(prev + diff);
+    num++;
+  }
+
+  // only whole records
+  if(num % numFields) {
+    return(RADIOLIB_ERR_INVALID_ENCODING);
+  }
+  *numRecords = num / numFields;
+  return(RADIOLIB_ERR_NONE);
+}
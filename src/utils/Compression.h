@@ -0,0 +1,110 @@
+#if !defined(_RADIOLIB_COMPRESSION_H)
+#define _RADIOLIB_COMPRESSION_H
+
+#include "../TypeDef.h"
+
+// LZ codec window and match length sizes in bits, defaults cover the largest LoRaWAN payload
+#define RADIOLIB_LZ_WINDOW_BITS                                 (8)
+#define RADIOLIB_LZ_LENGTH_BITS                                 (4)
+
+// LZ stream header, the first bit tells whether the payload was compressed or stored as it was
+#define RADIOLIB_LZ_HEADER_COMPRESSED                           (0x80)
+#define RADIOLIB_LZ_HEADER_STORED                               (0x00)
+
+// longest variable-length integer, 7 bits per byte
+#define RADIOLIB_DELTA_VARINT_MAX_LEN                           (5)
+
+/*!
+  \class RadioLibLZ
+  \brief Small-footprint LZSS codec in the style of heatshrink, for short payloads held in RAM.
+  The input itself serves as the window, so apart from the output buffer, no memory is needed.
+  The stream is a sequence of bit-packed tokens: a literal byte (1 flag bit and 8 bits),
+  or a reference to an earlier match (1 flag bit, the distance and the length of the match).
+  If the payload does not get shorter, it is stored as it was behind a single header byte.
+  Both ends must use the same window and length sizes.
+*/
+class RadioLibLZ {
+  public:
+    /*!
+      \brief Default constructor.
+    */
+    RadioLibLZ();
+
+    /*!
+      \brief Set the sizes of the back-references.
+      \param windowBits Number of bits of the match distance, 1 to 8. Matches can be up to 2^windowBits bytes back.
+      \param lengthBits Number of bits of the match length, 1 to 8. Together with windowBits at least 7,
+      so that the padding at the end of the stream can not be mistaken for a token.
+      \returns \ref status_codes
+    */
+    int16_t begin(uint8_t windowBits = RADIOLIB_LZ_WINDOW_BITS, uint8_t lengthBits = RADIOLIB_LZ_LENGTH_BITS);
+
+    /*!
+      \brief Compress a payload.
+      \param in Payload to compress.
+      \param len Length of the payload.
+      \param out Buffer to save the stream into, must not overlap the payload.
+      \param outLen Size of the output buffer, will be set to the length of the stream.
+      At most one byte more than the payload is needed.
+      \returns \ref status_codes
+    */
+    int16_t compress(const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) const;
+
+    /*!
+      \brief Decompress a payload.
+      \param in Stream produced by compress.
+      \param len Length of the stream.
+      \param out Buffer to save the payload into, must not overlap the stream.
+      \param outLen Size of the output buffer, will be set to the length of the payload.
+      \returns \ref status_codes
+    */
+    int16_t decompress(const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) const;
+
+#if !RADIOLIB_GODMODE
+  private:
+#endif
+    uint8_t windowBits = RADIOLIB_LZ_WINDOW_BITS;
+    uint8_t lengthBits = RADIOLIB_LZ_LENGTH_BITS;
+
+    // shortest match that is cheaper as a reference than as literals
+    uint8_t minMatch = 2;
+
+    // bit stream access, most significant bit first
+    static void putBits(uint8_t* buff, size_t* bitPos, uint32_t val, uint8_t bits);
+    static uint32_t getBits(const uint8_t* buff, size_t* bitPos, uint8_t bits);
+};
+
+/*!
+  \class RadioLibDelta
+  \brief Delta and variable-length integer coding of time series records.
+  Each record is a fixed number of integer fields (e.g. a timestamp and a few sensor readings).
+  Every field is stored as the difference to the same field of the previous record,
+  zig-zag encoded so that small negative steps stay small, in 7-bit groups.
+  The first record is stored against zero, so every payload can be decoded on its own.
+*/
+class RadioLibDelta {
+  public:
+    /*!
+      \brief Encode records.
+      \param values Fields of all records, record after record.
+      \param numRecords Number of records.
+      \param numFields Number of fields per record.
+      \param out Buffer to save the encoded records into.
+      \param outLen Size of the output buffer, will be set to the length of the encoded records.
+      \returns \ref status_codes
+    */
+    static int16_t encode(const int32_t* values, size_t numRecords, size_t numFields, uint8_t* out, size_t* outLen);
+
+    /*!
+      \brief Decode records.
+      \param in Encoded records.
+      \param len Length of the encoded records.
+      \param numFields Number of fields per record, as used to encode them.
+      \param values Buffer to save the fields of all records into, record after record.
+      \param numRecords Number of records the buffer can hold, will be set to the number of decoded records.
+      \returns \ref status_codes
+    */
+    static int16_t decode(const uint8_t* in, size_t len, size_t numFields, int32_t* values, size_t* numRecords);
+};
+
+#endif
@@ -3,12 +3,29 @@
 #include <string.h>
 
 RadioLibAES128::RadioLibAES128() {
-
+  this->activeKey = this->roundKey;
 }
 
-void RadioLibAES128::init(uint8_t* key) {
+void RadioLibAES128::init(const uint8_t* key) {
   this->keyPtr = key;
   this->keyExpansion(this->roundKey, key);
+  this->activeKey = this->roundKey;
+  this->expandedKey = nullptr;
+}
+
+void RadioLibAES128::init(const RadioLibAES128Key_t* key) {
+  this->keyPtr = nullptr;
+  this->activeKey = key->roundKey;
+  this->expandedKey = key;
+}
+
+void RadioLibAES128::expandKey(const uint8_t* key, RadioLibAES128Key_t* expanded) {
+  this->keyExpansion(expanded->roundKey, key);
+  this->keyPtr = key;
+  this->activeKey = expanded->roundKey;
+  this->expandedKey = nullptr;
+  this->generateSubkeys(expanded->subkey1, expanded->subkey2);
+  this->expandedKey = expanded;
 }
 
 size_t RadioLibAES128::encryptECB(uint8_t* in, size_t len, uint8_t* out) {
@@ -21,7 +38,7 @@ size_t RadioLibAES128::encryptECB(uint8_t* in, size_t len, uint8_t* out) {
   memcpy(out, in, len);
 
   for(size_t i = 0; i < num_blocks; i++) {
-    this->cipher((state_t*)(out + (RADIOLIB_AES128_BLOCK_SIZE * i)), this->roundKey);
+    this->cipher((state_t*)(out + (RADIOLIB_AES128_BLOCK_SIZE * i)), this->activeKey);
   }
 
   return(num_blocks*RADIOLIB_AES128_BLOCK_SIZE);
@@ -37,49 +54,16 @@ size_t RadioLibAES128::decryptECB(uint8_t* in, size_t len, uint8_t* out) {
   memcpy(out, in, len);
 
   for(size_t i = 0; i < num_blocks; i++) {
-    this->decipher((state_t*)(out + (RADIOLIB_AES128_BLOCK_SIZE * i)), this->roundKey);
+    this->decipher((state_t*)(out + (RADIOLIB_AES128_BLOCK_SIZE * i)), this->activeKey);
   }
 
   return(num_blocks*RADIOLIB_AES128_BLOCK_SIZE);
 }
 
 void RadioLibAES128::generateCMAC(uint8_t* in, size_t len, uint8_t* cmac) {
-  uint8_t key1[RADIOLIB_AES128_BLOCK_SIZE];
-  uint8_t key2[RADIOLIB_AES128_BLOCK_SIZE];
-  this->generateSubkeys(key1, key2);
-
-  size_t num_blocks = len / RADIOLIB_AES128_BLOCK_SIZE;
-  bool flag = true;
-  if(len % RADIOLIB_AES128_BLOCK_SIZE) {
-    num_blocks++;
-    flag = false;
-  }
-
-  uint8_t* buff = new uint8_t[num_blocks * RADIOLIB_AES128_BLOCK_SIZE];
-  memset(buff, 0, num_blocks * RADIOLIB_AES128_BLOCK_SIZE);
-  memcpy(buff, in, len);
-  if (flag) {
-    this->blockXor(&buff[(num_blocks - 1)*RADIOLIB_AES128_BLOCK_SIZE], &buff[(num_blocks - 1)*RADIOLIB_AES128_BLOCK_SIZE], key1);
-  } else {
-    buff[len] = 0x80;
-    this->blockXor(&buff[(num_blocks - 1)*RADIOLIB_AES128_BLOCK_SIZE], &buff[(num_blocks - 1)*RADIOLIB_AES128_BLOCK_SIZE], key2);
-  }
-
-  uint8_t X[] = {
-    0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00
-  };
-  uint8_t Y[RADIOLIB_AES128_BLOCK_SIZE];
-
-  for(size_t i = 0; i < num_blocks - 1; i++) {
-    this->blockXor(Y, &buff[i*RADIOLIB_AES128_BLOCK_SIZE], X);
-    this->encryptECB(Y, RADIOLIB_AES128_BLOCK_SIZE, X);
-  }
-  this->blockXor(Y, &buff[(num_blocks - 1)*RADIOLIB_AES128_BLOCK_SIZE], X);
-  this->encryptECB(Y, RADIOLIB_AES128_BLOCK_SIZE, cmac);
-  delete[] buff;
+  this->initCMAC();
+  this->updateCMAC(in, len);
+  this->finishCMAC(cmac);
 }
 
 bool RadioLibAES128::verifyCMAC(uint8_t* in, size_t len, const uint8_t* cmac) {
@@ -93,6 +77,57 @@ bool RadioLibAES128::verifyCMAC(uint8_t* in, size_t len, const uint8_t* cmac) {
   return(true);
 }
 
+void RadioLibAES128::initCMAC() {
+  memset(this->cmacState, 0x00, RADIOLIB_AES128_BLOCK_SIZE);
+  this->cmacBuffLen = 0;
+}
+
+void RadioLibAES128::updateCMAC(const uint8_t* in, size_t len) {
+  while(len > 0) {
+    // the last block is treated differently, so a full block is only processed once more data follows
+    if(this->cmacBuffLen == RADIOLIB_AES128_BLOCK_SIZE) {
+      this->blockXor(this->cmacState, this->cmacState, this->cmacBuff);
+      this->cipher((state_t*)this->cmacState, this->activeKey);
+      this->cmacBuffLen = 0;
+    }
+
+    size_t chunk = RADIOLIB_AES128_BLOCK_SIZE - this->cmacBuffLen;
+    if(chunk > len) {
+      chunk = len;
+    }
+    memcpy(&this->cmacBuff[this->cmacBuffLen], in, chunk);
+    this->cmacBuffLen += chunk;
+    in += chunk;
+    len -= chunk;
+  }
+}
+
+void RadioLibAES128::finishCMAC(uint8_t* cmac) {
+  // the subkeys of an expanded key are already known
+  uint8_t key1[RADIOLIB_AES128_BLOCK_SIZE];
+  uint8_t key2[RADIOLIB_AES128_BLOCK_SIZE];
+  if(this->expandedKey) {
+    memcpy(key1, this->expandedKey->subkey1, RADIOLIB_AES128_BLOCK_SIZE);
+    memcpy(key2, this->expandedKey->subkey2, RADIOLIB_AES128_BLOCK_SIZE);
+  } else {
+    this->generateSubkeys(key1, key2);
+  }
+
+  // a complete last block is masked with the first subkey, a padded one with the second
+  if(this->cmacBuffLen == RADIOLIB_AES128_BLOCK_SIZE) {
+    this->blockXor(this->cmacBuff, this->cmacBuff, key1);
+  } else {
+    memset(&this->cmacBuff[this->cmacBuffLen], 0x00, RADIOLIB_AES128_BLOCK_SIZE - this->cmacBuffLen);
+    this->cmacBuff[this->cmacBuffLen] = 0x80;
+    this->blockXor(this->cmacBuff, this->cmacBuff, key2);
+  }
+
+  this->blockXor(this->cmacState, this->cmacState, this->cmacBuff);
+  this->cipher((state_t*)this->cmacState, this->activeKey);
+  memcpy(cmac, this->cmacState, RADIOLIB_AES128_BLOCK_SIZE);
+  this->cmacBuffLen = 0;
+}
+
 void RadioLibAES128::keyExpansion(uint8_t* roundKey, const uint8_t* key) {
   uint8_t tmp[4];
 
@@ -124,7 +159,7 @@ void RadioLibAES128::keyExpansion(uint8_t* roundKey, const uint8_t* key) {
   }
 }
 
-void RadioLibAES128::cipher(state_t* state, uint8_t* roundKey) {
+void RadioLibAES128::cipher(state_t* state, const uint8_t* roundKey) {
   this->addRoundKey(0, state, roundKey);
   for(uint8_t round = 1; round < RADIOLIB_AES128_N_R; round++) {
     this->subBytes(state, aesSbox);
@@ -139,7 +174,7 @@ void RadioLibAES128::cipher(state_t* state, uint8_t* roundKey) {
 }
 
 
-void RadioLibAES128::decipher(state_t* state, uint8_t* roundKey) {
+void RadioLibAES128::decipher(state_t* state, const uint8_t* roundKey) {
   this->addRoundKey(RADIOLIB_AES128_N_R, state, roundKey);
   for(uint8_t round = RADIOLIB_AES128_N_R - 1; round > 0; --round) {
     this->shiftRows(state, true);
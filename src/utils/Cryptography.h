@@ -88,6 +88,22 @@ static const uint8_t aesSboxInv[] RADIOLIB_NONVOLATILE = {
 
 static const uint8_t aesRcon[] = { 0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
 
+/*!
+  \struct RadioLibAES128Key_t
+  \brief AES key expanded for repeated use, with the round keys and the CMAC subkeys.
+  Using an expanded key saves the key schedule and one block encryption per CMAC.
+*/
+struct RadioLibAES128Key_t {
+  /*! \brief Round keys */
+  uint8_t roundKey[RADIOLIB_AES128_KEY_EXP_SIZE];
+
+  /*! \brief First CMAC subkey, for a complete last block */
+  uint8_t subkey1[RADIOLIB_AES128_BLOCK_SIZE];
+
+  /*! \brief Second CMAC subkey, for a padded last block */
+  uint8_t subkey2[RADIOLIB_AES128_BLOCK_SIZE];
+};
+
 /*!
   \class RadioLibAES128
   Most of the implementation here is adapted from https://github.com/kokke/tiny-AES-c
@@ -105,7 +121,21 @@ class RadioLibAES128 {
       \brief Initialize the AES.
       \param key AES key to use.
     */
-    void init(uint8_t* key);
+    void init(const uint8_t* key);
+
+    /*!
+      \brief Initialize the AES with a key that was already expanded.
+      \param key Expanded key to use. It is not copied, so it must remain valid while in use.
+    */
+    void init(const RadioLibAES128Key_t* key);
+
+    /*!
+      \brief Expand a key, so that it can be used many times without repeating the key schedule.
+      The AES is left initialized with the expanded key.
+      \param key AES key to expand.
+      \param expanded Structure to save the expanded key into.
+    */
+    void expandKey(const uint8_t* key, RadioLibAES128Key_t* expanded);
 
     /*!
       \brief Perform ECB-type AES encryption.
@@ -143,14 +173,42 @@ class RadioLibAES128 {
       \returns True if valid, false otherwise.
     */
     bool verifyCMAC(uint8_t* in, size_t len, const uint8_t* cmac);
+
+    /*!
+      \brief Start calculating a message authentication code over data passed in parts,
+      without copying the whole message into a single buffer.
+    */
+    void initCMAC();
+
+    /*!
+      \brief Add data to the message authentication code started by initCMAC.
+      \param in Input data (unpadded).
+      \param len Length of the input data.
+    */
+    void updateCMAC(const uint8_t* in, size_t len);
+
+    /*!
+      \brief Finish the message authentication code started by initCMAC.
+      \param cmac Buffer to save the output MAC into. The buffer must be at least 16 bytes long!
+    */
+    void finishCMAC(uint8_t* cmac);
   
   private:
-    uint8_t* keyPtr = nullptr;
+    const uint8_t* keyPtr = nullptr;
     uint8_t roundKey[RADIOLIB_AES128_KEY_EXP_SIZE] = { 0 };
 
+    // round keys in use, and the expanded key they belong to (if any)
+    const uint8_t* activeKey = nullptr;
+    const RadioLibAES128Key_t* expandedKey = nullptr;
+
+    // CMAC chaining value and the last, possibly incomplete block that was not processed yet
+    uint8_t cmacState[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+    uint8_t cmacBuff[RADIOLIB_AES128_BLOCK_SIZE] = { 0 };
+    size_t cmacBuffLen = 0;
+
     void keyExpansion(uint8_t* roundKey, const uint8_t* key);
-    void cipher(state_t* state, uint8_t* roundKey);
-    void decipher(state_t* state, uint8_t* roundKey);
+    void cipher(state_t* state, const uint8_t* roundKey);
+    void decipher(state_t* state, const uint8_t* roundKey);
 
     void subWord(uint8_t* word);
     void rotWord(uint8_t* word);